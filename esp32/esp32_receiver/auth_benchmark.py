@@ -0,0 +1,122 @@
+"""Measures what signed control packets (see "Binding" in PacketFormat.md)
+cost an ESP32 receiver. tools/host_tests/auth_benchmark.cpp measures the
+same for the ESP8266 receive path on the host.
+
+The tag is checked in the receive path, before the channels are handed on,
+so it adds to the latency of every control packet and has to fit in the
+time the wifi callback has. This prints:
+ - verify: CPU cycles to check the tag on control packets with each number
+   of data bytes in DATA_SIZES (the counter and tag included), and what that
+   is in us at this ESP32s clock
+ - rx us: time in the receive path per control packet (the health
+   "process" figure) with the radio cut off from the air and FRAMES
+   packets injected: unsigned while unbound, signed while bound, and
+   unsigned while bound (a forger, all of which should be rejected). The
+   difference between the first two is the latency signing adds.
+ - airtime: a 4 channel control packet at RATE, with and without a
+   timestamp. Short packets are padded to fill the header, which hides
+   some of the counter and tag.
+
+From the REPL:
+    import auth_benchmark
+    auth_benchmark.run()
+Pass init=False if main.py has already called radio.init().
+"""
+import machine
+import struct
+import radio
+
+
+DATA_SIZES = (16, 20, 24, 64)  # 4 channels, with a timestamp, 6 channels with one, the most
+VERIFY_ITERATIONS = 10000
+FRAMES = 2000
+RATE = radio.RATE_1M
+OUR_ID = (0x02, 0x00, 0x00, 0x00, 0x00, 0x30)  # Not our real ID, so our real key is left alone
+KEY = bytes(range(16))
+
+HEADER_BYTES = 26
+HEADER_DATA_BYTES = 12
+TRAILER_BYTES = 8  # The counter and tag
+TIMESTAMP_BYTES = 4
+MIN_TRAILED_DATA = 8  # Short packets are padded to this before a timestamp or tag
+
+
+def frame_bytes(data_len):
+    """Frame length without the CRC, as phy_rate_airtime_us wants it"""
+    return HEADER_BYTES + max(data_len, HEADER_DATA_BYTES) - HEADER_DATA_BYTES
+
+
+def _process_us():
+    _, total_us, _ = radio.get_health()[0][1]
+    return total_us
+
+
+def bench_verify():
+    cpu_mhz = machine.freq() / 1e6
+    print("{:>6} {:>8} {:>8}".format("bytes", "cycles", "us"))
+    for data_len in DATA_SIZES:
+        cycles = radio.auth_cycles(data_len, VERIFY_ITERATIONS)
+        print("{:6} {:8.0f} {:8.2f}".format(data_len, cycles, cycles / cpu_mhz))
+
+
+def bench_rx(bound, signed):
+    if bound:
+        radio.set_key(OUR_ID, KEY)
+        if signed:
+            # Shows the receiver side where our signing counter is, and
+            # setting the same key again saves a counter limit past it
+            radio.inject_frame(OUR_ID, radio.PACKET_CONTROL | radio.PACKET_FLAG_AUTH, bytes(8))
+            radio.get_latest_packet()
+            radio.set_key(OUR_ID, KEY)
+    else:
+        radio.unbind(OUR_ID)
+    packet_type = radio.PACKET_CONTROL
+    if signed:
+        packet_type |= radio.PACKET_FLAG_AUTH
+    auth_before = radio.get_auth_stats()
+    start_us = _process_us()
+    for i in range(FRAMES):
+        radio.inject_frame(OUR_ID, packet_type, struct.pack('<4h', i & 0x7FFF, 0, 0, 0))
+        radio.get_latest_packet()  # Keep the queue from filling
+    rx_us = (_process_us() - start_us) / FRAMES
+    auth_after = radio.get_auth_stats()
+    verified, unsigned, bad_tag, replayed, early = [after - before for before, after in zip(auth_before, auth_after)]
+    return rx_us, verified, unsigned + bad_tag + replayed + early
+
+
+def bench_airtime():
+    for timestamped in (False, True):
+        data_len = 8  # 4 channels
+        if timestamped:
+            data_len = max(data_len, MIN_TRAILED_DATA) + TIMESTAMP_BYTES
+        unsigned_us = radio.airtime_us(RATE, frame_bytes(data_len))
+        signed_us = radio.airtime_us(RATE, frame_bytes(max(data_len, MIN_TRAILED_DATA) + TRAILER_BYTES))
+        print("airtime {} timestamp: {}us unsigned, {}us signed".format(
+            "with" if timestamped else "without", unsigned_us, signed_us
+        ))
+
+
+def run(init=True):
+    if init:
+        radio.init()
+    radio.set_id(OUR_ID)
+    radio.filter_by_id(1)
+    radio.simulate_medium(True)
+    try:
+        bench_verify()
+        print()
+        print("{:10} {:>8} {:>9} {:>9}".format("packets", "rx us", "verified", "rejected"))
+        rx_us = {}
+        for name, bound, signed in (("unbound", False, False), ("signed", True, True), ("forged", True, False)):
+            rx_us[name], verified, rejected = bench_rx(bound, signed)
+            print("{:10} {:8.1f} {:9} {:9}".format(name, rx_us[name], verified, rejected))
+        print("Signing adds {:.1f}us to the receive path".format(rx_us["signed"] - rx_us["unbound"]))
+        print()
+        bench_airtime()
+    finally:
+        radio.unbind(OUR_ID)
+        radio.simulate_medium(False)
+
+
+if __name__ == "__main__":
+    run()
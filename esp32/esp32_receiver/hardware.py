@@ -25,6 +25,37 @@ class Drive:
         self.front_right.set_velocity(right)
         self.rear_right.set_velocity(right)
 
+class NativeDrive:
+    """The same servos as Drive, but driven by the radio modules output task
+    straight from the control packets. They keep updating at a steady rate
+    however busy python is. Outputs have to be set up before radio.start_tasks"""
+    DUTY_TO_US = 20000 / 1024  # machine.PWM duty at 50Hz
+
+    # Control packets are [turn, velocity, ...]
+    LEFT = (-1.0, 1.0)  # velocity - turn
+    RIGHT = (1.0, 1.0)  # velocity + turn
+
+    def __init__(self):
+        self._attach(0, 14, 74, -1, self.LEFT)
+        self._attach(1, 27, 76, 1, self.RIGHT)
+        self._attach(2, 26, 77, -1, self.LEFT)
+        self._attach(3, 25, 68, 1, self.RIGHT)
+
+    def _attach(self, index, pin, center, invert, mix):
+        radio.set_output(
+            index, pin,
+            int(center * self.DUTY_TO_US),
+            int(ServoDrive.STEPS_TO_MAX_VEL * self.DUTY_TO_US * invert),
+            mix
+        )
+
+    def set_targets(self, velocity, turn):
+        pass
+
+    def update(self):
+        pass
+
+
 class ServoDrive:
     STEPS_TO_MAX_VEL = 60
     def __init__(self, pin, center, invert=False):
@@ -0,0 +1,119 @@
+"""Measures how steadily the servo outputs are updated while python is busy.
+
+Each mode updates the outputs at OUTPUT_HZ for RUN_SECONDS while a synthetic
+load (allocations, garbage collection and float maths) keeps the interpreter
+busy, then prints the mean, standard deviation and worst case time between
+output updates:
+ - python: the outputs are updated from the python loop (hardware.Drive)
+ - unpinned: the radio modules output task, free to run on either core
+ - pinned: the output task pinned to PINNED_CORE, away from python
+
+What is measured is the FreeRTOS scheduler sharing two real cores with the
+micropython interpreter and its garbage collector, so unlike the benchmarks
+in tools/host_tests this one only means anything on the device.
+
+From the REPL:
+    import jitter_benchmark
+    jitter_benchmark.run()
+Pass init=False if main.py has already called radio.init().
+"""
+import gc
+import math
+import time
+import radio
+import hardware
+
+
+OUTPUT_HZ = 50
+RUN_SECONDS = 20
+PINNED_CORE = 1
+
+
+class PeriodStats:
+    def __init__(self):
+        self.count = 0
+        self.mean = 0.0
+        self._sum_squares = 0.0
+        self.max = 0
+        self._last_us = None
+
+    def add(self, now_us):
+        if self._last_us is not None:
+            period = time.ticks_diff(now_us, self._last_us)
+            self.count += 1
+            delta = period - self.mean
+            self.mean += delta / self.count
+            self._sum_squares += delta * (period - self.mean)
+            self.max = max(self.max, period)
+        self._last_us = now_us
+
+    def std_dev(self):
+        if self.count < 2:
+            return 0.0
+        return math.sqrt(self._sum_squares / (self.count - 1))
+
+
+def _load_step(junk):
+    """One slice of a heavy main loop"""
+    junk.append([math.sin(i) * i for i in range(50)])
+    if len(junk) > 20:
+        junk.clear()
+        gc.collect()
+
+
+def _run_load(seconds):
+    junk = []
+    end_ms = time.ticks_add(time.ticks_ms(), seconds * 1000)
+    while time.ticks_diff(end_ms, time.ticks_ms()) > 0:
+        _load_step(junk)
+
+
+def bench_python(seconds):
+    drive = hardware.Drive()
+    stats = PeriodStats()
+    period_us = 1000000 // OUTPUT_HZ
+    junk = []
+    end_ms = time.ticks_add(time.ticks_ms(), seconds * 1000)
+    next_us = time.ticks_us()
+    while time.ticks_diff(end_ms, time.ticks_ms()) > 0:
+        _load_step(junk)
+        now_us = time.ticks_us()
+        if time.ticks_diff(now_us, next_us) >= 0:
+            drive.update()
+            stats.add(now_us)
+            next_us = time.ticks_add(next_us, period_us)
+    for servo in (drive.front_left, drive.front_right, drive.rear_left, drive.rear_right):
+        servo._pwm.deinit()
+    return stats.count, stats.mean, stats.std_dev(), stats.max
+
+
+def bench_tasks(core, seconds):
+    if radio.start_tasks(core, 0, OUTPUT_HZ) != 0:
+        raise RuntimeError("Couldn't start the radio tasks")
+    radio.reset_task_stats()
+    _run_load(seconds)
+    stats = radio.get_task_stats()
+    radio.stop_tasks()
+    return stats[4], stats[5], stats[6], stats[7]
+
+
+def _print_result(name, result):
+    updates, mean_us, std_dev_us, max_us = result
+    print("{:10} {:8} {:10.1f} {:10.1f} {:8}".format(name, updates, mean_us, std_dev_us, max_us))
+
+
+def run(init=True, seconds=RUN_SECONDS):
+    if init:
+        radio.init()
+    radio.stop_tasks()
+    hardware.NativeDrive()  # Sets up the outputs for the task modes
+
+    print("{:10} {:>8} {:>10} {:>10} {:>8}".format("mode", "updates", "mean us", "stddev us", "max us"))
+    _print_result("unpinned", bench_tasks(radio.CORE_ANY, seconds))
+    _print_result("pinned", bench_tasks(PINNED_CORE, seconds))
+    # Last, because machine.PWM takes the pins back from the output task
+    _print_result("python", bench_python(seconds))
+
+
+if __name__ == "__main__":
+    run()
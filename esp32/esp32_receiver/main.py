@@ -11,17 +11,62 @@ TELEMETRY_RSSI_ERROR = -90
 TELEMETRY_PACKET_LOSS_WARN = 0.3  # Warn if 30% of packets are lost
 TELEMETRY_PACKET_LOSS_ERROR = 0.8  # display error if 80% of telemetry packets are lost
 
+MAX_TRANSMIT_POWER = 78  # ~19.5dbm. Check your local regulations
+LOW_POWER_MODE = False  # Sleep between control packets. Not used with the radio tasks
+
+# The core to run the radio and servo output tasks on, away from python and
+# the wifi stack. radio.CORE_ANY lets them run on either core, None leaves
+# everything to this loop.
+RADIO_TASK_CORE = 1
+OUTPUT_HZ = 50
+
+# Until a transmitter binds us, anything on the channel can drive us. While
+# we aren't bound we listen for one for this long after boot. To bind to
+# another, call radio.unbind() and restart (see "Binding" in PacketFormat.md)
+BIND_WINDOW_MS = 30000
+
+# Timers for each stage of the loop, read with radio.get_profile()
+PROFILE_LOOP = radio.profile_timer("loop")
+PROFILE_PACKET = radio.profile_timer("get packet")
+PROFILE_TELEMETRY = radio.profile_timer("telemetry")
+PROFILE_BULK = radio.profile_timer("bulk")
+PROFILE_DRIVE = radio.profile_timer("drive")
+PROFILE_GC = radio.profile_timer("gc")
+
 
 class Receiver:
     def __init__(self, loop_hz):
-        self.drive = hardware.Drive()
         radio.init()
+        radio.set_max_power(MAX_TRANSMIT_POWER)
+        radio.low_power(LOW_POWER_MODE)
+        radio.enable_timestamps(True)  # Lets us synchronise with the transmitters clock
+        radio.bulk_receive(True)  # Accept config pushed from the transmitter
+        if not radio.is_bound():
+            radio.bind_listen(BIND_WINDOW_MS)
+        if RADIO_TASK_CORE is None:
+            self.drive = hardware.Drive()
+        else:
+            self.drive = hardware.NativeDrive()
+            radio.start_tasks(RADIO_TASK_CORE, 0, OUTPUT_HZ)
         self._loop_us = 1000 / loop_hz
 
+        self._rssi = 0
         self.telemetry_manager = TelemetryManager("Crawler", 100)
+        self.telemetry_manager.telemetries = [
+            ("RSSI", self._get_rssi),  # The transmitter adjusts its power from this
+            ("TX Power dBm", self._get_tx_power),
+            ("Energy/Frame uJ", self._get_frame_energy),
+            ("Current mA", self._get_current),
+            ("Sleep Misses", self._get_sleep_misses),
+            ("Latency us", self._get_latency),
+            ("Jitter us", self._get_jitter),
+            ("Output Jitter us", self._get_output_jitter),
+            ("Rejected Frames", self._get_rejected_frames),
+        ]
 
 
     def loop(self):
+        radio.profile_enter(PROFILE_PACKET)
         packet_data, packet_stats = radio.get_latest_packet()
         if packet_stats[3] > 0:
             # Got a packet
@@ -29,15 +74,59 @@ class Receiver:
                 values = struct.unpack('h'*int(len(packet_data)/2), packet_data)
                 f_values = [v/((2**16)/2) for v in values]
                 self.drive.set_targets(f_values[1], f_values[0])
+                self._rssi = packet_stats[2]
+        radio.profile_exit(PROFILE_PACKET)
 
+        radio.profile_enter(PROFILE_TELEMETRY)
         self.telemetry_manager.update()
+        radio.profile_exit(PROFILE_TELEMETRY)
+        radio.profile_enter(PROFILE_BULK)
+        radio.bulk_update()
+        radio.profile_exit(PROFILE_BULK)
+        radio.profile_enter(PROFILE_DRIVE)
         self.drive.update()
+        radio.profile_exit(PROFILE_DRIVE)
+
+
+    def _get_rssi(self):
+        return self._rssi, format_telemetry_lesser(self._rssi, TELEMETRY_RSSI_WARN, TELEMETRY_RSSI_ERROR)
+
+    def _get_tx_power(self):
+        return radio.get_power_stats()[0], radio.TELEMETRY_UNDEFINED
+
+    def _get_frame_energy(self):
+        return radio.get_power_stats()[1], radio.TELEMETRY_UNDEFINED
 
+    def _get_current(self):
+        return radio.get_duty_cycle_stats()[0], radio.TELEMETRY_UNDEFINED
+
+    def _get_sleep_misses(self):
+        return radio.get_duty_cycle_stats()[1], radio.TELEMETRY_UNDEFINED
+
+    def _get_latency(self):
+        return radio.get_clock_stats()[3], radio.TELEMETRY_UNDEFINED
+
+    def _get_jitter(self):
+        return radio.get_clock_stats()[4], radio.TELEMETRY_UNDEFINED
+
+    def _get_output_jitter(self):
+        return radio.get_task_stats()[6], radio.TELEMETRY_UNDEFINED
+
+    def _get_rejected_frames(self):
+        """Stale, duplicate or late control packets, and ones not signed by
+        the transmitter we are bound to, replayed or past the saved counter limit"""
+        newest, received, lost, reordered, duplicates, stale, resyncs = radio.get_link_stats(radio.STREAM_CONTROL)
+        verified, unsigned, bad_tag, replayed, early = radio.get_auth_stats()
+        return reordered + duplicates + stale + unsigned + bad_tag + replayed + early, radio.TELEMETRY_UNDEFINED
 
     def update(self):
         start_time = time.ticks_us()
+        radio.profile_enter(PROFILE_LOOP)
         self.loop()
+        radio.profile_exit(PROFILE_LOOP)
+        radio.profile_enter(PROFILE_GC)
         gc.collect()
+        radio.profile_exit(PROFILE_GC)
         end_time = time.ticks_us()
         sleep_time = self._loop_us - (end_time - start_time)
         sleep_time = max(0, sleep_time)  # Catch wrap-around
@@ -48,13 +137,10 @@ class Receiver:
 
     def _loop_wait(self, us):
         """Function that runs when nothing to do. Sleeps for the specific number
-        of microseconds"""
-        time.sleep_us(int(us))
-
-        # Busy wait so that the radio stays active. I hope to find a better way
-        #start_time = time.ticks_us()
-        #while time.ticks_us() - start_time < us:
-        #    pass
+        of microseconds, or in low power mode, until the next control packet
+        is due"""
+        if not radio.idle():
+            time.sleep_us(int(us))
 
 
 
@@ -74,14 +160,24 @@ class TelemetryManager:
 
     def send_next(self):
         self._prev_time = time.ticks_ms()
-        if self.telemetry_pointer > len(self.telemetries):
+        if self.telemetry_pointer >= len(self.telemetries):
             radio.send_name_packet(self.name)
             self.telemetry_pointer = 0
         else:
-            print("Sending telemetry not implemented")
+            name, getter = self.telemetries[self.telemetry_pointer]
+            value, status = getter()
+            radio.send_telemetry(status, value, name)
             self.telemetry_pointer += 1
 
 
+def format_telemetry_lesser(value, warn_threshold, error_threshold):
+    if value < error_threshold:
+        return radio.TELEMETRY_ERROR
+    elif value < warn_threshold:
+        return radio.TELEMETRY_WARN
+    return radio.TELEMETRY_OK
+
+
 def start():
     c = Receiver(30)
     while(1):
@@ -0,0 +1,114 @@
+"""Long running soak test of the receive path, for catching memory and
+latency regressions before they turn into a crash in the air.
+
+The radio is cut off from the air and fed synthetic frames of mixed traffic
+(control, telemetry, names from lots of devices, link reports and other
+peoples packets) through the same path as the wifi callback, while the python
+loop drains the packet queue and sends telemetry like main.py does.
+
+At the end a JSON report is printed and written to REPORT_FILE with the
+throughput, how long the callback, parsing and sending took, how full the
+queues got and the heap and stack high-water marks. Compare it with the
+report from an earlier build. tools/host_tests/soak.cpp pushes the same kind
+of traffic through the ESP8266's frame handling on a PC; this one covers
+what only the device has, like the wifi callback, the radio tasks and
+micropython's heap.
+
+From the REPL:
+    import soak
+    soak.run()
+Pass init=False if main.py has already called radio.init(), and tasks=True
+to run the receive path in the radio tasks.
+"""
+import gc
+import time
+import ujson
+import radio
+
+
+TOTAL_FRAMES = 1000000
+BURST_FRAMES = 50  # Frames injected per loop
+TELEMETRY_EVERY = 20  # Loops between telemetry packets
+PROGRESS_EVERY = 100000  # Frames between progress lines
+SEED = 1
+REPORT_FILE = "soak_report.json"
+
+TIMING_NAMES = ("callback", "process", "send")
+QUEUE_NAMES = ("rx_packets", "rx_frames", "tx")
+MEMORY_NAMES = (
+    "heap_free", "heap_min_free", "stack_free_python",
+    "stack_free_rx", "stack_free_tx", "stack_free_output",
+)
+
+
+def _report(frames, packets, elapsed_ms, python_min_free):
+    timings, queues, memory = radio.get_health()
+    report = {
+        "frames": frames,
+        "packets": packets,
+        "seconds": elapsed_ms / 1000,
+        "frames_per_second": frames * 1000 / max(elapsed_ms, 1),
+        "timing_us": {},
+        "queue_max": dict(zip(QUEUE_NAMES, queues)),
+        "memory": dict(zip(MEMORY_NAMES, memory)),
+        "python_heap_min_free": python_min_free,
+        "tx": radio.get_tx_stats(),
+    }
+    for name, (count, total_us, max_us) in zip(TIMING_NAMES, timings):
+        report["timing_us"][name] = {
+            "count": count,
+            "mean": total_us / count if count else 0,
+            "max": max_us,
+        }
+    return report
+
+
+def run(init=True, tasks=False, frames=TOTAL_FRAMES, seed=SEED):
+    if init:
+        radio.init()
+    if tasks:
+        radio.start_tasks(radio.CORE_ANY, 0, 0)
+
+    radio.simulate_medium(True)
+    gc.collect()
+    python_min_free = gc.mem_free()
+    injected = 0
+    packets = 0
+    loops = 0
+    start_ms = time.ticks_ms()
+    try:
+        while injected < frames:
+            burst = min(BURST_FRAMES, frames - injected)
+            radio.inject_frames(burst, seed + injected)
+            injected += burst
+
+            while True:
+                packet_data, packet_stats = radio.get_latest_packet()
+                if packet_stats[3] == 0:
+                    break
+                packets += 1
+
+            loops += 1
+            if loops % TELEMETRY_EVERY == 0:
+                radio.send_telemetry(radio.TELEMETRY_OK, injected, "Soak Frames")
+
+            python_min_free = min(python_min_free, gc.mem_free())
+            gc.collect()
+            if injected % PROGRESS_EVERY < BURST_FRAMES:
+                print("{} frames, {} packets, {} bytes free".format(injected, packets, python_min_free))
+    finally:
+        elapsed_ms = time.ticks_diff(time.ticks_ms(), start_ms)
+        radio.simulate_medium(False)
+        if tasks:
+            radio.stop_tasks()
+
+    report = _report(injected, packets, elapsed_ms, python_min_free)
+    text = ujson.dumps(report)
+    print(text)
+    with open(REPORT_FILE, "w") as report_file:
+        report_file.write(text)
+    return report
+
+
+if __name__ == "__main__":
+    run()
@@ -5,6 +5,16 @@ import time
 
 BATT_VOLTAGE_CALIB = 0.0016767922235722964
 
+# The sticks are sampled and processed natively by the radio module (see
+# sticks.h), so they cost the python loop nothing
+STICK_PINS = (32, 33, 34, 35)  # In ANALOG_CHANNEL order
+STICK_SAMPLE_HZ = 1000
+STICK_OVERSAMPLE = 16  # Averaging 16 samples lags the sticks by 8ms
+STICK_DEADBAND = 0.02
+STICK_EXPO = 0.0
+STICK_RATE = 1.0
+STICK_FULL_SCALE = 2 ** 15 - 1
+
 class Inputs:
     ANALOG_CHANNEL_STICK_RIGHT_Y = 0
     ANALOG_CHANNEL_STICK_RIGHT_X = 1
@@ -13,28 +23,32 @@ class Inputs:
 
     DIGITAL_CHANNEL_STICK_LEFT = 0
     DIGITAL_CHANNEL_STICK_RIGHT = 1
+
+    # The stick each control channel is sent from, for the radio tasks and
+    # python alike
+    CHANNEL_MAP = (
+        ANALOG_CHANNEL_STICK_RIGHT_X,
+        ANALOG_CHANNEL_STICK_RIGHT_Y,
+        ANALOG_CHANNEL_STICK_LEFT_X,
+        ANALOG_CHANNEL_STICK_LEFT_Y,
+    )
+
     def __init__(self):
         self._batt_adc = machine.ADC(machine.Pin(39))
         self._batt_adc.atten(machine.ADC.ATTN_11DB)
 
-        self.analog_inputs = [
-            machine.ADC(machine.Pin(32)),
-            machine.ADC(machine.Pin(33)),
-            machine.ADC(machine.Pin(34)),
-            machine.ADC(machine.Pin(35)),
-        ]
-            
         self.digital_inputs = [
             machine.Pin(25),
             machine.Pin(26),
         ]
 
-        for ana_in in self.analog_inputs:
-            ana_in.atten(ana_in.ATTN_11DB)
-
-        self.analog_calibrations = []
-        for channel in self.analog_inputs:
-            self.analog_calibrations.append(channel.read())
+        # Without a saved calibration the sticks are centered where they are now
+        if radio.sticks_start(STICK_PINS, STICK_SAMPLE_HZ, STICK_OVERSAMPLE) != 0:
+            print("Couldn't start the sticks")
+        for channel in range(len(STICK_PINS)):
+            radio.sticks_curve(channel, STICK_DEADBAND, STICK_EXPO, STICK_RATE)
+        if radio.sticks_map(self.CHANNEL_MAP) != 0:
+            print("Couldn't map the sticks to channels")
 
     def get_battery_volts(self):
         """Returns the battery voltage"""
@@ -46,12 +60,22 @@ class Inputs:
         pass
 
     def get_analog_input(self, channel):
-        """Returns the analog input as a percentage that is centered in the
-        middle of the ADC's range"""
-        raw = self.analog_inputs[channel].read()
-        corrected = (self.analog_calibrations[channel] - raw) / 2048
-        print(corrected)
-        return corrected
+        """Returns the stick position between -1 and 1"""
+        return radio.get_sticks()[channel] / STICK_FULL_SCALE
+
+    def get_channels(self):
+        """Returns the ready to send channel values, in CHANNEL_MAP order"""
+        return radio.get_stick_channels()
+
+    def calibrate(self, seconds=10):
+        """Move every stick through its full travel and let them go back
+        to center before the time is up. The calibration is saved, so this
+        only needs doing once. Returns False if a stick didn't move far
+        enough"""
+        radio.sticks_calibrate(True)
+        print("Move the sticks to their limits, then let them go")
+        time.sleep(seconds)
+        return radio.sticks_calibrate(False) == 0
 
 
 class Display():
@@ -2,7 +2,7 @@ import gc
 import time
 import hardware
 import radio
-import struct
+import recorder
 
 
 TELEMETRY_RSSI_WARN = -80
@@ -11,37 +11,41 @@ TELEMETRY_RSSI_ERROR = -90
 TELEMETRY_PACKET_LOSS_WARN = 0.3  # Warn if 30% of packets are lost
 TELEMETRY_PACKET_LOSS_ERROR = 0.8  # display error if 80% of telemetry packets are lost
 
-
-class PacketLossCounter:
-    def __init__(self):
-        self._prev_packet_id = 0
-        self.percent_got = 1.0
-        self._last_packet_time = time.ticks_ms()
-
-    def submit_packet_id(self, val):
-        diff = val - self._prev_packet_id
-        if diff != 0:
-            if diff < 0:
-                diff += 2 ** 8
-            self._prev_packet_id = val
-
-            self._last_packet_time = time.ticks_ms()
-
-            lost_percent = 1 / diff
-            self.percent_got = self.percent_got * 0.7 + lost_percent * 0.3
-        else:
-            """Same packet again packet or the number wrapped completely"""
-
-    @property
-    def percent_loss(self):
-        return 1 - self.percent_got
-
-    def update(self):
-        if time.ticks_ms() > self._last_packet_time + 500:
-            if self.percent_got > 0.01:
-                self.percent_got -= 0.01
-
-
+MAX_TRANSMIT_POWER = 78  # ~19.5dbm. Check your local regulations
+
+# Stream telemetry and link stats over serial as binary records for
+# tools/telemetry_recorder.py. They show up as junk in a serial terminal.
+SERIAL_RECORDS = False
+
+# PHY rate profile to use for each receiver, keyed by receiver ID. Receivers
+# not listed use DEFAULT_PROFILE. PROFILE_THROUGHPUT uses about a tenth of the
+# airtime of PROFILE_RANGE, PROFILE_LONG_RANGE only works with ESP32 receivers.
+DEFAULT_PROFILE = radio.PROFILE_RANGE
+RECEIVER_PROFILES = {
+    # (0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC): radio.PROFILE_THROUGHPUT,
+}
+
+# Timers for each stage of the loop. See profile_report.py
+PROFILE_LOOP = radio.profile_timer("loop")
+PROFILE_DISPLAY = radio.profile_timer("display")
+PROFILE_STATS = radio.profile_timer("system stats")
+PROFILE_INPUTS = radio.profile_timer("inputs")
+PROFILE_SEND = radio.profile_timer("send control")
+PROFILE_TELEMETRY = radio.profile_timer("telemetry")
+PROFILE_FIND_RX = radio.profile_timer("find rx")
+PROFILE_RECORDER = radio.profile_timer("recorder")
+PROFILE_GC = radio.profile_timer("gc")
+
+# Bind each receiver we connect to that we aren't bound to yet, so that only
+# we can drive it from then on. It has to be listening for a transmitter,
+# which receivers do for a while after they boot unbound. The key goes over
+# the air in the clear, so do this close to the receiver.
+BIND_RECEIVERS = False
+BIND_TIMEOUT_MS = 10000
+
+# How long to keep listening after the first receiver is heard before picking
+# the strongest. Receivers send a name packet every couple of seconds.
+DEVICE_SETTLE_MS = 2500
 
 
 class Controller:
@@ -53,93 +57,153 @@ class Controller:
         self.inputs = hardware.Inputs()
         self.display = hardware.Display()
         radio.init()
+        radio.set_max_power(MAX_TRANSMIT_POWER)
+        radio.enable_timestamps(True)  # Lets the receiver measure latency
 
         self._connected = False
         self._connected_id = None
+        self._search_start_ms = None
+        self._binding = False
+        self._bind_start_ms = 0
+        self._config_xfer_id = 0
 
-        self.packet_counter = PacketLossCounter()
+        self.recorder = recorder.Recorder() if SERIAL_RECORDS else None
 
         self._loop_counter = loop_hz
 
 
     def loop(self):
+        radio.profile_enter(PROFILE_DISPLAY)
         self.display.update()
+        radio.profile_exit(PROFILE_DISPLAY)
+        radio.profile_enter(PROFILE_STATS)
         self.update_system_stats()
+        radio.profile_exit(PROFILE_STATS)
 
         if self._connected:
             self._send_control()
+            if self._binding:
+                self._bind()
+            radio.profile_enter(PROFILE_TELEMETRY)
             self._update_telemetry()
+            radio.profile_exit(PROFILE_TELEMETRY)
         else:
+            radio.profile_enter(PROFILE_FIND_RX)
             self._find_rx()
+            radio.profile_exit(PROFILE_FIND_RX)
 
-        self.packet_counter.update()
+        if self.recorder:
+            radio.profile_enter(PROFILE_RECORDER)
+            self.recorder.update()
+            radio.profile_exit(PROFILE_RECORDER)
 
 
     def _find_rx(self):
-        """Listens for the first receiver to broadcast a name packet"""
+        """Binds to the strongest receiver that is broadcasting name packets,
+        once every receiver in range has had a chance to be heard"""
         radio.filter_by_id(False)
-        packet_data, packet_stats = radio.get_latest_packet()
-        if packet_stats[3] > 0:
-            # Got a packet
-            if packet_stats[1] == radio.PACKET_NAME:
-                try:
-                    name = packet_data[6:].decode('utf-8')
-                except UnicodeError:
-                    name = packet_data[6:]
-                    print(packet_data)
-                self.display.show_internal_value("Device Name", name, radio.TELEMETRY_OK)
-                self.display.show_internal_value("Device Id", packet_stats[0], radio.TELEMETRY_OK)
-                radio.set_id(packet_stats[0])
-                self._connected = True
-                self._connected_id = packet_stats[0]
-                radio.filter_by_id(True)
-                self.display.set_radio_state(self._connected)
+        devices = radio.get_devices()
+        self.display.show_internal_value("Receivers Found", len(devices), radio.TELEMETRY_OK)
+        missed = radio.get_device_overflows()
+        if missed:
+            # More receivers than the table holds, so the strongest may not be among them
+            self.display.show_internal_value("Receivers Missed", missed, radio.TELEMETRY_WARN)
+        if devices and self._search_start_ms is None:
+            self._search_start_ms = time.ticks_ms()
+        if devices and time.ticks_diff(time.ticks_ms(), self._search_start_ms) >= DEVICE_SETTLE_MS:
+            device_id, name, rssi, loss, age_ms = max(devices, key=lambda d: d[2])
+            try:
+                name = name.decode('utf-8')
+            except UnicodeError:
+                print(name)
+            self.display.show_internal_value("Device Name", name, radio.TELEMETRY_OK)
+            self.display.show_internal_value("Device Id", device_id, radio.TELEMETRY_OK)
+            radio.set_profile(device_id, RECEIVER_PROFILES.get(device_id, DEFAULT_PROFILE))
+            radio.set_id(device_id)
+            radio.clear_telemetry()  # Anything heard while searching isn't from this receiver
+            self._connected = True
+            self._connected_id = device_id
+            self._search_start_ms = None
+            radio.filter_by_id(True)
+            self.display.set_radio_state(self._connected)
+            self._binding = BIND_RECEIVERS and not radio.is_bound(device_id)
+            self._bind_start_ms = time.ticks_ms()
+            self._show_bound()
         else:
             self.display.show_internal_value("Device Name", "Not Connected", radio.TELEMETRY_ERROR)
             self.display.show_internal_value("Device Id", "Not Connected", radio.TELEMETRY_ERROR)
 
 
 
+    def _bind(self):
+        """Sends the connected receiver a bind request each loop until it
+        accepts, or until BIND_TIMEOUT_MS"""
+        if radio.bind() or time.ticks_diff(time.ticks_ms(), self._bind_start_ms) > BIND_TIMEOUT_MS:
+            self._binding = False
+            self._show_bound()
+
+
+    def _show_bound(self):
+        if radio.is_bound(self._connected_id):
+            self.display.show_internal_value("Bound", "Yes", radio.TELEMETRY_OK)
+        elif self._binding:
+            self.display.show_internal_value("Bound", "Binding", radio.TELEMETRY_WARN)
+        else:
+            self.display.show_internal_value("Bound", "No", radio.TELEMETRY_UNDEFINED)
+
+
+    def send_config(self, config_bytes):
+        """Uploads a config blob to the connected receiver in the background.
+        Returns False if an upload is already in progress"""
+        self._config_xfer_id = (self._config_xfer_id + 1) % 256
+        return radio.bulk_send(self._config_xfer_id, config_bytes) == 0
+
+
     def _send_control(self):
         """Sends control packets"""
-        channels = [
-            self.inputs.get_analog_input(self.inputs.ANALOG_CHANNEL_STICK_RIGHT_X),
-            self.inputs.get_analog_input(self.inputs.ANALOG_CHANNEL_STICK_RIGHT_Y),
-            self.inputs.get_analog_input(self.inputs.ANALOG_CHANNEL_STICK_LEFT_X),
-            self.inputs.get_analog_input(self.inputs.ANALOG_CHANNEL_STICK_LEFT_Y),
-        ]
-        for chan_id, chan in enumerate(channels):
-            channels[chan_id] = int(chan * ((2 ** 15) - 1))
+        radio.profile_enter(PROFILE_INPUTS)
+        # Already in the same channel order the radio tasks send them in
+        channels = self.inputs.get_channels()
+        radio.profile_exit(PROFILE_INPUTS)
+        radio.profile_enter(PROFILE_SEND)
         sent = radio.send_control_packet(
             channels
         )
-        if sent != 0:
+        radio.profile_exit(PROFILE_SEND)
+        # TX_SHED is the rate control backing off, which is expected when
+        # the channel is busy
+        if sent == radio.TX_FAILED:
             print("SEND PACKET FAILED")
 
     def _update_telemetry(self):
-        """Updates the telemetry from the remote device"""
-        packet_data, packet_stats = radio.get_latest_packet()
-        if packet_stats[3] > 0:
-            # Got a packet
-            if packet_stats[0] == self._connected_id:
-                if packet_stats[1] == radio.PACKET_TELEMETRY:
-                    status = packet_data[0]
-                    value = struct.unpack('f', packet_data[1:5])[0]
-                    try:
-                        name = packet_data[5:].decode('utf-8')
-                    except:
-                        name = packet_data[5:]
-                    self.display.show_external_value(name, value, status)
-
-
-                # All packets have a packet ID etc.
-                rssid = packet_stats[2]
-                self.display.show_internal_value(
-                    "RSSID", rssid,
-                    format_telemetry_lesser(rssid, TELEMETRY_RSSI_WARN, TELEMETRY_RSSI_ERROR)
-                )
-
-                self.packet_counter.submit_packet_id(packet_stats[4])
+        """Shows the telemetry that has changed since last time. The radio
+        module decodes and stores it as it arrives"""
+        for name, value, status, age_ms in radio.get_telemetry(True):
+            self.display.show_external_value(name, value, status)
+            if self.recorder:
+                self.recorder.telemetry(name, value, status)
+
+    def _update_link(self):
+        """Shows how well we hear the receiver, from the radio modules
+        device table"""
+        rssi = None
+        packet_loss = 1.0
+        for device_id, name, device_rssi, loss, age_ms in radio.get_devices():
+            if device_id == self._connected_id:
+                rssi = device_rssi
+                packet_loss = loss
+        if rssi is not None:
+            self.display.show_internal_value(
+                "RSSID", rssi,
+                format_telemetry_lesser(rssi, TELEMETRY_RSSI_WARN, TELEMETRY_RSSI_ERROR)
+            )
+        self.display.show_internal_value(
+            "Packet Loss", packet_loss * 100,
+            format_telemetry_greater(packet_loss, TELEMETRY_PACKET_LOSS_WARN, TELEMETRY_PACKET_LOSS_ERROR)
+        )
+        if self.recorder:
+            tx_stats = radio.get_tx_stats()
+            self.recorder.link(rssi or 0, packet_loss, tx_stats[7], tx_stats[1])
 
 
 
@@ -151,18 +215,38 @@ class Controller:
             self.display.show_internal_value("Uptime", time.ticks_ms() / 1000, radio.TELEMETRY_OK)
             self.display.show_internal_value("Average CPU", 100 - int(self._average_cpu * 100), radio.TELEMETRY_OK)
 
+            tx_dbm, energy_uj, airtime_us = radio.get_power_stats()
+            self.display.show_internal_value("TX Power dBm", tx_dbm, radio.TELEMETRY_UNDEFINED)
+            self.display.show_internal_value("Energy/Frame uJ", energy_uj, radio.TELEMETRY_UNDEFINED)
+            self.display.show_internal_value("Airtime/Frame us", airtime_us, radio.TELEMETRY_UNDEFINED)
+
+            sent, failed, shed_telemetry, shed_bulk, skipped_control, queue_depth, max_queue_depth, control_rate, last_error, refused = radio.get_tx_stats()
+            failed += refused
+            self.display.show_internal_value("TX Failures", failed, radio.TELEMETRY_OK if failed == 0 else radio.TELEMETRY_WARN)
+            self.display.show_internal_value("TX Queue", queue_depth, radio.TELEMETRY_UNDEFINED)
             self.display.show_internal_value(
-                "Packet Loss", self.packet_counter.percent_loss * 100,
-                format_telemetry_greater(self.packet_counter.percent_loss, TELEMETRY_PACKET_LOSS_WARN, TELEMETRY_PACKET_LOSS_ERROR)
+                "Control Rate %", int(control_rate * 100),
+                radio.TELEMETRY_OK if control_rate >= 1 else radio.TELEMETRY_WARN
             )
+
+            state, xfer_id, done_bytes, total_bytes, retransmits = radio.get_bulk_stats()
+            if state != radio.BULK_IDLE:
+                self.display.show_internal_value("Upload Bytes", done_bytes, radio.TELEMETRY_OK)
+
+            if self._connected:
+                self._update_link()
             self._loop_counter = 0
 
 
 
     def update(self):
         start_time = time.ticks_us()
+        radio.profile_enter(PROFILE_LOOP)
         self.loop()
+        radio.profile_exit(PROFILE_LOOP)
+        radio.profile_enter(PROFILE_GC)
         gc.collect()
+        radio.profile_exit(PROFILE_GC)
         end_time = time.ticks_us()
         sleep_time = self._loop_us - (end_time - start_time)
         sleep_time = max(0, sleep_time)  # Catch wrap-around
@@ -0,0 +1,75 @@
+"""Shows where the time in the controller loop goes, to find the stage that
+pushes it past its budget (33ms at 30Hz).
+
+main.py times each stage of the loop with the radio modules profiler. This
+runs the controller for RUN_SECONDS and prints, per stage, how often it ran,
+the min/mean/max time it took and a histogram of the times. Histogram bin 0
+counts stages under 64us and each bin after it is twice as wide, so the
+bins start at 0, 64us, 128us, ... 32ms, 65ms.
+
+Each scope also includes the python call that ends it, and costs the stage
+around it the calls that start and end it. Both are measured first and
+printed with the report.
+
+From the REPL (after interrupting main.py):
+    import profile_report
+    profile_report.run()
+Pass init=False to report on what main.py has already collected.
+"""
+import time
+import radio
+
+
+RUN_SECONDS = 20
+LOOP_HZ = 30
+OVERHEAD_SCOPES = 1000
+
+
+def measure_overhead():
+    """Returns how long an empty scope measures, and how long it takes to go
+    in and out of one, in microseconds"""
+    timer = radio.profile_timer("empty scope")
+    enter = radio.profile_enter
+    leave = radio.profile_exit
+    start_us = time.ticks_us()
+    for _ in range(OVERHEAD_SCOPES):
+        enter(timer)
+        leave(timer)
+    total_us = time.ticks_diff(time.ticks_us(), start_us)
+
+    start_us = time.ticks_us()
+    for _ in range(OVERHEAD_SCOPES):
+        pass
+    loop_us = time.ticks_diff(time.ticks_us(), start_us)
+
+    for name, count, min_us, mean_us, max_us, histogram in radio.get_profile():
+        if name == "empty scope":
+            return mean_us, (total_us - loop_us) / OVERHEAD_SCOPES
+    return 0, 0
+
+
+def report():
+    print("{:14} {:>7} {:>7} {:>9} {:>7}  {}".format("stage", "count", "min us", "mean us", "max us", "histogram"))
+    for name, count, min_us, mean_us, max_us, histogram in radio.get_profile():
+        if count == 0:
+            continue
+        print("{:14} {:7} {:7} {:9.1f} {:7}  {}".format(
+            name, count, min_us, mean_us, max_us, " ".join(str(c) for c in histogram)
+        ))
+
+
+def run(init=True, seconds=RUN_SECONDS):
+    measured_us, cost_us = measure_overhead()
+    if init:
+        import main
+        controller = main.Controller(LOOP_HZ)
+        radio.profile_reset()
+        end_ms = time.ticks_add(time.ticks_ms(), seconds * 1000)
+        while time.ticks_diff(end_ms, time.ticks_ms()) > 0:
+            controller.update()
+    report()
+    print("An empty scope measures {:.1f}us and costs {:.1f}us".format(measured_us, cost_us))
+
+
+if __name__ == "__main__":
+    run()
@@ -0,0 +1,74 @@
+"""Streams telemetry and link stats over serial as binary records, for
+tools/telemetry_recorder.py to log on a ground station.
+
+Each record is:
+    0xA5 0x5A | type | payload length | payload | fletcher-16 of type to payload
+The checksum lets the host pick the records out from between the text the
+rest of the transmitter prints. See "Serial Telemetry Records" in
+PacketFormat.md for the payloads.
+"""
+import struct
+import sys
+import time
+
+
+SYNC = b'\xa5\x5a'
+RECORD_NAME = 0x01
+RECORD_TELEMETRY = 0x02
+RECORD_LINK = 0x03
+
+NAME_REPEAT_MS = 5000  # Resend the names so a recorder started late learns them
+MAX_NAMES = 255
+
+
+def fletcher16(data):
+    sum1 = 0
+    sum2 = 0
+    for byte in data:
+        sum1 = (sum1 + byte) % 255
+        sum2 = (sum2 + sum1) % 255
+    return (sum2 << 8) | sum1
+
+
+class Recorder:
+    def __init__(self, stream=None):
+        self._stream = stream or sys.stdout.buffer
+        self._name_ids = {}
+        self._last_names_ms = time.ticks_ms()
+
+    def _write(self, record_type, payload):
+        body = bytes((record_type, len(payload))) + payload
+        self._stream.write(SYNC + body + struct.pack('<H', fletcher16(body)))
+
+    def _name_id(self, name):
+        name_id = self._name_ids.get(name)
+        if name_id is None:
+            if len(self._name_ids) >= MAX_NAMES:
+                return None
+            name_id = len(self._name_ids)
+            self._name_ids[name] = name_id
+            self._write_name(name, name_id)
+        return name_id
+
+    def _write_name(self, name, name_id):
+        if not isinstance(name, bytes):
+            name = name.encode('utf-8')
+        self._write(RECORD_NAME, bytes((name_id,)) + name)
+
+    def telemetry(self, name, value, status):
+        """Records a telemetry value from the receiver"""
+        name_id = self._name_id(name)
+        if name_id is not None:
+            self._write(RECORD_TELEMETRY, struct.pack('<IBBf', time.ticks_ms(), name_id, status, value))
+
+    def link(self, rssi, packet_loss, control_rate, tx_failed):
+        """Records the transmitters view of the link"""
+        self._write(RECORD_LINK, struct.pack(
+            '<IbffI', time.ticks_ms(), rssi, packet_loss, control_rate, tx_failed
+        ))
+
+    def update(self):
+        if time.ticks_diff(time.ticks_ms(), self._last_names_ms) > NAME_REPEAT_MS:
+            self._last_names_ms = time.ticks_ms()
+            for name, name_id in self._name_ids.items():
+                self._write_name(name, name_id)
@@ -0,0 +1,103 @@
+"""Compares reading the sticks from python with the native stick pipeline.
+
+Leave the sticks centered while it runs. For each path it reads the sticks
+at FRAME_HZ for RUN_SECONDS and prints, per stick, the noise (standard
+deviation of the channel value, as a percentage of full scale), plus how long
+each read of all the sticks took:
+ - python: one machine.ADC read per stick, scaled around a boot time center
+   reading (how hardware.Inputs used to work)
+ - native: radio.get_sticks(), oversampled, calibrated and curved in C
+
+The native path also lags the sticks by half its oversampling window, which
+is printed with it.
+
+From the REPL:
+    import stick_benchmark
+    stick_benchmark.run()
+"""
+import math
+import time
+import machine
+import radio
+import hardware
+
+
+FRAME_HZ = 30
+RUN_SECONDS = 10
+
+
+class Stats:
+    def __init__(self):
+        self.count = 0
+        self.mean = 0.0
+        self._sum_squares = 0.0
+
+    def add(self, value):
+        self.count += 1
+        delta = value - self.mean
+        self.mean += delta / self.count
+        self._sum_squares += delta * (value - self.mean)
+
+    def std_dev(self):
+        if self.count < 2:
+            return 0.0
+        return math.sqrt(self._sum_squares / (self.count - 1))
+
+
+def _read_python(adcs, centers):
+    return [int((center - adc.read()) / 2048 * hardware.STICK_FULL_SCALE) for adc, center in zip(adcs, centers)]
+
+
+def _measure(read, seconds):
+    noise = [Stats() for _ in hardware.STICK_PINS]
+    read_us = Stats()
+    max_read_us = 0
+    period_ms = 1000 // FRAME_HZ
+    end_ms = time.ticks_add(time.ticks_ms(), seconds * 1000)
+    while time.ticks_diff(end_ms, time.ticks_ms()) > 0:
+        start_us = time.ticks_us()
+        channels = read()
+        elapsed_us = time.ticks_diff(time.ticks_us(), start_us)
+        read_us.add(elapsed_us)
+        max_read_us = max(max_read_us, elapsed_us)
+        for stats, value in zip(noise, channels):
+            stats.add(value)
+        time.sleep_ms(period_ms)
+    return [100 * n.std_dev() / hardware.STICK_FULL_SCALE for n in noise], read_us.mean, max_read_us
+
+
+def bench_python(seconds):
+    radio.sticks_stop()  # Leave the ADC to python
+    adcs = []
+    for pin in hardware.STICK_PINS:
+        adc = machine.ADC(machine.Pin(pin))
+        adc.atten(machine.ADC.ATTN_11DB)
+        adcs.append(adc)
+    centers = [adc.read() for adc in adcs]
+    return _measure(lambda: _read_python(adcs, centers), seconds)
+
+
+def bench_native(seconds):
+    radio.sticks_stop()
+    if radio.sticks_start(hardware.STICK_PINS, hardware.STICK_SAMPLE_HZ, hardware.STICK_OVERSAMPLE) != 0:
+        raise RuntimeError("Couldn't start the sticks")
+    time.sleep_ms(100)  # Fill the oversampling window
+    return _measure(radio.get_sticks, seconds)
+
+
+def _print_result(name, result, lag_ms):
+    noise, mean_us, max_us = result
+    print("{:8} {:>24} {:10.1f} {:8} {:8.1f}".format(
+        name, " ".join("{:5.2f}".format(n) for n in noise), mean_us, max_us, lag_ms
+    ))
+
+
+def run(seconds=RUN_SECONDS):
+    print("{:8} {:>24} {:>10} {:>8} {:>8}".format("path", "noise % per stick", "read us", "max us", "lag ms"))
+    _print_result("python", bench_python(seconds), 0)
+    lag_ms = 1000 * hardware.STICK_OVERSAMPLE / 2 / hardware.STICK_SAMPLE_HZ
+    _print_result("native", bench_native(seconds), lag_ms)
+
+
+if __name__ == "__main__":
+    run()
@@ -0,0 +1,112 @@
+#include <string.h>
+
+#include "auth.h"
+#include "tranceiver.h"
+
+
+#define ROTL64(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+
+
+static inline void sip_round(uint64_t v[4]){
+    v[0] += v[1];
+    v[1] = ROTL64(v[1], 13);
+    v[1] ^= v[0];
+    v[0] = ROTL64(v[0], 32);
+    v[2] += v[3];
+    v[3] = ROTL64(v[3], 16);
+    v[3] ^= v[2];
+    v[0] += v[3];
+    v[3] = ROTL64(v[3], 21);
+    v[3] ^= v[0];
+    v[2] += v[1];
+    v[1] = ROTL64(v[1], 17);
+    v[1] ^= v[2];
+    v[2] = ROTL64(v[2], 32);
+}
+
+
+/* Two compression rounds for one 8 byte block */
+static inline void sip_block(uint64_t v[4], uint64_t m){
+    v[3] ^= m;
+    sip_round(v);
+    sip_round(v);
+    v[0] ^= m;
+}
+
+
+static inline uint64_t load_64(const uint8_t bytes[8]){
+    uint64_t word;
+    memcpy(&word, bytes, 8);  // Both ends are little endian
+    return word;
+}
+
+
+void auth_init_key(auth_key_state* state, const uint8_t key[AUTH_KEY_BYTES]){
+    uint64_t k0 = load_64(key);
+    uint64_t k1 = load_64(key + 8);
+    state->v[0] = k0 ^ 0x736f6d6570736575ULL;
+    state->v[1] = k1 ^ 0x646f72616e646f6dULL;
+    state->v[2] = k0 ^ 0x6c7967656e657261ULL;
+    state->v[3] = k1 ^ 0x7465646279746573ULL;
+}
+
+
+void auth_frame_header(uint8_t header[AUTH_HEADER_BYTES], const uint8_t id[6], uint8_t packet_count, uint8_t type_byte){
+    memcpy(header, id, 6);
+    header[6] = packet_count;
+    header[7] = type_byte & ~PACKET_HOPS_MASK;
+}
+
+
+uint32_t auth_tag(const auth_key_state* state, const uint8_t header[AUTH_HEADER_BYTES], const uint8_t data[], uint16_t len){
+    uint64_t v[4] = {state->v[0], state->v[1], state->v[2], state->v[3]};
+
+    // The header is exactly the first block
+    sip_block(v, load_64(header));
+
+    uint16_t whole = len & ~7;
+    for (uint16_t i=0; i<whole; i+=8){
+        sip_block(v, load_64(data + i));
+    }
+
+    // The last block holds what is left and the length of the message
+    uint8_t last[8] = {0};
+    memcpy(last, data + whole, len - whole);
+    last[7] = (uint8_t)(AUTH_HEADER_BYTES + len);
+    sip_block(v, load_64(last));
+
+    v[2] ^= 0xFF;
+    sip_round(v);
+    sip_round(v);
+    sip_round(v);
+    sip_round(v);
+    return (uint32_t)(v[0] ^ v[1] ^ v[2] ^ v[3]);
+}
+
+
+uint8_t auth_verify(const auth_key_state* state, const uint8_t header[AUTH_HEADER_BYTES], const uint8_t data[], uint16_t len){
+    if (len < AUTH_TAG_BYTES){
+        return 0;
+    }
+    uint16_t signed_len = len - AUTH_TAG_BYTES;
+    uint32_t tag;
+    memcpy(&tag, data + signed_len, AUTH_TAG_BYTES);
+    return auth_tag(state, header, data, signed_len) == tag;
+}
+
+
+uint32_t auth_bind_proof(const auth_key_state* state, const uint8_t id[6]){
+    uint8_t header[AUTH_HEADER_BYTES];
+    auth_frame_header(header, id, 0, PACKET_BIND);
+    const uint8_t accept = AUTH_BIND_ACCEPT;
+    return auth_tag(state, header, &accept, 1);
+}
+
+
+uint32_t auth_resync_tag(const auth_key_state* state, const uint8_t id[6], uint32_t counter){
+    uint8_t header[AUTH_HEADER_BYTES];
+    auth_frame_header(header, id, 0, PACKET_BIND);
+    uint8_t resync[1 + AUTH_COUNTER_BYTES] = {AUTH_BIND_RESYNC};
+    memcpy(resync + 1, &counter, AUTH_COUNTER_BYTES);
+    return auth_tag(state, header, resync, sizeof(resync));
+}
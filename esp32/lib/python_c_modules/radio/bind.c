@@ -0,0 +1,430 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "nvs.h"
+
+#include "bind.h"
+
+
+#define NVS_NAMESPACE "bind"
+#define NVS_KEYS_KEY "keys"
+#define NVS_COUNTER_KEY "counter"  // The end of the reserved signing counters
+#define ID_LENGTH 6
+
+
+typedef struct {
+    uint8_t used;
+    uint8_t id[ID_LENGTH];
+    uint8_t key[AUTH_KEY_BYTES];
+    uint32_t counter_limit;  // The most we take from the receiver, see bind.h
+} saved_key;
+
+typedef enum {
+    REQUEST_IDLE = 0,
+    REQUEST_WAITING = 1,  // For the receiver to accept
+    REQUEST_ACCEPTED = 2,  // Until bind_request() says so
+} request_state;
+
+
+// What is saved, and the key state worked out from it. Read by the RX path
+// and written by python, so everything here is under the lock
+static saved_key keys[BIND_MAX_KEYS];
+static auth_key_state key_states[BIND_MAX_KEYS];
+static uint8_t keys_changed = 0;
+static uint32_t accepted_counters[BIND_MAX_KEYS];  // The newest taken from each receiver ID
+static uint32_t newest_counters[BIND_MAX_KEYS];  // The newest with a good tag, taken or not
+
+// Signing counters. Every one up to counter_reserved may be used
+static uint32_t counter = 0;  // The last one used
+static uint32_t counter_reserved = 0;
+
+// Transmitter
+static request_state request = REQUEST_IDLE;
+static uint8_t request_id[ID_LENGTH];
+static uint8_t request_key[AUTH_KEY_BYTES];
+
+// Receiver
+static uint8_t listening = 0;
+static uint8_t listen_id[ID_LENGTH];
+static uint32_t listen_until_ms = 0;
+static uint8_t accept_due = 0;
+static uint32_t accept_proof = 0;
+static uint8_t resync_due = 0;
+static uint32_t last_resync_ms = 0;
+
+static portMUX_TYPE bind_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/* The slot holding id, or -1. Call with the lock held */
+static int8_t find_slot(const uint8_t id[ID_LENGTH]){
+    for (uint8_t i=0; i<BIND_MAX_KEYS; i++){
+        if (keys[i].used && memcmp(keys[i].id, id, ID_LENGTH) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* Call with the lock held */
+static uint8_t store_key(const uint8_t id[ID_LENGTH], const uint8_t key[AUTH_KEY_BYTES]){
+    int8_t slot = find_slot(id);
+    if (slot >= 0 && memcmp(keys[slot].key, key, AUTH_KEY_BYTES) == 0){
+        return 0;  // Already had it, so there is nothing to save
+    }
+    for (uint8_t i=0; i<BIND_MAX_KEYS && slot < 0; i++){
+        if (!keys[i].used){
+            slot = i;
+        }
+    }
+    if (slot < 0){
+        return 1;
+    }
+    keys[slot].used = 1;
+    memcpy(keys[slot].id, id, ID_LENGTH);
+    memcpy(keys[slot].key, key, AUTH_KEY_BYTES);
+    auth_init_key(&key_states[slot], key);
+    keys[slot].counter_limit = 0;  // A new key has its own counter
+    accepted_counters[slot] = 0;
+    newest_counters[slot] = 0;
+    keys_changed = 1;
+    return 0;
+}
+
+
+void bind_init(void){
+    nvs_handle handle;
+    saved_key loaded[BIND_MAX_KEYS];
+    size_t size = sizeof(loaded);
+    esp_err_t res = ESP_FAIL;
+    uint32_t saved_counter = 0;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK){
+        res = nvs_get_blob(handle, NVS_KEYS_KEY, loaded, &size);
+        nvs_get_u32(handle, NVS_COUNTER_KEY, &saved_counter);
+        nvs_close(handle);
+    }
+    portENTER_CRITICAL(&bind_lock);
+    if (res == ESP_OK && size == sizeof(loaded)){
+        memcpy(keys, loaded, sizeof(keys));
+        for (uint8_t i=0; i<BIND_MAX_KEYS; i++){
+            if (keys[i].used){
+                auth_init_key(&key_states[i], keys[i].key);
+            }
+        }
+    }
+    keys_changed = 0;
+    // Every counter taken before the reboot was within the limit. The
+    // limits are raised by the save below
+    for (uint8_t i=0; i<BIND_MAX_KEYS; i++){
+        accepted_counters[i] = keys[i].counter_limit;
+        newest_counters[i] = keys[i].counter_limit;
+    }
+    resync_due = 1;
+    // Some of the last block may have been used before the reboot, so none
+    // of it is safe. Nothing is signed until the next one is reserved
+    counter = saved_counter;
+    counter_reserved = saved_counter;
+    portEXIT_CRITICAL(&bind_lock);
+    bind_save_changes();
+}
+
+
+uint8_t bind_get_key(const uint8_t id[ID_LENGTH], auth_key_state* state){
+    portENTER_CRITICAL(&bind_lock);
+    int8_t slot = find_slot(id);
+    if (slot >= 0){
+        memcpy(state, &key_states[slot], sizeof(auth_key_state));
+    }
+    portEXIT_CRITICAL(&bind_lock);
+    return slot >= 0;
+}
+
+
+uint8_t bind_set_key(const uint8_t id[ID_LENGTH], const uint8_t key[AUTH_KEY_BYTES]){
+    portENTER_CRITICAL(&bind_lock);
+    uint8_t res = store_key(id, key);
+    portEXIT_CRITICAL(&bind_lock);
+    return res;
+}
+
+
+void bind_forget(const uint8_t id[ID_LENGTH]){
+    portENTER_CRITICAL(&bind_lock);
+    int8_t slot = find_slot(id);
+    if (slot >= 0){
+        memset(&keys[slot], 0, sizeof(saved_key));
+        accepted_counters[slot] = 0;
+        newest_counters[slot] = 0;
+        keys_changed = 1;
+    }
+    portEXIT_CRITICAL(&bind_lock);
+}
+
+
+/* The end of the block to reserve next, short of wrapping */
+static uint32_t next_reservation(uint32_t from){
+    return from <= UINT32_MAX - BIND_COUNTER_BLOCK ? from + BIND_COUNTER_BLOCK : UINT32_MAX;
+}
+
+
+static void reserve_counters(void){
+    portENTER_CRITICAL(&bind_lock);
+    // A resync can move the counter past the reservation
+    uint8_t due = (counter >= counter_reserved || counter_reserved - counter < BIND_COUNTER_BLOCK / 2) && counter_reserved != UINT32_MAX;
+    uint32_t reservation = next_reservation(counter);
+    portEXIT_CRITICAL(&bind_lock);
+    if (!due){
+        return;
+    }
+
+    nvs_handle handle;
+    esp_err_t res = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (res == ESP_OK){
+        res = nvs_set_u32(handle, NVS_COUNTER_KEY, reservation);
+        if (res == ESP_OK){
+            res = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (res == ESP_OK){
+        portENTER_CRITICAL(&bind_lock);
+        counter_reserved = reservation;
+        portEXIT_CRITICAL(&bind_lock);
+    }
+}
+
+
+uint8_t bind_next_counter(uint32_t* next){
+    portENTER_CRITICAL(&bind_lock);
+    uint8_t res = counter >= counter_reserved;
+    if (!res){
+        counter += 1;
+        *next = counter;
+    }
+    portEXIT_CRITICAL(&bind_lock);
+    return res;
+}
+
+
+uint8_t bind_accept_counter(const uint8_t id[ID_LENGTH], uint32_t frame_counter){
+    uint8_t res = BIND_COUNTER_REPLAYED;
+    portENTER_CRITICAL(&bind_lock);
+    int8_t slot = find_slot(id);
+    if (slot >= 0 && frame_counter > accepted_counters[slot]){
+        if (frame_counter > newest_counters[slot]){
+            newest_counters[slot] = frame_counter;
+        }
+        // Past the limit, a reboot would forget we took it
+        if (frame_counter > keys[slot].counter_limit){
+            res = BIND_COUNTER_EARLY;
+        } else {
+            accepted_counters[slot] = frame_counter;
+            res = BIND_COUNTER_TAKEN;
+        }
+    }
+    portEXIT_CRITICAL(&bind_lock);
+    return res;
+}
+
+
+/*
+ * The limit to save for the counters taken from a slot, or 0 if the one it
+ * has will do for a while. Call with the lock held
+ */
+static uint32_t next_limit(uint8_t slot){
+    uint32_t limit = keys[slot].counter_limit;
+    uint32_t newest = newest_counters[slot];
+    if (!keys[slot].used || limit == UINT32_MAX || (newest < limit && limit - newest >= BIND_COUNTER_BLOCK / 2)){
+        return 0;
+    }
+    return next_reservation(newest);
+}
+
+
+void bind_save_changes(void){
+    reserve_counters();
+
+    saved_key to_save[BIND_MAX_KEYS];
+    portENTER_CRITICAL(&bind_lock);
+    uint8_t changed = keys_changed;
+    memcpy(to_save, keys, sizeof(keys));
+    // Raised limits are only used once they are saved
+    for (uint8_t i=0; i<BIND_MAX_KEYS; i++){
+        uint32_t limit = next_limit(i);
+        if (limit != 0){
+            to_save[i].counter_limit = limit;
+            changed = 1;
+        }
+    }
+    keys_changed = 0;
+    portEXIT_CRITICAL(&bind_lock);
+    if (!changed){
+        return;
+    }
+
+    nvs_handle handle;
+    esp_err_t res = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (res == ESP_OK){
+        res = nvs_set_blob(handle, NVS_KEYS_KEY, to_save, sizeof(to_save));
+        if (res == ESP_OK){
+            res = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    portENTER_CRITICAL(&bind_lock);
+    if (res != ESP_OK){
+        keys_changed = 1;  // Try again next time
+    } else {
+        for (uint8_t i=0; i<BIND_MAX_KEYS; i++){
+            // Unless the key has changed meanwhile
+            uint8_t same_key = keys[i].used && memcmp(keys[i].id, to_save[i].id, ID_LENGTH) == 0 && memcmp(keys[i].key, to_save[i].key, AUTH_KEY_BYTES) == 0;
+            if (same_key && to_save[i].counter_limit > keys[i].counter_limit){
+                keys[i].counter_limit = to_save[i].counter_limit;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&bind_lock);
+}
+
+
+uint16_t bind_request(const uint8_t id[ID_LENGTH], uint8_t data[AUTH_BIND_REQUEST_BYTES]){
+    uint8_t new_key[AUTH_KEY_BYTES];
+    for (uint8_t i=0; i<AUTH_KEY_BYTES; i+=4){
+        uint32_t word = esp_random();  // Truly random while the radio is on
+        memcpy(new_key + i, &word, 4);
+    }
+
+    uint16_t len = AUTH_BIND_REQUEST_BYTES;
+    portENTER_CRITICAL(&bind_lock);
+    uint8_t same_id = memcmp(request_id, id, ID_LENGTH) == 0;
+    if (request == REQUEST_ACCEPTED && same_id){
+        request = REQUEST_IDLE;
+        len = 0;
+    } else {
+        if (request != REQUEST_WAITING || !same_id){
+            memcpy(request_id, id, ID_LENGTH);
+            memcpy(request_key, new_key, AUTH_KEY_BYTES);
+            request = REQUEST_WAITING;
+        }
+        data[0] = AUTH_BIND_REQUEST;
+        memcpy(data + 1, request_key, AUTH_KEY_BYTES);
+    }
+    portEXIT_CRITICAL(&bind_lock);
+    return len;
+}
+
+
+void bind_listen(const uint8_t id[ID_LENGTH], uint32_t window_ms, uint32_t now_ms){
+    portENTER_CRITICAL(&bind_lock);
+    memcpy(listen_id, id, ID_LENGTH);
+    listen_until_ms = now_ms + window_ms;
+    listening = window_ms > 0;
+    portEXIT_CRITICAL(&bind_lock);
+}
+
+
+uint8_t bind_take_accept(uint8_t data[AUTH_BIND_ACCEPT_BYTES]){
+    portENTER_CRITICAL(&bind_lock);
+    uint8_t due = accept_due;
+    uint32_t proof = accept_proof;
+    accept_due = 0;
+    portEXIT_CRITICAL(&bind_lock);
+    if (due){
+        data[0] = AUTH_BIND_ACCEPT;
+        memcpy(data + 1, &proof, AUTH_TAG_BYTES);
+    }
+    return due;
+}
+
+
+void bind_handle_packet(const uint8_t id[ID_LENGTH], const uint8_t data[], uint16_t len, uint32_t now_ms){
+    auth_key_state state;
+    if (data[0] == AUTH_BIND_REQUEST && len >= AUTH_BIND_REQUEST_BYTES){
+        auth_init_key(&state, data + 1);
+        uint32_t proof = auth_bind_proof(&state, id);
+        portENTER_CRITICAL(&bind_lock);
+        // Every copy is answered in case the last accept was lost
+        if (listening && (int32_t)(listen_until_ms - now_ms) > 0 && memcmp(id, listen_id, ID_LENGTH) == 0){
+            if (store_key(id, data + 1) == 0){
+                accept_proof = proof;
+                accept_due = 1;
+            }
+        }
+        portEXIT_CRITICAL(&bind_lock);
+    } else if (data[0] == AUTH_BIND_ACCEPT && len >= AUTH_BIND_ACCEPT_BYTES){
+        uint8_t key[AUTH_KEY_BYTES];
+        portENTER_CRITICAL(&bind_lock);
+        uint8_t waiting = request == REQUEST_WAITING && memcmp(id, request_id, ID_LENGTH) == 0;
+        memcpy(key, request_key, AUTH_KEY_BYTES);
+        portEXIT_CRITICAL(&bind_lock);
+        if (!waiting){
+            return;
+        }
+        auth_init_key(&state, key);
+        uint32_t proof;
+        memcpy(&proof, data + 1, AUTH_TAG_BYTES);
+        if (proof != auth_bind_proof(&state, id)){
+            return;
+        }
+        portENTER_CRITICAL(&bind_lock);
+        // Unless a new bind has started meanwhile
+        if (request == REQUEST_WAITING && memcmp(request_key, key, AUTH_KEY_BYTES) == 0 && store_key(id, key) == 0){
+            request = REQUEST_ACCEPTED;
+        }
+        portEXIT_CRITICAL(&bind_lock);
+    } else if (data[0] == AUTH_BIND_RESYNC && len >= AUTH_BIND_RESYNC_BYTES){
+        // A receiver we are bound to has rebooted and won't take counters
+        // up to this one
+        uint32_t resync_counter;
+        uint32_t tag;
+        memcpy(&resync_counter, data + 1, AUTH_COUNTER_BYTES);
+        memcpy(&tag, data + 1 + AUTH_COUNTER_BYTES, AUTH_TAG_BYTES);
+        if (!bind_get_key(id, &state) || tag != auth_resync_tag(&state, id, resync_counter)){
+            return;
+        }
+        portENTER_CRITICAL(&bind_lock);
+        if (counter < resync_counter){
+            counter = resync_counter;  // Signing waits for the next reservation if this is past it
+        }
+        portEXIT_CRITICAL(&bind_lock);
+    }
+}
+
+
+void bind_authenticated(const uint8_t id[ID_LENGTH]){
+    if (!listening && !resync_due){
+        return;
+    }
+    portENTER_CRITICAL(&bind_lock);
+    if (memcmp(id, listen_id, ID_LENGTH) == 0){
+        listening = 0;
+    }
+    resync_due = 0;
+    portEXIT_CRITICAL(&bind_lock);
+}
+
+
+uint8_t bind_take_resync(const uint8_t id[ID_LENGTH], uint8_t data[AUTH_BIND_RESYNC_BYTES], uint32_t now_ms){
+    if (!resync_due){
+        return 0;
+    }
+    auth_key_state state;
+    portENTER_CRITICAL(&bind_lock);
+    int8_t slot = find_slot(id);
+    uint8_t due = slot >= 0 && (now_ms - last_resync_ms) >= BIND_RESYNC_INTERVAL_MS;
+    uint32_t resync_counter = 0;
+    if (due){
+        memcpy(&state, &key_states[slot], sizeof(auth_key_state));
+        resync_counter = accepted_counters[slot];
+        last_resync_ms = now_ms;
+    }
+    portEXIT_CRITICAL(&bind_lock);
+    if (!due){
+        return 0;
+    }
+    uint32_t tag = auth_resync_tag(&state, id, resync_counter);
+    data[0] = AUTH_BIND_RESYNC;
+    memcpy(data + 1, &resync_counter, AUTH_COUNTER_BYTES);
+    memcpy(data + 1 + AUTH_COUNTER_BYTES, &tag, AUTH_TAG_BYTES);
+    return 1;
+}
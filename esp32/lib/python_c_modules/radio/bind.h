@@ -0,0 +1,130 @@
+#ifndef __bind_h__
+#define __bind_h__
+
+#include <stdint.h>
+#include "auth.h"
+
+// Binding a receiver to one transmitter with a shared key (see auth.h), so
+// nothing else on the channel can drive it.
+//
+// The transmitter makes a random key and sends it in bind requests until
+// the receiver answers with an accept that proves it has the key. The
+// receiver only takes a key while it is listening, which it stops doing at
+// the end of the window or on the first control packet signed with the new
+// key. From then on the transmitter signs every control packet it sends
+// that receiver, and the receiver drops control packets that aren't signed
+// with the key. See "Binding" in PacketFormat.md.
+//
+// Keys are kept by receiver ID, so one table serves a transmitter with
+// several receivers and a receiver with its own key. They are saved to NVS,
+// which can't be written from the RX path, so bind_save_changes() does it
+// later.
+//
+// This also keeps the counters that stop signed frames being replayed (see
+// auth.h), which have to keep going up across reboots at both ends. The
+// counter we sign with is reserved in NVS BIND_COUNTER_BLOCK at a time, and
+// a reboot carries on from the end of the last block. In the same way a
+// receiver only takes counters up to a limit saved with the key, raised a
+// block past the newest it has seen when it gets within half a block, and
+// a reboot carries on from the limit. The transmitter may still be below
+// it, so until a control packet gets through the receiver sends resyncs
+// asking it to sign above the limit. A recorded resync only moves the
+// transmitter's counter on, which does no harm.
+//
+// The key goes over the air in the clear, so bind at short range, or set
+// the same key on both ends over USB with bind_set_key().
+
+#define BIND_MAX_KEYS 8
+#define BIND_DEFAULT_WINDOW_MS 30000
+#define BIND_COUNTER_BLOCK 0x10000  // Reserved again when half used, so every 33s at 1kHz
+#define BIND_RESYNC_INTERVAL_MS 200
+
+// What bind_accept_counter() made of a counter
+#define BIND_COUNTER_TAKEN 0
+#define BIND_COUNTER_REPLAYED 1  // No newer than one already taken
+#define BIND_COUNTER_EARLY 2  // Past the saved limit, so not until it is raised
+
+
+/* Loads the saved keys. Call after NVS is up */
+void bind_init(void);
+
+/*
+ * Copies out the key state for a receiver. Returns nonzero if we are bound
+ * to it.
+ */
+uint8_t bind_get_key(const uint8_t id[6], auth_key_state* state);
+
+/*
+ * Sets the key for a receiver, replacing any it had. Returns nonzero if
+ * the table is full.
+ */
+uint8_t bind_set_key(const uint8_t id[6], const uint8_t key[AUTH_KEY_BYTES]);
+
+void bind_forget(const uint8_t id[6]);
+
+/*
+ * Writes the keys to NVS if they have changed, and reserves more signing
+ * counters or raises the limits on the counters taken if they are running
+ * low. Not from the RX path
+ */
+void bind_save_changes(void);
+
+/*
+ * Takes the counter for the next frame we sign. Returns nonzero, and
+ * nothing may be signed, if the reserved counters have run out because
+ * bind_save_changes() hasn't been called for a while.
+ */
+uint8_t bind_next_counter(uint32_t* counter);
+
+/*
+ * Checks the counter of a frame from id whose tag is good. Returns
+ * BIND_COUNTER_TAKEN, and remembers it, if it is newer than any other
+ * since the key was set and within the saved limit.
+ */
+uint8_t bind_accept_counter(const uint8_t id[6], uint32_t counter);
+
+
+/*
+ * The transmitter side
+ */
+
+/*
+ * Binds the receiver with this ID. The first call makes a new key, and
+ * each call puts a request carrying it in data to be sent to the receiver.
+ * Returns the length of the request, or 0 (and nothing to send) once the
+ * receiver has accepted, which ends the bind.
+ */
+uint16_t bind_request(const uint8_t id[6], uint8_t data[AUTH_BIND_REQUEST_BYTES]);
+
+
+/*
+ * The receiver side
+ */
+
+/* Takes a key from a transmitter sent to id for the next window_ms */
+void bind_listen(const uint8_t id[6], uint32_t window_ms, uint32_t now_ms);
+
+/*
+ * Puts an accept in data if one is due. Returns nonzero if it did. It is
+ * sent from our ID.
+ */
+uint8_t bind_take_accept(uint8_t data[AUTH_BIND_ACCEPT_BYTES]);
+
+/*
+ * Puts a resync for the key of id, our ID, in data if one is due. Returns
+ * nonzero if it did.
+ */
+uint8_t bind_take_resync(const uint8_t id[6], uint8_t data[AUTH_BIND_RESYNC_BYTES], uint32_t now_ms);
+
+
+/*
+ * Used by the tranceiver
+ */
+
+/* Handles a PACKET_BIND sent to id. Called from the RX path */
+void bind_handle_packet(const uint8_t id[6], const uint8_t data[], uint16_t len, uint32_t now_ms);
+
+/* A control packet for id was signed with its key, so any bind or resync is done */
+void bind_authenticated(const uint8_t id[6]);
+
+#endif
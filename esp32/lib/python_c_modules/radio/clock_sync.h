@@ -0,0 +1,59 @@
+#ifndef __clock_sync_h__
+#define __clock_sync_h__
+
+#include <stdint.h>
+
+// Estimates the offset and drift between the transmitters and the receivers
+// clocks so the receiver can measure the true one-way latency of each
+// control packet.
+//
+// The receiver timestamps its telemetry packets (t1). The transmitter notes
+// when it received one (t2) and replies with a sync packet containing t1, t2
+// and the time it sent the reply (t3). The receiver notes when the reply
+// arrives (t4) and works out the offset the same way NTP does.
+//
+// All times are in microseconds and are allowed to wrap.
+
+#define CLOCK_SYNC_MAX_EXTRA_DELAY_US 2000  // Ignore samples with a round trip this much slower than the best seen
+#define CLOCK_SYNC_LATENCY_UNKNOWN INT32_MIN
+#define CLOCK_SYNC_REPLY_BYTES 12
+
+
+/* ---------- Transmitter side ---------- */
+
+/*
+ * Records a timestamped packet from the receiver. The reply is sent with the
+ * next control packet.
+ */
+void clock_sync_handle_request(uint32_t t1, uint32_t t2);
+
+/*
+ * If a reply is due, fills out with t1, t2 and t3 (now) and returns nonzero
+ */
+uint8_t clock_sync_take_reply(uint8_t out[CLOCK_SYNC_REPLY_BYTES], uint32_t now_us);
+
+
+/* ---------- Receiver side ---------- */
+
+/* Handles a sync reply that arrived at t4 */
+void clock_sync_handle_reply(const uint8_t data[CLOCK_SYNC_REPLY_BYTES], uint32_t t4);
+
+/* Nonzero once at least one sync exchange has completed */
+uint8_t clock_sync_is_synced(void);
+
+/* Converts a time on the transmitters clock to a time on our clock */
+uint32_t clock_sync_to_local(uint32_t remote_us, uint32_t now_us);
+
+/*
+ * Works out the one way latency of a packet the transmitter timestamped,
+ * and updates the latency and jitter statistics. Returns
+ * CLOCK_SYNC_LATENCY_UNKNOWN if the clocks are not yet synchronised.
+ */
+int32_t clock_sync_packet_latency(uint32_t tx_remote_us, uint32_t rx_local_us);
+
+int32_t clock_sync_get_offset_us(void);
+float clock_sync_get_drift_ppm(void);
+float clock_sync_get_latency_us(void);  // Smoothed
+float clock_sync_get_jitter_us(void);
+
+#endif
@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "congestion.h"
+
+
+// When each frame handed to the wifi stack should have finished going out
+static uint32_t done_us[CONGESTION_TX_BUFFERS] = {0};
+static uint8_t done_head = 0;
+static uint32_t last_done_us = 0;
+
+static uint32_t congested_until_us = 0;
+static uint32_t last_decrease_us = 0;
+static float control_credit = 0;
+
+static volatile congestion_stats stats = {
+    .control_rate = 1.0f,
+};
+
+
+tx_priority congestion_priority(packet_types packet_type){
+    switch (packet_type){
+        case PACKET_TELEMETRY:
+        case PACKET_NAME:
+            return TX_PRIORITY_TELEMETRY;
+        case PACKET_BULK:
+            return TX_PRIORITY_BULK;
+        default:
+            return TX_PRIORITY_CONTROL;
+    }
+}
+
+
+static uint8_t queue_depth(uint32_t now_us){
+    uint8_t depth = 0;
+    for (uint8_t i=0; i<CONGESTION_TX_BUFFERS; i++){
+        if ((int32_t)(done_us[i] - now_us) > 0){
+            depth += 1;
+        }
+    }
+    stats.queue_depth = depth;
+    if (depth > stats.max_queue_depth){
+        stats.max_queue_depth = depth;
+    }
+    return depth;
+}
+
+
+uint8_t congestion_admit(tx_priority priority, uint32_t now_us){
+    uint8_t depth = queue_depth(now_us);
+    uint8_t congested = (int32_t)(congested_until_us - now_us) > 0;
+
+    if (priority == TX_PRIORITY_TELEMETRY && (congested || depth >= CONGESTION_SHED_TELEMETRY_DEPTH)){
+        stats.shed_telemetry += 1;
+        return 1;
+    }
+    if (priority == TX_PRIORITY_BULK && (congested || depth >= CONGESTION_SHED_BULK_DEPTH)){
+        stats.shed_bulk += 1;
+        return 1;
+    }
+    if (priority == TX_PRIORITY_CONTROL){
+        // Sends control_rate of the control packets offered, spread evenly
+        control_credit += stats.control_rate;
+        if (control_credit < 1.0f){
+            stats.skipped_control += 1;
+            return 1;
+        }
+        control_credit -= 1.0f;
+        if (!congested && stats.control_rate < 1.0f){
+            stats.control_rate += CONGESTION_RATE_INCREASE;
+            if (stats.control_rate > 1.0f){
+                stats.control_rate = 1.0f;
+            }
+        }
+    }
+    return 0;
+}
+
+
+void congestion_sent(int32_t result, uint32_t airtime_us, uint32_t now_us){
+    if (result != 0){
+        stats.failed += 1;
+        stats.last_error = result;
+        congested_until_us = now_us + CONGESTION_HOLD_US;
+
+        // One decrease per burst of failures, or a single full queue would
+        // take the rate straight to the minimum
+        if ((uint32_t)(now_us - last_decrease_us) > CONGESTION_HOLD_US){
+            stats.control_rate *= CONGESTION_RATE_DECREASE;
+            if (stats.control_rate < CONGESTION_MIN_CONTROL_RATE){
+                stats.control_rate = CONGESTION_MIN_CONTROL_RATE;
+            }
+            last_decrease_us = now_us;
+        }
+        return;
+    }
+    stats.sent += 1;
+
+    // Frames go out one after another, so this one finishes after the
+    // previous one
+    uint32_t start_us = now_us;
+    if ((int32_t)(last_done_us - now_us) > 0){
+        start_us = last_done_us;
+    }
+    last_done_us = start_us + CONGESTION_FRAME_OVERHEAD_US + airtime_us;
+    done_us[done_head] = last_done_us;
+    done_head = (done_head + 1) % CONGESTION_TX_BUFFERS;
+}
+
+
+void congestion_refused(void){
+    stats.refused += 1;
+}
+
+
+void congestion_get_stats(congestion_stats* out){
+    memcpy(out, (const void*)&stats, sizeof(congestion_stats));
+}
@@ -0,0 +1,65 @@
+#ifndef __congestion_h__
+#define __congestion_h__
+
+#include <stdint.h>
+#include "tranceiver.h"
+
+// Backpressure for the TX path. The wifi stack only has a few TX buffers,
+// and on a busy channel they fill up and sends start failing in bursts.
+//
+// We keep an estimate of how many frames are still waiting to go out from
+// the airtime of each frame sent. As that queue grows, telemetry is dropped
+// first and then bulk packets. Control packets are never dropped for queue
+// depth, but their rate is cut in half whenever a send fails and creeps back
+// up with every control packet that goes out (AIMD).
+//
+// Only the context that sends packets touches the state, so statistics are
+// read without a lock.
+
+#define CONGESTION_TX_BUFFERS 16  // dynamic_tx_buf_num given to the wifi stack
+#define CONGESTION_FRAME_OVERHEAD_US 120  // DIFS and the average backoff before each frame
+#define CONGESTION_SHED_TELEMETRY_DEPTH 6  // Drop telemetry with this many frames waiting
+#define CONGESTION_SHED_BULK_DEPTH 10  // Drop bulk packets with this many frames waiting
+#define CONGESTION_HOLD_US 100000  // Keep shedding for this long after a failed send
+#define CONGESTION_MIN_CONTROL_RATE 0.25f  // Always send at least this fraction of control packets
+#define CONGESTION_RATE_DECREASE 0.5f
+#define CONGESTION_RATE_INCREASE 0.02f  // Per control packet sent
+
+
+typedef enum {
+    TX_PRIORITY_CONTROL = 0,  // Control, link and clock sync. Rate limited, never dropped
+    TX_PRIORITY_BULK = 1,
+    TX_PRIORITY_TELEMETRY = 2,  // Telemetry and names. Dropped first
+} tx_priority;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t failed;  // Refused by the wifi stack
+    uint32_t shed_telemetry;
+    uint32_t shed_bulk;
+    uint32_t skipped_control;  // Left out by the rate control
+    uint8_t queue_depth;  // Frames estimated to still be waiting to go out
+    uint8_t max_queue_depth;
+    float control_rate;  // Fraction of control packets being sent
+    int32_t last_error;  // esp_err_t of the last failed send
+    uint32_t refused;  // Too long or couldn't be signed, so never handed to the wifi stack
+} congestion_stats;
+
+
+tx_priority congestion_priority(packet_types packet_type);
+
+/*
+ * Decides whether a packet should be sent now. Returns nonzero if it should
+ * be dropped.
+ */
+uint8_t congestion_admit(tx_priority priority, uint32_t now_us);
+
+/* Records the result of handing a frame to the wifi stack */
+void congestion_sent(int32_t result, uint32_t airtime_us, uint32_t now_us);
+
+/* Records a packet that couldn't be made into a frame */
+void congestion_refused(void);
+
+void congestion_get_stats(congestion_stats* stats);
+
+#endif
@@ -0,0 +1,137 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "device_table.h"
+
+
+static device_entry device_table[DEVICE_TABLE_SIZE];
+static uint32_t overflows = 0;
+
+// The table is written from the wifi task and read from python
+static portMUX_TYPE device_table_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint32_t hash_id(const uint8_t id[6]){
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint8_t i=0; i<6; i++){
+        hash ^= id[i];
+        hash *= 16777619u;
+    }
+    if (hash == 0){
+        hash = 1;  // 0 is reserved for empty slots
+    }
+    return hash;
+}
+
+static uint8_t is_expired(const device_entry* entry, uint32_t now_ms){
+    return (now_ms - entry->last_seen_ms) > DEVICE_TABLE_EXPIRE_MS;
+}
+
+static device_entry* find_entry(uint32_t hash, const uint8_t id[6]){
+    for (uint8_t i=0; i<DEVICE_TABLE_MAX_PROBE; i++){
+        device_entry* entry = &device_table[(hash + i) & (DEVICE_TABLE_SIZE - 1)];
+        if (entry->hash == hash && memcmp(entry->id, id, 6) == 0){
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void update_link(device_entry* entry, int8_t rssi, uint32_t now_ms){
+    entry->rssi = rssi;
+    entry->last_seen_ms = now_ms;
+}
+
+static void update_loss(device_entry* entry, uint8_t packet_id, uint32_t now_ms){
+    uint8_t diff = packet_id - entry->last_packet_id;
+    if (entry->has_packet_id && diff != 0 && !is_expired(entry, now_ms)){
+        // Same smoothing as the transmitters PacketLossCounter
+        float lost = 1.0f - 1.0f / diff;
+        entry->loss = entry->loss * 0.7f + lost * 0.3f;
+    }
+    entry->last_packet_id = packet_id;
+    entry->has_packet_id = 1;
+}
+
+
+void device_table_clear(void){
+    portENTER_CRITICAL(&device_table_lock);
+    memset(device_table, 0, sizeof(device_table));
+    overflows = 0;
+    portEXIT_CRITICAL(&device_table_lock);
+}
+
+
+void device_table_handle_name(const uint8_t id[6], const uint8_t name[], uint8_t name_len, int8_t rssi, uint32_t now_ms){
+    uint32_t hash = hash_id(id);
+
+    // Receivers pad their name with null characters
+    while (name_len > 0 && name[name_len - 1] == 0){
+        name_len -= 1;
+    }
+    if (name_len > TRANCEIVER_MAX_NAME_LENGTH){
+        name_len = TRANCEIVER_MAX_NAME_LENGTH;
+    }
+
+    portENTER_CRITICAL(&device_table_lock);
+    device_entry* entry = find_entry(hash, id);
+    if (entry == NULL){
+        // Use the first free or expired slot. Live receivers are never
+        // pushed out, so a crowded channel can't hide one that is in use
+        for (uint8_t i=0; i<DEVICE_TABLE_MAX_PROBE; i++){
+            device_entry* slot = &device_table[(hash + i) & (DEVICE_TABLE_SIZE - 1)];
+            if (slot->hash == 0 || is_expired(slot, now_ms)){
+                entry = slot;
+                break;
+            }
+        }
+        if (entry == NULL){
+            overflows += 1;
+            portEXIT_CRITICAL(&device_table_lock);
+            return;
+        }
+        memset(entry, 0, sizeof(device_entry));
+        entry->hash = hash;
+        memcpy(entry->id, id, 6);
+    }
+    memcpy(entry->name, name, name_len);
+    entry->name_len = name_len;
+    update_link(entry, rssi, now_ms);
+    portEXIT_CRITICAL(&device_table_lock);
+}
+
+
+void device_table_handle_telemetry(const uint8_t id[6], int8_t rssi, uint8_t packet_id, uint32_t now_ms){
+    uint32_t hash = hash_id(id);
+    portENTER_CRITICAL(&device_table_lock);
+    device_entry* entry = find_entry(hash, id);
+    if (entry != NULL){
+        update_loss(entry, packet_id, now_ms);
+        update_link(entry, rssi, now_ms);
+    }
+    portEXIT_CRITICAL(&device_table_lock);
+}
+
+
+uint8_t device_table_snapshot(device_entry out[], uint8_t max_entries, uint32_t now_ms){
+    uint8_t count = 0;
+    portENTER_CRITICAL(&device_table_lock);
+    for (uint16_t i=0; i<DEVICE_TABLE_SIZE && count < max_entries; i++){
+        device_entry* entry = &device_table[i];
+        if (entry->hash != 0 && !is_expired(entry, now_ms)){
+            out[count] = *entry;
+            count += 1;
+        }
+    }
+    portEXIT_CRITICAL(&device_table_lock);
+    return count;
+}
+
+
+uint32_t device_table_overflows(void){
+    portENTER_CRITICAL(&device_table_lock);
+    uint32_t count = overflows;
+    portEXIT_CRITICAL(&device_table_lock);
+    return count;
+}
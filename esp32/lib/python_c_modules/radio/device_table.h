@@ -0,0 +1,57 @@
+#ifndef __device_table_h__
+#define __device_table_h__
+
+#include <stdint.h>
+#include "tranceiver.h"
+
+// Keeps track of every receiver that has announced itself with a name packet.
+// Entries live in a fixed size open-addressed hash table keyed by a hash of
+// the receiver UID. Probing is bounded, so updating the table from the radio
+// callback costs the same no matter how many receivers are on the channel.
+
+#define DEVICE_TABLE_SIZE 64  // Must be a power of two
+#define DEVICE_TABLE_MAX_PROBE 8
+#define DEVICE_TABLE_EXPIRE_MS 5000  // Forget receivers not heard for this long
+
+
+typedef struct {
+  uint32_t hash;  // 0 means the slot has never been used
+  uint8_t id[6];
+  uint8_t name_len;
+  char name[TRANCEIVER_MAX_NAME_LENGTH];
+  int8_t rssi;
+  uint8_t last_packet_id;  // Pcnt of the last telemetry packet
+  uint8_t has_packet_id;
+  uint32_t last_seen_ms;
+  float loss;  // Smoothed fraction of the receivers telemetry packets that went missing
+} device_entry;
+
+
+/* Forget all receivers */
+void device_table_clear(void);
+
+/*
+ * Records a name packet. Creates an entry for the receiver if it isn't
+ * already known. Only free or expired slots are reused, so if every slot the
+ * receiver could go in is held by a live one it is left out and counted in
+ * device_table_overflows().
+ */
+void device_table_handle_name(const uint8_t id[6], const uint8_t name[], uint8_t name_len, int8_t rssi, uint32_t now_ms);
+
+/*
+ * Updates the link statistics of an already known receiver from a telemetry
+ * packet. Telemetry has its own sequence numbers (see sequence.h), so the
+ * loss is worked out from those alone. Unknown receivers are ignored.
+ */
+void device_table_handle_telemetry(const uint8_t id[6], int8_t rssi, uint8_t packet_id, uint32_t now_ms);
+
+/*
+ * Copies the receivers heard within the last DEVICE_TABLE_EXPIRE_MS into
+ * out. Returns the number of entries copied (at most max_entries)
+ */
+uint8_t device_table_snapshot(device_entry out[], uint8_t max_entries, uint32_t now_ms);
+
+/* Name packets from new receivers that didn't fit, since the table was last cleared */
+uint32_t device_table_overflows(void);
+
+#endif
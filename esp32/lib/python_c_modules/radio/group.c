@@ -0,0 +1,97 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "group.h"
+
+
+static uint8_t joined = 0;
+static uint8_t group_id[6] = {0};
+static uint8_t member_index = 0;
+
+// Joined from python and checked from the RX path
+static portMUX_TYPE group_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint16_t table_bytes(uint8_t members){
+    // The member count and members + 1 starts, padded so the channels are
+    // aligned
+    uint16_t len = 1 + members + 1;
+    return (len + 1) & ~1;
+}
+
+
+uint8_t group_join(const uint8_t id[6], uint8_t index){
+    if (index >= GROUP_MAX_MEMBERS){
+        return 1;
+    }
+    portENTER_CRITICAL(&group_lock);
+    memcpy(group_id, id, sizeof(group_id));
+    member_index = index;
+    joined = 1;
+    portEXIT_CRITICAL(&group_lock);
+    return 0;
+}
+
+
+void group_leave(void){
+    portENTER_CRITICAL(&group_lock);
+    joined = 0;
+    portEXIT_CRITICAL(&group_lock);
+}
+
+
+uint8_t group_get_id(uint8_t id[6]){
+    portENTER_CRITICAL(&group_lock);
+    uint8_t res = joined;
+    memcpy(id, group_id, sizeof(group_id));
+    portEXIT_CRITICAL(&group_lock);
+    return res;
+}
+
+
+uint16_t group_build(uint8_t out[], uint16_t max_len, const int16_t channels[], const uint8_t counts[], uint8_t members){
+    if (members == 0 || members > GROUP_MAX_MEMBERS){
+        return 0;
+    }
+    uint16_t header_len = table_bytes(members);
+    uint16_t total_channels = 0;
+    for (uint8_t i=0; i<members; i++){
+        total_channels += counts[i];
+    }
+    uint16_t len = header_len + total_channels * 2;
+    if (len > max_len){
+        return 0;
+    }
+
+    memset(out, 0, header_len);
+    out[0] = members;
+    uint8_t start = 0;
+    for (uint8_t i=0; i<members; i++){
+        out[1 + i] = start;
+        start += counts[i];
+    }
+    out[1 + members] = start;
+    memcpy(out + header_len, channels, total_channels * 2);
+    return len;
+}
+
+
+uint16_t group_find_slice(const uint8_t id[6], const uint8_t data[], uint16_t data_len, uint16_t* offset){
+    portENTER_CRITICAL(&group_lock);
+    uint8_t ours = joined && memcmp(id, group_id, sizeof(group_id)) == 0;
+    uint8_t index = member_index;
+    portEXIT_CRITICAL(&group_lock);
+
+    uint8_t members = data[0];
+    if (!ours || index >= members || members > GROUP_MAX_MEMBERS){
+        return 0;
+    }
+    uint16_t header_len = table_bytes(members);
+    uint16_t start = header_len + data[1 + index] * 2;
+    uint16_t end = header_len + data[1 + index + 1] * 2;
+    if (end <= start || end > data_len){
+        return 0;
+    }
+    *offset = start;
+    return end - start;
+}
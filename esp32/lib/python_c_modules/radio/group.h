@@ -0,0 +1,49 @@
+#ifndef __group_h__
+#define __group_h__
+
+#include <stdint.h>
+
+// Group control packets drive several receivers with one frame.
+//
+// Receivers join a group, which is just a second ID they answer to, and
+// are given a member index. A group packet is sent to the group ID and
+// carries the channels of every member back to back, after a member index
+// table holding where each members channels start:
+//     members | start[0] .. start[members] | (pad to even) | channels
+// A receiver finds its slice from start[index] and start[index + 1], so it
+// costs the same however big the group is. Members can have different
+// numbers of channels. The slice is then handled exactly like a control
+// packet.
+//
+// The transmitter joins the group too, so it knows where to send them (its
+// member index isn't used).
+
+#define GROUP_MAX_MEMBERS 16
+
+
+/*
+ * Answer to group packets sent to group_id, taking the slice at
+ * member_index. Returns nonzero if the index is out of range.
+ */
+uint8_t group_join(const uint8_t group_id[6], uint8_t member_index);
+
+void group_leave(void);
+
+/* Copies out the group ID. Returns 0 if we aren't in a group */
+uint8_t group_get_id(uint8_t group_id[6]);
+
+/*
+ * Fills out the data of a group packet. counts[i] is the number of channels
+ * for member i, whose channels follow those of member i-1 in channels.
+ * Returns the number of bytes, or 0 if they don't fit in max_len.
+ */
+uint16_t group_build(uint8_t out[], uint16_t max_len, const int16_t channels[], const uint8_t counts[], uint8_t members);
+
+/*
+ * If the group packet data was sent to our group and has a slice for us,
+ * sets offset to where our channels start in data and returns their length
+ * in bytes. Otherwise returns 0.
+ */
+uint16_t group_find_slice(const uint8_t id[6], const uint8_t data[], uint16_t data_len, uint16_t* offset);
+
+#endif
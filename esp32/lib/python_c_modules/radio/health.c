@@ -0,0 +1,104 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+
+#include "health.h"
+#include "radio_tasks.h"
+
+
+static volatile health_timing timings[HEALTH_TIMING_COUNT];
+static volatile uint32_t queue_max[HEALTH_QUEUE_COUNT];
+
+
+void health_record_time(health_timing_id id, uint32_t elapsed_us){
+    volatile health_timing* timing = &timings[id];
+    timing->count += 1;
+    timing->total_us += elapsed_us;
+    if (elapsed_us > timing->max_us){
+        timing->max_us = elapsed_us;
+    }
+}
+
+
+void health_record_queue(health_queue_id id, uint32_t occupancy){
+    if (occupancy > queue_max[id]){
+        queue_max[id] = occupancy;
+    }
+}
+
+
+void health_get_timing(health_timing_id id, health_timing* timing){
+    memcpy(timing, (const void*)&timings[id], sizeof(health_timing));
+}
+
+
+uint32_t health_get_queue_max(health_queue_id id){
+    return queue_max[id];
+}
+
+
+void health_get_memory(health_memory* memory){
+    memory->heap_free = esp_get_free_heap_size();
+    memory->heap_min_free = esp_get_minimum_free_heap_size();
+    memory->stack_free_python = uxTaskGetStackHighWaterMark(NULL);
+    radio_tasks_get_stack_free(&memory->stack_free_rx, &memory->stack_free_tx, &memory->stack_free_output);
+}
+
+
+static uint32_t next_random(uint32_t* state){
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+void health_inject_mixed(uint32_t count, uint32_t seed){
+    uint32_t state = seed ? seed : 1;
+    const uint8_t* our_id = tranceiver_get_id();
+    uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+
+    for (uint32_t i=0; i<count; i++){
+        uint32_t pick = next_random(&state) % 100;
+        uint32_t value = next_random(&state);
+        int8_t rssi = -40 - (int8_t)(value % 50);
+        uint8_t id[6];
+        memcpy(id, our_id, sizeof(id));
+
+        if (pick < HEALTH_MIX_CONTROL){
+            uint8_t num_channels = 4 + value % 12;
+            for (uint8_t c=0; c<num_channels * 2; c++){
+                data[c] = next_random(&state);
+            }
+            tranceiver_inject_frame(id, PACKET_CONTROL, data, num_channels * 2, rssi);
+        } else if ((pick -= HEALTH_MIX_CONTROL) < HEALTH_MIX_TELEMETRY){
+            memset(data, 0, sizeof(data));
+            data[0] = TELEMETRY_OK;
+            memcpy(data + 1, &value, 4);
+            memcpy(data + 5, "Soak", 4);
+            tranceiver_inject_frame(id, PACKET_TELEMETRY, data, 5 + 4 + value % 8, rssi);
+        } else if ((pick -= HEALTH_MIX_TELEMETRY) < HEALTH_MIX_NAME){
+            // Name packets carry the receivers own ID in the data too
+            id[5] = value % HEALTH_MIX_DEVICES;
+            memcpy(data, id, sizeof(id));
+            memcpy(data + sizeof(id), "Soak receiver", 13);
+            tranceiver_inject_frame(id, PACKET_NAME, data, sizeof(id) + 13, rssi);
+        } else if ((pick -= HEALTH_MIX_NAME) < HEALTH_MIX_LINK){
+            data[0] = (uint8_t)-60;  // A good link, so the power doesn't wander
+            data[1] = 0;
+            tranceiver_inject_frame(id, PACKET_LINK, data, 2, rssi);
+        } else {
+            // Someone else's, or a type we don't know
+            uint8_t unknown_type = value & 1;
+            if (!unknown_type){
+                id[0] ^= 0xFF;
+            }
+            memset(data, 0, 12);
+            tranceiver_inject_frame(id, unknown_type ? 0x7E : PACKET_CONTROL, data, 12, rssi);
+        }
+    }
+}
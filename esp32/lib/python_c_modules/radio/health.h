@@ -0,0 +1,69 @@
+#ifndef __health_h__
+#define __health_h__
+
+#include <stdint.h>
+#include "tranceiver.h"
+
+// Statistics for catching memory and latency regressions in long runs: how
+// long the radio spends in its callback and sending, how full the queues
+// get and how close the stacks and heap come to running out.
+//
+// Each figure has one writer, so they are read without a lock. They are
+// never reset, so the worst cases cover everything since boot.
+//
+// health_inject_mixed feeds synthetic frames through the same path as the
+// wifi callback, which lets a soak run push millions of frames of mixed
+// traffic through the receive path without a transmitter.
+
+typedef enum {
+    HEALTH_TIMING_CALLBACK = 0,  // The wifi callback
+    HEALTH_TIMING_PROCESS = 1,  // Parsing a frame, in the callback or the RX task
+    HEALTH_TIMING_SEND = 2,  // Handing a frame to the wifi stack
+    HEALTH_TIMING_COUNT
+} health_timing_id;
+
+typedef enum {
+    HEALTH_QUEUE_RX_PACKETS = 0,  // Packets waiting for python
+    HEALTH_QUEUE_RX_FRAMES = 1,  // Frames waiting for the RX task
+    HEALTH_QUEUE_TX = 2,  // Packets waiting for the TX task
+    HEALTH_QUEUE_COUNT
+} health_queue_id;
+
+typedef struct {
+    uint32_t count;
+    uint32_t total_us;
+    uint32_t max_us;
+} health_timing;
+
+typedef struct {
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t stack_free_python;  // The calling task's stack high-water mark
+    uint32_t stack_free_rx;  // Radio tasks. 0 if they aren't running
+    uint32_t stack_free_tx;
+    uint32_t stack_free_output;
+} health_memory;
+
+// Share of the frames health_inject_mixed generates, in percent
+#define HEALTH_MIX_CONTROL 60
+#define HEALTH_MIX_TELEMETRY 15
+#define HEALTH_MIX_NAME 10  // From HEALTH_MIX_DEVICES different receivers
+#define HEALTH_MIX_LINK 5
+#define HEALTH_MIX_FOREIGN 10  // Someone else's ID or an unknown type, so they are rejected
+#define HEALTH_MIX_DEVICES 100  // More than fit in the device table
+
+
+void health_record_time(health_timing_id id, uint32_t elapsed_us);
+void health_record_queue(health_queue_id id, uint32_t occupancy);
+
+void health_get_timing(health_timing_id id, health_timing* timing);
+uint32_t health_get_queue_max(health_queue_id id);
+void health_get_memory(health_memory* memory);
+
+/*
+ * Injects count synthetic received frames of mixed traffic. The same seed
+ * gives the same frames.
+ */
+void health_inject_mixed(uint32_t count, uint32_t seed);
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef __lockfree_h__
+#define __lockfree_h__
+
+#include <stdint.h>
+#include <string.h>
+
+// Handoff between the radio tasks and the interpreter without taking locks,
+// so neither side can hold up the other even when they are on different
+// cores.
+//
+// spsc_ring is a single producer, single consumer ring of slot indexes. The
+// caller owns the slot storage, which keeps the ring usable for any slot
+// type. The producer asks for a slot, fills it and commits it. The consumer
+// does the same in the other direction.
+//
+// seqlock publishes a "latest value" (eg channel values) from one writer to
+// any number of readers. Readers copy the value out and retry if the writer
+// was part way through updating it. Readers never wait for the writer: a
+// high priority task could otherwise spin forever over a writer it has
+// preempted on the same core. After SEQLOCK_READ_TRIES failed copies they
+// give up and keep the last value they read.
+
+
+typedef struct {
+    volatile uint32_t head;  // Only written by the producer
+    volatile uint32_t tail;  // Only written by the consumer
+    uint32_t size;
+} spsc_ring;
+
+#define SPSC_RING_INIT(slots) {0, 0, (slots)}
+
+
+/* The slot to write the next item into, or -1 if the ring is full */
+static inline int32_t spsc_write_slot(spsc_ring* ring){
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (head - tail >= ring->size){
+        return -1;
+    }
+    return head % ring->size;
+}
+
+/* Hands the slot from spsc_write_slot to the consumer */
+static inline void spsc_commit_write(spsc_ring* ring){
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* The slot holding the oldest item, or -1 if the ring is empty */
+static inline int32_t spsc_read_slot(spsc_ring* ring){
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head == tail){
+        return -1;
+    }
+    return tail % ring->size;
+}
+
+/* Gives the slot from spsc_read_slot back to the producer */
+static inline void spsc_commit_read(spsc_ring* ring){
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* How many items are waiting. Call it from the producer */
+static inline uint32_t spsc_occupancy(spsc_ring* ring){
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&ring->head, __ATOMIC_RELAXED) - tail;
+}
+
+
+typedef struct {
+    volatile uint32_t sequence;  // Odd while the writer is updating the value
+} seqlock;
+
+#define SEQLOCK_INIT {0}
+#define SEQLOCK_READ_TRIES 4
+
+
+static inline void seqlock_write_begin(seqlock* lock){
+    uint32_t sequence = __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqlock_write_end(seqlock* lock){
+    uint32_t sequence = __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+/* Call before copying the value out. Pass the result to seqlock_read_retry */
+static inline uint32_t seqlock_read_begin(seqlock* lock){
+    return __atomic_load_n(&lock->sequence, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Nonzero if the copy can't be used because the writer was part way through
+ * or changed the value while it was being copied out
+ */
+static inline uint8_t seqlock_read_retry(seqlock* lock, uint32_t sequence){
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return (sequence & 1) || __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) != sequence;
+}
+
+/*
+ * Copies out a value protected by the seqlock. Returns nonzero if every try
+ * was spoilt by the writer, in which case out may be half written.
+ */
+static inline uint8_t seqlock_read(seqlock* lock, const volatile void* value, void* out, size_t size){
+    for (uint8_t i=0; i<SEQLOCK_READ_TRIES; i++){
+        uint32_t sequence = seqlock_read_begin(lock);
+        memcpy(out, (const void*)value, size);
+        if (!seqlock_read_retry(lock, sequence)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+#endif
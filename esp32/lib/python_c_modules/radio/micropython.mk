@@ -1,3 +1,20 @@
 SRC_USERMOD += \
 	radio/tranceiver.c \
+	radio/device_table.c \
+	radio/telemetry_store.c \
+	radio/power_control.c \
+	radio/duty_cycle.c \
+	radio/clock_sync.c \
+	radio/phy_rate.c \
+	radio/bulk.c \
+	radio/radio_tasks.c \
+	radio/congestion.c \
+	radio/health.c \
+	radio/sticks.c \
+	radio/group.c \
+	radio/relay.c \
+	radio/sequence.c \
+	radio/profiler.c \
+	radio/auth.c \
+	radio/bind.c \
 	radio/radio_py.c \
@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include "phy_rate.h"
+
+
+typedef enum {
+    MODULATION_DSSS,  // 802.11b, long preamble
+    MODULATION_OFDM,  // 802.11g
+    MODULATION_HT,  // 802.11n mixed format, 20MHz, long guard interval
+    MODULATION_LR,
+} modulation;
+
+typedef struct {
+    modulation mod;
+    uint16_t kbps;
+    uint16_t bits_per_symbol;  // OFDM and HT only
+} rate_info;
+
+static const rate_info rates[PHY_RATE_COUNT] = {
+    [PHY_RATE_DEFAULT] = {MODULATION_DSSS, 1000, 0},
+    [PHY_RATE_1M] = {MODULATION_DSSS, 1000, 0},
+    [PHY_RATE_2M] = {MODULATION_DSSS, 2000, 0},
+    [PHY_RATE_5M5] = {MODULATION_DSSS, 5500, 0},
+    [PHY_RATE_11M] = {MODULATION_DSSS, 11000, 0},
+    [PHY_RATE_6M] = {MODULATION_OFDM, 6000, 24},
+    [PHY_RATE_9M] = {MODULATION_OFDM, 9000, 36},
+    [PHY_RATE_12M] = {MODULATION_OFDM, 12000, 48},
+    [PHY_RATE_18M] = {MODULATION_OFDM, 18000, 72},
+    [PHY_RATE_24M] = {MODULATION_OFDM, 24000, 96},
+    [PHY_RATE_36M] = {MODULATION_OFDM, 36000, 144},
+    [PHY_RATE_48M] = {MODULATION_OFDM, 48000, 192},
+    [PHY_RATE_54M] = {MODULATION_OFDM, 54000, 216},
+    [PHY_RATE_MCS0] = {MODULATION_HT, 6500, 26},
+    [PHY_RATE_MCS1] = {MODULATION_HT, 13000, 52},
+    [PHY_RATE_MCS2] = {MODULATION_HT, 19500, 78},
+    [PHY_RATE_MCS3] = {MODULATION_HT, 26000, 104},
+    [PHY_RATE_MCS4] = {MODULATION_HT, 39000, 156},
+    [PHY_RATE_MCS5] = {MODULATION_HT, 52000, 208},
+    [PHY_RATE_MCS6] = {MODULATION_HT, 58500, 234},
+    [PHY_RATE_MCS7] = {MODULATION_HT, 65000, 260},
+    [PHY_RATE_LR_250K] = {MODULATION_LR, 250, 0},
+    [PHY_RATE_LR_500K] = {MODULATION_LR, 500, 0},
+};
+
+#define DSSS_PREAMBLE_US 192
+#define OFDM_PREAMBLE_US 20
+#define HT_PREAMBLE_US 36
+#define SIGNAL_EXTENSION_US 6  // OFDM in the 2.4GHz band
+#define SERVICE_AND_TAIL_BITS 22
+#define FRAME_CRC_BYTES 4
+
+
+typedef struct {
+    uint8_t id[6];
+    phy_profile profile;
+} profile_entry;
+
+static profile_entry profiles[PHY_RATE_MAX_PROFILES] = {0};
+
+
+uint8_t phy_rate_is_long_range(phy_rate rate){
+    return rate < PHY_RATE_COUNT && rates[rate].mod == MODULATION_LR;
+}
+
+
+uint32_t phy_rate_kbps(phy_rate rate){
+    if (rate >= PHY_RATE_COUNT){
+        return 0;
+    }
+    return rates[rate].kbps;
+}
+
+
+uint32_t phy_rate_airtime_us(phy_rate rate, uint16_t frame_bytes){
+    if (rate >= PHY_RATE_COUNT){
+        rate = PHY_RATE_DEFAULT;
+    }
+    const rate_info* info = &rates[rate];
+    uint32_t bits = (frame_bytes + FRAME_CRC_BYTES) * 8;
+
+    switch (info->mod){
+        case MODULATION_OFDM:
+        case MODULATION_HT: {
+            uint32_t preamble = info->mod == MODULATION_OFDM ? OFDM_PREAMBLE_US : HT_PREAMBLE_US;
+            uint32_t symbols = (bits + SERVICE_AND_TAIL_BITS + info->bits_per_symbol - 1) / info->bits_per_symbol;
+            return preamble + symbols * 4 + SIGNAL_EXTENSION_US;
+        }
+        case MODULATION_LR:
+            // Assume an 802.11b style preamble in front of the slow payload
+        case MODULATION_DSSS:
+        default:
+            return DSSS_PREAMBLE_US + (bits * 1000 + info->kbps - 1) / info->kbps;
+    }
+}
+
+
+phy_rate phy_rate_for_profile(phy_profile profile){
+    switch (profile){
+        case PHY_PROFILE_RANGE:
+            return PHY_RATE_1M;
+        case PHY_PROFILE_THROUGHPUT:
+            return PHY_RATE_24M;
+        case PHY_PROFILE_LONG_RANGE:
+            return PHY_RATE_LR_250K;
+        default:
+            return PHY_RATE_DEFAULT;
+    }
+}
+
+
+uint8_t phy_rate_set_profile(const uint8_t id[6], phy_profile profile){
+    uint8_t i = 0;
+    profile_entry* free_slot = NULL;
+    for (i=0; i<PHY_RATE_MAX_PROFILES; i++){
+        if (profiles[i].profile != PHY_PROFILE_DEFAULT && memcmp(profiles[i].id, id, 6) == 0){
+            profiles[i].profile = profile;
+            return 0;
+        }
+        if (free_slot == NULL && profiles[i].profile == PHY_PROFILE_DEFAULT){
+            free_slot = &profiles[i];
+        }
+    }
+    if (profile == PHY_PROFILE_DEFAULT){
+        return 0;
+    }
+    if (free_slot == NULL){
+        return 1;
+    }
+    memcpy(free_slot->id, id, 6);
+    free_slot->profile = profile;
+    return 0;
+}
+
+
+phy_profile phy_rate_get_profile(const uint8_t id[6]){
+    uint8_t i = 0;
+    for (i=0; i<PHY_RATE_MAX_PROFILES; i++){
+        if (profiles[i].profile != PHY_PROFILE_DEFAULT && memcmp(profiles[i].id, id, 6) == 0){
+            return profiles[i].profile;
+        }
+    }
+    return PHY_PROFILE_DEFAULT;
+}
@@ -0,0 +1,78 @@
+#ifndef __phy_rate_h__
+#define __phy_rate_h__
+
+#include <stdint.h>
+
+// Fixed PHY rate selection and an airtime calculator.
+//
+// Left to itself the SDK sends injected frames at 1Mbps with a long
+// preamble, so a 40 byte control packet holds the channel for over half a
+// millisecond. Airtime is what limits how many models can share a channel,
+// so the rate can be fixed per receiver, either directly or by picking a
+// profile:
+//  - PHY_PROFILE_RANGE: 1Mbps DSSS, the most robust rate any ESP can hear
+//  - PHY_PROFILE_THROUGHPUT: 24Mbps OFDM, about a tenth of the airtime
+//  - PHY_PROFILE_LONG_RANGE: Espressifs 250kbps long range mode. Only other
+//    ESP32s can receive it.
+
+typedef enum {
+    PHY_RATE_DEFAULT = 0,  // Whatever the SDK picks (1Mbps)
+    PHY_RATE_1M,
+    PHY_RATE_2M,
+    PHY_RATE_5M5,
+    PHY_RATE_11M,
+    PHY_RATE_6M,
+    PHY_RATE_9M,
+    PHY_RATE_12M,
+    PHY_RATE_18M,
+    PHY_RATE_24M,
+    PHY_RATE_36M,
+    PHY_RATE_48M,
+    PHY_RATE_54M,
+    PHY_RATE_MCS0,
+    PHY_RATE_MCS1,
+    PHY_RATE_MCS2,
+    PHY_RATE_MCS3,
+    PHY_RATE_MCS4,
+    PHY_RATE_MCS5,
+    PHY_RATE_MCS6,
+    PHY_RATE_MCS7,
+    PHY_RATE_LR_250K,
+    PHY_RATE_LR_500K,
+    PHY_RATE_COUNT
+} phy_rate;
+
+typedef enum {
+    PHY_PROFILE_DEFAULT = 0,  // Use the rate set with tranceiver_set_phy_rate
+    PHY_PROFILE_RANGE = 1,
+    PHY_PROFILE_THROUGHPUT = 2,
+    PHY_PROFILE_LONG_RANGE = 3,
+} phy_profile;
+
+#define PHY_RATE_MAX_PROFILES 8  // Number of receivers that can have their own profile
+
+
+/* Nonzero if the rate is one of the long range modes */
+uint8_t phy_rate_is_long_range(phy_rate rate);
+
+/* The data rate in kbps */
+uint32_t phy_rate_kbps(phy_rate rate);
+
+/*
+ * How long a frame of frame_bytes bytes (excluding the CRC) holds the
+ * channel for, including the preamble. The long range figures are
+ * approximate as the format isn't documented.
+ */
+uint32_t phy_rate_airtime_us(phy_rate rate, uint16_t frame_bytes);
+
+/* The rate a profile uses */
+phy_rate phy_rate_for_profile(phy_profile profile);
+
+/* Sets the profile used when talking to the receiver with this ID.
+ * PHY_PROFILE_DEFAULT removes it. Returns nonzero if the table is full */
+uint8_t phy_rate_set_profile(const uint8_t id[6], phy_profile profile);
+
+/* The profile for the receiver with this ID */
+phy_profile phy_rate_get_profile(const uint8_t id[6]);
+
+#endif
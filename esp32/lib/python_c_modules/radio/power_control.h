@@ -0,0 +1,57 @@
+#ifndef __power_control_h__
+#define __power_control_h__
+
+#include <stdint.h>
+
+// Closed loop transmit power control. The power is adjusted to keep the
+// signal at the far end of the link POWER_CONTROL_HYSTERESIS dB either side
+// of POWER_CONTROL_TARGET_RSSI. It ramps up fast when the signal fades and
+// steps down slowly when there is spare margin.
+//
+// Power values use the same units as tranceiver_set_power (~0.25dBm)
+
+#define POWER_CONTROL_MIN_POWER 8  // 2dbm = 1.5mW
+#define POWER_CONTROL_DEFAULT_MAX_POWER 78  // 19.5dbm = 90mW. Check your local regulations
+#define POWER_CONTROL_TARGET_RSSI -70
+#define POWER_CONTROL_HYSTERESIS 5
+#define POWER_CONTROL_MIN_STEP_UP 8  // 2dB
+#define POWER_CONTROL_STEP_DOWN 1  // 0.25dB
+#define POWER_CONTROL_SAMPLES_BEFORE_STEP_DOWN 10
+#define POWER_CONTROL_FEEDBACK_TIMEOUT_MS 1000  // Several link feedback intervals at the slowest telemetry rate
+#define POWER_CONTROL_LINK_INTERVAL_MS 100  // How often each end reports the RSSI it hears
+
+
+/* Resets the controller to the specified power */
+void power_control_init(int8_t power);
+
+/* Turn automatic power control on or off. When off, the power stays wherever
+ * it was last set */
+void power_control_enable(uint8_t enabled);
+
+/* Sets the maximum power the controller will ever select. */
+void power_control_set_max_power(int8_t max_power);
+
+/*
+ * Submit the RSSI the far end measured for our packets, from its link
+ * feedback packets (or the receivers RSSI telemetry).
+ */
+void power_control_feedback(int8_t rssi, uint32_t now_ms);
+
+/*
+ * Steps the power up if no feedback has arrived for a while (ie the link
+ * has faded out) and returns the power that should be used for the next
+ * packet.
+ */
+int8_t power_control_update(uint32_t now_ms);
+
+/* The power currently selected */
+int8_t power_control_get_power(void);
+
+/* The transmit power in dBm */
+float power_control_get_dbm(void);
+
+/* The radiated energy in microjoules of a frame that held the channel for
+ * airtime_us at the current power */
+float power_control_frame_energy_uj(uint32_t airtime_us);
+
+#endif
@@ -0,0 +1,122 @@
+#include <string.h>
+#include "xtensa/core-macros.h"
+#include "rom/ets_sys.h"
+
+#include "profiler.h"
+
+
+typedef struct {
+    char name[PROFILER_NAME_BYTES];
+    uint32_t start_cycles;
+    uint8_t in_scope;
+    uint32_t count;
+    uint64_t total_cycles;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint32_t histogram[PROFILER_HISTOGRAM_BINS];
+} profiler_timer_state;
+
+
+static profiler_timer_state timers[PROFILER_MAX_TIMERS];
+static uint8_t num_timers = 0;
+static uint32_t cycles_per_us = 0;
+
+
+static void clear_figures(profiler_timer_state* timer){
+    timer->in_scope = 0;
+    timer->count = 0;
+    timer->total_cycles = 0;
+    timer->min_cycles = UINT32_MAX;
+    timer->max_cycles = 0;
+    memset(timer->histogram, 0, sizeof(timer->histogram));
+}
+
+
+static uint8_t histogram_bin(uint32_t cycles){
+    uint32_t multiple = cycles / (cycles_per_us * PROFILER_HISTOGRAM_FIRST_US);
+    if (multiple == 0){
+        return 0;
+    }
+    // Bin n holds multiples of the first bin from 2^(n-1) up to 2^n
+    uint8_t bin = 32 - __builtin_clz(multiple);
+    return bin < PROFILER_HISTOGRAM_BINS ? bin : PROFILER_HISTOGRAM_BINS - 1;
+}
+
+
+int8_t profiler_timer(const char* name){
+    for (uint8_t i=0; i<num_timers; i++){
+        if (strncmp(timers[i].name, name, PROFILER_NAME_BYTES - 1) == 0){
+            return i;
+        }
+    }
+    if (num_timers >= PROFILER_MAX_TIMERS){
+        return PROFILER_NO_TIMER;
+    }
+    if (cycles_per_us == 0){
+        cycles_per_us = ets_get_cpu_frequency();
+    }
+    profiler_timer_state* timer = &timers[num_timers];
+    strncpy(timer->name, name, PROFILER_NAME_BYTES - 1);
+    timer->name[PROFILER_NAME_BYTES - 1] = '\0';
+    clear_figures(timer);
+    return num_timers++;
+}
+
+
+void profiler_enter(int8_t timer){
+    if (timer < 0 || timer >= num_timers){
+        return;
+    }
+    timers[timer].in_scope = 1;
+    // Last, so the time spent here isn't counted
+    timers[timer].start_cycles = XTHAL_GET_CCOUNT();
+}
+
+
+void profiler_exit(int8_t timer){
+    // First, for the same reason
+    uint32_t now = XTHAL_GET_CCOUNT();
+    if (timer < 0 || timer >= num_timers || !timers[timer].in_scope){
+        return;
+    }
+    profiler_timer_state* state = &timers[timer];
+    uint32_t cycles = now - state->start_cycles;
+    state->in_scope = 0;
+    state->count += 1;
+    state->total_cycles += cycles;
+    if (cycles < state->min_cycles){
+        state->min_cycles = cycles;
+    }
+    if (cycles > state->max_cycles){
+        state->max_cycles = cycles;
+    }
+    state->histogram[histogram_bin(cycles)] += 1;
+}
+
+
+void profiler_reset(void){
+    cycles_per_us = ets_get_cpu_frequency();  // In case machine.freq() has changed it
+    for (uint8_t i=0; i<num_timers; i++){
+        clear_figures(&timers[i]);
+    }
+}
+
+
+uint8_t profiler_timer_count(void){
+    return num_timers;
+}
+
+
+uint8_t profiler_get_stats(int8_t timer, profiler_stats* stats){
+    if (timer < 0 || timer >= num_timers){
+        return 1;
+    }
+    const profiler_timer_state* state = &timers[timer];
+    memcpy(stats->name, state->name, sizeof(stats->name));
+    stats->count = state->count;
+    stats->min_us = state->count ? state->min_cycles / cycles_per_us : 0;
+    stats->max_us = state->max_cycles / cycles_per_us;
+    stats->mean_us = state->count ? (float)state->total_cycles / state->count / cycles_per_us : 0;
+    memcpy(stats->histogram, state->histogram, sizeof(stats->histogram));
+    return 0;
+}
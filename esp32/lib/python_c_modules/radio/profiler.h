@@ -0,0 +1,58 @@
+#ifndef __profiler_h__
+#define __profiler_h__
+
+#include <stdint.h>
+
+// Named scoped timers for finding which stage of the python loop blows its
+// budget. Each timer is entered and exited around a stage and keeps the
+// count, min, mean and max of its scopes and a histogram of how long they
+// took.
+//
+// They count CPU cycles (CCOUNT), so entering and exiting costs a few dozen
+// cycles on top of the python calls to reach them. The cycle counter is per
+// core, so a scope must be exited on the core it was entered on, which the
+// pinned python task always is. The timers are only used from the python
+// task, so they have no lock.
+
+#define PROFILER_MAX_TIMERS 16
+#define PROFILER_NAME_BYTES 16  // Including the terminator
+#define PROFILER_HISTOGRAM_BINS 12
+// Bin 0 holds scopes under this long, each bin after it twice as long, and
+// the last one everything longer
+#define PROFILER_HISTOGRAM_FIRST_US 64
+
+#define PROFILER_NO_TIMER -1
+
+
+typedef struct {
+    char name[PROFILER_NAME_BYTES];
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    float mean_us;
+    uint32_t histogram[PROFILER_HISTOGRAM_BINS];
+} profiler_stats;
+
+
+/*
+ * Returns the index of the timer with this name, adding it if there isn't
+ * one. Longer names are truncated. Returns PROFILER_NO_TIMER if all
+ * PROFILER_MAX_TIMERS are taken.
+ */
+int8_t profiler_timer(const char* name);
+
+/* Starts a scope. Entering a timer that is already in a scope restarts it */
+void profiler_enter(int8_t timer);
+
+/* Ends the timers scope and records how long it took */
+void profiler_exit(int8_t timer);
+
+/* Clears every timers figures, keeping the timers */
+void profiler_reset(void);
+
+uint8_t profiler_timer_count(void);
+
+/* Returns nonzero if there is no such timer */
+uint8_t profiler_get_stats(int8_t timer, profiler_stats* stats);
+
+#endif
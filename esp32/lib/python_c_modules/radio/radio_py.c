@@ -11,7 +11,25 @@
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
 
+#include "esp_timer.h"
+#include "xtensa/core-macros.h"
+
 #include "tranceiver.h"
+#include "device_table.h"
+#include "telemetry_store.h"
+#include "power_control.h"
+#include "duty_cycle.h"
+#include "clock_sync.h"
+#include "phy_rate.h"
+#include "bulk.h"
+#include "radio_tasks.h"
+#include "congestion.h"
+#include "health.h"
+#include "sticks.h"
+#include "group.h"
+#include "relay.h"
+#include "profiler.h"
+#include "bind.h"
 
 /* This python module exposes all functions that talk to the actuators and
  * sensors on board the robot */
@@ -41,22 +59,87 @@ STATIC mp_obj_t radio_get_latest_packet(void) {
         source_id[i] = mp_obj_new_int(packet_data.source_id[i]);
     }
 
-    mp_obj_t packet_stats_array[5];
+    mp_obj_t packet_stats_array[6];
     packet_stats_array[0] = mp_obj_new_tuple(6, source_id);
     packet_stats_array[1] = mp_obj_new_int(packet_data.packet_type);
     packet_stats_array[2] = mp_obj_new_int(packet_data.rssi);
     packet_stats_array[3] = mp_obj_new_int(packet_data.packet_len);
-    packet_stats_array[4] = mp_obj_new_int(packet_data.packet_id);
+    packet_stats_array[4] = mp_obj_new_int_from_uint(packet_data.packet_id);
+    if (packet_data.packet_len != 0 && packet_data.latency_us != CLOCK_SYNC_LATENCY_UNKNOWN){
+        packet_stats_array[5] = mp_obj_new_int(packet_data.latency_us);
+    } else {
+        packet_stats_array[5] = mp_const_none;
+    }
 
     mp_obj_t output[2];
     output[0] = mp_obj_new_str_from_vstr(&mp_type_bytes, &in_data);
-    output[1] = mp_obj_new_tuple(5, packet_stats_array);
+    output[1] = mp_obj_new_tuple(6, packet_stats_array);
 
     return mp_obj_new_tuple(2, output);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_latest_packet_obj, radio_get_latest_packet);
 
 
+STATIC mp_obj_t radio_get_devices(void) {
+    static device_entry devices[DEVICE_TABLE_SIZE];
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    uint8_t num_devices = device_table_snapshot(devices, DEVICE_TABLE_SIZE, now_ms);
+
+    mp_obj_t device_list = mp_obj_new_list(0, NULL);
+    for (uint8_t i=0; i<num_devices; i++){
+        device_entry* device = &devices[i];
+
+        mp_obj_t device_id[6];
+        for (int j=0; j<6; j++){
+            device_id[j] = mp_obj_new_int(device->id[j]);
+        }
+
+        mp_obj_t device_data[5];
+        device_data[0] = mp_obj_new_tuple(6, device_id);
+        device_data[1] = mp_obj_new_bytes((const byte*)device->name, device->name_len);
+        device_data[2] = mp_obj_new_int(device->rssi);
+        device_data[3] = mp_obj_new_float(device->loss);
+        device_data[4] = mp_obj_new_int(now_ms - device->last_seen_ms);
+        mp_obj_list_append(device_list, mp_obj_new_tuple(5, device_data));
+    }
+    return device_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_devices_obj, radio_get_devices);
+
+
+STATIC mp_obj_t radio_get_device_overflows(void) {
+    // Receivers left out of get_devices because the table was full
+    return mp_obj_new_int_from_uint(device_table_overflows());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_device_overflows_obj, radio_get_device_overflows);
+
+
+STATIC mp_obj_t radio_get_telemetry(mp_obj_t dirty_only) {
+    static telemetry_entry entries[TELEMETRY_STORE_SIZE];
+    uint32_t now_ms = esp_timer_get_time() / 1000;
+    uint8_t num_entries = telemetry_store_snapshot(entries, TELEMETRY_STORE_SIZE, mp_obj_is_true(dirty_only));
+
+    mp_obj_t telemetry_list = mp_obj_new_list(0, NULL);
+    for (uint8_t i=0; i<num_entries; i++){
+        telemetry_entry* entry = &entries[i];
+        mp_obj_t entry_data[4];
+        entry_data[0] = mp_obj_new_str(entry->name, entry->name_len);
+        entry_data[1] = mp_obj_new_float(entry->value);
+        entry_data[2] = mp_obj_new_int(entry->status);
+        entry_data[3] = mp_obj_new_int(now_ms - entry->updated_ms);
+        mp_obj_list_append(telemetry_list, mp_obj_new_tuple(4, entry_data));
+    }
+    return telemetry_list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(radio_get_telemetry_obj, radio_get_telemetry);
+
+STATIC mp_obj_t radio_clear_telemetry(void) {
+    telemetry_store_clear();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_clear_telemetry_obj, radio_clear_telemetry);
+
+
 STATIC mp_obj_t radio_filter_by_id(mp_obj_t enabled) {
     tranceiver_enable_filter_by_id(mp_obj_get_int(enabled));
     return mp_const_none;
@@ -64,6 +147,25 @@ STATIC mp_obj_t radio_filter_by_id(mp_obj_t enabled) {
 MP_DEFINE_CONST_FUN_OBJ_1(radio_filter_by_id_obj, radio_filter_by_id);
 
 
+STATIC mp_obj_t radio_enable_timestamps(mp_obj_t enabled) {
+    tranceiver_enable_timestamps(mp_obj_get_int(enabled));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_enable_timestamps_obj, radio_enable_timestamps);
+
+
+STATIC mp_obj_t radio_get_clock_stats(void) {
+    mp_obj_t clock_stats[5];
+    clock_stats[0] = mp_obj_new_int(clock_sync_is_synced());
+    clock_stats[1] = mp_obj_new_int(clock_sync_get_offset_us());
+    clock_stats[2] = mp_obj_new_float(clock_sync_get_drift_ppm());
+    clock_stats[3] = mp_obj_new_float(clock_sync_get_latency_us());
+    clock_stats[4] = mp_obj_new_float(clock_sync_get_jitter_us());
+    return mp_obj_new_tuple(5, clock_stats);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_clock_stats_obj, radio_get_clock_stats);
+
+
 STATIC mp_obj_t radio_set_channel(mp_obj_t channel) {
     tranceiver_set_channel(mp_obj_get_int(channel));
     return mp_const_none;
@@ -76,15 +178,573 @@ STATIC mp_obj_t radio_set_power(mp_obj_t power) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(radio_set_power_obj, radio_set_power);
 
+STATIC mp_obj_t radio_set_max_power(mp_obj_t power) {
+    power_control_set_max_power(mp_obj_get_int(power));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_set_max_power_obj, radio_set_max_power);
 
-STATIC mp_obj_t radio_set_id(mp_obj_t id_bytes) {
+STATIC mp_obj_t radio_power_control(mp_obj_t enabled) {
+    power_control_enable(mp_obj_get_int(enabled));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_power_control_obj, radio_power_control);
+
+STATIC mp_obj_t radio_get_power_stats(void) {
+    mp_obj_t power_stats[3];
+    uint32_t airtime_us = tranceiver_get_last_frame_airtime_us();
+    power_stats[0] = mp_obj_new_float(power_control_get_dbm());
+    power_stats[1] = mp_obj_new_float(power_control_frame_energy_uj(airtime_us));
+    power_stats[2] = mp_obj_new_int(airtime_us);
+    return mp_obj_new_tuple(3, power_stats);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_power_stats_obj, radio_get_power_stats);
+
+
+STATIC mp_obj_t radio_get_tx_stats(void) {
+    congestion_stats stats;
+    congestion_get_stats(&stats);
+    mp_obj_t tx_stats[10];
+    tx_stats[0] = mp_obj_new_int_from_uint(stats.sent);
+    tx_stats[1] = mp_obj_new_int_from_uint(stats.failed);
+    tx_stats[2] = mp_obj_new_int_from_uint(stats.shed_telemetry);
+    tx_stats[3] = mp_obj_new_int_from_uint(stats.shed_bulk);
+    tx_stats[4] = mp_obj_new_int_from_uint(stats.skipped_control);
+    tx_stats[5] = mp_obj_new_int(stats.queue_depth);
+    tx_stats[6] = mp_obj_new_int(stats.max_queue_depth);
+    tx_stats[7] = mp_obj_new_float(stats.control_rate);
+    tx_stats[8] = mp_obj_new_int(stats.last_error);
+    tx_stats[9] = mp_obj_new_int_from_uint(stats.refused);
+    return mp_obj_new_tuple(10, tx_stats);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_tx_stats_obj, radio_get_tx_stats);
+
+
+STATIC mp_obj_t radio_low_power(mp_obj_t enabled) {
+    duty_cycle_enable(mp_obj_get_int(enabled));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_low_power_obj, radio_low_power);
+
+STATIC mp_obj_t radio_idle(void) {
+    if (radio_tasks_running()){
+        return mp_obj_new_int(0);  // The tasks need the radio and the CPU
+    }
+    return mp_obj_new_int(duty_cycle_idle());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_idle_obj, radio_idle);
+
+STATIC mp_obj_t radio_get_duty_cycle_stats(void) {
+    mp_obj_t duty_cycle_stats[2];
+    duty_cycle_stats[0] = mp_obj_new_float(duty_cycle_current_ma());
+    duty_cycle_stats[1] = mp_obj_new_int(duty_cycle_sleep_misses());
+    return mp_obj_new_tuple(2, duty_cycle_stats);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_duty_cycle_stats_obj, radio_get_duty_cycle_stats);
+
+
+STATIC mp_obj_t radio_set_phy_rate(mp_obj_t rate) {
+    return mp_obj_new_int(tranceiver_set_phy_rate(mp_obj_get_int(rate)));
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_set_phy_rate_obj, radio_set_phy_rate);
+
+STATIC mp_obj_t radio_long_range(mp_obj_t enabled) {
+    tranceiver_enable_long_range(mp_obj_get_int(enabled));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_long_range_obj, radio_long_range);
+
+STATIC mp_obj_t radio_airtime_us(mp_obj_t rate, mp_obj_t frame_bytes) {
+    return mp_obj_new_int(phy_rate_airtime_us(mp_obj_get_int(rate), mp_obj_get_int(frame_bytes)));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_airtime_us_obj, radio_airtime_us);
+
+
+static void get_id(mp_obj_t id_bytes, uint8_t id[6]){
     mp_obj_t* id_py;
     mp_obj_get_array_fixed_n(id_bytes, 6, &id_py);
+    for (uint8_t i=0; i<6; i++){
+        id[i] = mp_obj_get_int(id_py[i]);
+    }
+}
 
+STATIC mp_obj_t radio_set_profile(mp_obj_t id_bytes, mp_obj_t profile) {
     uint8_t id[6] = {0};
-    for (uint8_t i=0; i<sizeof(id); i++){
-        id[i] = mp_obj_get_int(id_py[i]);
+    get_id(id_bytes, id);
+    return mp_obj_new_int(phy_rate_set_profile(id, mp_obj_get_int(profile)));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_set_profile_obj, radio_set_profile);
+
+
+STATIC mp_obj_t radio_bulk_send(mp_obj_t xfer_id, mp_obj_t data) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    uint8_t res = bulk_send(mp_obj_get_int(xfer_id), bufinfo.buf, bufinfo.len, esp_timer_get_time());
+    return mp_obj_new_int(res);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_bulk_send_obj, radio_bulk_send);
+
+STATIC mp_obj_t radio_bulk_receive(mp_obj_t enabled) {
+    tranceiver_enable_bulk_receive(mp_obj_get_int(enabled));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_bulk_receive_obj, radio_bulk_receive);
+
+STATIC mp_obj_t radio_bulk_abort(void) {
+    bulk_abort();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_bulk_abort_obj, radio_bulk_abort);
+
+STATIC mp_obj_t radio_bulk_update(void) {
+    tranceiver_bulk_update();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_bulk_update_obj, radio_bulk_update);
+
+STATIC mp_obj_t radio_get_bulk_stats(void) {
+    bulk_stats stats;
+    bulk_get_stats(&stats);
+    mp_obj_t bulk_stats_py[5];
+    bulk_stats_py[0] = mp_obj_new_int(stats.state);
+    bulk_stats_py[1] = mp_obj_new_int(stats.xfer_id);
+    bulk_stats_py[2] = mp_obj_new_int(stats.done_bytes);
+    bulk_stats_py[3] = mp_obj_new_int(stats.total_bytes);
+    bulk_stats_py[4] = mp_obj_new_int(stats.retransmits);
+    return mp_obj_new_tuple(5, bulk_stats_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_bulk_stats_obj, radio_get_bulk_stats);
+
+STATIC mp_obj_t radio_get_bulk_data(void) {
+    uint32_t len = 0;
+    const uint8_t* data = bulk_get_data(&len);
+    if (data == NULL){
+        return mp_const_none;
+    }
+    return mp_obj_new_bytes(data, len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_bulk_data_obj, radio_get_bulk_data);
+
+
+STATIC mp_obj_t radio_relay_start(size_t n_args, const mp_obj_t* args) {
+    uint8_t id[6] = {0};
+    get_id(args[0], id);
+    uint8_t max_hops = n_args > 1 ? mp_obj_get_int(args[1]) : RELAY_DEFAULT_MAX_HOPS;
+    uint32_t max_delay_us = n_args > 2 ? mp_obj_get_int(args[2]) : RELAY_DEFAULT_MAX_DELAY_US;
+    return mp_obj_new_int(relay_start(id, max_hops, max_delay_us));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_relay_start_obj, 1, 3, radio_relay_start);
+
+STATIC mp_obj_t radio_relay_stop(void) {
+    relay_stop();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_relay_stop_obj, radio_relay_stop);
+
+STATIC mp_obj_t radio_get_relay_stats(void) {
+    relay_stats stats;
+    relay_get_stats(&stats);
+    mp_obj_t relay_stats_py[9];
+    relay_stats_py[0] = mp_obj_new_int_from_uint(stats.offered);
+    relay_stats_py[1] = mp_obj_new_int_from_uint(stats.forwarded);
+    relay_stats_py[2] = mp_obj_new_int_from_uint(stats.duplicates);
+    relay_stats_py[3] = mp_obj_new_int_from_uint(stats.expired);
+    relay_stats_py[4] = mp_obj_new_int_from_uint(stats.late);
+    relay_stats_py[5] = mp_obj_new_int_from_uint(stats.queue_full);
+    relay_stats_py[6] = mp_obj_new_int_from_uint(stats.tx_failed);
+    relay_stats_py[7] = mp_obj_new_float(stats.forwarded ? (float)stats.delay_total_us / stats.forwarded : 0.0f);
+    relay_stats_py[8] = mp_obj_new_int_from_uint(stats.delay_max_us);
+    return mp_obj_new_tuple(9, relay_stats_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_relay_stats_obj, radio_get_relay_stats);
+
+
+STATIC mp_obj_t radio_get_link_stats(mp_obj_t stream) {
+    sequence_stats stats;
+    tranceiver_get_link_stats(mp_obj_get_int(stream), &stats);
+    mp_obj_t link_stats_py[7];
+    link_stats_py[0] = mp_obj_new_int_from_uint(stats.newest);
+    link_stats_py[1] = mp_obj_new_int_from_uint(stats.received);
+    link_stats_py[2] = mp_obj_new_int_from_uint(stats.lost);
+    link_stats_py[3] = mp_obj_new_int_from_uint(stats.reordered);
+    link_stats_py[4] = mp_obj_new_int_from_uint(stats.duplicates);
+    link_stats_py[5] = mp_obj_new_int_from_uint(stats.stale);
+    link_stats_py[6] = mp_obj_new_int_from_uint(stats.resyncs);
+    return mp_obj_new_tuple(7, link_stats_py);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_get_link_stats_obj, radio_get_link_stats);
+
+
+STATIC mp_obj_t radio_bind(void) {
+    return mp_obj_new_bool(tranceiver_bind());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_bind_obj, radio_bind);
+
+STATIC mp_obj_t radio_bind_listen(size_t n_args, const mp_obj_t* args) {
+    tranceiver_bind_listen(n_args > 0 ? mp_obj_get_int(args[0]) : BIND_DEFAULT_WINDOW_MS);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_bind_listen_obj, 0, 1, radio_bind_listen);
+
+STATIC mp_obj_t radio_is_bound(size_t n_args, const mp_obj_t* args) {
+    // Our own ID by default
+    uint8_t id[6];
+    memcpy(id, tranceiver_get_id(), 6);
+    if (n_args > 0){
+        get_id(args[0], id);
+    }
+    auth_key_state state;
+    return mp_obj_new_bool(bind_get_key(id, &state));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_is_bound_obj, 0, 1, radio_is_bound);
+
+STATIC mp_obj_t radio_unbind(size_t n_args, const mp_obj_t* args) {
+    uint8_t id[6];
+    memcpy(id, tranceiver_get_id(), 6);
+    if (n_args > 0){
+        get_id(args[0], id);
     }
+    bind_forget(id);
+    bind_save_changes();
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_unbind_obj, 0, 1, radio_unbind);
+
+STATIC mp_obj_t radio_set_key(mp_obj_t id_bytes, mp_obj_t key) {
+    uint8_t id[6] = {0};
+    get_id(id_bytes, id);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(key, &bufinfo, MP_BUFFER_READ);
+    if (bufinfo.len != AUTH_KEY_BYTES){
+        return mp_obj_new_int(1);
+    }
+    uint8_t res = bind_set_key(id, bufinfo.buf);
+    bind_save_changes();
+    return mp_obj_new_int(res);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_set_key_obj, radio_set_key);
+
+STATIC mp_obj_t radio_get_auth_stats(void) {
+    auth_stats stats;
+    tranceiver_get_auth_stats(&stats);
+    mp_obj_t auth_stats_py[5];
+    auth_stats_py[0] = mp_obj_new_int_from_uint(stats.verified);
+    auth_stats_py[1] = mp_obj_new_int_from_uint(stats.unsigned_rejected);
+    auth_stats_py[2] = mp_obj_new_int_from_uint(stats.bad_tag);
+    auth_stats_py[3] = mp_obj_new_int_from_uint(stats.replayed);
+    auth_stats_py[4] = mp_obj_new_int_from_uint(stats.early);
+    return mp_obj_new_tuple(5, auth_stats_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_auth_stats_obj, radio_get_auth_stats);
+
+STATIC mp_obj_t radio_auth_cycles(mp_obj_t data_len, mp_obj_t iterations) {
+    // Mean CPU cycles to check the tag on a frame with data_len bytes of
+    // data (the tag included), as the RX path does
+    uint8_t key[AUTH_KEY_BYTES] = {0};
+    uint8_t header[AUTH_HEADER_BYTES] = {0};
+    uint8_t data[TRANCEIVER_MAX_PACKET_BYTES] = {0};
+    uint16_t len = mp_obj_get_int(data_len);
+    uint32_t count = mp_obj_get_int(iterations);
+    if (len < AUTH_TAG_BYTES || len > TRANCEIVER_MAX_PACKET_BYTES || count == 0){
+        return mp_obj_new_int(0);
+    }
+    auth_key_state state;
+    auth_init_key(&state, key);
+    uint32_t start = XTHAL_GET_CCOUNT();
+    for (uint32_t i=0; i<count; i++){
+        data[0] = i;
+        auth_verify(&state, header, data, len);
+    }
+    uint32_t cycles = XTHAL_GET_CCOUNT() - start;
+    return mp_obj_new_float((float)cycles / count);
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_auth_cycles_obj, radio_auth_cycles);
+
+
+STATIC mp_obj_t radio_start_tasks(size_t n_args, const mp_obj_t* args) {
+    radio_tasks_config config;
+    radio_tasks_default_config(&config);
+    config.core = mp_obj_get_int(args[0]);
+    config.control_hz = mp_obj_get_int(args[1]);
+    config.output_hz = mp_obj_get_int(args[2]);
+    if (n_args > 3){
+        // (rx, tx, output) priorities
+        mp_obj_t* priorities;
+        mp_obj_get_array_fixed_n(args[3], 3, &priorities);
+        config.rx_priority = mp_obj_get_int(priorities[0]);
+        config.tx_priority = mp_obj_get_int(priorities[1]);
+        config.output_priority = mp_obj_get_int(priorities[2]);
+    }
+    return mp_obj_new_int(radio_tasks_start(&config));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_start_tasks_obj, 3, 4, radio_start_tasks);
+
+STATIC mp_obj_t radio_stop_tasks(void) {
+    radio_tasks_stop();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_stop_tasks_obj, radio_stop_tasks);
+
+STATIC mp_obj_t radio_set_output(size_t n_args, const mp_obj_t* args) {
+    mp_obj_t* mix_py;
+    size_t mix_len = 0;
+    mp_obj_get_array(args[4], &mix_len, &mix_py);
+    float mix[RADIO_OUTPUT_MIX_CHANNELS] = {0};
+    for (uint8_t i=0; i<mix_len && i<RADIO_OUTPUT_MIX_CHANNELS; i++){
+        mix[i] = mp_obj_get_float(mix_py[i]);
+    }
+    uint8_t res = radio_tasks_set_output(
+        mp_obj_get_int(args[0]), mp_obj_get_int(args[1]),
+        mp_obj_get_int(args[2]), mp_obj_get_int(args[3]), mix
+    );
+    return mp_obj_new_int(res);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_set_output_obj, 5, 5, radio_set_output);
+
+STATIC mp_obj_t radio_get_task_stats(void) {
+    radio_tasks_stats stats;
+    radio_tasks_get_stats(&stats);
+    mp_obj_t task_stats_py[8];
+    task_stats_py[0] = mp_obj_new_int_from_uint(stats.rx_frames);
+    task_stats_py[1] = mp_obj_new_int_from_uint(stats.rx_dropped);
+    task_stats_py[2] = mp_obj_new_int_from_uint(stats.tx_sent);
+    task_stats_py[3] = mp_obj_new_int_from_uint(stats.tx_dropped);
+    task_stats_py[4] = mp_obj_new_int_from_uint(stats.output_updates);
+    task_stats_py[5] = mp_obj_new_float(stats.output_period_us);
+    task_stats_py[6] = mp_obj_new_float(stats.output_jitter_us);
+    task_stats_py[7] = mp_obj_new_int_from_uint(stats.output_max_period_us);
+    return mp_obj_new_tuple(8, task_stats_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_task_stats_obj, radio_get_task_stats);
+
+STATIC mp_obj_t radio_reset_task_stats(void) {
+    radio_tasks_reset_stats();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_reset_task_stats_obj, radio_reset_task_stats);
+
+
+STATIC mp_obj_t radio_sticks_start(size_t n_args, const mp_obj_t* args) {
+    mp_obj_t* pins_py;
+    size_t num_pins = 0;
+    mp_obj_get_array(args[0], &num_pins, &pins_py);
+    if (num_pins > STICKS_MAX_CHANNELS){
+        num_pins = STICKS_MAX_CHANNELS;
+        printf("Only the first %d sticks are sampled\n", STICKS_MAX_CHANNELS);
+    }
+    uint8_t pins[STICKS_MAX_CHANNELS];
+    for (uint8_t i=0; i<num_pins; i++){
+        pins[i] = mp_obj_get_int(pins_py[i]);
+    }
+    uint16_t sample_hz = n_args > 1 ? mp_obj_get_int(args[1]) : STICKS_DEFAULT_SAMPLE_HZ;
+    uint8_t oversample = n_args > 2 ? mp_obj_get_int(args[2]) : STICKS_DEFAULT_OVERSAMPLE;
+    return mp_obj_new_int(sticks_start(pins, num_pins, sample_hz, oversample));
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_sticks_start_obj, 1, 3, radio_sticks_start);
+
+STATIC mp_obj_t radio_sticks_stop(void) {
+    sticks_stop();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_sticks_stop_obj, radio_sticks_stop);
+
+STATIC mp_obj_t radio_sticks_curve(size_t n_args, const mp_obj_t* args) {
+    uint8_t res = sticks_set_curve(
+        mp_obj_get_int(args[0]), mp_obj_get_float(args[1]),
+        mp_obj_get_float(args[2]), mp_obj_get_float(args[3])
+    );
+    return mp_obj_new_int(res);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(radio_sticks_curve_obj, 4, 4, radio_sticks_curve);
+
+STATIC mp_obj_t radio_sticks_map(mp_obj_t sticks_obj) {
+    mp_obj_t* sticks_py;
+    size_t num_channels = 0;
+    mp_obj_get_array(sticks_obj, &num_channels, &sticks_py);
+    if (num_channels > STICKS_MAX_CHANNELS){
+        return mp_obj_new_int(1);
+    }
+    uint8_t sticks[STICKS_MAX_CHANNELS];
+    for (uint8_t i=0; i<num_channels; i++){
+        sticks[i] = mp_obj_get_int(sticks_py[i]);
+    }
+    return mp_obj_new_int(sticks_set_map(sticks, num_channels));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(radio_sticks_map_obj, radio_sticks_map);
+
+STATIC mp_obj_t radio_get_sticks(void) {
+    int16_t channels[STICKS_MAX_CHANNELS];
+    uint8_t num_channels = sticks_get_sticks(channels);
+    mp_obj_t channels_py[STICKS_MAX_CHANNELS];
+    for (uint8_t i=0; i<num_channels; i++){
+        channels_py[i] = mp_obj_new_int(channels[i]);
+    }
+    return mp_obj_new_tuple(num_channels, channels_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_sticks_obj, radio_get_sticks);
+
+STATIC mp_obj_t radio_get_stick_channels(void) {
+    int16_t channels[STICKS_MAX_CHANNELS];
+    uint8_t num_channels = sticks_get_channels(channels);
+    mp_obj_t channels_py[STICKS_MAX_CHANNELS];
+    for (uint8_t i=0; i<num_channels; i++){
+        channels_py[i] = mp_obj_new_int(channels[i]);
+    }
+    return mp_obj_new_tuple(num_channels, channels_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_stick_channels_obj, radio_get_stick_channels);
+
+STATIC mp_obj_t radio_get_sticks_raw(void) {
+    float raw[STICKS_MAX_CHANNELS];
+    uint8_t num_channels = sticks_get_raw(raw);
+    mp_obj_t raw_py[STICKS_MAX_CHANNELS];
+    for (uint8_t i=0; i<num_channels; i++){
+        raw_py[i] = mp_obj_new_float(raw[i]);
+    }
+    return mp_obj_new_tuple(num_channels, raw_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_sticks_raw_obj, radio_get_sticks_raw);
+
+STATIC mp_obj_t radio_sticks_calibrate(mp_obj_t stage) {
+    // True to start, then False to finish and save
+    if (mp_obj_is_true(stage)){
+        sticks_calibrate_begin();
+        return mp_obj_new_int(0);
+    }
+    return mp_obj_new_int(sticks_calibrate_end(1));
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_sticks_calibrate_obj, radio_sticks_calibrate);
+
+STATIC mp_obj_t radio_get_sticks_calibration(mp_obj_t channel) {
+    sticks_calibration calibration;
+    sticks_get_calibration(mp_obj_get_int(channel), &calibration);
+    mp_obj_t calibration_py[3] = {
+        mp_obj_new_int(calibration.min),
+        mp_obj_new_int(calibration.center),
+        mp_obj_new_int(calibration.max),
+    };
+    return mp_obj_new_tuple(3, calibration_py);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_get_sticks_calibration_obj, radio_get_sticks_calibration);
+
+
+STATIC mp_obj_t radio_profile_timer(mp_obj_t name) {
+    return mp_obj_new_int(profiler_timer(mp_obj_str_get_str(name)));
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_profile_timer_obj, radio_profile_timer);
+
+STATIC mp_obj_t radio_profile_enter(mp_obj_t timer) {
+    profiler_enter(mp_obj_get_int(timer));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_profile_enter_obj, radio_profile_enter);
+
+STATIC mp_obj_t radio_profile_exit(mp_obj_t timer) {
+    profiler_exit(mp_obj_get_int(timer));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_profile_exit_obj, radio_profile_exit);
+
+STATIC mp_obj_t radio_profile_reset(void) {
+    profiler_reset();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_profile_reset_obj, radio_profile_reset);
+
+STATIC mp_obj_t radio_get_profile(void) {
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    for (uint8_t i=0; i<profiler_timer_count(); i++){
+        profiler_stats stats;
+        profiler_get_stats(i, &stats);
+        mp_obj_t histogram_py[PROFILER_HISTOGRAM_BINS];
+        for (uint8_t bin=0; bin<PROFILER_HISTOGRAM_BINS; bin++){
+            histogram_py[bin] = mp_obj_new_int_from_uint(stats.histogram[bin]);
+        }
+        mp_obj_t timer_py[6] = {
+            mp_obj_new_str(stats.name, strlen(stats.name)),
+            mp_obj_new_int_from_uint(stats.count),
+            mp_obj_new_int_from_uint(stats.min_us),
+            mp_obj_new_float(stats.mean_us),
+            mp_obj_new_int_from_uint(stats.max_us),
+            mp_obj_new_tuple(PROFILER_HISTOGRAM_BINS, histogram_py),
+        };
+        mp_obj_list_append(list, mp_obj_new_tuple(6, timer_py));
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_profile_obj, radio_get_profile);
+
+
+STATIC mp_obj_t radio_get_health(void) {
+    mp_obj_t timings_py[HEALTH_TIMING_COUNT];
+    for (uint8_t i=0; i<HEALTH_TIMING_COUNT; i++){
+        health_timing timing;
+        health_get_timing(i, &timing);
+        mp_obj_t timing_py[3] = {
+            mp_obj_new_int_from_uint(timing.count),
+            mp_obj_new_int_from_uint(timing.total_us),
+            mp_obj_new_int_from_uint(timing.max_us),
+        };
+        timings_py[i] = mp_obj_new_tuple(3, timing_py);
+    }
+
+    mp_obj_t queues_py[HEALTH_QUEUE_COUNT];
+    for (uint8_t i=0; i<HEALTH_QUEUE_COUNT; i++){
+        queues_py[i] = mp_obj_new_int_from_uint(health_get_queue_max(i));
+    }
+
+    health_memory memory;
+    health_get_memory(&memory);
+    mp_obj_t memory_py[6] = {
+        mp_obj_new_int_from_uint(memory.heap_free),
+        mp_obj_new_int_from_uint(memory.heap_min_free),
+        mp_obj_new_int_from_uint(memory.stack_free_python),
+        mp_obj_new_int_from_uint(memory.stack_free_rx),
+        mp_obj_new_int_from_uint(memory.stack_free_tx),
+        mp_obj_new_int_from_uint(memory.stack_free_output),
+    };
+
+    mp_obj_t health_py[3] = {
+        mp_obj_new_tuple(HEALTH_TIMING_COUNT, timings_py),
+        mp_obj_new_tuple(HEALTH_QUEUE_COUNT, queues_py),
+        mp_obj_new_tuple(6, memory_py),
+    };
+    return mp_obj_new_tuple(3, health_py);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(radio_get_health_obj, radio_get_health);
+
+STATIC mp_obj_t radio_simulate_medium(mp_obj_t enabled) {
+    tranceiver_simulate_medium(mp_obj_is_true(enabled));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_simulate_medium_obj, radio_simulate_medium);
+
+STATIC mp_obj_t radio_inject_frames(mp_obj_t count, mp_obj_t seed) {
+    health_inject_mixed(mp_obj_get_int(count), mp_obj_get_int(seed));
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_inject_frames_obj, radio_inject_frames);
+
+STATIC mp_obj_t radio_inject_frame(mp_obj_t id_bytes, mp_obj_t packet_type, mp_obj_t data) {
+    uint8_t id[6] = {0};
+    get_id(id_bytes, id);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(data, &bufinfo, MP_BUFFER_READ);
+    tranceiver_inject_frame(id, mp_obj_get_int(packet_type), bufinfo.buf, bufinfo.len, -50);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_3(radio_inject_frame_obj, radio_inject_frame);
+
+STATIC mp_obj_t radio_inject_repeat(mp_obj_t hops) {
+    tranceiver_inject_repeat(mp_obj_get_int(hops), -50);
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_inject_repeat_obj, radio_inject_repeat);
+
+
+STATIC mp_obj_t radio_set_id(mp_obj_t id_bytes) {
+    uint8_t id[6] = {0};
+    get_id(id_bytes, id);
 
     tranceiver_set_id(id);
     return mp_const_none;
@@ -106,12 +766,56 @@ STATIC mp_obj_t radio_send_control_packet(mp_obj_t channels) {
     }
 
     int16_t res = tranceiver_send_control_packet(channel_values, num_channels);
+    // Reserves more signing counters when they run low, which can't be done
+    // from the TX task
+    bind_save_changes();
 
     return mp_obj_new_int(res);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(radio_send_control_packet_obj, radio_send_control_packet);
 
 
+STATIC mp_obj_t radio_join_group(mp_obj_t id_bytes, mp_obj_t member_index) {
+    uint8_t id[6] = {0};
+    get_id(id_bytes, id);
+    return mp_obj_new_int(group_join(id, mp_obj_get_int(member_index)));
+}
+MP_DEFINE_CONST_FUN_OBJ_2(radio_join_group_obj, radio_join_group);
+
+STATIC mp_obj_t radio_leave_group(void) {
+    group_leave();
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(radio_leave_group_obj, radio_leave_group);
+
+STATIC mp_obj_t radio_send_group_packet(mp_obj_t member_channels) {
+    // A list with a list of channels for each member
+    mp_obj_t* members_py;
+    size_t num_members = 0;
+    mp_obj_get_array(member_channels, &num_members, &members_py);
+    if (num_members > GROUP_MAX_MEMBERS){
+        num_members = GROUP_MAX_MEMBERS;
+        printf("Only the first %d group members can be sent to\n", GROUP_MAX_MEMBERS);
+    }
+
+    int16_t channel_values[TRANCEIVER_MAX_PACKET_BYTES / 2] = {0};
+    uint8_t counts[GROUP_MAX_MEMBERS] = {0};
+    uint16_t total = 0;
+    for (uint8_t m=0; m<num_members; m++){
+        mp_obj_t* channels_py;
+        size_t num_channels = 0;
+        mp_obj_get_array(members_py[m], &num_channels, &channels_py);
+        for (uint16_t i=0; i<num_channels && total < TRANCEIVER_MAX_PACKET_BYTES / 2; i++){
+            channel_values[total++] = mp_obj_get_int(channels_py[i]);
+            counts[m] += 1;
+        }
+    }
+
+    return mp_obj_new_int(tranceiver_send_group_packet(channel_values, counts, num_members));
+}
+MP_DEFINE_CONST_FUN_OBJ_1(radio_send_group_packet_obj, radio_send_group_packet);
+
+
 STATIC mp_obj_t radio_send_name_packet(mp_obj_t name_str) {
     size_t name_len = 0;
     const char* name = mp_obj_str_get_data(name_str, &name_len);
@@ -121,17 +825,93 @@ STATIC mp_obj_t radio_send_name_packet(mp_obj_t name_str) {
 MP_DEFINE_CONST_FUN_OBJ_1(radio_send_name_packet_obj, radio_send_name_packet);
 
 
+STATIC mp_obj_t radio_send_telemetry(mp_obj_t status, mp_obj_t value, mp_obj_t name_str) {
+    size_t name_len = 0;
+    const char* name = mp_obj_str_get_data(name_str, &name_len);
+    int16_t res = tranceiver_send_telemtry(
+        mp_obj_get_int(status),
+        mp_obj_get_float(value),
+        name,
+        name_len
+    );
+    return mp_obj_new_int(res);
+}
+MP_DEFINE_CONST_FUN_OBJ_3(radio_send_telemetry_obj, radio_send_telemetry);
+
+
 STATIC const mp_map_elem_t radio_globals_table[] = {
     { MP_OBJ_NEW_QSTR(MP_QSTR___name__), MP_OBJ_NEW_QSTR(MP_QSTR_radio) },
     // Functions
     { MP_OBJ_NEW_QSTR(MP_QSTR_init), (mp_obj_t)&radio_init_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_filter_by_id), (mp_obj_t)&radio_filter_by_id_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_enable_timestamps), (mp_obj_t)&radio_enable_timestamps_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_clock_stats), (mp_obj_t)&radio_get_clock_stats_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_get_latest_packet), (mp_obj_t)&radio_get_latest_packet_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_devices), (mp_obj_t)&radio_get_devices_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_device_overflows), (mp_obj_t)&radio_get_device_overflows_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_telemetry), (mp_obj_t)&radio_get_telemetry_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_clear_telemetry), (mp_obj_t)&radio_clear_telemetry_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_channel), (mp_obj_t)&radio_set_channel_obj },
-    { MP_OBJ_NEW_QSTR(MP_QSTR_set_power), (mp_obj_t)&radio_set_power },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_power), (mp_obj_t)&radio_set_power_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_max_power), (mp_obj_t)&radio_set_max_power_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_power_control), (mp_obj_t)&radio_power_control_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_power_stats), (mp_obj_t)&radio_get_power_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_tx_stats), (mp_obj_t)&radio_get_tx_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_low_power), (mp_obj_t)&radio_low_power_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_idle), (mp_obj_t)&radio_idle_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_duty_cycle_stats), (mp_obj_t)&radio_get_duty_cycle_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_phy_rate), (mp_obj_t)&radio_set_phy_rate_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_long_range), (mp_obj_t)&radio_long_range_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_airtime_us), (mp_obj_t)&radio_airtime_us_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_profile), (mp_obj_t)&radio_set_profile_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_bulk_send), (mp_obj_t)&radio_bulk_send_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_bulk_receive), (mp_obj_t)&radio_bulk_receive_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_bulk_abort), (mp_obj_t)&radio_bulk_abort_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_bulk_update), (mp_obj_t)&radio_bulk_update_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_bulk_stats), (mp_obj_t)&radio_get_bulk_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_bulk_data), (mp_obj_t)&radio_get_bulk_data_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_relay_start), (mp_obj_t)&radio_relay_start_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_relay_stop), (mp_obj_t)&radio_relay_stop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_relay_stats), (mp_obj_t)&radio_get_relay_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_link_stats), (mp_obj_t)&radio_get_link_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_bind), (mp_obj_t)&radio_bind_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_bind_listen), (mp_obj_t)&radio_bind_listen_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_is_bound), (mp_obj_t)&radio_is_bound_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_unbind), (mp_obj_t)&radio_unbind_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_key), (mp_obj_t)&radio_set_key_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_auth_stats), (mp_obj_t)&radio_get_auth_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_auth_cycles), (mp_obj_t)&radio_auth_cycles_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_start_tasks), (mp_obj_t)&radio_start_tasks_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_stop_tasks), (mp_obj_t)&radio_stop_tasks_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_set_output), (mp_obj_t)&radio_set_output_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_task_stats), (mp_obj_t)&radio_get_task_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_reset_task_stats), (mp_obj_t)&radio_reset_task_stats_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sticks_start), (mp_obj_t)&radio_sticks_start_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sticks_stop), (mp_obj_t)&radio_sticks_stop_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sticks_curve), (mp_obj_t)&radio_sticks_curve_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sticks_calibrate), (mp_obj_t)&radio_sticks_calibrate_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_sticks_map), (mp_obj_t)&radio_sticks_map_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_sticks), (mp_obj_t)&radio_get_sticks_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_stick_channels), (mp_obj_t)&radio_get_stick_channels_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_sticks_raw), (mp_obj_t)&radio_get_sticks_raw_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_sticks_calibration), (mp_obj_t)&radio_get_sticks_calibration_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_profile_timer), (mp_obj_t)&radio_profile_timer_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_profile_enter), (mp_obj_t)&radio_profile_enter_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_profile_exit), (mp_obj_t)&radio_profile_exit_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_profile_reset), (mp_obj_t)&radio_profile_reset_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_profile), (mp_obj_t)&radio_get_profile_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_get_health), (mp_obj_t)&radio_get_health_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_simulate_medium), (mp_obj_t)&radio_simulate_medium_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_inject_frames), (mp_obj_t)&radio_inject_frames_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_inject_frame), (mp_obj_t)&radio_inject_frame_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_inject_repeat), (mp_obj_t)&radio_inject_repeat_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_set_id), (mp_obj_t)&radio_set_id_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send_control_packet), (mp_obj_t)&radio_send_control_packet_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_join_group), (mp_obj_t)&radio_join_group_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_leave_group), (mp_obj_t)&radio_leave_group_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_group_packet), (mp_obj_t)&radio_send_group_packet_obj },
     { MP_OBJ_NEW_QSTR(MP_QSTR_send_name_packet), (mp_obj_t)&radio_send_name_packet_obj },
+    { MP_OBJ_NEW_QSTR(MP_QSTR_send_telemetry), (mp_obj_t)&radio_send_telemetry_obj },
 
     // Constants
     { MP_ROM_QSTR(MP_QSTR_TELEMETRY_OK), MP_ROM_INT(TELEMETRY_OK) },
@@ -143,6 +923,61 @@ STATIC const mp_map_elem_t radio_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_PACKET_CONTROL), MP_ROM_INT(PACKET_CONTROL) },
     { MP_ROM_QSTR(MP_QSTR_PACKET_NAME), MP_ROM_INT(PACKET_NAME) },
     { MP_ROM_QSTR(MP_QSTR_PACKET_TELEMETRY), MP_ROM_INT(PACKET_TELEMETRY) },
+    { MP_ROM_QSTR(MP_QSTR_PACKET_LINK), MP_ROM_INT(PACKET_LINK) },
+    { MP_ROM_QSTR(MP_QSTR_PACKET_SYNC), MP_ROM_INT(PACKET_SYNC) },
+    { MP_ROM_QSTR(MP_QSTR_PACKET_BULK), MP_ROM_INT(PACKET_BULK) },
+    { MP_ROM_QSTR(MP_QSTR_PACKET_GROUP), MP_ROM_INT(PACKET_GROUP) },
+    { MP_ROM_QSTR(MP_QSTR_PACKET_BIND), MP_ROM_INT(PACKET_BIND) },
+    { MP_ROM_QSTR(MP_QSTR_PACKET_FLAG_AUTH), MP_ROM_INT(PACKET_FLAG_AUTH) },
+
+    { MP_ROM_QSTR(MP_QSTR_TX_OK), MP_ROM_INT(TRANCEIVER_TX_OK) },
+    { MP_ROM_QSTR(MP_QSTR_TX_FAILED), MP_ROM_INT(TRANCEIVER_TX_FAILED) },
+    { MP_ROM_QSTR(MP_QSTR_TX_SHED), MP_ROM_INT(TRANCEIVER_TX_SHED) },
+
+    { MP_ROM_QSTR(MP_QSTR_RATE_DEFAULT), MP_ROM_INT(PHY_RATE_DEFAULT) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_1M), MP_ROM_INT(PHY_RATE_1M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_2M), MP_ROM_INT(PHY_RATE_2M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_5M5), MP_ROM_INT(PHY_RATE_5M5) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_11M), MP_ROM_INT(PHY_RATE_11M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_6M), MP_ROM_INT(PHY_RATE_6M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_9M), MP_ROM_INT(PHY_RATE_9M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_12M), MP_ROM_INT(PHY_RATE_12M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_18M), MP_ROM_INT(PHY_RATE_18M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_24M), MP_ROM_INT(PHY_RATE_24M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_36M), MP_ROM_INT(PHY_RATE_36M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_48M), MP_ROM_INT(PHY_RATE_48M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_54M), MP_ROM_INT(PHY_RATE_54M) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS0), MP_ROM_INT(PHY_RATE_MCS0) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS1), MP_ROM_INT(PHY_RATE_MCS1) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS2), MP_ROM_INT(PHY_RATE_MCS2) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS3), MP_ROM_INT(PHY_RATE_MCS3) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS4), MP_ROM_INT(PHY_RATE_MCS4) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS5), MP_ROM_INT(PHY_RATE_MCS5) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS6), MP_ROM_INT(PHY_RATE_MCS6) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_MCS7), MP_ROM_INT(PHY_RATE_MCS7) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_LR_250K), MP_ROM_INT(PHY_RATE_LR_250K) },
+    { MP_ROM_QSTR(MP_QSTR_RATE_LR_500K), MP_ROM_INT(PHY_RATE_LR_500K) },
+
+    { MP_ROM_QSTR(MP_QSTR_PROFILE_DEFAULT), MP_ROM_INT(PHY_PROFILE_DEFAULT) },
+    { MP_ROM_QSTR(MP_QSTR_PROFILE_RANGE), MP_ROM_INT(PHY_PROFILE_RANGE) },
+    { MP_ROM_QSTR(MP_QSTR_PROFILE_THROUGHPUT), MP_ROM_INT(PHY_PROFILE_THROUGHPUT) },
+    { MP_ROM_QSTR(MP_QSTR_PROFILE_LONG_RANGE), MP_ROM_INT(PHY_PROFILE_LONG_RANGE) },
+
+    { MP_ROM_QSTR(MP_QSTR_BULK_IDLE), MP_ROM_INT(BULK_IDLE) },
+    { MP_ROM_QSTR(MP_QSTR_BULK_SENDING), MP_ROM_INT(BULK_SENDING) },
+    { MP_ROM_QSTR(MP_QSTR_BULK_RECEIVING), MP_ROM_INT(BULK_RECEIVING) },
+    { MP_ROM_QSTR(MP_QSTR_BULK_COMPLETE), MP_ROM_INT(BULK_COMPLETE) },
+    { MP_ROM_QSTR(MP_QSTR_BULK_FAILED), MP_ROM_INT(BULK_FAILED) },
+    { MP_ROM_QSTR(MP_QSTR_BULK_MAX_BYTES), MP_ROM_INT(BULK_MAX_BYTES) },
+
+    { MP_ROM_QSTR(MP_QSTR_CORE_ANY), MP_ROM_INT(RADIO_TASKS_CORE_ANY) },
+
+    { MP_ROM_QSTR(MP_QSTR_STREAM_CONTROL), MP_ROM_INT(SEQUENCE_STREAM_CONTROL) },
+    { MP_ROM_QSTR(MP_QSTR_STREAM_GROUP), MP_ROM_INT(SEQUENCE_STREAM_GROUP) },
+    { MP_ROM_QSTR(MP_QSTR_STREAM_TELEMETRY), MP_ROM_INT(SEQUENCE_STREAM_TELEMETRY) },
+
+    { MP_ROM_QSTR(MP_QSTR_PROFILE_NO_TIMER), MP_ROM_INT(PROFILER_NO_TIMER) },
+    { MP_ROM_QSTR(MP_QSTR_PROFILE_HISTOGRAM_FIRST_US), MP_ROM_INT(PROFILER_HISTOGRAM_FIRST_US) },
 
     { MP_ROM_QSTR(MP_QSTR_CHANNEL_VALUE_UNDEFINED), MP_ROM_INT(CHANNEL_VALUE_UNDEFINED) },
 };
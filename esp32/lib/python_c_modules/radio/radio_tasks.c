@@ -0,0 +1,624 @@
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+
+#include "radio_tasks.h"
+#include "lockfree.h"
+#include "health.h"
+#include "sticks.h"
+#include "relay.h"
+
+
+#define MIN_FRAME_BYTES (26 + 4)  // Header and CRC
+#define MAX_FRAME_BYTES (26 + TRANCEIVER_MAX_PACKET_BYTES - 12 + 4)  // The first 12 data bytes are in the header
+#define MAX_CHANNELS (TRANCEIVER_MAX_PACKET_BYTES / 2)
+
+#define OUTPUT_SPEED_MODE LEDC_LOW_SPEED_MODE  // machine.PWM only uses the high speed channels
+#define OUTPUT_TIMER LEDC_TIMER_3
+#define OUTPUT_DUTY_BITS 16
+#define OUTPUT_PERIOD_US (1000000 / RADIO_OUTPUT_PWM_HZ)
+#define OUTPUT_MIN_US 500
+#define OUTPUT_MAX_US 2500
+#define OUTPUT_UNUSED 0xFF
+
+// Task notification bits
+#define NOTIFY_STOP 0x01
+#define NOTIFY_RX 0x02
+#define NOTIFY_TX_QUEUE 0x04
+#define NOTIFY_TX_CONTROL 0x08
+#define NOTIFY_TX_BULK 0x10
+#define NOTIFY_OUTPUT 0x20
+#define NOTIFY_TX_RELAY 0x40
+
+
+typedef struct {
+    uint32_t rx_time_us;
+    uint16_t sig_len;
+    int8_t rssi;
+    int8_t noise_floor;
+    uint8_t payload[MAX_FRAME_BYTES];
+} raw_frame;
+
+typedef struct {
+    uint8_t packet_type;
+    uint16_t data_len;
+    uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];  // Aligned for channel values
+} tx_item;
+
+typedef struct {
+    int16_t values[MAX_CHANNELS];
+    uint8_t num_channels;
+    uint32_t updated_us;
+} channel_values;
+
+typedef struct {
+    uint8_t pin;
+    uint16_t center_us;
+    int16_t scale_us;
+    float mix[RADIO_OUTPUT_MIX_CHANNELS];
+} output_config;
+
+typedef struct {
+    uint32_t updates;
+    float period_us;
+    float jitter_us;
+    uint32_t max_period_us;
+} output_stats;
+
+typedef struct {
+    uint32_t rx_frames;  // RX task
+    uint32_t rx_dropped;  // Wifi callback
+    uint32_t tx_sent;  // TX task
+    uint32_t tx_dropped;  // Python
+} task_counters;
+
+
+static volatile uint8_t running = 0;
+static volatile uint32_t notifiers_active = 0;  // Callers part way through waking a task
+static volatile uint32_t tasks_alive = 0;
+static radio_tasks_config config;
+static TaskHandle_t rx_task = NULL;
+static TaskHandle_t tx_task = NULL;
+static TaskHandle_t output_task = NULL;
+static esp_timer_handle_t control_timer = NULL;
+static esp_timer_handle_t output_timer = NULL;
+
+// Wifi callback -> RX task
+static raw_frame rx_frames[RADIO_TASKS_RX_RING_SLOTS];
+static spsc_ring rx_ring = SPSC_RING_INIT(RADIO_TASKS_RX_RING_SLOTS);
+
+// Python -> TX task
+static tx_item tx_items[RADIO_TASKS_TX_RING_SLOTS];
+static spsc_ring tx_ring = SPSC_RING_INIT(RADIO_TASKS_TX_RING_SLOTS);
+static channel_values tx_channels;
+static seqlock tx_channels_lock = SEQLOCK_INIT;
+
+// RX task -> output task
+static channel_values rx_channels;
+static seqlock rx_channels_lock = SEQLOCK_INIT;
+
+// Output task -> python
+static output_stats shared_output_stats;
+static seqlock output_stats_lock = SEQLOCK_INIT;
+static volatile uint8_t output_reset_requested = 0;
+
+static output_config outputs[RADIO_MAX_OUTPUTS] = {
+    [0 ... RADIO_MAX_OUTPUTS - 1] = {.pin = OUTPUT_UNUSED}
+};
+static volatile task_counters counters;
+static task_counters counters_at_reset;  // Only touched by python
+
+
+void radio_tasks_default_config(radio_tasks_config* out){
+    out->core = RADIO_TASKS_DEFAULT_CORE;
+    out->rx_priority = RADIO_TASKS_RX_PRIORITY;
+    out->tx_priority = RADIO_TASKS_TX_PRIORITY;
+    out->output_priority = RADIO_TASKS_OUTPUT_PRIORITY;
+    out->control_hz = 0;
+    out->output_hz = RADIO_OUTPUT_PWM_HZ;
+}
+
+
+uint8_t radio_tasks_running(void){
+    return running;
+}
+
+
+/*
+ * Wakes a task unless the tasks are stopping. radio_tasks_stop waits for
+ * anyone part way through this before the tasks are deleted.
+ */
+static void notify_task(TaskHandle_t* task, uint32_t bits){
+    __atomic_add_fetch(&notifiers_active, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&running, __ATOMIC_SEQ_CST) && *task != NULL){
+        xTaskNotify(*task, bits, eSetBits);
+    }
+    __atomic_sub_fetch(&notifiers_active, 1, __ATOMIC_SEQ_CST);
+}
+
+
+static void task_exit(void){
+    __atomic_sub_fetch(&tasks_alive, 1, __ATOMIC_SEQ_CST);
+    vTaskDelete(NULL);
+}
+
+
+static void write_channels(seqlock* lock, channel_values* shared, const int16_t channel_values[], uint8_t num_channels, uint32_t now_us){
+    if (num_channels > MAX_CHANNELS){
+        num_channels = MAX_CHANNELS;
+    }
+    seqlock_write_begin(lock);
+    if (num_channels > 0){
+        memcpy(shared->values, channel_values, num_channels * 2);
+    }
+    shared->num_channels = num_channels;
+    shared->updated_us = now_us;
+    seqlock_write_end(lock);
+}
+
+
+/*
+ * RX processing
+ */
+
+uint8_t radio_tasks_rx_frame(const uint8_t payload[], uint16_t sig_len, int8_t rssi, int8_t noise_floor, uint32_t now_us){
+    // Hold off radio_tasks_stop until the frame is in the ring
+    __atomic_add_fetch(&notifiers_active, 1, __ATOMIC_SEQ_CST);
+    uint8_t handled = __atomic_load_n(&running, __ATOMIC_SEQ_CST);
+    int32_t slot = -1;
+    if (handled && sig_len >= MIN_FRAME_BYTES && sig_len <= MAX_FRAME_BYTES){  // Anything else can't be one of ours
+        slot = spsc_write_slot(&rx_ring);
+        if (slot < 0){
+            counters.rx_dropped += 1;
+        }
+    }
+    if (slot >= 0){
+        raw_frame* frame = &rx_frames[slot];
+        frame->rx_time_us = now_us;
+        frame->sig_len = sig_len;
+        frame->rssi = rssi;
+        frame->noise_floor = noise_floor;
+        memcpy(frame->payload, payload, sig_len);
+        spsc_commit_write(&rx_ring);
+        health_record_queue(HEALTH_QUEUE_RX_FRAMES, spsc_occupancy(&rx_ring));
+        xTaskNotify(rx_task, NOTIFY_RX, eSetBits);
+    }
+    __atomic_sub_fetch(&notifiers_active, 1, __ATOMIC_SEQ_CST);
+    return !handled;
+}
+
+
+static void rx_task_main(void* arg){
+    uint32_t bits = 0;
+    while (1){
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if (bits & NOTIFY_STOP){
+            break;
+        }
+        int32_t slot;
+        while ((slot = spsc_read_slot(&rx_ring)) >= 0){
+            const raw_frame* frame = &rx_frames[slot];
+            tranceiver_process_frame(frame->payload, frame->sig_len, frame->rssi, frame->noise_floor, frame->rx_time_us);
+            spsc_commit_read(&rx_ring);
+            counters.rx_frames += 1;
+        }
+    }
+    task_exit();
+}
+
+
+void radio_tasks_publish_rx_channels(const int16_t channel_values[], uint8_t num_channels, uint32_t now_us){
+    write_channels(&rx_channels_lock, &rx_channels, channel_values, num_channels, now_us);
+}
+
+
+/*
+ * TX scheduler
+ */
+
+uint8_t radio_tasks_owns_tx(void){
+    return running && tx_task != NULL && xTaskGetCurrentTaskHandle() != tx_task;
+}
+
+
+uint8_t radio_tasks_queue_tx(packet_types packet_type, const uint8_t data[], uint16_t data_len){
+    if (data_len > TRANCEIVER_MAX_PACKET_BYTES){
+        return 1;
+    }
+    int32_t slot = spsc_write_slot(&tx_ring);
+    if (slot < 0){
+        counters.tx_dropped += 1;
+        return 1;
+    }
+    tx_items[slot].packet_type = packet_type;
+    tx_items[slot].data_len = data_len;
+    memcpy(tx_items[slot].data, data, data_len);
+    spsc_commit_write(&tx_ring);
+    health_record_queue(HEALTH_QUEUE_TX, spsc_occupancy(&tx_ring));
+
+    notify_task(&tx_task, NOTIFY_TX_QUEUE);
+    return 0;
+}
+
+
+uint8_t radio_tasks_set_tx_channels(const int16_t channel_values[], uint8_t num_channels){
+    if (!running || config.control_hz == 0){
+        return 1;
+    }
+    write_channels(&tx_channels_lock, &tx_channels, channel_values, num_channels, esp_timer_get_time());
+    return 0;
+}
+
+
+void radio_tasks_request_bulk_update(void){
+    notify_task(&tx_task, NOTIFY_TX_BULK);
+}
+
+
+void radio_tasks_request_relay(void){
+    notify_task(&tx_task, NOTIFY_TX_RELAY);
+}
+
+
+static void send_queued(void){
+    int32_t slot;
+    while ((slot = spsc_read_slot(&tx_ring)) >= 0){
+        const tx_item* item = &tx_items[slot];
+        if (item->packet_type == PACKET_CONTROL){
+            tranceiver_send_control_packet((int16_t*)item->data, item->data_len / 2);
+        } else {
+            tranceiver_send_packet_now(item->packet_type, item->data, item->data_len);
+        }
+        spsc_commit_read(&tx_ring);
+        counters.tx_sent += 1;
+    }
+}
+
+
+static void tx_task_main(void* arg){
+    channel_values channels = {0};
+    channel_values copy;
+    uint32_t bits = 0;
+    while (1){
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if (bits & NOTIFY_STOP){
+            break;
+        }
+        if (bits & NOTIFY_TX_RELAY){
+            // First, as relayed frames only have a short time to get out
+            relay_forward();
+        }
+        if (bits & NOTIFY_TX_QUEUE){
+            send_queued();
+        }
+        if (bits & NOTIFY_TX_CONTROL){
+            int16_t stick_values[STICKS_MAX_CHANNELS];
+            uint8_t num_sticks = sticks_get_channels(stick_values);
+            // If python is part way through updating them, resend the last ones
+            if (seqlock_read(&tx_channels_lock, &tx_channels, &copy, sizeof(copy)) == 0){
+                channels = copy;
+            }
+            uint8_t channels_fresh = channels.num_channels > 0 && ((uint32_t)esp_timer_get_time() - channels.updated_us) <= RADIO_TASKS_TX_CHANNELS_TIMEOUT_MS * 1000;
+            if (num_sticks > 0){
+                tranceiver_send_control_packet(stick_values, num_sticks);
+                counters.tx_sent += 1;
+            } else if (channels_fresh){
+                tranceiver_send_control_packet(channels.values, channels.num_channels);
+                counters.tx_sent += 1;
+            } else {
+                // Still move any bulk transfer along
+                tranceiver_bulk_update();
+            }
+        } else if (bits & NOTIFY_TX_BULK){
+            // Sending a control packet already sends any bulk packets
+            tranceiver_bulk_update();
+        }
+    }
+    task_exit();
+}
+
+
+static void control_timer_callback(void* arg){
+    notify_task(&tx_task, NOTIFY_TX_CONTROL);
+}
+
+
+/*
+ * Output driver
+ */
+
+uint8_t radio_tasks_set_output(uint8_t index, uint8_t pin, uint16_t center_us, int16_t scale_us, const float mix[RADIO_OUTPUT_MIX_CHANNELS]){
+    if (running || index >= RADIO_MAX_OUTPUTS){
+        return 1;
+    }
+    outputs[index].pin = pin;
+    outputs[index].center_us = center_us;
+    outputs[index].scale_us = scale_us;
+    memcpy(outputs[index].mix, mix, sizeof(outputs[index].mix));
+    return 0;
+}
+
+
+static uint32_t us_to_duty(int32_t us){
+    if (us < OUTPUT_MIN_US){
+        us = OUTPUT_MIN_US;
+    } else if (us > OUTPUT_MAX_US){
+        us = OUTPUT_MAX_US;
+    }
+    return ((uint32_t)us << OUTPUT_DUTY_BITS) / OUTPUT_PERIOD_US;
+}
+
+
+static uint8_t setup_outputs(void){
+    ledc_timer_config_t timer = {
+        .speed_mode = OUTPUT_SPEED_MODE,
+        .duty_resolution = (ledc_timer_bit_t)OUTPUT_DUTY_BITS,
+        .timer_num = OUTPUT_TIMER,
+        .freq_hz = RADIO_OUTPUT_PWM_HZ,
+    };
+    if (ledc_timer_config(&timer) != ESP_OK){
+        return 1;
+    }
+    for (uint8_t i=0; i<RADIO_MAX_OUTPUTS; i++){
+        if (outputs[i].pin == OUTPUT_UNUSED){
+            continue;
+        }
+        ledc_channel_config_t channel = {
+            .gpio_num = outputs[i].pin,
+            .speed_mode = OUTPUT_SPEED_MODE,
+            .channel = (ledc_channel_t)i,
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = OUTPUT_TIMER,
+            .duty = us_to_duty(outputs[i].center_us),
+        };
+        if (ledc_channel_config(&channel) != ESP_OK){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static void stop_outputs(void){
+    for (uint8_t i=0; i<RADIO_MAX_OUTPUTS; i++){
+        if (outputs[i].pin != OUTPUT_UNUSED){
+            ledc_stop(OUTPUT_SPEED_MODE, (ledc_channel_t)i, 0);
+        }
+    }
+}
+
+
+static void write_outputs(const channel_values* channels, uint8_t failsafe){
+    for (uint8_t i=0; i<RADIO_MAX_OUTPUTS; i++){
+        const output_config* output = &outputs[i];
+        if (output->pin == OUTPUT_UNUSED){
+            continue;
+        }
+        float value = 0;
+        for (uint8_t c=0; c<RADIO_OUTPUT_MIX_CHANNELS && c<channels->num_channels && !failsafe; c++){
+            if (channels->values[c] != CHANNEL_VALUE_UNDEFINED){
+                value += output->mix[c] * channels->values[c] / 32768.0f;
+            }
+        }
+        if (value > 1.0f){
+            value = 1.0f;
+        } else if (value < -1.0f){
+            value = -1.0f;
+        }
+        ledc_set_duty(OUTPUT_SPEED_MODE, (ledc_channel_t)i, us_to_duty(output->center_us + (int32_t)(output->scale_us * value)));
+        ledc_update_duty(OUTPUT_SPEED_MODE, (ledc_channel_t)i);
+    }
+}
+
+
+static void publish_output_stats(const output_stats* stats){
+    seqlock_write_begin(&output_stats_lock);
+    shared_output_stats = *stats;
+    seqlock_write_end(&output_stats_lock);
+}
+
+
+static void output_task_main(void* arg){
+    channel_values channels = {0};
+    channel_values copy;
+    output_stats stats = {0};
+    uint32_t periods = 0;
+    float sum_squares = 0;  // Of the differences from the mean (Welford)
+    uint32_t last_us = 0;
+    uint32_t bits = 0;
+    while (1){
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if (bits & NOTIFY_STOP){
+            break;
+        }
+        uint32_t now_us = esp_timer_get_time();
+        if (output_reset_requested){
+            memset(&stats, 0, sizeof(stats));
+            periods = 0;
+            sum_squares = 0;
+            last_us = 0;
+            output_reset_requested = 0;
+        }
+
+        if (seqlock_read(&rx_channels_lock, &rx_channels, &copy, sizeof(copy)) == 0){
+            channels = copy;
+        }
+        uint8_t failsafe = channels.num_channels == 0 || (now_us - channels.updated_us) > RADIO_OUTPUT_FAILSAFE_MS * 1000;
+        write_outputs(&channels, failsafe);
+
+        stats.updates += 1;
+        if (last_us != 0){
+            uint32_t period = now_us - last_us;
+            periods += 1;
+            float delta = period - stats.period_us;
+            stats.period_us += delta / periods;
+            sum_squares += delta * (period - stats.period_us);
+            if (periods > 1){
+                stats.jitter_us = sqrtf(sum_squares / (periods - 1));
+            }
+            if (period > stats.max_period_us){
+                stats.max_period_us = period;
+            }
+        }
+        last_us = now_us;
+        publish_output_stats(&stats);
+    }
+    task_exit();
+}
+
+
+static void output_timer_callback(void* arg){
+    notify_task(&output_task, NOTIFY_OUTPUT);
+}
+
+
+/*
+ * Starting and stopping
+ */
+
+static uint8_t create_task(TaskFunction_t function, const char* name, uint8_t priority, TaskHandle_t* handle){
+    BaseType_t core = config.core == RADIO_TASKS_CORE_ANY ? tskNO_AFFINITY : config.core;
+    if (xTaskCreatePinnedToCore(function, name, RADIO_TASKS_STACK_BYTES, NULL, priority, handle, core) != pdPASS){
+        *handle = NULL;
+        return 1;
+    }
+    __atomic_add_fetch(&tasks_alive, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+
+static uint8_t start_timer(esp_timer_cb_t callback, const char* name, uint16_t hz, esp_timer_handle_t* handle){
+    esp_timer_create_args_t args = {
+        .callback = callback,
+        .name = name,
+    };
+    if (esp_timer_create(&args, handle) != ESP_OK){
+        *handle = NULL;
+        return 1;
+    }
+    return esp_timer_start_periodic(*handle, 1000000 / hz) != ESP_OK;
+}
+
+
+static void stop_timer(esp_timer_handle_t* handle){
+    if (*handle != NULL){
+        esp_timer_stop(*handle);
+        esp_timer_delete(*handle);
+        *handle = NULL;
+    }
+}
+
+
+static void wait_for_tasks(void){
+    while (__atomic_load_n(&notifiers_active, __ATOMIC_SEQ_CST) != 0){
+        vTaskDelay(1);
+    }
+    TaskHandle_t* tasks[] = {&rx_task, &tx_task, &output_task};
+    for (uint8_t i=0; i<sizeof(tasks)/sizeof(tasks[0]); i++){
+        if (*tasks[i] != NULL){
+            xTaskNotify(*tasks[i], NOTIFY_STOP, eSetBits);
+        }
+    }
+    while (__atomic_load_n(&tasks_alive, __ATOMIC_SEQ_CST) != 0){
+        vTaskDelay(1);
+    }
+    rx_task = NULL;
+    tx_task = NULL;
+    output_task = NULL;
+}
+
+
+uint8_t radio_tasks_start(const radio_tasks_config* new_config){
+    if (running){
+        return 1;
+    }
+    config = *new_config;
+
+    // Anything left over from last time is stale
+    rx_ring.head = rx_ring.tail = 0;
+    tx_ring.head = tx_ring.tail = 0;
+    write_channels(&tx_channels_lock, &tx_channels, NULL, 0, 0);
+
+    uint8_t uses_outputs = 0;
+    for (uint8_t i=0; i<RADIO_MAX_OUTPUTS; i++){
+        uses_outputs |= outputs[i].pin != OUTPUT_UNUSED;
+    }
+    uses_outputs &= config.output_hz > 0;
+    if (uses_outputs && setup_outputs() != 0){
+        return 1;
+    }
+    output_reset_requested = uses_outputs;
+
+    uint8_t failed = create_task(rx_task_main, "radio_rx", config.rx_priority, &rx_task);
+    failed |= create_task(tx_task_main, "radio_tx", config.tx_priority, &tx_task);
+    if (uses_outputs){
+        failed |= create_task(output_task_main, "radio_out", config.output_priority, &output_task);
+    }
+    if (failed){
+        wait_for_tasks();
+        return 1;
+    }
+
+    __atomic_store_n(&running, 1, __ATOMIC_SEQ_CST);
+    if (config.control_hz > 0){
+        failed |= start_timer(control_timer_callback, "radio_control", config.control_hz, &control_timer);
+    }
+    if (uses_outputs){
+        failed |= start_timer(output_timer_callback, "radio_output", config.output_hz, &output_timer);
+    }
+    if (failed){
+        radio_tasks_stop();
+        return 1;
+    }
+    return 0;
+}
+
+
+void radio_tasks_stop(void){
+    if (!running){
+        return;
+    }
+    __atomic_store_n(&running, 0, __ATOMIC_SEQ_CST);
+    stop_timer(&control_timer);
+    stop_timer(&output_timer);
+    wait_for_tasks();
+    stop_outputs();
+}
+
+
+void radio_tasks_get_stack_free(uint32_t* rx, uint32_t* tx, uint32_t* output){
+    *rx = rx_task != NULL ? uxTaskGetStackHighWaterMark(rx_task) : 0;
+    *tx = tx_task != NULL ? uxTaskGetStackHighWaterMark(tx_task) : 0;
+    *output = output_task != NULL ? uxTaskGetStackHighWaterMark(output_task) : 0;
+}
+
+
+void radio_tasks_get_stats(radio_tasks_stats* stats){
+    stats->rx_frames = counters.rx_frames - counters_at_reset.rx_frames;
+    stats->rx_dropped = counters.rx_dropped - counters_at_reset.rx_dropped;
+    stats->tx_sent = counters.tx_sent - counters_at_reset.tx_sent;
+    stats->tx_dropped = counters.tx_dropped - counters_at_reset.tx_dropped;
+
+    output_stats output = {0};
+    if (output_reset_requested || seqlock_read(&output_stats_lock, &shared_output_stats, &output, sizeof(output)) != 0){
+        memset(&output, 0, sizeof(output));
+    }
+    stats->output_updates = output.updates;
+    stats->output_period_us = output.period_us;
+    stats->output_jitter_us = output.jitter_us;
+    stats->output_max_period_us = output.max_period_us;
+}
+
+
+void radio_tasks_reset_stats(void){
+    memcpy(&counters_at_reset, (const void*)&counters, sizeof(counters_at_reset));
+    if (output_task != NULL){
+        output_reset_requested = 1;
+    } else {
+        output_stats empty = {0};
+        publish_output_stats(&empty);
+    }
+}
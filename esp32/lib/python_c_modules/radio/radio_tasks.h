@@ -0,0 +1,119 @@
+#ifndef __radio_tasks_h__
+#define __radio_tasks_h__
+
+#include <stdint.h>
+#include "tranceiver.h"
+
+// Moves the time critical work out of the wifi callback and the
+// interpreter into three FreeRTOS tasks that can be pinned to one core:
+//  - RX: parses the frames the wifi callback hands over
+//  - TX scheduler: sends control packets at a fixed rate from the sticks
+//    (sticks.h) if they are running, or else from the latest channel values
+//    python set, plus anything python asked to send
+//  - Output driver: sets the servo pulses from the latest control packet at
+//    a fixed rate
+//
+// Python only talks to the tasks through the lock-free rings and seqlocks in
+// lockfree.h, so a busy interpreter can't hold them up.
+
+#define RADIO_TASKS_CORE_ANY -1  // Let FreeRTOS run the tasks on either core
+#define RADIO_TASKS_DEFAULT_CORE 1  // MicroPython and the wifi task live on core 0
+#define RADIO_TASKS_RX_PRIORITY 20  // Below the wifi task (23)
+#define RADIO_TASKS_TX_PRIORITY 19
+#define RADIO_TASKS_OUTPUT_PRIORITY 18
+#define RADIO_TASKS_STACK_BYTES 4096
+#define RADIO_TASKS_RX_RING_SLOTS 16
+#define RADIO_TASKS_TX_RING_SLOTS 8
+#define RADIO_TASKS_TX_CHANNELS_TIMEOUT_MS 250  // Stop sending pythons channels if it hasn't updated them for this long
+
+#define RADIO_MAX_OUTPUTS 8
+#define RADIO_OUTPUT_MIX_CHANNELS 4  // Outputs are a weighted sum of the first four channels
+#define RADIO_OUTPUT_PWM_HZ 50
+#define RADIO_OUTPUT_FAILSAFE_MS 500  // Outputs go back to center if control packets stop for this long
+
+
+typedef struct {
+    int8_t core;  // 0, 1 or RADIO_TASKS_CORE_ANY
+    uint8_t rx_priority;
+    uint8_t tx_priority;
+    uint8_t output_priority;
+    uint16_t control_hz;  // Control packet rate. 0 to send them when python does
+    uint16_t output_hz;  // Output update rate. 0 for no output task
+} radio_tasks_config;
+
+typedef struct {
+    uint32_t rx_frames;
+    uint32_t rx_dropped;  // The RX task fell behind and the ring was full
+    uint32_t tx_sent;
+    uint32_t tx_dropped;  // Python sent faster than the TX task could keep up
+    uint32_t output_updates;
+    float output_period_us;  // Mean time between output updates
+    float output_jitter_us;  // Standard deviation of the time between output updates
+    uint32_t output_max_period_us;
+} radio_tasks_stats;
+
+
+void radio_tasks_default_config(radio_tasks_config* config);
+
+/*
+ * Starts the tasks. Outputs must be set up first. Returns nonzero if they
+ * are already running or couldn't be created.
+ */
+uint8_t radio_tasks_start(const radio_tasks_config* config);
+
+/* Stops the tasks and goes back to doing everything in the callers context */
+void radio_tasks_stop(void);
+
+uint8_t radio_tasks_running(void);
+
+/*
+ * Sets up an output. It is driven at center_us + scale_us * the weighted sum
+ * of the channels, each of which is between -1 and 1. Returns nonzero if the
+ * tasks are running or the index is out of range.
+ */
+uint8_t radio_tasks_set_output(uint8_t index, uint8_t pin, uint16_t center_us, int16_t scale_us, const float mix[RADIO_OUTPUT_MIX_CHANNELS]);
+
+void radio_tasks_get_stats(radio_tasks_stats* stats);
+void radio_tasks_reset_stats(void);
+
+/* The least free stack each task has had, or 0 if it isn't running */
+void radio_tasks_get_stack_free(uint32_t* rx, uint32_t* tx, uint32_t* output);
+
+
+/*
+ * Used by the tranceiver
+ */
+
+/*
+ * Hands a frame from the wifi callback to the RX task. Returns nonzero if
+ * the tasks aren't running and the caller has to process it itself.
+ */
+uint8_t radio_tasks_rx_frame(const uint8_t payload[], uint16_t sig_len, int8_t rssi, int8_t noise_floor, uint32_t now_us);
+
+/* Latest channel values from the far end, for the output driver */
+void radio_tasks_publish_rx_channels(const int16_t channel_values[], uint8_t num_channels, uint32_t now_us);
+
+/*
+ * Nonzero if packets have to be sent through radio_tasks_queue_tx because
+ * the TX task is running and this isn't it
+ */
+uint8_t radio_tasks_owns_tx(void);
+
+/* Queues a packet for the TX task. Returns nonzero if the queue is full */
+uint8_t radio_tasks_queue_tx(packet_types packet_type, const uint8_t data[], uint16_t data_len);
+
+/*
+ * Gives the TX scheduler new channel values to send. Returns nonzero if it
+ * isn't sending control packets itself. Control packets stop if these
+ * aren't updated for RADIO_TASKS_TX_CHANNELS_TIMEOUT_MS, so the receivers
+ * failsafe when python hangs rather than hold the last sticks.
+ */
+uint8_t radio_tasks_set_tx_channels(const int16_t channel_values[], uint8_t num_channels);
+
+/* Asks the TX task to send any bulk packets that are due */
+void radio_tasks_request_bulk_update(void);
+
+/* Asks the TX task to send the frames the relay has queued (relay.h) */
+void radio_tasks_request_relay(void);
+
+#endif
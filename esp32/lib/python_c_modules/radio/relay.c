@@ -0,0 +1,170 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "relay.h"
+#include "tranceiver.h"
+#include "radio_tasks.h"
+#include "lockfree.h"
+
+
+// Where things are in a frame. See PacketFormat.md
+#define HEADER_BYTES 26
+#define ID_OFFSET 4
+#define ID_LENGTH 6
+#define PACKET_TYPE_OFFSET 23
+#define MAX_FRAME_BYTES (HEADER_BYTES + TRANCEIVER_MAX_PACKET_BYTES - 12)
+
+
+typedef struct {
+    uint32_t hash;  // 0 if the slot is empty
+    uint32_t time_us;
+} seen_entry;
+
+typedef struct {
+    uint32_t rx_time_us;
+    uint16_t frame_len;
+    uint8_t frame[MAX_FRAME_BYTES];
+} queued_frame;
+
+
+static volatile uint8_t active = 0;
+static uint8_t target_id[ID_LENGTH] = {0};
+static uint8_t max_hops = RELAY_DEFAULT_MAX_HOPS;
+static uint32_t max_delay_us = RELAY_DEFAULT_MAX_DELAY_US;
+static relay_stats stats;
+
+// Frames we have sent or heard recently. Written by the RX path and the TX
+// task
+static seen_entry seen[RELAY_SEEN_SLOTS];
+static uint8_t seen_next = 0;
+static portMUX_TYPE seen_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// RX path -> TX task
+static queued_frame queue_frames[RELAY_QUEUE_SLOTS];
+static spsc_ring queue = SPSC_RING_INIT(RELAY_QUEUE_SLOTS);
+
+
+static uint32_t hash_frame(const uint8_t frame[], uint16_t frame_len){
+    // FNV-1a of everything from the ID on, without the hop count, which is
+    // the only thing a relay changes
+    uint32_t hash = 2166136261u;
+    for (uint16_t i=ID_OFFSET; i<frame_len; i++){
+        uint8_t byte = frame[i];
+        if (i == PACKET_TYPE_OFFSET){
+            byte &= ~PACKET_HOPS_MASK;
+        }
+        hash ^= byte;
+        hash *= 16777619u;
+    }
+    if (hash == 0){
+        hash = 1;  // 0 is reserved for empty slots
+    }
+    return hash;
+}
+
+
+/* Remembers the frame. Returns nonzero if it was already remembered */
+static uint8_t remember(uint32_t hash, uint32_t now_us){
+    uint8_t found = 0;
+    portENTER_CRITICAL(&seen_lock);
+    for (uint8_t i=0; i<RELAY_SEEN_SLOTS; i++){
+        if (seen[i].hash == hash && (now_us - seen[i].time_us) < RELAY_SEEN_US){
+            found = 1;
+            break;
+        }
+    }
+    if (!found){
+        seen[seen_next].hash = hash;
+        seen[seen_next].time_us = now_us;
+        seen_next = (seen_next + 1) % RELAY_SEEN_SLOTS;
+    }
+    portEXIT_CRITICAL(&seen_lock);
+    return found;
+}
+
+
+uint8_t relay_start(const uint8_t id[6], uint8_t hops, uint32_t delay_us){
+    if (!radio_tasks_running() || hops == 0 || hops > RELAY_MAX_HOPS){
+        return 1;
+    }
+    __atomic_store_n(&active, 0, __ATOMIC_SEQ_CST);
+    memcpy(target_id, id, ID_LENGTH);
+    max_hops = hops;
+    max_delay_us = delay_us;
+    memset(&stats, 0, sizeof(stats));
+    __atomic_store_n(&active, 1, __ATOMIC_SEQ_CST);
+    return 0;
+}
+
+
+void relay_stop(void){
+    __atomic_store_n(&active, 0, __ATOMIC_SEQ_CST);
+}
+
+
+void relay_get_stats(relay_stats* out){
+    memcpy(out, &stats, sizeof(stats));
+}
+
+
+uint8_t relay_receive(const uint8_t frame[], uint16_t frame_len, uint32_t now_us){
+    if (frame_len < HEADER_BYTES || frame_len > MAX_FRAME_BYTES){
+        return 0;
+    }
+    uint8_t hops = (frame[PACKET_TYPE_OFFSET] & PACKET_HOPS_MASK) >> PACKET_HOPS_SHIFT;
+    uint8_t already_seen = remember(hash_frame(frame, frame_len), now_us);
+    if (already_seen && hops > 0){
+        stats.duplicates += 1;
+        return 1;
+    }
+    if (already_seen || !__atomic_load_n(&active, __ATOMIC_SEQ_CST) || memcmp(frame + ID_OFFSET, target_id, ID_LENGTH) != 0){
+        return 0;
+    }
+
+    stats.offered += 1;
+    if (hops >= max_hops){
+        stats.expired += 1;
+        return 0;
+    }
+    int32_t slot = spsc_write_slot(&queue);
+    if (slot < 0){
+        stats.queue_full += 1;
+        return 0;
+    }
+    queued_frame* item = &queue_frames[slot];
+    memcpy(item->frame, frame, frame_len);
+    item->frame[PACKET_TYPE_OFFSET] = (frame[PACKET_TYPE_OFFSET] & ~PACKET_HOPS_MASK) | ((hops + 1) << PACKET_HOPS_SHIFT);
+    item->frame_len = frame_len;
+    item->rx_time_us = now_us;
+    spsc_commit_write(&queue);
+    radio_tasks_request_relay();
+    return 0;
+}
+
+
+void relay_sent(const uint8_t frame[], uint16_t frame_len, uint32_t now_us){
+    remember(hash_frame(frame, frame_len), now_us);
+}
+
+
+void relay_forward(void){
+    int32_t slot;
+    while ((slot = spsc_read_slot(&queue)) >= 0){
+        const queued_frame* item = &queue_frames[slot];
+        uint32_t delay_us = (uint32_t)esp_timer_get_time() - item->rx_time_us;
+        if (delay_us > max_delay_us){
+            // Too stale to be any use to the far end
+            stats.late += 1;
+        } else if (tranceiver_relay_frame(item->frame, item->frame_len) != TRANCEIVER_TX_OK){
+            stats.tx_failed += 1;
+        } else {
+            stats.forwarded += 1;
+            stats.delay_total_us += delay_us;
+            if (delay_us > stats.delay_max_us){
+                stats.delay_max_us = delay_us;
+            }
+        }
+        spsc_commit_read(&queue);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef __relay_h__
+#define __relay_h__
+
+#include <stdint.h>
+
+// Repeats another receivers frames to stretch the range past one hop.
+//
+// A relay listens for frames with the target receivers ID and sends them
+// again unchanged, except for the hop count in the packet type byte (see
+// "Relaying" in PacketFormat.md). The transmitter and the receiver both use
+// the receivers ID, so this carries control packets out and telemetry back.
+//
+// - Frames that have already made max_hops hops aren't repeated (the TTL),
+//   so relays within range of each other can't pass a frame back and forth.
+// - Every node remembers the frames it has sent and heard for
+//   RELAY_SEEN_US. A relayed copy of one of those is dropped, by the relays
+//   and by the endpoints, which would otherwise act on a control packet
+//   twice or hear their own packets come back.
+// - A frame is only worth repeating while it is fresh, so one that has
+//   waited longer than max_delay_us to be sent is dropped instead.
+//
+// The frames are sent by the TX task, which owns the radio while the radio
+// tasks run, so relaying needs them running.
+
+#define RELAY_DEFAULT_MAX_HOPS 1
+#define RELAY_MAX_HOPS 3  // The most the hop count in the type byte can hold
+#define RELAY_DEFAULT_MAX_DELAY_US 2000
+#define RELAY_QUEUE_SLOTS 8
+#define RELAY_SEEN_SLOTS 32  // Frames remembered for duplicate suppression
+#define RELAY_SEEN_US 200000
+
+
+typedef struct {
+    uint32_t offered;  // Frames for the target
+    uint32_t forwarded;
+    uint32_t duplicates;  // Copies of frames we had already seen, on any ID
+    uint32_t expired;  // Had already made max_hops hops
+    uint32_t late;  // Waited longer than max_delay_us
+    uint32_t queue_full;
+    uint32_t tx_failed;  // Refused by the wifi stack or shed by congestion control
+    uint32_t delay_total_us;  // From arriving to being handed to the wifi stack
+    uint32_t delay_max_us;
+} relay_stats;
+
+
+/*
+ * Starts repeating frames for target_id. Returns nonzero if the radio tasks
+ * aren't running or max_hops is out of range.
+ */
+uint8_t relay_start(const uint8_t target_id[6], uint8_t max_hops, uint32_t max_delay_us);
+
+void relay_stop(void);
+
+/* Clears the stats when the relay starts */
+void relay_get_stats(relay_stats* stats);
+
+
+/*
+ * Used by the tranceiver
+ */
+
+/*
+ * Called for every frame received, before anything else looks at it
+ * (frame_len excludes the CRC). Queues it to be repeated if it is for the
+ * target. Returns nonzero if it is a relayed copy of a frame we have
+ * already seen and should be ignored.
+ */
+uint8_t relay_receive(const uint8_t frame[], uint16_t frame_len, uint32_t now_us);
+
+/* Called for every frame we send, so relayed copies of it are ignored */
+void relay_sent(const uint8_t frame[], uint16_t frame_len, uint32_t now_us);
+
+/* Sends the queued frames. Called by the TX task */
+void relay_forward(void);
+
+#endif
@@ -0,0 +1,441 @@
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "driver/adc.h"
+#include "nvs.h"
+
+#include "sticks.h"
+#include "lockfree.h"
+
+
+#define NVS_NAMESPACE "sticks"
+#define NVS_CALIBRATION_KEY "calibration"
+#define NO_ADC_CHANNEL 0xFF
+
+
+// Written by python, read by the sampler
+typedef struct {
+    sticks_calibration calibration[STICKS_MAX_CHANNELS];
+    float deadband[STICKS_MAX_CHANNELS];
+    float curve[STICKS_MAX_CHANNELS][STICKS_CURVE_POINTS];
+    uint8_t channel_map[STICKS_MAX_CHANNELS];  // Stick each channel is sent from
+    uint8_t num_mapped;
+} stick_settings;
+
+// Written by the sampler, read by python and the TX task
+typedef struct {
+    int16_t sticks[STICKS_MAX_CHANNELS];
+    int16_t channels[STICKS_MAX_CHANNELS];  // Through the channel map
+    float raw[STICKS_MAX_CHANNELS];
+    uint16_t travel_min[STICKS_MAX_CHANNELS];  // Since sticks_calibrate_begin
+    uint16_t travel_max[STICKS_MAX_CHANNELS];
+    uint8_t num_sticks;
+    uint8_t num_channels;
+} stick_state;
+
+
+static volatile uint8_t running = 0;
+static volatile uint8_t sampling = 0;  // The timer callback is part way through
+static volatile uint8_t calibrating = 0;
+static volatile uint8_t calibration_reset_requested = 0;
+static esp_timer_handle_t sample_timer = NULL;
+
+static uint8_t num_channels = 0;
+static adc1_channel_t adc_channels[STICKS_MAX_CHANNELS];
+static uint8_t oversample = STICKS_DEFAULT_OVERSAMPLE;
+
+static stick_settings settings;  // Python's copy
+static stick_settings shared_settings;
+static seqlock settings_lock = SEQLOCK_INIT;
+
+static stick_state shared_state;
+static seqlock state_lock = SEQLOCK_INIT;
+
+// Only touched by the sampler
+static uint16_t samples[STICKS_MAX_CHANNELS][STICKS_MAX_OVERSAMPLE];
+static uint32_t sample_sums[STICKS_MAX_CHANNELS];
+static uint8_t sample_head = 0;
+static uint8_t sample_count = 0;
+static stick_settings sampler_settings;
+static uint32_t sampler_settings_sequence = 0;
+static stick_state state;
+
+
+static adc1_channel_t pin_to_adc_channel(uint8_t pin){
+    switch (pin){
+        case 36: return ADC1_CHANNEL_0;
+        case 37: return ADC1_CHANNEL_1;
+        case 38: return ADC1_CHANNEL_2;
+        case 39: return ADC1_CHANNEL_3;
+        case 32: return ADC1_CHANNEL_4;
+        case 33: return ADC1_CHANNEL_5;
+        case 34: return ADC1_CHANNEL_6;
+        case 35: return ADC1_CHANNEL_7;
+        default: return (adc1_channel_t)NO_ADC_CHANNEL;
+    }
+}
+
+
+static void publish_settings(void){
+    seqlock_write_begin(&settings_lock);
+    memcpy(&shared_settings, &settings, sizeof(stick_settings));
+    seqlock_write_end(&settings_lock);
+}
+
+
+static uint8_t calibration_valid(const sticks_calibration* calibration){
+    return calibration->center >= calibration->min + STICKS_MIN_SPAN
+        && calibration->max >= calibration->center + STICKS_MIN_SPAN
+        && calibration->max <= STICKS_ADC_MAX;
+}
+
+
+static uint8_t load_calibration(void){
+    nvs_handle handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK){
+        return 1;
+    }
+    sticks_calibration loaded[STICKS_MAX_CHANNELS];
+    size_t size = sizeof(loaded);
+    esp_err_t res = nvs_get_blob(handle, NVS_CALIBRATION_KEY, loaded, &size);
+    nvs_close(handle);
+    if (res != ESP_OK || size != sizeof(loaded)){
+        return 1;
+    }
+    for (uint8_t i=0; i<num_channels; i++){
+        if (!calibration_valid(&loaded[i])){
+            return 1;
+        }
+    }
+    memcpy(settings.calibration, loaded, sizeof(loaded));
+    return 0;
+}
+
+
+static uint8_t save_calibration(void){
+    nvs_handle handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK){
+        return 1;
+    }
+    esp_err_t res = nvs_set_blob(handle, NVS_CALIBRATION_KEY, settings.calibration, sizeof(settings.calibration));
+    if (res == ESP_OK){
+        res = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return res != ESP_OK;
+}
+
+
+/* Assumes the sticks are centered and uses the full ADC range either side */
+static void center_sticks(void){
+    for (uint8_t i=0; i<num_channels; i++){
+        uint32_t total = 0;
+        for (uint8_t s=0; s<oversample; s++){
+            total += adc1_get_raw(adc_channels[i]);
+        }
+        sticks_calibration* calibration = &settings.calibration[i];
+        calibration->min = 0;
+        calibration->center = total / oversample;
+        calibration->max = STICKS_ADC_MAX;
+    }
+}
+
+
+static int16_t process_stick(const stick_settings* current, uint8_t channel, float raw){
+    const sticks_calibration* calibration = &current->calibration[channel];
+
+    // Higher readings are negative, as they always have been from python
+    float position;
+    if (raw < calibration->center){
+        position = (calibration->center - raw) / (float)(calibration->center - calibration->min);
+    } else {
+        position = -(raw - calibration->center) / (float)(calibration->max - calibration->center);
+    }
+
+    float magnitude = fabsf(position);
+    float deadband = current->deadband[channel];
+    if (magnitude <= deadband){
+        return 0;
+    }
+    magnitude = (magnitude - deadband) / (1.0f - deadband);
+    if (magnitude > 1.0f){
+        magnitude = 1.0f;
+    }
+
+    float index = magnitude * (STICKS_CURVE_POINTS - 1);
+    uint8_t below = (uint8_t)index;
+    float value = current->curve[channel][STICKS_CURVE_POINTS - 1];
+    if (below < STICKS_CURVE_POINTS - 1){
+        float fraction = index - below;
+        value = current->curve[channel][below] * (1.0f - fraction) + current->curve[channel][below + 1] * fraction;
+    }
+    return (int16_t)lrintf(copysignf(value, position) * 32767);
+}
+
+
+static void sample_timer_callback(void* arg){
+    __atomic_store_n(&sampling, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&running, __ATOMIC_SEQ_CST)){
+        __atomic_store_n(&sampling, 0, __ATOMIC_SEQ_CST);
+        return;
+    }
+
+    // Only copy the settings out when python has changed them
+    if (seqlock_read_begin(&settings_lock) != sampler_settings_sequence){
+        stick_settings copy;
+        uint32_t sequence = seqlock_read_begin(&settings_lock);
+        memcpy(&copy, &shared_settings, sizeof(copy));
+        if (!seqlock_read_retry(&settings_lock, sequence)){
+            sampler_settings = copy;
+            sampler_settings_sequence = sequence;
+        }
+    }
+
+    for (uint8_t i=0; i<num_channels; i++){
+        uint16_t sample = adc1_get_raw(adc_channels[i]);
+        sample_sums[i] += sample;
+        if (sample_count == oversample){
+            sample_sums[i] -= samples[i][sample_head];
+        }
+        samples[i][sample_head] = sample;
+    }
+    sample_head = (sample_head + 1) % oversample;
+    if (sample_count < oversample){
+        sample_count += 1;
+    }
+
+    uint8_t reset_travel = calibration_reset_requested;
+    for (uint8_t i=0; i<num_channels; i++){
+        float raw = sample_sums[i] / (float)sample_count;
+        uint16_t rounded = (uint16_t)lrintf(raw);
+        state.raw[i] = raw;
+        state.sticks[i] = process_stick(&sampler_settings, i, raw);
+        if (reset_travel){
+            state.travel_min[i] = rounded;
+            state.travel_max[i] = rounded;
+        } else if (calibrating){
+            if (rounded < state.travel_min[i]){
+                state.travel_min[i] = rounded;
+            }
+            if (rounded > state.travel_max[i]){
+                state.travel_max[i] = rounded;
+            }
+        }
+    }
+    if (reset_travel){
+        calibration_reset_requested = 0;
+    }
+    for (uint8_t i=0; i<sampler_settings.num_mapped; i++){
+        state.channels[i] = state.sticks[sampler_settings.channel_map[i]];
+    }
+    state.num_sticks = num_channels;
+    state.num_channels = sampler_settings.num_mapped;
+
+    seqlock_write_begin(&state_lock);
+    memcpy(&shared_state, &state, sizeof(stick_state));
+    seqlock_write_end(&state_lock);
+    __atomic_store_n(&sampling, 0, __ATOMIC_SEQ_CST);
+}
+
+
+static void set_linear_curve(uint8_t channel){
+    for (uint8_t p=0; p<STICKS_CURVE_POINTS; p++){
+        settings.curve[channel][p] = p / (float)(STICKS_CURVE_POINTS - 1);
+    }
+    settings.deadband[channel] = 0;
+}
+
+
+uint8_t sticks_start(const uint8_t pins[], uint8_t new_num_channels, uint16_t sample_hz, uint8_t new_oversample){
+    if (running || new_num_channels == 0 || new_num_channels > STICKS_MAX_CHANNELS || sample_hz == 0){
+        return 1;
+    }
+    for (uint8_t i=0; i<new_num_channels; i++){
+        adc_channels[i] = pin_to_adc_channel(pins[i]);
+        if (adc_channels[i] == (adc1_channel_t)NO_ADC_CHANNEL){
+            return 1;
+        }
+    }
+    num_channels = new_num_channels;
+    oversample = new_oversample;
+    if (oversample < 1){
+        oversample = 1;
+    } else if (oversample > STICKS_MAX_OVERSAMPLE){
+        oversample = STICKS_MAX_OVERSAMPLE;
+    }
+
+    adc1_config_width(ADC_WIDTH_BIT_12);
+    for (uint8_t i=0; i<num_channels; i++){
+        adc1_config_channel_atten(adc_channels[i], ADC_ATTN_DB_11);
+        set_linear_curve(i);
+        settings.channel_map[i] = i;
+    }
+    settings.num_mapped = num_channels;
+    if (load_calibration() != 0){
+        center_sticks();
+    }
+    publish_settings();
+    sampler_settings = settings;
+    sampler_settings_sequence = seqlock_read_begin(&settings_lock);
+
+    memset(sample_sums, 0, sizeof(sample_sums));
+    sample_head = 0;
+    sample_count = 0;
+    calibrating = 0;
+    calibration_reset_requested = 0;
+    memset(&state, 0, sizeof(state));
+
+    esp_timer_create_args_t args = {
+        .callback = sample_timer_callback,
+        .name = "sticks",
+    };
+    if (esp_timer_create(&args, &sample_timer) != ESP_OK){
+        sample_timer = NULL;
+        return 1;
+    }
+    __atomic_store_n(&running, 1, __ATOMIC_SEQ_CST);
+    if (esp_timer_start_periodic(sample_timer, 1000000 / sample_hz) != ESP_OK){
+        sticks_stop();
+        return 1;
+    }
+    return 0;
+}
+
+
+void sticks_stop(void){
+    __atomic_store_n(&running, 0, __ATOMIC_SEQ_CST);
+    if (sample_timer != NULL){
+        esp_timer_stop(sample_timer);
+        esp_timer_delete(sample_timer);
+        sample_timer = NULL;
+    }
+    // A sample may still be part way through on the other core
+    while (__atomic_load_n(&sampling, __ATOMIC_SEQ_CST)){
+        vTaskDelay(1);
+    }
+}
+
+
+uint8_t sticks_running(void){
+    return running;
+}
+
+
+uint8_t sticks_set_curve(uint8_t channel, float deadband, float expo, float rate){
+    if (channel >= STICKS_MAX_CHANNELS){
+        return 1;
+    }
+    deadband = fminf(fmaxf(deadband, 0.0f), 0.9f);
+    expo = fminf(fmaxf(expo, 0.0f), 1.0f);
+    rate = fminf(fmaxf(rate, 0.0f), 1.0f);
+
+    settings.deadband[channel] = deadband;
+    for (uint8_t p=0; p<STICKS_CURVE_POINTS; p++){
+        float x = p / (float)(STICKS_CURVE_POINTS - 1);
+        settings.curve[channel][p] = rate * (expo * x * x * x + (1.0f - expo) * x);
+    }
+    publish_settings();
+    return 0;
+}
+
+
+uint8_t sticks_set_map(const uint8_t sticks[], uint8_t new_num_mapped){
+    if (new_num_mapped > STICKS_MAX_CHANNELS){
+        return 1;
+    }
+    for (uint8_t i=0; i<new_num_mapped; i++){
+        if (sticks[i] >= num_channels){
+            return 1;
+        }
+    }
+    memcpy(settings.channel_map, sticks, new_num_mapped);
+    settings.num_mapped = new_num_mapped;
+    publish_settings();
+    return 0;
+}
+
+
+static uint8_t read_state(stick_state* out){
+    if (!running){
+        return 1;
+    }
+    stick_state copy;
+    if (seqlock_read(&state_lock, &shared_state, &copy, sizeof(copy)) != 0){
+        return 1;
+    }
+    *out = copy;
+    return 0;
+}
+
+
+uint8_t sticks_get_channels(int16_t channels[STICKS_MAX_CHANNELS]){
+    stick_state copy;
+    if (read_state(&copy) != 0){
+        return 0;
+    }
+    memcpy(channels, copy.channels, copy.num_channels * sizeof(int16_t));
+    return copy.num_channels;
+}
+
+
+uint8_t sticks_get_sticks(int16_t sticks[STICKS_MAX_CHANNELS]){
+    stick_state copy;
+    if (read_state(&copy) != 0){
+        return 0;
+    }
+    memcpy(sticks, copy.sticks, copy.num_sticks * sizeof(int16_t));
+    return copy.num_sticks;
+}
+
+
+uint8_t sticks_get_raw(float raw[STICKS_MAX_CHANNELS]){
+    stick_state copy;
+    if (read_state(&copy) != 0){
+        return 0;
+    }
+    memcpy(raw, copy.raw, copy.num_sticks * sizeof(float));
+    return copy.num_sticks;
+}
+
+
+void sticks_calibrate_begin(void){
+    calibration_reset_requested = 1;
+    calibrating = 1;
+}
+
+
+uint8_t sticks_calibrate_end(uint8_t save){
+    calibrating = 0;
+    stick_state copy;
+    if (calibration_reset_requested || read_state(&copy) != 0){
+        return 1;
+    }
+
+    sticks_calibration calibration[STICKS_MAX_CHANNELS];
+    for (uint8_t i=0; i<copy.num_sticks; i++){
+        calibration[i].min = copy.travel_min[i];
+        calibration[i].center = (uint16_t)lrintf(copy.raw[i]);
+        calibration[i].max = copy.travel_max[i];
+        if (!calibration_valid(&calibration[i])){
+            return 1;
+        }
+    }
+    memcpy(settings.calibration, calibration, copy.num_sticks * sizeof(sticks_calibration));
+    publish_settings();
+
+    if (save){
+        return save_calibration();
+    }
+    return 0;
+}
+
+
+void sticks_get_calibration(uint8_t channel, sticks_calibration* calibration){
+    if (channel >= STICKS_MAX_CHANNELS){
+        memset(calibration, 0, sizeof(sticks_calibration));
+        return;
+    }
+    *calibration = settings.calibration[channel];
+}
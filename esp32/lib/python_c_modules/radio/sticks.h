@@ -0,0 +1,90 @@
+#ifndef __sticks_h__
+#define __sticks_h__
+
+#include <stdint.h>
+
+// Turns the stick ADCs into ready to send channel values, off the python
+// loop. An esp_timer samples every stick at STICKS_DEFAULT_SAMPLE_HZ and
+// averages the last few samples of each (oversampling), then:
+//  - scales it to -1..1 from the min/center/max calibration, which is kept
+//    in NVS so it survives a reboot
+//  - applies a deadband around center
+//  - looks the result up in an expo/dual rate curve table
+// The result is published as int16 channel values, ordered by the channel
+// map. While the radio tasks send control packets at a fixed rate they send
+// these directly, so the sticks reach the air without going through python
+// at all. Python sends the same ones, so both paths agree on which stick is
+// which channel.
+
+#define STICKS_MAX_CHANNELS 8
+#define STICKS_DEFAULT_SAMPLE_HZ 1000
+#define STICKS_DEFAULT_OVERSAMPLE 16  // Samples averaged. Lags the stick by half this many samples
+#define STICKS_MAX_OVERSAMPLE 64
+#define STICKS_CURVE_POINTS 33  // Curve table entries for 0..1, interpolated between
+#define STICKS_ADC_MAX 4095
+#define STICKS_MIN_SPAN 200  // Calibrations with less travel than this either side of center are refused
+
+
+typedef struct {
+    uint16_t min;
+    uint16_t center;
+    uint16_t max;
+} sticks_calibration;
+
+
+/*
+ * Starts sampling the sticks on the given ADC1 pins (32-39). Channel i comes
+ * from pins[i]. Loads the calibration from NVS, or centers each stick where
+ * it is if there isn't one. Returns nonzero if a pin isn't an ADC1 pin or
+ * the timer couldn't be started.
+ */
+uint8_t sticks_start(const uint8_t pins[], uint8_t num_channels, uint16_t sample_hz, uint8_t oversample);
+
+void sticks_stop(void);
+
+uint8_t sticks_running(void);
+
+/*
+ * Sets a channels curve. The deadband (0..1) is the stick travel around
+ * center that reads as 0. expo (0..1) softens the response around center
+ * and rate (0..1) scales the whole output, for dual rates. Returns nonzero
+ * if the channel is out of range.
+ */
+uint8_t sticks_set_curve(uint8_t channel, float deadband, float expo, float rate);
+
+/*
+ * Sets which stick each channel is sent from: channel i is the stick on
+ * pins[sticks[i]] in sticks_start. Until this is called the channels are in
+ * pin order. Returns nonzero if a stick is out of range.
+ */
+uint8_t sticks_set_map(const uint8_t sticks[], uint8_t num_channels);
+
+/*
+ * Copies out the latest channel values, in channel map order, ready to
+ * send. Returns the number of channels, or 0 if the sticks aren't running.
+ */
+uint8_t sticks_get_channels(int16_t channels[STICKS_MAX_CHANNELS]);
+
+/* The same values in pin order. Returns the number of sticks */
+uint8_t sticks_get_sticks(int16_t sticks[STICKS_MAX_CHANNELS]);
+
+/* The latest oversampled ADC readings, before calibration */
+uint8_t sticks_get_raw(float raw[STICKS_MAX_CHANNELS]);
+
+/*
+ * Starts recording how far each stick moves. Move every stick through its
+ * full travel, let them go back to center, then call sticks_calibrate_end.
+ */
+void sticks_calibrate_begin(void);
+
+/*
+ * Takes the center from where the sticks are now and the min and max from
+ * the travel seen since sticks_calibrate_begin, and saves them to NVS if
+ * save is set. Returns nonzero and keeps the old calibration if a stick
+ * didn't move far enough both ways.
+ */
+uint8_t sticks_calibrate_end(uint8_t save);
+
+void sticks_get_calibration(uint8_t channel, sticks_calibration* calibration);
+
+#endif
@@ -0,0 +1,91 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "telemetry_store.h"
+
+
+static telemetry_entry store[TELEMETRY_STORE_SIZE];
+
+// The store is written from the RX path and read from python
+static portMUX_TYPE store_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static uint32_t hash_name(const uint8_t name[], uint8_t name_len){
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (uint8_t i=0; i<name_len; i++){
+        hash ^= name[i];
+        hash *= 16777619u;
+    }
+    if (hash == 0){
+        hash = 1;  // 0 is reserved for empty slots
+    }
+    return hash;
+}
+
+
+void telemetry_store_clear(void){
+    portENTER_CRITICAL(&store_lock);
+    memset(store, 0, sizeof(store));
+    portEXIT_CRITICAL(&store_lock);
+}
+
+
+void telemetry_store_update(const uint8_t name[], uint8_t name_len, telemetry_status status, float value, uint32_t now_ms){
+    if (name_len > TRANCEIVER_MAX_NAME_LENGTH){
+        name_len = TRANCEIVER_MAX_NAME_LENGTH;
+    }
+    uint32_t hash = hash_name(name, name_len);
+
+    portENTER_CRITICAL(&store_lock);
+    telemetry_entry* entry = NULL;
+    telemetry_entry* oldest = NULL;
+    uint8_t found = 0;
+    for (uint8_t i=0; i<TELEMETRY_STORE_MAX_PROBE; i++){
+        telemetry_entry* slot = &store[(hash + i) & (TELEMETRY_STORE_SIZE - 1)];
+        if (slot->hash == hash && slot->name_len == name_len && memcmp(slot->name, name, name_len) == 0){
+            entry = slot;
+            found = 1;
+            break;
+        }
+        if (slot->hash == 0){
+            // Nothing further along the probe sequence, so it's a new channel
+            entry = slot;
+            break;
+        }
+        if (oldest == NULL || (now_ms - slot->updated_ms) > (now_ms - oldest->updated_ms)){
+            oldest = slot;
+        }
+    }
+    if (entry == NULL){
+        entry = oldest;
+    }
+    if (!found){
+        memset(entry, 0, sizeof(telemetry_entry));
+        entry->hash = hash;
+        memcpy(entry->name, name, name_len);
+        entry->name_len = name_len;
+    }
+    entry->status = status;
+    entry->value = value;
+    entry->updated_ms = now_ms;
+    entry->updates += 1;
+    entry->dirty = 1;
+    portEXIT_CRITICAL(&store_lock);
+}
+
+
+uint8_t telemetry_store_snapshot(telemetry_entry out[], uint8_t max_entries, uint8_t dirty_only){
+    uint8_t count = 0;
+    portENTER_CRITICAL(&store_lock);
+    for (uint16_t i=0; i<TELEMETRY_STORE_SIZE && count < max_entries; i++){
+        telemetry_entry* entry = &store[i];
+        if (entry->hash != 0 && (entry->dirty || !dirty_only)){
+            out[count] = *entry;
+            entry->dirty = 0;
+            count += 1;
+        }
+    }
+    portEXIT_CRITICAL(&store_lock);
+    return count;
+}
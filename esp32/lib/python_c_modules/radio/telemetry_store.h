@@ -0,0 +1,48 @@
+#ifndef __telemetry_store_h__
+#define __telemetry_store_h__
+
+#include <stdint.h>
+#include "tranceiver.h"
+
+// The latest value of every telemetry channel the far end sends, updated
+// straight from the RX path so python never has to decode telemetry packets.
+// Entries live in a fixed size open-addressed hash table keyed by a hash of
+// the channel name, with bounded probing like the device table, so storing a
+// value costs the same however many channels there are and never allocates.
+//
+// Each entry is marked dirty when it changes, so python can read just the
+// channels that have been updated since it last looked.
+
+#define TELEMETRY_STORE_SIZE 32  // Must be a power of two
+#define TELEMETRY_STORE_MAX_PROBE 8
+
+
+typedef struct {
+    uint32_t hash;  // 0 means the slot has never been used
+    char name[TRANCEIVER_MAX_NAME_LENGTH];
+    uint8_t name_len;
+    telemetry_status status;
+    float value;
+    uint32_t updated_ms;
+    uint32_t updates;
+    uint8_t dirty;
+} telemetry_entry;
+
+
+/* Forget every channel, eg when connecting to a different receiver */
+void telemetry_store_clear(void);
+
+/*
+ * Records a telemetry value. If the table is full, the channel updated least
+ * recently is replaced.
+ */
+void telemetry_store_update(const uint8_t name[], uint8_t name_len, telemetry_status status, float value, uint32_t now_ms);
+
+/*
+ * Copies the channels into out and marks them clean. With dirty_only, only
+ * the channels updated since they were last copied out. Returns the number
+ * of entries copied (at most max_entries)
+ */
+uint8_t telemetry_store_snapshot(telemetry_entry out[], uint8_t max_entries, uint8_t dirty_only);
+
+#endif
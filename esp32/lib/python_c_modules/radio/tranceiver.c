@@ -9,8 +9,26 @@
 #include "driver/gpio.h"
 #include "sdkconfig.h"
 #include "lwip/err.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
 
 #include "tranceiver.h"
+#include "device_table.h"
+#include "telemetry_store.h"
+#include "power_control.h"
+#include "duty_cycle.h"
+#include "clock_sync.h"
+#include "phy_rate.h"
+#include "bulk.h"
+#include "radio_tasks.h"
+#include "congestion.h"
+#include "health.h"
+#include "lockfree.h"
+#include "group.h"
+#include "relay.h"
+#include "sequence.h"
+#include "auth.h"
+#include "bind.h"
 
 
 /* Parameters for the transmitter */
@@ -22,8 +40,34 @@
 
 
 static uint8_t filter_by_id = 1;
-uint8_t last_sent_packet_count = 0;
-static QueueHandle_t rx_packet_queue;
+static uint8_t current_channel = DEFAULT_WIFI_CHANNEL;
+static uint8_t timestamps_enabled = 0;
+static int8_t applied_power = DEFAULT_TRANSMIT_POWER;
+static uint32_t last_sent_airtime_us = 0;
+static phy_rate default_rate = PHY_RATE_DEFAULT;
+static phy_rate applied_rate = PHY_RATE_DEFAULT;
+static uint8_t long_range_enabled = 0;
+
+// Link quality of the packets we receive, reported back to the far end
+static int8_t last_rx_rssi = 0;
+static uint32_t last_rx_ms = 0;
+static uint32_t last_link_sent_ms = 0;
+
+// While simulating the medium, frames only come from tranceiver_inject_frame
+static volatile uint8_t simulated_medium = 0;
+static volatile uint32_t callbacks_active = 0;
+
+// The next Pcnt of each stream we send
+static uint8_t sent_counts[SEQUENCE_STREAM_COUNT] = {0};
+static uint8_t injected_counts[SEQUENCE_STREAM_COUNT] = {0};
+
+// Sequence windows for the streams we receive. Only touched by the RX path,
+// which resets them when asked
+static sequence_window rx_windows[SEQUENCE_STREAM_COUNT];
+static volatile uint8_t rx_windows_reset = 1;
+
+// Control packets checked against the key for the receiver (bind.h)
+static auth_stats auth_results;
 
 
 uint8_t packet_header[] = {
@@ -44,11 +88,55 @@ uint8_t packet_header[] = {
 #define PACKET_COUNT_OFFSET 22
 #define PACKET_TYPE_OFFSET 23
 #define DATA_1_OFFSET 10
+#define INJECTED_NOISE_FLOOR -95
+#define MIN_TRAILED_DATA 8  // Short packets are padded to this before a timestamp or tag
 
 
 static uint8_t tx_packet_buffer[sizeof(packet_header) + TRANCEIVER_MAX_PACKET_BYTES] = {0};
-uint8_t rx_packet_buffer[sizeof(packet_stats) + TRANCEIVER_MAX_PACKET_BYTES] = {0};
-uint8_t rx_packet_out_buff[sizeof(packet_stats) + TRANCEIVER_MAX_PACKET_BYTES] = {0};
+
+// The last frame injected, for tranceiver_inject_repeat
+static uint8_t injected_frame[sizeof(packet_header) + TRANCEIVER_MAX_PACKET_BYTES + 4];
+static uint16_t injected_frame_len = 0;
+
+// Metadata and data continuous in memory
+typedef struct {
+    packet_stats stats;
+    uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+} rx_packet;
+
+// Received packets waiting for python. Filled by the wifi callback, or the
+// RX task when the radio tasks are running.
+#define RX_PACKET_SLOTS 4
+static rx_packet rx_packets[RX_PACKET_SLOTS];
+static spsc_ring rx_packet_ring = SPSC_RING_INIT(RX_PACKET_SLOTS);
+
+
+// Our rate numbering to the SDKs
+static const wifi_phy_rate_t sdk_rates[PHY_RATE_COUNT] = {
+    [PHY_RATE_DEFAULT] = WIFI_PHY_RATE_1M_L,
+    [PHY_RATE_1M] = WIFI_PHY_RATE_1M_L,
+    [PHY_RATE_2M] = WIFI_PHY_RATE_2M_L,
+    [PHY_RATE_5M5] = WIFI_PHY_RATE_5M_L,
+    [PHY_RATE_11M] = WIFI_PHY_RATE_11M_L,
+    [PHY_RATE_6M] = WIFI_PHY_RATE_6M,
+    [PHY_RATE_9M] = WIFI_PHY_RATE_9M,
+    [PHY_RATE_12M] = WIFI_PHY_RATE_12M,
+    [PHY_RATE_18M] = WIFI_PHY_RATE_18M,
+    [PHY_RATE_24M] = WIFI_PHY_RATE_24M,
+    [PHY_RATE_36M] = WIFI_PHY_RATE_36M,
+    [PHY_RATE_48M] = WIFI_PHY_RATE_48M,
+    [PHY_RATE_54M] = WIFI_PHY_RATE_54M,
+    [PHY_RATE_MCS0] = WIFI_PHY_RATE_MCS0_LGI,
+    [PHY_RATE_MCS1] = WIFI_PHY_RATE_MCS1_LGI,
+    [PHY_RATE_MCS2] = WIFI_PHY_RATE_MCS2_LGI,
+    [PHY_RATE_MCS3] = WIFI_PHY_RATE_MCS3_LGI,
+    [PHY_RATE_MCS4] = WIFI_PHY_RATE_MCS4_LGI,
+    [PHY_RATE_MCS5] = WIFI_PHY_RATE_MCS5_LGI,
+    [PHY_RATE_MCS6] = WIFI_PHY_RATE_MCS6_LGI,
+    [PHY_RATE_MCS7] = WIFI_PHY_RATE_MCS7_LGI,
+    [PHY_RATE_LR_250K] = WIFI_PHY_RATE_LORA_250K,
+    [PHY_RATE_LR_500K] = WIFI_PHY_RATE_LORA_500K,
+};
 
 
 uint16_t min_16(uint16_t a, uint16_t b){
@@ -69,100 +157,373 @@ static void print_buffer(const uint8_t* buff, uint16_t len){
 
 void tranceiver_set_channel(uint8_t channel){
 	esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+	current_channel = channel;
 }
 
 
 void tranceiver_set_power(int8_t power){
 	esp_wifi_set_max_tx_power(power);
+	applied_power = power;
+	power_control_init(power);
+}
+
+
+void tranceiver_enable_long_range(uint8_t enabled){
+    // Keep b/g/n on so we can still hear receivers that aren't using it
+    uint8_t protocols = WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N;
+    if (enabled){
+        protocols |= WIFI_PROTOCOL_LR;
+    }
+    esp_wifi_set_protocol(ESP_IF_WIFI_STA, protocols);
+    long_range_enabled = enabled;
+}
+
+
+uint8_t tranceiver_set_phy_rate(uint8_t rate){
+    if (rate >= PHY_RATE_COUNT){
+        return 1;
+    }
+    default_rate = rate;
+    return 0;
+}
+
+
+static void apply_phy_rate(phy_rate rate){
+    if (rate == applied_rate){
+        return;
+    }
+    if (phy_rate_is_long_range(rate) && !long_range_enabled){
+        tranceiver_enable_long_range(1);
+    }
+    esp_wifi_internal_set_fix_rate(ESP_IF_WIFI_STA, rate != PHY_RATE_DEFAULT, sdk_rates[rate]);
+    applied_rate = rate;
 }
 
 
 void tranceiver_set_id(const uint8_t id_bytes[6]){
-    uint8_t i = 0;
-    for (i=0; i<12; i+=1){
-        packet_header[ID_OFFSET + i] = id_bytes[i%6];
+    // Only the recipient address. The next six bytes are data.
+    if (memcmp(packet_header + ID_OFFSET, id_bytes, ID_LENGTH) != 0){
+        // A different receiver numbers its packets separately
+        __atomic_store_n(&rx_windows_reset, 1, __ATOMIC_SEQ_CST);
     }
+    memcpy(packet_header + ID_OFFSET, id_bytes, ID_LENGTH);
+}
+
+const uint8_t* tranceiver_get_id(void){
+    return packet_header + ID_OFFSET;
 }
 
 void tranceiver_enable_filter_by_id(uint8_t enabled){
   filter_by_id = enabled;
 }
 
+void tranceiver_enable_timestamps(uint8_t enabled){
+  timestamps_enabled = enabled;
+}
 
-static void _handle_data_packet(void* buff, wifi_promiscuous_pkt_type_t type) {
-	/* Runs whenever there is an incoming packet */
-	const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buff;
+void tranceiver_get_link_stats(sequence_stream_id stream, sequence_stats* stats){
+    if (stream >= SEQUENCE_STREAM_COUNT){
+        memset(stats, 0, sizeof(sequence_stats));
+        return;
+    }
+    memcpy(stats, &rx_windows[stream].stats, sizeof(sequence_stats));
+}
+
+void tranceiver_get_auth_stats(auth_stats* stats){
+    memcpy(stats, &auth_results, sizeof(auth_stats));
+}
+
+
+static void process_frame(const uint8_t payload[], uint16_t sig_len, int8_t rssi, int8_t noise_floor, uint32_t now_us){
+    // Repeat it if we are relaying for its receiver, and ignore copies of
+    // frames we have already had from a relay
+    if (relay_receive(payload, sig_len - 4, now_us) != 0){
+        return;
+    }
+
+    uint32_t now_ms = now_us / 1000;
+    uint8_t packet_type = payload[PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK;
+    uint8_t packet_flags = payload[PACKET_TYPE_OFFSET] & ~PACKET_TYPE_MASK;
+    sequence_stream_id stream = sequence_stream_for(packet_type);
+
+    // Keep track of every receiver on the channel, whichever one we are
+    // talking to.
+    if (packet_type == PACKET_NAME){
+        if (memcmp(payload+ID_OFFSET, payload+DATA_1_OFFSET, ID_LENGTH) == 0){
+            uint16_t name_len = sig_len - sizeof(packet_header) - 4 + 12 - ID_LENGTH;
+            if (name_len <= TRANCEIVER_MAX_NAME_LENGTH){
+                // The name starts in the header and continues after it
+                uint8_t name[TRANCEIVER_MAX_NAME_LENGTH] = {0};
+                uint8_t in_header = 12 - ID_LENGTH;
+                memcpy(name, payload+DATA_1_OFFSET+ID_LENGTH, min_16(name_len, in_header));
+                if (name_len > in_header){
+                    memcpy(name + in_header, payload+sizeof(packet_header), name_len - in_header);
+                }
+                device_table_handle_name(
+                    payload+ID_OFFSET, name, name_len,
+                    rssi, now_ms
+                );
+            }
+        }
+    } else if (packet_type == PACKET_TELEMETRY){
+        device_table_handle_telemetry(
+            payload+ID_OFFSET,
+            rssi, payload[PACKET_COUNT_OFFSET], now_ms
+        );
+    }
 
     //  Ensure the first two mac addresses are the same. This means it is not
     // and 802.11 packet, but is one of ours.
 
     /* Check that the ID matches what we expect */
-	if (filter_by_id){
-		if (memcmp(packet_header+ID_OFFSET, (ppkt->payload)+ID_OFFSET, ID_LENGTH) != 0) {
+    if (packet_type == PACKET_GROUP){
+        // Sent to the group ID instead, which is checked with our slice
+    } else if (filter_by_id){
+		if (memcmp(packet_header+ID_OFFSET, payload+ID_OFFSET, ID_LENGTH) != 0) {
 			return;
 		}
     } else {
-        if (memcmp((ppkt->payload)+ID_OFFSET, ((ppkt->payload)+ID_OFFSET+ID_LENGTH), ID_LENGTH) != 0){
+        if (memcmp(payload+ID_OFFSET, (payload+ID_OFFSET+ID_LENGTH), ID_LENGTH) != 0){
             // Reject non-name packets
             return;
         }
     }
 
-	uint16_t data_len = ppkt->rx_ctrl.sig_len - sizeof(packet_header) - 4 + 12;  //magic numbers is 4=crc bytes 12=data bytes in header
-	if (data_len > TRANCEIVER_MAX_PACKET_BYTES){
+	uint16_t data_len = sig_len - sizeof(packet_header) - 4 + 12;  //magic numbers is 4=crc bytes 12=data bytes in header
+	if (data_len < 12 || data_len > TRANCEIVER_MAX_PACKET_BYTES){
 		return;
 	}
 
-	// Make metadata and data continuous in memory
-    packet_stats* this_packet = (packet_stats*)&rx_packet_buffer;
+    rx_packet packet;
+    packet_stats* this_packet = &packet.stats;
     this_packet->packet_type = PACKET_NONE;
-	this_packet->rssi = ppkt->rx_ctrl.rssi;
-	this_packet->noise_floor = ppkt->rx_ctrl.noise_floor;
-	this_packet->packet_len = data_len;
-    this_packet->packet_id = ppkt->payload[PACKET_COUNT_OFFSET];
-    this_packet->packet_type = (uint8_t)ppkt->payload[PACKET_TYPE_OFFSET];
+	this_packet->rssi = rssi;
+	this_packet->noise_floor = noise_floor;
+    this_packet->packet_id = payload[PACKET_COUNT_OFFSET];
+    this_packet->packet_type = (packet_types)packet_type;
+    this_packet->rx_time_us = now_us;
     memcpy(
         this_packet->source_id,
-        (ppkt->payload)+ID_OFFSET,
+        payload+ID_OFFSET,
         6
     );
 
     // The first 12 bytes are part of the header
     memcpy(
-		rx_packet_buffer + sizeof(packet_stats),
-		(ppkt->payload)+DATA_1_OFFSET,
+		packet.data,
+		payload+DATA_1_OFFSET,
 		12
 	);
 
     // The rest of the data is after the header
 	memcpy(
-		rx_packet_buffer + sizeof(packet_stats) + 12,
-		(ppkt->payload)+sizeof(packet_header),
-		data_len
+		packet.data + 12,
+		payload+sizeof(packet_header),
+		data_len - 12
 	);
-    if (rx_packet_queue != NULL){
-        xQueueSend(
-            rx_packet_queue,
-            rx_packet_buffer,
-            0
-        );
+
+    // Once bound to a transmitter, only control packets signed with its key
+    // get through. Group packets can't be signed for each member, so none
+    // do. Checked before the sequence window, so a forged Pcnt can't push
+    // the real ones out of it
+    auth_key_state key;
+    if ((packet_type == PACKET_CONTROL || packet_type == PACKET_GROUP) && bind_get_key(packet_header + ID_OFFSET, &key)){
+        if (packet_type == PACKET_GROUP || !(packet_flags & PACKET_FLAG_AUTH)){
+            auth_results.unsigned_rejected += 1;
+            return;
+        }
+        uint8_t signed_header[AUTH_HEADER_BYTES];
+        auth_frame_header(signed_header, payload + ID_OFFSET, payload[PACKET_COUNT_OFFSET], payload[PACKET_TYPE_OFFSET]);
+        if (data_len < AUTH_TRAILER_BYTES || !auth_verify(&key, signed_header, packet.data, data_len)){
+            auth_results.bad_tag += 1;
+            return;
+        }
+        // A recorded copy has a good tag too, but not a new counter
+        uint32_t auth_counter;
+        memcpy(&auth_counter, packet.data + data_len - AUTH_TRAILER_BYTES, AUTH_COUNTER_BYTES);
+        uint8_t taken = bind_accept_counter(payload + ID_OFFSET, auth_counter);
+        if (taken == BIND_COUNTER_REPLAYED){
+            auth_results.replayed += 1;
+            return;
+        }
+        if (taken == BIND_COUNTER_EARLY){
+            auth_results.early += 1;
+            return;
+        }
+        auth_results.verified += 1;
+        bind_authenticated(payload + ID_OFFSET);
+    }
+
+    // A signed packet ends with the counter and tag, and a timestamp goes
+    // just before them. Only control packets are ever signed
+    uint16_t trailer_len = 0;
+    if (packet_flags & PACKET_FLAG_AUTH){
+        if (packet_type != PACKET_CONTROL){
+            return;
+        }
+        trailer_len += AUTH_TRAILER_BYTES;
+    }
+    if (packet_flags & PACKET_FLAG_TIMESTAMP){
+        trailer_len += 4;
+    }
+    if (data_len < trailer_len){
+        return;
+    }
+    data_len -= trailer_len;
+    const uint8_t* data = packet.data;
+    this_packet->tx_timestamp = 0;
+    this_packet->latency_us = CLOCK_SYNC_LATENCY_UNKNOWN;
+    if (packet_flags & PACKET_FLAG_TIMESTAMP){
+        memcpy(&this_packet->tx_timestamp, data + data_len, 4);
+        if (packet_type == PACKET_CONTROL || packet_type == PACKET_GROUP){
+            this_packet->latency_us = clock_sync_packet_latency(this_packet->tx_timestamp, now_us);
+        } else if (packet_type == PACKET_TELEMETRY){
+            clock_sync_handle_request(this_packet->tx_timestamp, now_us);
+        }
+    }
+
+    // Only our slice of a group packet goes any further, as a control packet
+    if (packet_type == PACKET_GROUP){
+        uint16_t slice_offset = 0;
+        uint16_t slice_len = group_find_slice(payload+ID_OFFSET, data, data_len, &slice_offset);
+        if (slice_len == 0){
+            return;
+        }
+        memmove(packet.data, packet.data + slice_offset, slice_len);
+        data_len = slice_len;
+        packet_type = PACKET_CONTROL;
+        this_packet->packet_type = PACKET_CONTROL;
+    }
+	this_packet->packet_len = data_len;
+
+    // Drop stale and duplicate packets, and control packets older than one
+    // we have already acted on
+    if (__atomic_load_n(&rx_windows_reset, __ATOMIC_SEQ_CST)){
+        for (uint8_t i=0; i<SEQUENCE_STREAM_COUNT; i++){
+            sequence_reset(&rx_windows[i]);
+        }
+        __atomic_store_n(&rx_windows_reset, 0, __ATOMIC_SEQ_CST);
+    }
+    if (stream != SEQUENCE_STREAM_OTHER && (filter_by_id || stream == SEQUENCE_STREAM_GROUP)){
+        sequence_result result = sequence_check(&rx_windows[stream], payload[PACKET_COUNT_OFFSET], now_us, &this_packet->packet_id);
+        if (result == SEQUENCE_STALE || result == SEQUENCE_DUPLICATE){
+            return;
+        }
+        if (packet_type == PACKET_CONTROL && result != SEQUENCE_NEW){
+            return;
+        }
+    }
+
+    last_rx_rssi = rssi;
+    last_rx_ms = now_ms;
+
+    if (packet_type == PACKET_CONTROL){
+        duty_cycle_frame_received(now_us, (uint8_t)this_packet->packet_id);
+    }
+
+    // Link feedback and clock sync are consumed here and never make it to
+    // the queue
+    if (packet_type == PACKET_LINK){
+        power_control_feedback((int8_t)data[0], now_ms);
+        return;
+    }
+    if (packet_type == PACKET_SYNC){
+        clock_sync_handle_reply(data, now_us);
+        return;
+    }
+    if (packet_type == PACKET_BULK){
+        bulk_handle_packet(data, data_len, now_us);
+        return;
+    }
+    if (packet_type == PACKET_BIND){
+        bind_handle_packet(payload + ID_OFFSET, data, data_len, now_ms);
+        return;
+    }
+    if (packet_type == PACKET_TELEMETRY){
+        if (data_len < 5){
+            return;  // Not even the status and value
+        }
+        uint8_t name_len = data_len - 5;
+        while (name_len > 0 && data[5 + name_len - 1] == 0){
+            name_len -= 1;  // Short packets are padded out to fill the header
+        }
+        float value = 0;
+        memcpy(&value, data + 1, sizeof(value));
+        if (name_len == strlen(TELEMETRY_NAME_RSSI) && memcmp(data + 5, TELEMETRY_NAME_RSSI, name_len) == 0){
+            power_control_feedback((int8_t)value, now_ms);
+        }
+        // Python reads telemetry from the store, so it skips the queue
+        telemetry_store_update(data + 5, name_len, (telemetry_status)data[0], value, now_ms);
+        return;
+    }
+
+    if (packet_type == PACKET_CONTROL){
+        radio_tasks_publish_rx_channels((const int16_t*)data, data_len / 2, now_us);
+    }
+
+    // If python isn't keeping up, the newest packets are dropped
+    int32_t slot = spsc_write_slot(&rx_packet_ring);
+    if (slot >= 0){
+        memcpy(&rx_packets[slot], &packet, sizeof(packet_stats) + data_len);
+        spsc_commit_write(&rx_packet_ring);
+    }
+    health_record_queue(HEALTH_QUEUE_RX_PACKETS, spsc_occupancy(&rx_packet_ring));
+}
+
+
+void tranceiver_process_frame(const uint8_t payload[], uint16_t sig_len, int8_t rssi, int8_t noise_floor, uint32_t now_us){
+    process_frame(payload, sig_len, rssi, noise_floor, now_us);
+    health_record_time(HEALTH_TIMING_PROCESS, (uint32_t)esp_timer_get_time() - now_us);
+}
+
+
+static void receive_frame(const uint8_t payload[], uint16_t sig_len, int8_t rssi, int8_t noise_floor){
+    uint32_t now_us = esp_timer_get_time();
+
+    // The RX task does the processing if it is running
+    if (radio_tasks_rx_frame(payload, sig_len, rssi, noise_floor, now_us) != 0){
+        tranceiver_process_frame(payload, sig_len, rssi, noise_floor, now_us);
+    }
+    health_record_time(HEALTH_TIMING_CALLBACK, (uint32_t)esp_timer_get_time() - now_us);
+}
+
+
+static void _handle_data_packet(void* buff, wifi_promiscuous_pkt_type_t type) {
+	/* Runs whenever there is an incoming packet */
+	const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buff;
+    __atomic_add_fetch(&callbacks_active, 1, __ATOMIC_SEQ_CST);
+    if (!__atomic_load_n(&simulated_medium, __ATOMIC_SEQ_CST)){
+        receive_frame(ppkt->payload, ppkt->rx_ctrl.sig_len, ppkt->rx_ctrl.rssi, ppkt->rx_ctrl.noise_floor);
+    }
+    __atomic_sub_fetch(&callbacks_active, 1, __ATOMIC_SEQ_CST);
+}
+
+
+void tranceiver_simulate_medium(uint8_t enabled){
+    __atomic_store_n(&simulated_medium, enabled, __ATOMIC_SEQ_CST);
+    // Wait for any real frame part way through, so the receive path only
+    // ever has one producer
+    while (__atomic_load_n(&callbacks_active, __ATOMIC_SEQ_CST) != 0){
+        vTaskDelay(1);
     }
 }
 
 void tranceiver_get_latest_packet(uint8_t buff[], packet_stats* stats){
-    if (xQueueReceive(rx_packet_queue, &rx_packet_out_buff, 0) == pdTRUE){
-        packet_stats* this_packet = (packet_stats*)&rx_packet_buffer;
+    int32_t slot = spsc_read_slot(&rx_packet_ring);
+    if (slot >= 0){
+        const rx_packet* packet = &rx_packets[slot];
         memcpy(
             stats,
-            this_packet,
+            &packet->stats,
             sizeof(packet_stats)
         );
 
         memcpy(
             buff,
-            rx_packet_buffer + sizeof(packet_stats),
-            min_16(this_packet->packet_len, TRANCEIVER_MAX_PACKET_BYTES)
+            packet->data,
+            min_16(packet->stats.packet_len, TRANCEIVER_MAX_PACKET_BYTES)
         );
+        spsc_commit_read(&rx_packet_ring);
     } else {
         stats->packet_len = 0;
     }
@@ -171,13 +532,11 @@ void tranceiver_get_latest_packet(uint8_t buff[], packet_stats* stats){
 
 void tranceiver_init(void){
 	wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    cfg.dynamic_tx_buf_num = 16;
+    cfg.dynamic_tx_buf_num = CONGESTION_TX_BUFFERS;
 	ESP_ERROR_CHECK( esp_wifi_init(&cfg) );
 	ESP_ERROR_CHECK( esp_wifi_set_mode(WIFI_MODE_STA) );
 	ESP_ERROR_CHECK( esp_wifi_start() );
 
-    rx_packet_queue = xQueueCreate(2, sizeof(rx_packet_buffer));
-
 	//Set up a callback to be called whenever packets arrive.
 	esp_wifi_set_promiscuous(true);
 	wifi_promiscuous_filter_t filter;
@@ -188,48 +547,263 @@ void tranceiver_init(void){
 
 	tranceiver_set_channel(DEFAULT_WIFI_CHANNEL);
 	tranceiver_set_power(DEFAULT_TRANSMIT_POWER);
+	bind_init();
 }
 
 
 
-static uint8_t tranceiver_send_packet(const packet_types packet_type, const uint8_t data[], const uint16_t data_len){
+void tranceiver_sleep(uint32_t us){
+    // Light sleep doesn't keep the wifi running, so stop it and bring it
+    // back up on the same channel afterwards.
+    esp_wifi_stop();
+    esp_sleep_enable_timer_wakeup(us);
+    esp_light_sleep_start();
+    esp_wifi_start();
+
+    esp_wifi_set_promiscuous(true);
+    esp_wifi_set_channel(current_channel, WIFI_SECOND_CHAN_NONE);
+    esp_wifi_set_max_tx_power(applied_power);
+    if (long_range_enabled){
+        tranceiver_enable_long_range(1);
+    }
+    if (applied_rate != PHY_RATE_DEFAULT){
+        esp_wifi_internal_set_fix_rate(ESP_IF_WIFI_STA, true, sdk_rates[applied_rate]);
+    }
+}
+
+
+
+/*
+ * Fills out a frame with our header and the data. Returns its length,
+ * without the CRC the wifi stack adds.
+ */
+static uint16_t build_frame(uint8_t frame[], uint8_t packet_count, uint8_t type_byte, const uint8_t payload[], uint16_t payload_len){
     // Copy in header
-	memcpy(&tx_packet_buffer, &packet_header, sizeof(packet_header));
+	memcpy(frame, packet_header, sizeof(packet_header));
 
     // Copy in data
     uint16_t i = 0;
     uint16_t extra_bytes = 0; // Number bytes greater than the packet size
-    for (i=0; i < data_len; i++){
+    for (i=0; i < payload_len; i++){
         if (i < 12){ //First 12 bytes go into header
-            tx_packet_buffer[DATA_1_OFFSET + i] = data[i];
+            frame[DATA_1_OFFSET + i] = payload[i];
         } else {  //The remaining data goes at teh end
-            tx_packet_buffer[sizeof(packet_header) + (i - 12)] = data[i];
+            frame[sizeof(packet_header) + (i - 12)] = payload[i];
             extra_bytes += 1;
         }
     }
 
     // Set metadata
-    tx_packet_buffer[PACKET_COUNT_OFFSET] = last_sent_packet_count;
-    last_sent_packet_count += 1;
-    tx_packet_buffer[PACKET_TYPE_OFFSET] = (uint8_t)packet_type;
+    frame[PACKET_COUNT_OFFSET] = packet_count;
+    frame[PACKET_TYPE_OFFSET] = type_byte;
+    return sizeof(packet_header) + extra_bytes;
+}
+
+
+/*
+ * Hands a finished frame to the wifi stack, at the power and rate for the
+ * receiver it is addressed to
+ */
+static uint8_t transmit(const uint8_t frame[], uint16_t frame_len, uint32_t now_us){
+    int8_t power = power_control_update(now_us / 1000);
+    if (power != applied_power){
+        esp_wifi_set_max_tx_power(power);
+        applied_power = power;
+    }
+
+    // Receivers with their own profile override the default rate
+    phy_rate rate = default_rate;
+    phy_profile profile = phy_rate_get_profile(frame + ID_OFFSET);
+    if (profile != PHY_PROFILE_DEFAULT){
+        rate = phy_rate_for_profile(profile);
+    }
+    apply_phy_rate(rate);
+
+    //print_buffer(frame, frame_len);
 
-    //print_buffer(tx_packet_buffer, sizeof(packet_header) + extra_bytes);
+    // So we ignore it if a relay sends it back to us
+    relay_sent(frame, frame_len, now_us);
 
-    return esp_wifi_80211_tx(
+    last_sent_airtime_us = phy_rate_airtime_us(applied_rate, frame_len);
+    esp_err_t res = esp_wifi_80211_tx(
 		ESP_IF_WIFI_STA,
-		(void*)&tx_packet_buffer, sizeof(packet_header) + extra_bytes,
+		(void*)frame, frame_len,
 		false
 	);
+    congestion_sent(res, last_sent_airtime_us, now_us);
+    health_record_time(HEALTH_TIMING_SEND, (uint32_t)esp_timer_get_time() - now_us);
+    if (res != ESP_OK){
+        return TRANCEIVER_TX_FAILED;
+    }
+    return TRANCEIVER_TX_OK;
+}
+
+
+/*
+ * Appends the next signing counter and the tag for a frame to its payload
+ * (which must have room for them). Returns the new length, or 0 if there
+ * is no counter to sign with.
+ */
+static uint16_t sign_payload(const auth_key_state* key, uint8_t payload[], uint16_t payload_len, const uint8_t id[ID_LENGTH], uint8_t packet_count, uint8_t type_byte){
+    uint32_t auth_counter;
+    if (bind_next_counter(&auth_counter) != 0){
+        return 0;
+    }
+    if (payload_len < MIN_TRAILED_DATA){
+        payload_len = MIN_TRAILED_DATA;
+    }
+    memcpy(payload + payload_len, &auth_counter, AUTH_COUNTER_BYTES);
+    payload_len += AUTH_COUNTER_BYTES;
+    uint8_t signed_header[AUTH_HEADER_BYTES];
+    auth_frame_header(signed_header, id, packet_count, type_byte);
+    uint32_t tag = auth_tag(key, signed_header, payload, payload_len);
+    memcpy(payload + payload_len, &tag, AUTH_TAG_BYTES);
+    return payload_len + AUTH_TAG_BYTES;
+}
+
+
+uint8_t tranceiver_send_packet_now(const packet_types packet_type, const uint8_t data[], const uint16_t data_len){
+    uint32_t now_us = esp_timer_get_time();
+
+    // Group packets go to the group rather than the receiver
+    uint8_t address[ID_LENGTH];
+    memcpy(address, packet_header + ID_OFFSET, ID_LENGTH);
+    if (packet_type == PACKET_GROUP){
+        group_get_id(address);
+    }
+
+    // Control packets for a receiver we are bound to are signed, with room
+    // kept for the counter and tag. Anything that doesn't fit is refused
+    // rather than cut short, before it can use up any of the send rate
+    auth_key_state key;
+    uint8_t sign = packet_type == PACKET_CONTROL && bind_get_key(address, &key);
+    uint16_t max_len = sign ? TRANCEIVER_MAX_PACKET_BYTES - AUTH_TRAILER_BYTES : TRANCEIVER_MAX_PACKET_BYTES;
+    if (data_len > max_len){
+        congestion_refused();
+        return TRANCEIVER_TX_FAILED;
+    }
+    if (congestion_admit(congestion_priority(packet_type), now_us) != 0){
+        return TRANCEIVER_TX_SHED;
+    }
+
+    uint8_t payload[TRANCEIVER_MAX_PACKET_BYTES] = {0};
+    uint16_t payload_len = data_len;
+    memcpy(payload, data, payload_len);
+
+    uint8_t packet_flags = 0;
+    if (timestamps_enabled && (packet_type == PACKET_CONTROL || packet_type == PACKET_GROUP || packet_type == PACKET_TELEMETRY) && payload_len + 4 <= max_len){
+        // The timestamp has to be the last four bytes (before any tag), and
+        // short packets are padded out to fill the header anyway.
+        if (payload_len < MIN_TRAILED_DATA){
+            payload_len = MIN_TRAILED_DATA;
+        }
+        memcpy(payload + payload_len, &now_us, 4);
+        payload_len += 4;
+        packet_flags |= PACKET_FLAG_TIMESTAMP;
+    }
+
+    uint8_t* count = &sent_counts[sequence_stream_for(packet_type)];
+    if (sign){
+        packet_flags |= PACKET_FLAG_AUTH;
+        payload_len = sign_payload(&key, payload, payload_len, address, *count, (uint8_t)packet_type | packet_flags);
+        if (payload_len == 0){
+            congestion_refused();
+            return TRANCEIVER_TX_FAILED;
+        }
+    }
+    uint16_t frame_len = build_frame(tx_packet_buffer, *count, (uint8_t)packet_type | packet_flags, payload, payload_len);
+    memcpy(tx_packet_buffer + ID_OFFSET, address, ID_LENGTH);
+    *count += 1;
+    return transmit(tx_packet_buffer, frame_len, now_us);
+}
+
+
+uint8_t tranceiver_relay_frame(const uint8_t frame[], uint16_t frame_len){
+    uint32_t now_us = esp_timer_get_time();
+    packet_types packet_type = frame[PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK;
+    if (congestion_admit(congestion_priority(packet_type), now_us) != 0){
+        return TRANCEIVER_TX_SHED;
+    }
+    return transmit(frame, frame_len, now_us);
+}
+
+
+void tranceiver_inject_frame(const uint8_t id_bytes[6], uint8_t packet_type, const uint8_t data[], uint16_t data_len, int8_t rssi){
+    memset(injected_frame, 0, sizeof(injected_frame));
+    uint8_t* count = &injected_counts[sequence_stream_for(packet_type & PACKET_TYPE_MASK)];
+
+    // Signed as the transmitter would if it asks for a tag and we have a key
+    uint8_t payload[TRANCEIVER_MAX_PACKET_BYTES] = {0};
+    uint16_t payload_len = min_16(data_len, TRANCEIVER_MAX_PACKET_BYTES);
+    memcpy(payload, data, payload_len);
+    auth_key_state key;
+    if ((packet_type & PACKET_FLAG_AUTH) && payload_len + AUTH_TRAILER_BYTES <= TRANCEIVER_MAX_PACKET_BYTES && bind_get_key(id_bytes, &key)){
+        uint16_t signed_len = sign_payload(&key, payload, payload_len, id_bytes, *count, packet_type);
+        payload_len = signed_len > 0 ? signed_len : payload_len;
+    }
+    injected_frame_len = build_frame(injected_frame, *count, packet_type, payload, payload_len);
+    *count += 1;
+    memcpy(injected_frame + ID_OFFSET, id_bytes, ID_LENGTH);
+    receive_frame(injected_frame, injected_frame_len + 4, rssi, INJECTED_NOISE_FLOOR);  // The 4 is the CRC
+}
+
+
+void tranceiver_inject_repeat(uint8_t hops, int8_t rssi){
+    if (injected_frame_len == 0){
+        return;
+    }
+    uint8_t frame[sizeof(injected_frame)];
+    memcpy(frame, injected_frame, sizeof(frame));
+    frame[PACKET_TYPE_OFFSET] = (frame[PACKET_TYPE_OFFSET] & ~PACKET_HOPS_MASK) | ((hops << PACKET_HOPS_SHIFT) & PACKET_HOPS_MASK);
+    receive_frame(frame, injected_frame_len + 4, rssi, INJECTED_NOISE_FLOOR);
+}
+
+
+static uint8_t tranceiver_send_packet(const packet_types packet_type, const uint8_t data[], const uint16_t data_len){
+    // Only the TX task sends while the radio tasks are running
+    if (radio_tasks_owns_tx()){
+        return radio_tasks_queue_tx(packet_type, data, data_len);
+    }
+    return tranceiver_send_packet_now(packet_type, data, data_len);
 }
 
 
 uint8_t telemetry_buffer[sizeof(telemetry_packet)] = {0};
+/*
+ * Tells the far end how well we can hear it so it can adjust its power, at
+ * most every POWER_CONTROL_LINK_INTERVAL_MS. Both ends send it, as the
+ * receivers RSSI telemetry comes round too rarely to steer the transmitter.
+ */
+static void send_link_feedback(uint32_t now_ms){
+    if ((now_ms - last_link_sent_ms) >= POWER_CONTROL_LINK_INTERVAL_MS && (now_ms - last_rx_ms) < POWER_CONTROL_FEEDBACK_TIMEOUT_MS){
+        last_link_sent_ms = now_ms;
+        uint8_t link_data[2] = {(uint8_t)last_rx_rssi, (uint8_t)applied_power};
+        tranceiver_send_packet(PACKET_LINK, link_data, sizeof(link_data));
+    }
+}
+
+
 uint8_t tranceiver_send_telemtry(const telemetry_status status, const float value, const char name[], const uint8_t name_len){
     telemetry_buffer[0] = status;
     memcpy(telemetry_buffer+1, (uint8_t*)&value, 4);
     memcpy(telemetry_buffer+5, name, min_16(name_len, TRANCEIVER_MAX_NAME_LENGTH));
     uint16_t total_size = min_16(name_len, TRANCEIVER_MAX_NAME_LENGTH) + sizeof(value) + 1;  // the 1 is the status
-    return tranceiver_send_packet(PACKET_TELEMETRY, (uint8_t*)&telemetry_buffer, total_size);
+    uint8_t res = tranceiver_send_packet(PACKET_TELEMETRY, (uint8_t*)&telemetry_buffer, total_size);
+    send_link_feedback(esp_timer_get_time() / 1000);
+
+    // Answer a bind request, and keep the key it brought
+    uint8_t accept[AUTH_BIND_ACCEPT_BYTES];
+    if (bind_take_accept(accept)){
+        tranceiver_send_packet(PACKET_BIND, accept, sizeof(accept));
+    }
+    bind_save_changes();
+
+    // After a reboot, ask the transmitter to sign above the saved limit
+    uint8_t resync[AUTH_BIND_RESYNC_BYTES];
+    if (bind_take_resync(packet_header + ID_OFFSET, resync, esp_timer_get_time() / 1000)){
+        tranceiver_send_packet(PACKET_BIND, resync, sizeof(resync));
+    }
+    return res;
 }
 
 
@@ -246,5 +820,82 @@ uint8_t tranceiver_send_name_packet(const uint8_t name[], uint8_t len){
 
 
 uint8_t tranceiver_send_control_packet(int16_t channel_values[], uint8_t num_channels){
-    return tranceiver_send_packet(PACKET_CONTROL, (uint8_t*)channel_values, num_channels*2);
+    if (radio_tasks_owns_tx()){
+        // The TX task sends them at its own rate if it has one, otherwise as
+        // soon as it can. Either way it follows up with the packets below.
+        if (radio_tasks_set_tx_channels(channel_values, num_channels) == 0){
+            return 0;
+        }
+        return radio_tasks_queue_tx(PACKET_CONTROL, (uint8_t*)channel_values, num_channels*2);
+    }
+
+    uint8_t res = tranceiver_send_packet(PACKET_CONTROL, (uint8_t*)channel_values, num_channels*2);
+    send_link_feedback(esp_timer_get_time() / 1000);
+
+    // Answer the receivers clock sync request
+    uint8_t sync_data[CLOCK_SYNC_REPLY_BYTES];
+    if (clock_sync_take_reply(sync_data, esp_timer_get_time())){
+        tranceiver_send_packet(PACKET_SYNC, sync_data, sizeof(sync_data));
+    }
+
+    // Fill some of the gap until the next control packet with bulk data
+    tranceiver_bulk_update();
+    return res;
+}
+
+
+uint8_t tranceiver_bind(void){
+    uint8_t request[AUTH_BIND_REQUEST_BYTES];
+    uint16_t len = bind_request(packet_header + ID_OFFSET, request);
+    bind_save_changes();
+    if (len == 0){
+        return 1;
+    }
+    tranceiver_send_packet(PACKET_BIND, request, len);
+    return 0;
+}
+
+
+void tranceiver_bind_listen(uint32_t window_ms){
+    bind_listen(packet_header + ID_OFFSET, window_ms, esp_timer_get_time() / 1000);
+}
+
+
+uint8_t tranceiver_send_group_packet(const int16_t channel_values[], const uint8_t counts[], uint8_t members){
+    uint8_t group_id[ID_LENGTH];
+    if (!group_get_id(group_id)){
+        return TRANCEIVER_TX_FAILED;
+    }
+    uint8_t group_data[TRANCEIVER_MAX_PACKET_BYTES];
+    uint16_t len = group_build(group_data, sizeof(group_data), channel_values, counts, members);
+    if (len == 0){
+        return TRANCEIVER_TX_FAILED;
+    }
+    return tranceiver_send_packet(PACKET_GROUP, group_data, len);
+}
+
+
+void tranceiver_bulk_update(void){
+    if (radio_tasks_owns_tx()){
+        radio_tasks_request_bulk_update();
+        return;
+    }
+    uint8_t bulk_data[TRANCEIVER_MAX_PACKET_BYTES];
+    for (uint8_t i=0; i<BULK_PACKETS_PER_UPDATE; i++){
+        uint16_t len = bulk_next_packet(bulk_data, esp_timer_get_time());
+        if (len == 0 || tranceiver_send_packet(PACKET_BULK, bulk_data, len) != 0){
+            break;
+        }
+        bulk_charge_airtime(last_sent_airtime_us);
+    }
+}
+
+
+void tranceiver_enable_bulk_receive(uint8_t enabled){
+    bulk_enable_receive(enabled, BULK_MAX_SEGMENT_BYTES);
+}
+
+
+uint32_t tranceiver_get_last_frame_airtime_us(void){
+    return last_sent_airtime_us;
 }
@@ -1,12 +1,16 @@
 #ifndef __tranciever_h__
 #define __tranciever_h__
 
+#include "sequence.h"
+#include "auth.h"
+
 
 //This module handles injecting and sniffing packets. It implements the
 
 #define TRANCEIVER_MAX_PACKET_BYTES 64
 #define TRANCEIVER_MAX_NAME_LENGTH 16
 #define CHANNEL_VALUE_UNDEFINED -32768
+#define TELEMETRY_NAME_RSSI "RSSI"  // Receivers report the RSSI of control packets under this name
 
 
 typedef enum {
@@ -22,17 +26,37 @@ typedef enum {
   PACKET_CONTROL = 0x01,
   PACKET_TELEMETRY = 0x02,
   PACKET_NAME = 0x03,
+  PACKET_LINK = 0x04,
+  PACKET_SYNC = 0x05,
+  PACKET_BULK = 0x06,
+  PACKET_GROUP = 0x07,
+  PACKET_BIND = 0x08,
 } packet_types;
 
+// Results of sending a packet
+#define TRANCEIVER_TX_OK 0
+#define TRANCEIVER_TX_FAILED 1  // The wifi stack refused it, usually because its TX buffers are full, or it was too long to send
+#define TRANCEIVER_TX_SHED 2  // Dropped by congestion control (see congestion.h)
+
+// The top bits of the packet type byte are flags
+#define PACKET_TYPE_MASK 0x0F
+#define PACKET_HOPS_MASK 0x30  // Times the frame has been repeated by a relay (relay.h)
+#define PACKET_HOPS_SHIFT 4
+#define PACKET_FLAG_AUTH 0x40  // The last 4 bytes are a tag (auth.h), and any timestamp comes before them
+#define PACKET_FLAG_TIMESTAMP 0x80  // The last 4 bytes are the senders clock in us
+
 
 typedef struct {
   int8_t rssi;
   uint8_t source_id[6];
-  uint8_t packet_id;
+  uint32_t packet_id;  // Sequence number within its stream, extended to 32 bits for control and telemetry
   uint8_t packet_len;
   packet_types packet_type;
 
   int8_t noise_floor;
+  uint32_t tx_timestamp;  // The senders clock, if the packet was timestamped
+  int32_t latency_us;  // One way latency, or CLOCK_SYNC_LATENCY_UNKNOWN
+  uint32_t rx_time_us;  // Our clock when the packet arrived
 } packet_stats;
 
 typedef struct {
@@ -52,16 +76,27 @@ void tranceiver_get_latest_packet(uint8_t buff[], packet_stats* stats);
 
 /*
  * Send the specified
- * Returns nonzero if not sent
+ * Returns nonzero if not sent (one of the TRANCEIVER_TX_ results). Telemetry
+ * is the first thing dropped when the channel is congested.
 */
 uint8_t tranceiver_send_telemtry(const telemetry_status status, const float value, const char name[], const uint8_t name_len);
 
 /*
  * Sends a control packet with the specified channels
- * Returns nonzero if not sent
+ * Returns nonzero if not sent (one of the TRANCEIVER_TX_ results). When the
+ * channel is congested some control packets are skipped to bring the rate
+ * down, which returns TRANCEIVER_TX_SHED.
  */
 uint8_t tranceiver_send_control_packet(int16_t channel_values[], uint8_t num_channels);
 
+/*
+ * Sends one control packet to every member of the group we joined (see
+ * group.h). counts[i] channels are sent to member i, taken in order from
+ * channel_values. Returns TRANCEIVER_TX_FAILED if we haven't joined a group
+ * or the channels don't fit in a packet.
+ */
+uint8_t tranceiver_send_group_packet(const int16_t channel_values[], const uint8_t counts[], uint8_t members);
+
 /*
  * Broadcasts this devices name to the world
  */
@@ -80,6 +115,26 @@ uint8_t tranceiver_send_name_packet(const uint8_t name[], uint8_t len);
  */
 void tranceiver_set_power(int8_t transmit_power);
 
+/*
+ * How long the last frame sent held the channel for. Used to work out the
+ * energy spent per frame.
+ */
+uint32_t tranceiver_get_last_frame_airtime_us(void);
+
+/*
+ * Fixes the PHY rate packets are sent at (one of the phy_rate values in
+ * phy_rate.h). Receivers given their own profile with phy_rate_set_profile
+ * use that instead. Returns nonzero if the rate is not valid.
+ */
+uint8_t tranceiver_set_phy_rate(uint8_t rate);
+
+/*
+ * Allows Espressifs long range mode alongside normal 802.11b/g/n. It is
+ * turned on automatically when a long range rate is selected. Only ESP32s
+ * can receive long range frames.
+ */
+void tranceiver_enable_long_range(uint8_t enabled);
+
 
 /* Sets the wifi transmission frequency. Check your countries regulations.
  * (most countries allow use of 1 - 11. Some countries restrict the use of
@@ -94,10 +149,102 @@ void tranceiver_set_channel(uint8_t channel);
  */
 void tranceiver_set_id(const uint8_t id_bytes[6]);
 
+const uint8_t* tranceiver_get_id(void);
+
 /*
  *  Only packets that match the trancievers ID are receivable with the
  * get_latest_packet function
  */
 void tranceiver_enable_filter_by_id(uint8_t enabled);
 
+/*
+ * Timestamps outgoing control, group and telemetry packets. The transmitter
+ * needs this on to measure latency, the receiver needs it on to synchronise
+ * its clock.
+ */
+void tranceiver_enable_timestamps(uint8_t enabled);
+
+/*
+ * How the sequence numbers of a stream of packets we have received went
+ * (see sequence.h). Only packets for our ID, or our group, are counted.
+ * Stale and duplicate packets are dropped, and so are control packets that
+ * arrive after a newer one. The stats start again when the ID changes.
+ */
+void tranceiver_get_link_stats(sequence_stream_id stream, sequence_stats* stats);
+
+/*
+ * Binds the receiver with our ID to us (see bind.h), sending it a bind
+ * request. Call it until it returns nonzero, once the receiver has
+ * accepted. From then on our control packets to it are signed.
+ */
+uint8_t tranceiver_bind(void);
+
+/*
+ * Lets a transmitter bind us for the next window_ms. Our accept is sent
+ * along with the next telemetry packet.
+ */
+void tranceiver_bind_listen(uint32_t window_ms);
+
+/*
+ * How the control packets checked against our key went. Once bound, those
+ * that aren't signed with it are dropped.
+ */
+void tranceiver_get_auth_stats(auth_stats* stats);
+
+/*
+ * Sends any bulk transfer packets that are due (see bulk.h). This is done
+ * after every control packet, so only receivers need to call it.
+ */
+void tranceiver_bulk_update(void);
+
+/* Accept bulk transfers from the far end */
+void tranceiver_enable_bulk_receive(uint8_t enabled);
+
+/*
+ * Turns the radio and CPU off for the specified time. Packets arriving in
+ * this time are lost.
+ */
+void tranceiver_sleep(uint32_t us);
+
+
+/*
+ * Used by the radio tasks (radio_tasks.h)
+ */
+
+/* Parses a received frame. Normally called from the wifi callback */
+void tranceiver_process_frame(const uint8_t payload[], uint16_t sig_len, int8_t rssi, int8_t noise_floor, uint32_t now_us);
+
+/* Sends a packet from the callers context, even if the TX task is running */
+uint8_t tranceiver_send_packet_now(const packet_types packet_type, const uint8_t data[], const uint16_t data_len);
+
+/*
+ * Sends a frame someone else built, as it is (frame_len excludes the CRC).
+ * Used by the relay from the TX task.
+ */
+uint8_t tranceiver_relay_frame(const uint8_t frame[], uint16_t frame_len);
+
+
+/*
+ * Soak testing (health.h)
+ */
+
+/*
+ * Ignores real frames, so the receive path can be driven with
+ * tranceiver_inject_frame instead
+ */
+void tranceiver_simulate_medium(uint8_t enabled);
+
+/*
+ * Passes a frame built like one of ours, but from the given ID, through the
+ * same path as frames from the wifi callback. Only use it while simulating
+ * the medium, or it races with the real frames.
+ */
+void tranceiver_inject_frame(const uint8_t id_bytes[6], uint8_t packet_type, const uint8_t data[], uint16_t data_len, int8_t rssi);
+
+/*
+ * Injects the last injected frame again, with the given hop count, as a
+ * relay would repeat it
+ */
+void tranceiver_inject_repeat(uint8_t hops, int8_t rssi);
+
 #endif
@@ -0,0 +1,82 @@
+#ifndef __AUTH_H__
+#define __AUTH_H__
+
+#include <stdint.h>
+
+// Per frame authentication, so a receiver only obeys the transmitter it is
+// bound to (see bind.h).
+//
+// A frame is signed with a 4 byte tag: the first half of a SipHash-2-4 of
+// its ID, Pcnt and type byte (without the hop count, which relays change)
+// followed by its data. The data ends with a 4 byte counter and then the
+// tag, after everything else including the timestamp. SipHash is built for
+// short messages: a control packet is 3 or 4 blocks, on the order of a
+// thousand cycles on a 32 bit CPU. The key is mixed into the starting state
+// once, when it is set, so nothing per frame depends on the key schedule.
+//
+// The counter goes up with every frame the signer signs, and a receiver
+// only takes a frame whose counter is higher than the last good one it
+// had. Unlike the 8 bit Pcnt it never wraps or restarts, so a recorded
+// frame stays useless however long the link has been quiet, and both ends
+// keep their counters over a restart (see bind.h). 32 bits is short for a
+// MAC, but a forger only gets one guess per frame.
+
+#define AUTH_KEY_BYTES 16
+#define AUTH_TAG_BYTES 4
+#define AUTH_COUNTER_BYTES 4
+#define AUTH_TRAILER_BYTES (AUTH_COUNTER_BYTES + AUTH_TAG_BYTES)  // Added to the data of a signed frame
+#define AUTH_HEADER_BYTES 8  // The ID, Pcnt and type byte covered by the tag
+
+// The first data byte of a PACKET_BIND. See "Binding" in PacketFormat.md
+#define AUTH_BIND_REQUEST 0x01  // Followed by the key
+#define AUTH_BIND_ACCEPT 0x02  // Followed by the proof
+#define AUTH_BIND_RESYNC 0x03  // Followed by the counter to carry on from and its tag
+#define AUTH_BIND_REQUEST_BYTES (1 + AUTH_KEY_BYTES)
+#define AUTH_BIND_ACCEPT_BYTES (1 + AUTH_TAG_BYTES)
+#define AUTH_BIND_RESYNC_BYTES (1 + AUTH_COUNTER_BYTES + AUTH_TAG_BYTES)
+
+
+typedef struct {
+  uint64_t v[4];  // The SipHash state with the key mixed in
+} auth_key_state;
+
+typedef struct {
+  uint32_t verified;  // Control packets with a good tag
+  uint32_t unsigned_rejected;  // Control and group packets without one
+  uint32_t bad_tag;
+  uint32_t replayed;  // Good tags, but no newer than one already had
+  uint32_t early;  // Good tags, but past the counters saved for a restart
+} auth_stats;
+
+
+/* Mixes the key into the starting state */
+void auth_init_key(auth_key_state* state, const uint8_t key[AUTH_KEY_BYTES]);
+
+/*
+ * Copies the fields of a frame the tag covers out of its header, with the
+ * hop count cleared.
+ */
+void auth_frame_header(uint8_t header[AUTH_HEADER_BYTES], const uint8_t id[6], uint8_t packet_count, uint8_t type_byte);
+
+/* The tag for a frame with this header and data */
+uint32_t auth_tag(const auth_key_state* state, const uint8_t header[AUTH_HEADER_BYTES], const uint8_t data[], uint16_t len);
+
+/*
+ * Checks the tag on the end of data. len includes the tag. Returns nonzero
+ * if it is good.
+ */
+uint8_t auth_verify(const auth_key_state* state, const uint8_t header[AUTH_HEADER_BYTES], const uint8_t data[], uint16_t len);
+
+/*
+ * What a receiver sends back to show it has the key it was sent: the tag
+ * of an accept from id, with no Pcnt.
+ */
+uint32_t auth_bind_proof(const auth_key_state* state, const uint8_t id[6]);
+
+/*
+ * The tag of a resync from id, which asks the transmitter to sign with
+ * counters above counter. Like an accept it has no Pcnt.
+ */
+uint32_t auth_resync_tag(const auth_key_state* state, const uint8_t id[6], uint32_t counter);
+
+#endif
@@ -0,0 +1,146 @@
+#include <string.h>
+#include <EEPROM.h>
+
+#include "bind.h"
+
+
+#define ID_LENGTH 6
+#define LIMIT_EEPROM_OFFSET (BIND_EEPROM_OFFSET + 1 + AUTH_KEY_BYTES)
+
+
+static uint8_t bound = 0;
+static uint8_t key[AUTH_KEY_BYTES];
+static uint8_t key_changed = 0;
+static uint32_t counter_limit = 0;
+
+static uint8_t listening = 0;
+static uint8_t listen_id[ID_LENGTH];
+static uint32_t listen_until_ms = 0;
+static uint8_t accept_due = 0;
+static uint32_t accept_proof = 0;
+static uint8_t resync_due = 0;
+static uint32_t last_resync_ms = 0;
+
+
+void bind_begin(void){
+  EEPROM.begin(BIND_EEPROM_OFFSET + BIND_EEPROM_BYTES);
+  if (EEPROM.read(BIND_EEPROM_OFFSET) != BIND_EEPROM_MAGIC){
+    return;
+  }
+  for (uint8_t i=0; i<AUTH_KEY_BYTES; i++){
+    key[i] = EEPROM.read(BIND_EEPROM_OFFSET + 1 + i);
+  }
+  EEPROM.get(LIMIT_EEPROM_OFFSET, counter_limit);
+  bound = 1;
+  // The transmitter doesn't know we restarted
+  resync_due = 1;
+}
+
+
+const uint8_t* bind_get_key(void){
+  return bound ? key : NULL;
+}
+
+
+void bind_forget(void){
+  if (bound){
+    bound = 0;
+    key_changed = 1;
+    counter_limit = 0;
+  }
+}
+
+
+void bind_save_changes(void){
+  if (!key_changed){
+    return;
+  }
+  key_changed = 0;
+  EEPROM.write(BIND_EEPROM_OFFSET, bound ? BIND_EEPROM_MAGIC : 0);
+  for (uint8_t i=0; i<AUTH_KEY_BYTES; i++){
+    EEPROM.write(BIND_EEPROM_OFFSET + 1 + i, bound ? key[i] : 0);
+  }
+  EEPROM.put(LIMIT_EEPROM_OFFSET, counter_limit);
+  EEPROM.commit();
+}
+
+
+uint32_t bind_get_counter_limit(void){
+  return counter_limit;
+}
+
+
+uint8_t bind_save_counter_limit(uint32_t limit){
+  if (!bound || key_changed){
+    return 1;  // Goes with a key that isn't saved yet
+  }
+  EEPROM.put(LIMIT_EEPROM_OFFSET, limit);
+  if (!EEPROM.commit()){
+    return 1;
+  }
+  counter_limit = limit;
+  return 0;
+}
+
+
+void bind_listen(const uint8_t id[ID_LENGTH], uint32_t window_ms, uint32_t now_ms){
+  memcpy(listen_id, id, ID_LENGTH);
+  listen_until_ms = now_ms + window_ms;
+  listening = window_ms > 0;
+}
+
+
+uint8_t bind_handle_packet(const uint8_t id[ID_LENGTH], const uint8_t data[], uint16_t len, uint32_t now_ms){
+  if (data[0] != AUTH_BIND_REQUEST || len < AUTH_BIND_REQUEST_BYTES){
+    return 0;
+  }
+  if (!listening || (int32_t)(listen_until_ms - now_ms) <= 0 || memcmp(id, listen_id, ID_LENGTH) != 0){
+    return 0;
+  }
+  // Every copy is answered in case the last accept was lost
+  auth_key_state state;
+  auth_init_key(&state, data + 1);
+  accept_proof = auth_bind_proof(&state, id);
+  accept_due = 1;
+  if (bound && memcmp(key, data + 1, AUTH_KEY_BYTES) == 0){
+    return 0;
+  }
+  memcpy(key, data + 1, AUTH_KEY_BYTES);
+  bound = 1;
+  key_changed = 1;
+  counter_limit = 0;  // A new key has its own counter
+  resync_due = 0;
+  return 1;
+}
+
+
+void bind_authenticated(void){
+  listening = 0;
+  resync_due = 0;
+}
+
+
+uint8_t bind_take_accept(uint8_t data[AUTH_BIND_ACCEPT_BYTES]){
+  if (!accept_due){
+    return 0;
+  }
+  accept_due = 0;
+  data[0] = AUTH_BIND_ACCEPT;
+  memcpy(data + 1, &accept_proof, AUTH_TAG_BYTES);
+  return 1;
+}
+
+
+uint8_t bind_take_resync(const uint8_t id[ID_LENGTH], uint32_t counter, uint8_t data[AUTH_BIND_RESYNC_BYTES], uint32_t now_ms){
+  if (!bound || !resync_due || (now_ms - last_resync_ms) < BIND_RESYNC_INTERVAL_MS){
+    return 0;
+  }
+  last_resync_ms = now_ms;
+  auth_key_state state;
+  auth_init_key(&state, key);
+  uint32_t tag = auth_resync_tag(&state, id, counter);
+  data[0] = AUTH_BIND_RESYNC;
+  memcpy(data + 1, &counter, AUTH_COUNTER_BYTES);
+  memcpy(data + 1 + AUTH_COUNTER_BYTES, &tag, AUTH_TAG_BYTES);
+  return 1;
+}
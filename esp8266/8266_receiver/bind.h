@@ -0,0 +1,79 @@
+#ifndef __BIND_H__
+#define __BIND_H__
+
+#include <stdint.h>
+#include "auth.h"
+
+// Binding to one transmitter with a shared key (see auth.h), so nothing
+// else on the channel can drive us.
+//
+// The transmitter makes a random key and sends it in bind requests until
+// we answer with an accept that proves we have it. We only take a key
+// while listening, which stops at the end of the window or on the first
+// control packet signed with the new key. From then on control packets
+// that aren't signed with the key are dropped. See "Binding" in
+// PacketFormat.md.
+//
+// The key is kept in EEPROM. The callback can't write flash, so
+// bind_save_changes() does it later from the main loop.
+//
+// The counters on signed control packets have to keep going up across a
+// restart too (see auth.h), or recorded packets would be taken again. So
+// the core only takes counters up to a limit saved next to the key, which
+// the main loop raises BIND_COUNTER_BLOCK past the newest counter seen
+// whenever it gets within half a block. After a restart the core carries
+// on from the saved limit. The transmitter may still be below it, so until
+// a control packet gets through we send resyncs asking it to sign above it.
+
+#define BIND_EEPROM_OFFSET 0
+#define BIND_EEPROM_MAGIC 0xB1  // Marks a saved key
+#define BIND_EEPROM_BYTES (1 + AUTH_KEY_BYTES + AUTH_COUNTER_BYTES)  // Magic, key, counter limit
+#define BIND_COUNTER_BLOCK 0x10000  // Saved again when half used, so every 33s at 1kHz
+#define BIND_RESYNC_INTERVAL_MS 200
+
+
+/* Starts the EEPROM and loads the saved key, if there is one */
+void bind_begin(void);
+
+/* The key we are bound with, or NULL */
+const uint8_t* bind_get_key(void);
+
+void bind_forget(void);
+
+/* Writes the key to EEPROM if it has changed. Not from the callback */
+void bind_save_changes(void);
+
+/* The counter limit saved with the key, 0 for a new key */
+uint32_t bind_get_counter_limit(void);
+
+/*
+ * Writes a higher counter limit to EEPROM. Not from the callback. Returns
+ * nonzero if it couldn't, and the core mustn't take counters up to it.
+ */
+uint8_t bind_save_counter_limit(uint32_t limit);
+
+/* Takes a key from a transmitter sent to id for the next window_ms */
+void bind_listen(const uint8_t id[6], uint32_t window_ms, uint32_t now_ms);
+
+/*
+ * Handles a PACKET_BIND sent to id. Called from the callback. Returns
+ * nonzero if it gave us a new key.
+ */
+uint8_t bind_handle_packet(const uint8_t id[6], const uint8_t data[], uint16_t len, uint32_t now_ms);
+
+/* A control packet was signed with our key, so the bind is done */
+void bind_authenticated(void);
+
+/*
+ * Puts an accept in data if one is due. Returns nonzero if it did. It is
+ * sent from our ID.
+ */
+uint8_t bind_take_accept(uint8_t data[AUTH_BIND_ACCEPT_BYTES]);
+
+/*
+ * Puts a resync asking for counters above counter in data, if one is due.
+ * Returns nonzero if it did. It is sent from id.
+ */
+uint8_t bind_take_resync(const uint8_t id[6], uint32_t counter, uint8_t data[AUTH_BIND_RESYNC_BYTES], uint32_t now_ms);
+
+#endif
@@ -0,0 +1,369 @@
+#include <string.h>
+
+#include "bulk.h"
+
+
+static bulk_state state = BULK_IDLE;
+static uint8_t xfer_id = 0;
+static uint8_t blob[BULK_MAX_BYTES];
+static uint32_t blob_len = 0;
+static uint32_t blob_checksum = 0;
+static uint16_t segment_size = 0;  // 0 until the receiver has answered
+static uint16_t total_segments = 0;
+static uint8_t done[BULK_MAX_SEGMENTS / 8];  // Segments acknowledged (sending) or received (receiving)
+static uint16_t base = 0;  // First segment not yet done
+static uint32_t retransmits = 0;
+
+// Sender
+static uint16_t next_new = 0;  // First segment never sent
+static uint32_t sent_at_us[BULK_WINDOW];
+static uint32_t start_sent_at_us = 0;
+static uint32_t last_ack_us = 0;
+static int32_t budget_us = 0;
+static uint32_t budget_updated_us = 0;
+
+// Receiver
+static uint8_t receive_enabled = 0;
+static uint8_t received = 0;  // The blob came from the far end
+static uint16_t receive_segment_size = 0;
+static uint8_t ack_pending = 0;
+static uint8_t abort_pending = 0;
+
+
+static uint32_t checksum(const uint8_t data[], uint32_t len){
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (uint32_t i=0; i<len; i++){
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static uint8_t is_done(uint16_t segment){
+  return done[segment / 8] & (1 << (segment % 8));
+}
+
+static void mark_done(uint16_t segment){
+  if (segment < total_segments){
+    done[segment / 8] |= (1 << (segment % 8));
+  }
+}
+
+static void advance_base(void){
+  while (base < total_segments && is_done(base)){
+    base++;
+  }
+}
+
+static uint32_t segment_bytes(uint16_t segment){
+  uint32_t offset = (uint32_t)segment * segment_size;
+  if (blob_len - offset < segment_size){
+    return blob_len - offset;
+  }
+  return segment_size;
+}
+
+static uint32_t done_bytes(void){
+  if (state == BULK_COMPLETE){
+    return blob_len;
+  }
+  uint32_t total = 0;
+  for (uint16_t i=0; i<total_segments; i++){
+    if (is_done(i)){
+      total += segment_bytes(i);
+    }
+  }
+  return total;
+}
+
+static void set_segment_size(uint16_t size){
+  segment_size = size;
+  total_segments = (blob_len + size - 1) / size;
+  if (total_segments == 0){
+    total_segments = 1;  // An empty blob still needs to be acknowledged
+  }
+}
+
+static void read_u32(const uint8_t data[], uint32_t* out){
+  memcpy(out, data, 4);
+}
+
+
+uint8_t bulk_send(uint8_t id, const uint8_t data[], uint32_t len, uint32_t now_us){
+  if (len > BULK_MAX_BYTES){
+    return 1;
+  }
+  if (state == BULK_SENDING || state == BULK_RECEIVING){
+    return 1;
+  }
+  state = BULK_SENDING;
+  received = 0;
+  xfer_id = id;
+  memcpy(blob, data, len);
+  blob_len = len;
+  blob_checksum = checksum(blob, len);
+  segment_size = 0;
+  total_segments = 0;
+  base = 0;
+  next_new = 0;
+  retransmits = 0;
+  memset(done, 0, sizeof(done));
+  start_sent_at_us = now_us - BULK_RETRY_US;  // Announce straight away
+  last_ack_us = now_us;
+  return 0;
+}
+
+
+void bulk_enable_receive(uint8_t enabled, uint16_t max_segment){
+  receive_enabled = enabled;
+  receive_segment_size = max_segment < BULK_MAX_SEGMENT_BYTES ? max_segment : BULK_MAX_SEGMENT_BYTES;
+}
+
+
+void bulk_abort(void){
+  if (state == BULK_SENDING || state == BULK_RECEIVING){
+    abort_pending = 1;
+  }
+  state = BULK_IDLE;
+}
+
+
+static void handle_start(uint8_t id, const uint8_t data[], uint16_t len){
+  if (len < 10 || !receive_enabled){
+    return;
+  }
+  uint32_t new_len, new_checksum;
+  read_u32(data + 2, &new_len);
+  read_u32(data + 6, &new_checksum);
+
+  uint8_t same = (id == xfer_id && new_len == blob_len && new_checksum == blob_checksum);
+  if (same && (state == BULK_RECEIVING || state == BULK_COMPLETE)){
+    // The sender lost track of us. Tell it where we got to.
+    ack_pending = 1;
+    return;
+  }
+  if (state == BULK_SENDING || new_len > BULK_MAX_BYTES || receive_segment_size == 0){
+    return;
+  }
+  if ((new_len + receive_segment_size - 1) / receive_segment_size > BULK_MAX_SEGMENTS){
+    return;
+  }
+  state = BULK_RECEIVING;
+  received = 1;
+  xfer_id = id;
+  blob_len = new_len;
+  blob_checksum = new_checksum;
+  set_segment_size(receive_segment_size);
+  base = 0;
+  retransmits = 0;
+  memset(done, 0, sizeof(done));
+  ack_pending = 1;
+}
+
+
+static void handle_data(uint8_t id, const uint8_t data[], uint16_t len){
+  if (id != xfer_id || len < BULK_HEADER_BYTES){
+    return;
+  }
+  if (state == BULK_COMPLETE){
+    ack_pending = 1;  // Our last ack got lost
+    return;
+  }
+  if (state != BULK_RECEIVING){
+    return;
+  }
+  uint16_t segment = data[2] | (data[3] << 8);
+  if (segment >= total_segments || len - BULK_HEADER_BYTES < segment_bytes(segment)){
+    return;
+  }
+  if (is_done(segment)){
+    retransmits++;
+  } else {
+    memcpy(blob + (uint32_t)segment * segment_size, data + BULK_HEADER_BYTES, segment_bytes(segment));
+    mark_done(segment);
+    advance_base();
+  }
+  if (base >= total_segments){
+    state = checksum(blob, blob_len) == blob_checksum ? BULK_COMPLETE : BULK_FAILED;
+  }
+  ack_pending = 1;
+}
+
+
+static void handle_ack(uint8_t id, const uint8_t data[], uint16_t len, uint32_t now_us){
+  if (id != xfer_id || len < 9 || state != BULK_SENDING){
+    return;
+  }
+  uint16_t ack_base = data[2] | (data[3] << 8);
+  uint32_t bitmap;
+  read_u32(data + 4, &bitmap);
+  uint16_t ack_segment_size = data[8];
+
+  if (segment_size == 0){
+    if (ack_segment_size == 0 || ack_segment_size > BULK_MAX_SEGMENT_BYTES){
+      return;
+    }
+    set_segment_size(ack_segment_size);
+    next_new = ack_base;  // Resume from wherever the receiver got to
+  } else if (ack_segment_size != segment_size){
+    return;
+  }
+
+  for (uint16_t i=0; i<ack_base && i<total_segments; i++){
+    mark_done(i);
+  }
+  for (uint8_t i=0; i<BULK_WINDOW; i++){
+    if (bitmap & (1u << i)){
+      mark_done(ack_base + 1 + i);
+    }
+  }
+  advance_base();
+  if (next_new < base){
+    next_new = base;
+  }
+  last_ack_us = now_us;
+  if (base >= total_segments){
+    state = BULK_COMPLETE;
+  }
+}
+
+
+void bulk_handle_packet(const uint8_t data[], uint16_t len, uint32_t now_us){
+  if (len < 2){
+    return;
+  }
+  uint8_t id = data[1];
+  switch (data[0]){
+    case BULK_START:
+      handle_start(id, data, len);
+      break;
+    case BULK_DATA:
+      handle_data(id, data, len);
+      break;
+    case BULK_ACK:
+      handle_ack(id, data, len, now_us);
+      break;
+    case BULK_ABORT:
+      if (id == xfer_id && (state == BULK_SENDING || state == BULK_RECEIVING)){
+        state = BULK_IDLE;
+      }
+      break;
+  }
+}
+
+
+static uint16_t make_ack(uint8_t out[]){
+  uint32_t bitmap = 0;
+  for (uint8_t i=0; i<BULK_WINDOW; i++){
+    uint16_t segment = base + 1 + i;
+    if (segment < total_segments && is_done(segment)){
+      bitmap |= (1u << i);
+    }
+  }
+  out[0] = BULK_ACK;
+  out[1] = xfer_id;
+  out[2] = base & 0xFF;
+  out[3] = base >> 8;
+  memcpy(out + 4, &bitmap, 4);
+  out[8] = segment_size;
+  ack_pending = 0;
+  return 9;
+}
+
+static uint16_t make_data(uint8_t out[], uint16_t segment, uint32_t now_us){
+  uint32_t bytes = segment_bytes(segment);
+  out[0] = BULK_DATA;
+  out[1] = xfer_id;
+  out[2] = segment & 0xFF;
+  out[3] = segment >> 8;
+  memcpy(out + BULK_HEADER_BYTES, blob + (uint32_t)segment * segment_size, bytes);
+  sent_at_us[segment % BULK_WINDOW] = now_us;
+  return BULK_HEADER_BYTES + bytes;
+}
+
+static uint16_t next_sender_packet(uint8_t out[], uint32_t now_us){
+  if (segment_size != 0 && (now_us - last_ack_us) > BULK_STALL_US){
+    // Lost the receiver. Announce again and resume from its ack.
+    segment_size = 0;
+    start_sent_at_us = now_us - BULK_RETRY_US;
+  }
+  if (segment_size == 0){
+    if ((now_us - start_sent_at_us) < BULK_RETRY_US){
+      return 0;
+    }
+    start_sent_at_us = now_us;
+    out[0] = BULK_START;
+    out[1] = xfer_id;
+    memcpy(out + 2, &blob_len, 4);
+    memcpy(out + 6, &blob_checksum, 4);
+    return 10;
+  }
+  if (budget_us <= 0){
+    return 0;
+  }
+
+  // Anything in the window that has gone unacknowledged for too long
+  for (uint16_t segment=base; segment<next_new && segment<base+BULK_WINDOW; segment++){
+    if (!is_done(segment) && (now_us - sent_at_us[segment % BULK_WINDOW]) >= BULK_RETRY_US){
+      retransmits++;
+      return make_data(out, segment, now_us);
+    }
+  }
+  // Otherwise something new, if the window has room
+  if (next_new < total_segments && next_new < base + BULK_WINDOW){
+    next_new++;
+    return make_data(out, next_new - 1, now_us);
+  }
+  return 0;
+}
+
+
+uint16_t bulk_next_packet(uint8_t out[TRANCEIVER_MAX_PACKET_BYTES], uint32_t now_us){
+  uint16_t len = 0;
+  uint32_t elapsed_us = now_us - budget_updated_us;
+  if (elapsed_us > BULK_MAX_BURST_US * 100 / BULK_AIRTIME_SHARE_PERCENT){
+    elapsed_us = BULK_MAX_BURST_US * 100 / BULK_AIRTIME_SHARE_PERCENT;
+  }
+  budget_us += elapsed_us * BULK_AIRTIME_SHARE_PERCENT / 100;
+  if (budget_us > BULK_MAX_BURST_US){
+    budget_us = BULK_MAX_BURST_US;
+  }
+  budget_updated_us = now_us;
+
+  if (abort_pending){
+    out[0] = BULK_ABORT;
+    out[1] = xfer_id;
+    abort_pending = 0;
+    len = 2;
+  } else if (ack_pending){
+    len = make_ack(out);
+  } else if (state == BULK_SENDING){
+    len = next_sender_packet(out, now_us);
+  }
+  return len;
+}
+
+
+void bulk_charge_airtime(uint32_t airtime_us){
+  budget_us -= airtime_us;
+}
+
+
+void bulk_get_stats(bulk_stats* stats){
+  stats->state = state;
+  stats->xfer_id = xfer_id;
+  stats->total_bytes = blob_len;
+  stats->done_bytes = done_bytes();
+  stats->retransmits = retransmits;
+}
+
+
+const uint8_t* bulk_get_data(uint32_t* len){
+  if (state != BULK_COMPLETE || !received){
+    *len = 0;
+    return NULL;
+  }
+  *len = blob_len;
+  return blob;
+}
@@ -0,0 +1,93 @@
+#ifndef __BULK_H__
+#define __BULK_H__
+
+#include <stdint.h>
+#include "tranceiver.h"
+
+// Segmented transfer of blobs bigger than one packet (receiver configs,
+// logs) in either direction.
+//
+// The sender announces the blob, the receiver replies with how big a
+// segment it can see, and the segments are then sent with a sliding window.
+// The receiver acknowledges with the first segment it is missing plus a
+// bitmap of which of the following ones it has, so only lost segments are
+// sent again. If the acks stop, the sender goes back to announcing the blob
+// and carries on from wherever the receiver got up to.
+//
+// Bulk packets are only sent when there is airtime budget left, so they use
+// at most BULK_AIRTIME_SHARE_PERCENT of the channel and don't hold up
+// control packets.
+
+#define BULK_HEADER_BYTES 4
+#define BULK_MAX_SEGMENT_BYTES (TRANCEIVER_MAX_PACKET_BYTES - BULK_HEADER_BYTES)
+#define BULK_MAX_SEGMENTS 256
+#define BULK_MAX_BYTES 2048
+#define BULK_WINDOW 32  // Segments in flight. Also the width of the ack bitmap
+#define BULK_RETRY_US 60000  // Resend anything not acknowledged after this long
+#define BULK_STALL_US 500000  // Go back to announcing the blob if no acks arrive for this long
+#define BULK_AIRTIME_SHARE_PERCENT 20
+#define BULK_MAX_BURST_US 5000  // The most unused airtime that can be saved up
+#define BULK_PACKETS_PER_UPDATE 8
+
+
+typedef enum {
+  BULK_START = 0,  // Sender: xfer id, length, checksum
+  BULK_DATA = 1,  // Sender: xfer id, segment number, segment
+  BULK_ACK = 2,  // Receiver: xfer id, first missing segment, bitmap, segment size
+  BULK_ABORT = 3,  // Either: xfer id
+} bulk_kind;
+
+typedef enum {
+  BULK_IDLE = 0,
+  BULK_SENDING = 1,
+  BULK_RECEIVING = 2,
+  BULK_COMPLETE = 3,
+  BULK_FAILED = 4,  // The blob arrived but its checksum didn't match
+} bulk_state;
+
+typedef struct {
+  bulk_state state;
+  uint8_t xfer_id;
+  uint32_t total_bytes;
+  uint32_t done_bytes;  // Acknowledged or received so far
+  uint32_t retransmits;
+} bulk_stats;
+
+
+/*
+ * Starts sending a blob to the far end. The data is copied. Returns nonzero
+ * if it is too big or a transfer is already in progress.
+ */
+uint8_t bulk_send(uint8_t xfer_id, const uint8_t data[], uint32_t len, uint32_t now_us);
+
+/*
+ * Accept blobs from the far end. max_segment is how many bytes of a bulk
+ * segment we are able to receive.
+ */
+void bulk_enable_receive(uint8_t enabled, uint16_t max_segment);
+
+/* Stops the current transfer and tells the far end */
+void bulk_abort(void);
+
+/* Handles a bulk packet from the far end */
+void bulk_handle_packet(const uint8_t data[], uint16_t len, uint32_t now_us);
+
+/*
+ * Fills out with the next bulk packet to send, if there is one and there is
+ * airtime budget left for it. Returns its length, or 0 if there is nothing
+ * to send.
+ */
+uint16_t bulk_next_packet(uint8_t out[TRANCEIVER_MAX_PACKET_BYTES], uint32_t now_us);
+
+/* Tell the airtime budget how long the last bulk packet took to send */
+void bulk_charge_airtime(uint32_t airtime_us);
+
+void bulk_get_stats(bulk_stats* stats);
+
+/*
+ * The received blob, once the state is BULK_COMPLETE. Returns NULL
+ * otherwise.
+ */
+const uint8_t* bulk_get_data(uint32_t* len);
+
+#endif
@@ -0,0 +1,111 @@
+#include <string.h>
+#include "clock_sync.h"
+
+
+static uint8_t synced = 0;
+static uint32_t offset_us = 0;  // Remote minus local, modulo 2^32
+static uint32_t offset_measured_at_us = 0;
+static float drift_ppm = 0;
+static uint32_t min_round_trip_us = 0;
+
+static uint8_t have_latency = 0;
+static int32_t last_latency_us = 0;
+static float latency_us = 0;
+static float jitter_us = 0;
+
+
+static uint32_t read_u32(const uint8_t data[]){
+  uint32_t out = 0;
+  memcpy(&out, data, 4);
+  return out;
+}
+
+
+static uint32_t offset_at(uint32_t now_us){
+  int32_t since = now_us - offset_measured_at_us;
+  return offset_us + (int32_t)(drift_ppm * since / 1e6f);
+}
+
+
+void clock_sync_handle_reply(const uint8_t data[CLOCK_SYNC_REPLY_BYTES], uint32_t t4){
+  uint32_t t1 = read_u32(data);
+  uint32_t t2 = read_u32(data + 4);
+  uint32_t t3 = read_u32(data + 8);
+
+  int32_t round_trip = (int32_t)(t4 - t1) - (int32_t)(t3 - t2);
+  if (round_trip < 0){
+    return;
+  }
+  // Average the two offset estimates without falling over when they wrap
+  uint32_t a = t2 - t1;
+  uint32_t b = t3 - t4;
+  uint32_t offset = a + (int32_t)(b - a) / 2;
+
+  if (!synced){
+    min_round_trip_us = round_trip;
+    offset_us = offset;
+    offset_measured_at_us = t4;
+    synced = 1;
+  } else {
+    // Let the best round trip slowly get worse in case the route changed
+    min_round_trip_us += 10;
+    if ((uint32_t)round_trip < min_round_trip_us){
+      min_round_trip_us = round_trip;
+    }
+    if ((uint32_t)round_trip <= min_round_trip_us + CLOCK_SYNC_MAX_EXTRA_DELAY_US){
+      int32_t since = t4 - offset_measured_at_us;
+      int32_t error = offset - offset_at(t4);
+      if (since > 0){
+        drift_ppm += (error * 1e6f / since) * 0.1f;
+      }
+      offset_us = offset_at(t4) + error / 4;
+      offset_measured_at_us = t4;
+    }
+  }
+}
+
+
+uint8_t clock_sync_is_synced(void){
+  return synced;
+}
+
+
+uint32_t clock_sync_to_local(uint32_t remote_us, uint32_t now_us){
+  return remote_us - offset_at(now_us);
+}
+
+
+int32_t clock_sync_packet_latency(uint32_t tx_remote_us, uint32_t rx_local_us){
+  if (!synced){
+    return CLOCK_SYNC_LATENCY_UNKNOWN;
+  }
+  int32_t latency = rx_local_us - (tx_remote_us - offset_at(rx_local_us));
+  if (have_latency){
+    // Same as the RTP interarrival jitter (RFC 3550)
+    int32_t change = latency - last_latency_us;
+    jitter_us += ((change < 0 ? -change : change) - jitter_us) / 16.0f;
+    latency_us += (latency - latency_us) / 16.0f;
+  } else {
+    latency_us = latency;
+    have_latency = 1;
+  }
+  last_latency_us = latency;
+  return latency;
+}
+
+
+int32_t clock_sync_get_offset_us(void){
+  return offset_us;
+}
+
+float clock_sync_get_drift_ppm(void){
+  return drift_ppm;
+}
+
+float clock_sync_get_latency_us(void){
+  return latency_us;
+}
+
+float clock_sync_get_jitter_us(void){
+  return jitter_us;
+}
@@ -0,0 +1,173 @@
+#include <Arduino.h>
+#include "duty_cycle.h"
+#include "tranceiver.h"
+
+
+static uint8_t duty_cycle_enabled = 0;
+
+// The learnt schedule
+static uint32_t frame_period_us = 0;
+static uint32_t last_arrival_us = 0;
+static uint8_t last_arrival_id = 0;
+static uint8_t have_arrival = 0;
+static uint32_t arrival_jitter_us = 0;
+static uint8_t frames_on_schedule = 0;
+
+// How late we come out of sleep compared to what we asked for
+static uint32_t wake_latency_us = 0;
+
+// Times we were asleep since the last packet arrived
+typedef struct {
+  uint32_t start_us;
+  uint32_t end_us;
+} SleepWindow;
+static SleepWindow sleep_windows[DUTY_CYCLE_MAX_SLEEP_WINDOWS];
+static uint8_t num_sleep_windows = 0;
+
+// Current draw accounting
+static uint32_t last_accounted_us = 0;
+static float awake_us = 0;
+static float asleep_us = 0;
+
+static uint32_t sleep_misses = 0;
+
+
+void duty_cycle_enable(uint8_t enabled){
+  duty_cycle_enabled = enabled;
+  frames_on_schedule = 0;
+}
+
+
+static uint8_t was_asleep_at(uint32_t time_us){
+  for (uint8_t i=0; i<num_sleep_windows; i++){
+    if (time_us - sleep_windows[i].start_us <= sleep_windows[i].end_us - sleep_windows[i].start_us){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+void duty_cycle_frame_received(uint32_t now_us, uint8_t packet_id){
+  if (!have_arrival){
+    have_arrival = 1;
+    last_arrival_us = now_us;
+    last_arrival_id = packet_id;
+    return;
+  }
+
+  uint32_t interval = now_us - last_arrival_us;
+  if (interval < DUTY_CYCLE_MIN_GUARD_US){
+    // Part of the same burst (eg link feedback right after a control packet)
+    return;
+  }
+
+  if (frame_period_us == 0){
+    frame_period_us = interval;
+  } else {
+    // Work out how many slots went past, never more than the number of
+    // packets the transmitter sent.
+    uint32_t slots = (interval + frame_period_us / 2) / frame_period_us;
+    uint8_t sent = packet_id - last_arrival_id;
+    if (slots > sent && sent > 0){
+      slots = sent;
+    }
+    if (slots == 0){
+      slots = 1;
+    }
+
+    int32_t error = interval - slots * frame_period_us;
+    uint32_t abs_error = error < 0 ? -error : error;
+    if (abs_error < frame_period_us / 4){
+      frame_period_us += error / (int32_t)(slots * 8);
+      arrival_jitter_us += ((int32_t)abs_error - (int32_t)arrival_jitter_us) / 8;
+      if (frames_on_schedule < DUTY_CYCLE_LOCK_FRAMES){
+        frames_on_schedule += 1;
+      }
+    } else {
+      // Schedule changed. Start learning again
+      frame_period_us = interval / slots;
+      frames_on_schedule = 0;
+    }
+
+    for (uint32_t i=1; i<slots; i++){
+      if (was_asleep_at(last_arrival_us + i * frame_period_us)){
+        sleep_misses += 1;
+      }
+    }
+  }
+
+  last_arrival_us = now_us;
+  last_arrival_id = packet_id;
+  num_sleep_windows = 0;
+}
+
+
+static void account_time(uint32_t now_us, uint32_t slept_us){
+  awake_us += (now_us - last_accounted_us) - slept_us;
+  asleep_us += slept_us;
+  last_accounted_us = now_us;
+
+  // Slowly forget the past
+  if (awake_us + asleep_us > 10e6){
+    awake_us /= 2;
+    asleep_us /= 2;
+  }
+}
+
+
+static uint32_t time_until_sleep_end(uint32_t now_us){
+  if (!duty_cycle_enabled || frames_on_schedule < DUTY_CYCLE_LOCK_FRAMES){
+    return 0;
+  }
+  uint32_t since_arrival = now_us - last_arrival_us;
+  if (since_arrival > DUTY_CYCLE_MAX_MISSED * frame_period_us){
+    // Lost the transmitter. Stay awake until we find it again
+    frames_on_schedule = 0;
+    return 0;
+  }
+
+  uint32_t until_next = frame_period_us - (since_arrival % frame_period_us);
+  uint32_t guard = DUTY_CYCLE_MIN_GUARD_US + 4 * arrival_jitter_us + wake_latency_us;
+  if (until_next < guard + DUTY_CYCLE_MIN_SLEEP_US){
+    return 0;
+  }
+  return until_next - guard;
+}
+
+
+uint8_t duty_cycle_idle(void){
+  uint32_t start_us = micros();
+  uint32_t sleep_us = time_until_sleep_end(start_us);
+  if (sleep_us == 0 || num_sleep_windows >= DUTY_CYCLE_MAX_SLEEP_WINDOWS){
+    account_time(start_us, 0);
+    return 0;
+  }
+
+  tranceiver_sleep(sleep_us);
+
+  uint32_t end_us = micros();
+  uint32_t actual_us = end_us - start_us;
+  if (actual_us > sleep_us){
+    wake_latency_us += ((int32_t)(actual_us - sleep_us) - (int32_t)wake_latency_us) / 4;
+  }
+  sleep_windows[num_sleep_windows].start_us = start_us;
+  sleep_windows[num_sleep_windows].end_us = end_us;
+  num_sleep_windows += 1;
+  account_time(end_us, actual_us);
+  return 1;
+}
+
+
+float duty_cycle_current_ma(void){
+  float total = awake_us + asleep_us;
+  if (total == 0){
+    return DUTY_CYCLE_AWAKE_MA;
+  }
+  return (awake_us * DUTY_CYCLE_AWAKE_MA + asleep_us * DUTY_CYCLE_ASLEEP_MA) / total;
+}
+
+
+uint32_t duty_cycle_sleep_misses(void){
+  return sleep_misses;
+}
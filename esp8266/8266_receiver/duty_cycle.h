@@ -0,0 +1,48 @@
+#ifndef __DUTY_CYCLE_H__
+#define __DUTY_CYCLE_H__
+
+#include <stdint.h>
+
+// Low power mode for the receiver. The transmitter sends control packets on
+// a fixed schedule, so once we've learnt that schedule from the packet
+// arrival times we can turn the radio off between packets and wake up just
+// before the next one is due.
+//
+// The CPU sleeps too, so servo pulses pause while asleep. Most servos hold
+// their position through a gap of a few tens of ms, but check yours.
+
+#define DUTY_CYCLE_MIN_GUARD_US 2000  // Always wake at least this early
+#define DUTY_CYCLE_MIN_SLEEP_US 3000  // Not worth going to sleep for less than this
+#define DUTY_CYCLE_LOCK_FRAMES 8  // Packets on schedule before we trust it
+#define DUTY_CYCLE_MAX_MISSED 4  // Stay awake to re-learn the schedule after missing this many packets
+#define DUTY_CYCLE_MAX_SLEEP_WINDOWS 4
+
+// Rough supply current of the ESP8266 for reporting
+#define DUTY_CYCLE_AWAKE_MA 56.0
+#define DUTY_CYCLE_ASLEEP_MA 0.9
+
+
+/* Turn low power mode on or off */
+void duty_cycle_enable(uint8_t enabled);
+
+/*
+ * Tell the scheduler a control packet arrived from the transmitter. The
+ * gap in packet_id (the control stream's sequence number, see sequence.h)
+ * says how many were sent in between.
+ */
+void duty_cycle_frame_received(uint32_t now_us, uint8_t packet_id);
+
+/*
+ * Turns the radio off until just before the next packet is due, if the
+ * schedule is known and the gap is long enough to be worth it. Returns
+ * nonzero if it slept.
+ */
+uint8_t duty_cycle_idle(void);
+
+/* Estimated average supply current in mA */
+float duty_cycle_current_ma(void);
+
+/* Number of packets that were missed because they arrived while asleep */
+uint32_t duty_cycle_sleep_misses(void);
+
+#endif
@@ -0,0 +1,79 @@
+#include <Arduino.h>
+#include <string.h>
+
+#include "health.h"
+
+
+static volatile uint32_t callbacks = 0;
+static volatile uint32_t callback_total_us = 0;
+static volatile uint32_t callback_max_us = 0;
+static volatile uint32_t packets = 0;
+static uint32_t heap_min_free = UINT32_MAX;
+static uint32_t stack_min_free = UINT32_MAX;
+static uint32_t last_report_ms = 0;
+
+
+void health_record_callback(uint32_t elapsed_us, uint8_t was_packet){
+  callbacks += 1;
+  callback_total_us += elapsed_us;
+  if (elapsed_us > callback_max_us){
+    callback_max_us = elapsed_us;
+  }
+  if (was_packet){
+    packets += 1;
+  }
+}
+
+
+void health_update(void){
+  uint32_t heap_free = ESP.getFreeHeap();
+  if (heap_free < heap_min_free){
+    heap_min_free = heap_free;
+  }
+  uint32_t stack_free = ESP.getFreeContStack();
+  if (stack_free < stack_min_free){
+    stack_min_free = stack_free;
+  }
+
+  uint32_t now_ms = millis();
+  if (HEALTH_REPORT_INTERVAL_MS != 0 && now_ms - last_report_ms >= HEALTH_REPORT_INTERVAL_MS){
+    last_report_ms = now_ms;
+    health_print_report();
+  }
+}
+
+
+void health_get_stats(health_stats* stats){
+  // The callback can run between these reads, but each value is only ever
+  // a little stale
+  stats->callbacks = callbacks;
+  stats->callback_total_us = callback_total_us;
+  stats->callback_max_us = callback_max_us;
+  stats->packets = packets;
+  stats->heap_min_free = heap_min_free;
+  stats->stack_min_free = stack_min_free;
+  stats->uptime_ms = millis();
+}
+
+
+void health_print_report(void){
+  health_stats stats;
+  health_get_stats(&stats);
+  uint32_t mean_us = stats.callbacks ? stats.callback_total_us / stats.callbacks : 0;
+
+  Serial.print("{\"uptime_ms\":");
+  Serial.print(stats.uptime_ms);
+  Serial.print(",\"callbacks\":");
+  Serial.print(stats.callbacks);
+  Serial.print(",\"packets\":");
+  Serial.print(stats.packets);
+  Serial.print(",\"callback_mean_us\":");
+  Serial.print(mean_us);
+  Serial.print(",\"callback_max_us\":");
+  Serial.print(stats.callback_max_us);
+  Serial.print(",\"heap_min_free\":");
+  Serial.print(stats.heap_min_free);
+  Serial.print(",\"stack_min_free\":");
+  Serial.print(stats.stack_min_free);
+  Serial.println("}");
+}
@@ -0,0 +1,40 @@
+#ifndef __HEALTH_H__
+#define __HEALTH_H__
+
+#include <stdint.h>
+
+// Statistics for catching memory and latency regressions in long runs: how
+// long the wifi callback takes and how close the heap and stack come to
+// running out. Reported as one line of JSON over serial so a soak run can be
+// logged and compared with earlier ones. tools/host_tests/soak.cpp reports
+// the same figures for the frame handling run on a PC.
+
+#define HEALTH_REPORT_INTERVAL_MS 0  // How often to print the report. 0 for never
+
+
+typedef struct {
+  uint32_t callbacks;
+  uint32_t callback_total_us;
+  uint32_t callback_max_us;
+  uint32_t packets;  // Callbacks that carried one of our packets
+  uint32_t heap_min_free;
+  uint32_t stack_min_free;
+  uint32_t uptime_ms;
+} health_stats;
+
+
+/* Records how long one run of the wifi callback took */
+void health_record_callback(uint32_t elapsed_us, uint8_t was_packet);
+
+/*
+ * Samples the heap and stack, and prints the report if it is due. Call this
+ * from the main loop.
+ */
+void health_update(void);
+
+void health_get_stats(health_stats* stats);
+
+/* Prints the report over serial as a line of JSON */
+void health_print_report(void);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __I2C_BUS_NULL_H__
+#define __I2C_BUS_NULL_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// I2C bus traits with no bus behind them, so the output drivers can be run
+// on a host. Every write lands in a register file per device address (with
+// the register address auto-incrementing, as the PCA9685 does) and is
+// counted, along with how long it would have held the bus at the clock
+// passed to begin(). See pca9685.h, and tools/host_tests/pca9685_test.cpp
+// and pca9685_benchmark.cpp.
+
+struct NullI2cLog {
+  uint32_t clock_hz;
+  uint32_t writes;
+  uint32_t bytes;  // Register addresses included, device addresses not
+  uint32_t bus_time_us;
+  uint32_t wait_us;
+  uint8_t registers[128][256];  // By device address
+};
+
+
+struct I2cBusNull {
+  static constexpr uint8_t MAX_WRITE_BYTES = 128;
+  // A start, the address byte and its ACK, and a stop
+  static constexpr uint8_t WRITE_OVERHEAD_BITS = 1 + 9 + 1;
+  static constexpr uint8_t BITS_PER_BYTE = 9;  // With the ACK
+
+  static NullI2cLog& log(void){
+    static NullI2cLog log;
+    return log;
+  }
+
+  /* Clears the log and the registers */
+  static void begin(uint8_t, uint8_t, uint32_t clock_hz){
+    memset(&log(), 0, sizeof(NullI2cLog));
+    log().clock_hz = clock_hz;
+  }
+
+  static uint8_t write(uint8_t address, const uint8_t data[], uint8_t len){
+    NullI2cLog& l = log();
+    if (address >= 128 || len == 0 || l.clock_hz == 0){
+      return 2;  // As Wire reports a NACK on the address
+    }
+    uint8_t reg = data[0];
+    for (uint8_t i=1; i<len; i++){
+      l.registers[address][reg++] = data[i];
+    }
+    uint32_t bits = WRITE_OVERHEAD_BITS + len * BITS_PER_BYTE;
+    l.writes += 1;
+    l.bytes += len;
+    l.bus_time_us += (bits * 1000000 + l.clock_hz - 1) / l.clock_hz;
+    return 0;
+  }
+
+  static void wait_us(uint16_t us){
+    log().wait_us += us;
+  }
+};
+
+#endif
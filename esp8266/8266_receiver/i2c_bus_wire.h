@@ -0,0 +1,29 @@
+#ifndef __I2C_BUS_WIRE_H__
+#define __I2C_BUS_WIRE_H__
+
+#include <stdint.h>
+#include <Arduino.h>
+#include <Wire.h>
+
+// I2C bus traits for the Arduino Wire library. See pca9685.h
+
+struct I2cBusWire {
+  static constexpr uint8_t MAX_WRITE_BYTES = 128;  // Wire's transmit buffer
+
+  static void begin(uint8_t sda_pin, uint8_t scl_pin, uint32_t clock_hz){
+    Wire.begin(sda_pin, scl_pin);
+    Wire.setClock(clock_hz);
+  }
+
+  static uint8_t write(uint8_t address, const uint8_t data[], uint8_t len){
+    Wire.beginTransmission(address);
+    Wire.write(data, len);
+    return Wire.endTransmission();
+  }
+
+  static void wait_us(uint16_t us){
+    delayMicroseconds(us);
+  }
+};
+
+#endif
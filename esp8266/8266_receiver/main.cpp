@@ -3,11 +3,25 @@
 #include "tranceiver.h"
 #include "outputs.h"
 #include "telemetry.h"
+#include "power_control.h"
+#include "duty_cycle.h"
+#include "clock_sync.h"
+#include "phy_rate.h"
+#include "bulk.h"
+#include "health.h"
+#include "sensors.h"
 
 #define BATTERY_SCALER 620
 #define SERVO_LEFT_PIN 14
 #define SERVO_RIGHT_PIN 12
 #define BLUE_LED_PIN 2
+#define MAX_TRANSMIT_POWER 78  // ~19.5dbm. Check your local regulations
+#define LOW_POWER_MODE false  // Sleep between control packets
+#define TELEMETRY_PHY_PROFILE PHY_PROFILE_RANGE  // PHY_PROFILE_THROUGHPUT uses about a tenth of the airtime
+#define GROUP_MEMBER_INDEX -1  // Our slice of group control packets, or -1 to not join the group
+#define BIND_WINDOW_MS 30000  // How long after power on an unbound receiver takes a key. Bound receivers ignore group packets
+#define UNBIND_PIN 0  // The flash button. Hold it at power on to forget the transmitter we are bound to
+const uint8_t group_id[6] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x01};  // Must match the transmitters group
 const uint8_t name[] = "Tichy Stick v3";
 
 TelemChannel telem_batt_voltage = {
@@ -16,10 +30,70 @@ TelemChannel telem_batt_voltage = {
   0.0,
 };
 TelemChannel telem_rssi = {
-  "RSSI",
+  TELEMETRY_NAME_RSSI,
   TELEMETRY_UNDEFINED,
   0.0,
 };
+TelemChannel telem_tx_power = {
+  "TX Power dBm",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_frame_energy = {
+  "Energy/Frame uJ",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_current = {
+  "Current mA",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_sleep_misses = {
+  "Sleep Misses",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_latency = {
+  "Latency us",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_jitter = {
+  "Jitter us",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_config_bytes = {
+  "Config Bytes",
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+TelemChannel telem_rejected = {
+  "Rejected Frames",  // Stale, duplicate, late, unsigned or forged control packets
+  TELEMETRY_UNDEFINED,
+  0.0,
+};
+
+// ------------------------ Sensors -----------------------
+float getBatteryVolts(){
+  return analogRead(A0) * (BATTERY_SCALER / 100000.0);
+}
+
+Sensor battery_sensor = {
+  getBatteryVolts,
+  50,
+  SENSOR_FILTER_MEDIAN,  // The ADC picks up the odd spike from the servos
+  9,
+  &telem_batt_voltage,
+};
+Sensor rssi_sensor = {
+  NULL,
+  0,  // Pushed as control packets arrive
+  SENSOR_FILTER_MIN_HOLD,  // Report the worst of the recent packets
+  8,
+  &telem_rssi,
+};
 
 void setup() {
   pinMode(BLUE_LED_PIN, OUTPUT);
@@ -29,25 +103,47 @@ void setup() {
   tranceiver_init();
   tranceiver_set_channel(1);
   tranceiver_enable_filter_by_id(true);
+  tranceiver_enable_timestamps(true);
+  tranceiver_set_phy_rate(phy_rate_for_profile(TELEMETRY_PHY_PROFILE));
+  tranceiver_enable_bulk_receive(true);  // Accept config pushed from the transmitter
+  pinMode(UNBIND_PIN, INPUT_PULLUP);
+  if (digitalRead(UNBIND_PIN) == LOW){
+    Serial.println("Forgetting transmitter");
+    tranceiver_unbind();
+  }
+  if (!tranceiver_is_bound()){
+    tranceiver_bind_listen(BIND_WINDOW_MS);
+  }
+  if (GROUP_MEMBER_INDEX >= 0){
+    tranceiver_join_group(group_id, GROUP_MEMBER_INDEX);
+  }
+  power_control_set_max_power(MAX_TRANSMIT_POWER);
+  duty_cycle_enable(LOW_POWER_MODE);
   Serial.println("Begin Init Servos");
   init_outputs();
   Serial.println("Begin Init Telemetry");
   register_telem(&telem_batt_voltage);
   register_telem(&telem_rssi);
+  register_telem(&telem_tx_power);
+  register_telem(&telem_frame_energy);
+  register_telem(&telem_current);
+  register_telem(&telem_sleep_misses);
+  register_telem(&telem_latency);
+  register_telem(&telem_jitter);
+  register_telem(&telem_config_bytes);
+  register_telem(&telem_rejected);
+  Serial.println("Begin Init Sensors");
+  register_sensor(&battery_sensor);
+  register_sensor(&rssi_sensor);
+  init_sensors();
   Serial.println("Init Complete");
   digitalWrite(BLUE_LED_PIN, HIGH);
 }
 
-// ------------------------ Sensors -----------------------
-uint16_t getBatteryMillVolts(){
-  uint16_t raw = analogRead(A0);
-  uint16_t corrected = raw * BATTERY_SCALER / 100;
-  return corrected;
-}
-
 uint16_t telem_counter = 0;
 uint8_t latest_packet[TRANCEIVER_MAX_PACKET_BYTES] = {0};
 packet_stats latest_packet_stats;
+uint32_t last_rx_time_us = 0;
 
 
 // the loop function runs over and over again forever
@@ -63,7 +159,8 @@ void loop() {
   }
 
   tranceiver_get_latest_packet(latest_packet, &latest_packet_stats);
-  if (latest_packet_stats.packet_len != 0){
+  if (latest_packet_stats.packet_len != 0 && latest_packet_stats.rx_time_us != last_rx_time_us){
+    last_rx_time_us = latest_packet_stats.rx_time_us;
     if (latest_packet_stats.packet_type == PACKET_CONTROL){
       float channels[6] = {0};
       for (uint8_t i=0; i<6; i++){
@@ -72,18 +169,39 @@ void loop() {
         raw += latest_packet[i*2 + 1] << 8;
         channels[i] = float(raw) / (32767.0);
       }
-      handle_channels(channels, 6);
+      handle_channels(channels, 6, latest_packet_stats.rx_time_us);
     }
     
-    telem_rssi.value = latest_packet_stats.rssi;
+    sensor_push(&rssi_sensor, latest_packet_stats.rssi);
     telem_rssi.status = status_from_value_lesser(telem_rssi.value, -70, -90);
   }
   
-  telem_batt_voltage.value = getBatteryMillVolts() / 1000.0;
   telem_batt_voltage.status = status_from_value_lesser(telem_batt_voltage.value, 3.3, 2.7);
+  telem_tx_power.value = power_control_get_dbm();
+  telem_frame_energy.value = power_control_frame_energy_uj(tranceiver_get_last_frame_airtime_us());
+  telem_current.value = duty_cycle_current_ma();
+  telem_sleep_misses.value = duty_cycle_sleep_misses();
+  telem_latency.value = clock_sync_get_latency_us();
+  telem_jitter.value = clock_sync_get_jitter_us();
+
+  bulk_stats config_stats;
+  bulk_get_stats(&config_stats);
+  telem_config_bytes.value = config_stats.done_bytes;
+  telem_config_bytes.status = config_stats.state == BULK_FAILED ? TELEMETRY_ERROR : TELEMETRY_OK;
+
+  sequence_stats control_stats;
+  tranceiver_get_link_stats(GROUP_MEMBER_INDEX >= 0 ? SEQUENCE_STREAM_GROUP : SEQUENCE_STREAM_CONTROL, &control_stats);
+  auth_stats control_auth;
+  tranceiver_get_auth_stats(&control_auth);
+  telem_rejected.value = control_stats.reordered + control_stats.duplicates + control_stats.stale + control_auth.unsigned_rejected + control_auth.bad_tag + control_auth.replayed + control_auth.early;
   update_telemetry();
+  tranceiver_bulk_update();
+  health_update();
 
   digitalWrite(BLUE_LED_PIN, HIGH);
-  // Ensure the other tasks on the 8266 have time to run
-  delay(10);  
+  // Ensure the other tasks on the 8266 have time to run. In low power mode
+  // this sleeps until the next control packet is due.
+  if (!duty_cycle_idle()){
+    delay(10);
+  }
 }
@@ -1,31 +1,157 @@
+#include <Arduino.h>
+#include <Ticker.h>
 #include "outputs.h"
+#include "pca9685.h"
+#include "i2c_bus_wire.h"
 
-void initServo(ServoConfig* servo){
-  servo->servo.attach(servo->pin);
-  servo->servo.write(servo->center);
+static Ticker output_ticker;
+static float frame_interval_us = 33333;  // Smoothed time between control packets
+static uint32_t last_frame_us = 0;
+static uint32_t last_update_us = 0;
+static const OutputBackend* backend;
+
+
+static void servo_begin(void){
+  for (uint8_t i=0; i<OUTPUT_COUNT; i++){
+    Outputs[i].servo.attach(Outputs[i].pin);
+  }
+}
+
+static void servo_set_pulse_us(uint8_t output, float pulse_us){
+  Outputs[output].servo.writeMicroseconds(pulse_us);
+}
+
+static void servo_flush(void){
+  // Each pulse width takes effect as it is written
+}
+
+static const OutputBackend servo_backend = {
+  .begin=servo_begin,
+  .set_pulse_us=servo_set_pulse_us,
+  .flush=servo_flush,
+  .max_update_hz=0
+};
+
+
+static Pca9685<I2cBusWire> expanders[PCA9685_EXPANDERS];
+
+static void pca9685_begin(void){
+  I2cBusWire::begin(PCA9685_SDA_PIN, PCA9685_SCL_PIN, PCA9685_I2C_HZ);
+  for (uint8_t i=0; i<PCA9685_EXPANDERS; i++){
+    expanders[i].begin(PCA9685_FIRST_ADDRESS + i, PCA9685_PWM_HZ);
+  }
+}
+
+static void pca9685_set_pulse_us(uint8_t output, float pulse_us){
+  uint8_t expander = Outputs[output].pin / Pca9685<I2cBusWire>::OUTPUTS;
+  if (expander < PCA9685_EXPANDERS){
+    expanders[expander].set_pulse_us(Outputs[output].pin % Pca9685<I2cBusWire>::OUTPUTS, pulse_us);
+  }
 }
 
-void writeServo(ServoConfig* servo, float percent){
+static void pca9685_flush(void){
+  for (uint8_t i=0; i<PCA9685_EXPANDERS; i++){
+    expanders[i].flush();
+  }
+}
+
+static const OutputBackend pca9685_backend = {
+  .begin=pca9685_begin,
+  .set_pulse_us=pca9685_set_pulse_us,
+  .flush=pca9685_flush,
+  .max_update_hz=PCA9685_PWM_HZ  // Anything sent faster is overwritten before the expander latches it
+};
+
+
+static void writeServo(uint8_t output, float percent){
+  ServoConfig* servo = &Outputs[output];
   if (servo->reverse){
     percent *= -1;
   }
+  float degrees = servo->center;
   if (percent > 0){
     int8_t delta_up = servo->max - servo->center;
-    servo->servo.write(servo->center + percent * delta_up);
+    degrees += percent * delta_up;
   } else {
     int8_t delta_down = servo->center - servo->min;
-    servo->servo.write(servo->center + percent * delta_down);
+    degrees += percent * delta_down;
+  }
+  backend->set_pulse_us(output, SERVO_MIN_PULSE_US + degrees * (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) / 180.0);
+}
+
+static void setServoTarget(ServoConfig* servo, float percent, uint32_t arrival_us){
+  servo->prev_target = servo->target;
+  servo->target = percent;
+  servo->start = servo->output;
+  servo->target_us = arrival_us;
+}
+
+static void updateServo(uint8_t output, uint32_t now_us, float dt){
+  ServoConfig* servo = &Outputs[output];
+  float progress = (int32_t)(now_us - servo->target_us) / frame_interval_us;
+  if (progress < 0){
+    progress = 0;
+  } else if (progress > 1){
+    progress = 1;
+  }
+
+  float desired = servo->target;
+  if (OUTPUT_SMOOTHING == OUTPUT_INTERPOLATE){
+    desired = servo->start + (servo->target - servo->start) * progress;
+  } else if (OUTPUT_SMOOTHING == OUTPUT_EXTRAPOLATE){
+    desired = servo->target + (servo->target - servo->prev_target) * progress;
+    desired = constrain(desired, -1.0, 1.0);
+  }
+
+  float change = desired - servo->output;
+  if (servo->max_slew > 0){
+    float max_change = servo->max_slew * dt;
+    change = constrain(change, -max_change, max_change);
   }
+  servo->output += change;
+  writeServo(output, servo->output);
+}
+
+static void update_outputs(void){
+  uint32_t now_us = micros();
+  float dt = (now_us - last_update_us) / 1e6;
+  last_update_us = now_us;
+  for (uint8_t i=0; i<OUTPUT_COUNT; i++){
+    updateServo(i, now_us, dt);
+  }
+  backend->flush();
 }
 
 void init_outputs(){
-  initServo(&LeftServo);
-  initServo(&RightServo);
+  backend = OUTPUT_BACKEND == OUTPUT_BACKEND_PCA9685 ? &pca9685_backend : &servo_backend;
+  backend->begin();
+  for (uint8_t i=0; i<OUTPUT_COUNT; i++){
+    writeServo(i, 0);
+  }
+  backend->flush();
+  last_update_us = micros();
+  uint16_t update_hz = OUTPUT_UPDATE_HZ;
+  if (backend->max_update_hz > 0 && backend->max_update_hz < update_hz){
+    update_hz = backend->max_update_hz;
+  }
+  output_ticker.attach_ms(1000 / update_hz, update_outputs);
 }
 
-void handle_channels(float channels[], uint8_t channel_len){
-  float left = -channels[1] + channels[0];
-  float right = -channels[1] - channels[0];
-  writeServo(&LeftServo, left);
-  writeServo(&RightServo, right);
+void handle_channels(float channels[], uint8_t channel_len, uint32_t arrival_us){
+  if (arrival_us == last_frame_us){
+    return;  // The main loop sees the same packet until the next one arrives
+  }
+  uint32_t interval = arrival_us - last_frame_us;
+  if (interval < OUTPUT_MAX_FRAME_INTERVAL_US){
+    frame_interval_us = frame_interval_us * 0.9 + interval * 0.1;
+  }
+  last_frame_us = arrival_us;
+
+  for (uint8_t i=0; i<OUTPUT_COUNT; i++){
+    float target = 0;
+    for (uint8_t c=0; c<channel_len && c<OUTPUT_CHANNELS; c++){
+      target += Outputs[i].mix[c] * channels[c];
+    }
+    setServoTarget(&Outputs[i], target, arrival_us);
+  }
 }
@@ -2,35 +2,110 @@
 #define __OUTPUTS_H__
 #include <Servo.h>
 
+// The outputs are updated off a timer at OUTPUT_UPDATE_HZ rather than only
+// when a control packet arrives, so the servos move smoothly even at low
+// control packet rates. Between packets the outputs either:
+//  - OUTPUT_HOLD: jump to each new value (the old behaviour)
+//  - OUTPUT_INTERPOLATE: glide to each new value over one packet interval.
+//    Smooth, but adds a packet interval of lag.
+//  - OUTPUT_EXTRAPOLATE: continue the trend of the last two packets for up
+//    to one packet interval. No lag, but overshoots when the sticks stop.
+// Each output is then slew limited.
+//
+// The outputs are driven by a backend:
+//  - OUTPUT_BACKEND_SERVO: the Servo library on GPIO pins. Every output
+//    costs a software PWM interrupt, so only a few are practical.
+//  - OUTPUT_BACKEND_PCA9685: PCA9685 I2C expanders, 16 outputs each. The
+//    outputs changed by one update are sent in a single burst. See pca9685.h
+//    The burst is written from the output timer: with all 16 outputs moving
+//    it holds the bus for about 1.5ms at 400kHz (see pca9685_benchmark in
+//    tools/host_tests). The expander only picks up new pulse widths once
+//    per PWM frame, so the outputs are only updated at PCA9685_PWM_HZ,
+//    which keeps that to a few percent of the CPU.
+
+#define OUTPUT_UPDATE_HZ 250  // At most. Backends that can't use it go slower
+#define OUTPUT_SMOOTHING OUTPUT_INTERPOLATE
+#define OUTPUT_MAX_FRAME_INTERVAL_US 200000  // Longer gaps than this are dropouts, not the packet rate
+#define OUTPUT_BACKEND OUTPUT_BACKEND_SERVO
+#define OUTPUT_CHANNELS 6  // Channels a control packet can mix into each output
+
+// With several expanders, output 16 is the first output of the second
+// expander, which is at the next address
+#define PCA9685_EXPANDERS 1
+#define PCA9685_FIRST_ADDRESS 0x40
+#define PCA9685_PWM_HZ 50  // Digital servos can take more, and get finer steps with it
+#define PCA9685_SDA_PIN 4
+#define PCA9685_SCL_PIN 5
+#define PCA9685_I2C_HZ 400000
+
+// The Servo library defaults, for writing fractions of a degree
+#define SERVO_MIN_PULSE_US 544
+#define SERVO_MAX_PULSE_US 2400
+
+typedef enum {
+  OUTPUT_HOLD,
+  OUTPUT_INTERPOLATE,
+  OUTPUT_EXTRAPOLATE,
+} output_smoothing;
+
+typedef enum {
+  OUTPUT_BACKEND_SERVO,
+  OUTPUT_BACKEND_PCA9685,
+} output_backend_type;
+
 typedef struct {
-  uint8_t pin;
+  void (*begin)(void);
+  void (*set_pulse_us)(uint8_t output, float pulse_us);  // May only be staged until flush()
+  void (*flush)(void);  // Called once all the outputs have been set for an update
+  uint16_t max_update_hz;  // Updates faster than this are wasted. 0 for no limit
+} OutputBackend;
+
+typedef struct {
+  uint8_t pin;  // The GPIO pin, or the expander output with OUTPUT_BACKEND_PCA9685
   uint8_t min;
   uint8_t max;
   uint8_t center;
   bool reverse;
+  float max_slew;  // Most the output can change per second (the range is -1 to 1). 0 for no limit
+  float mix[OUTPUT_CHANNELS];  // How much of each channel drives the output
   Servo servo;
-} ServoConfig;
 
+  // Smoothing state
+  float output;
+  float start;  // Where the output was when the latest target arrived
+  float target;
+  float prev_target;
+  uint32_t target_us;
+} ServoConfig;
 
-static ServoConfig LeftServo = {
-  .pin=12,
-  .min=40,  //Upwards
-  .max=120, //Downwards
-  .center=90,
-  .reverse=false
-};
 
-static ServoConfig RightServo = {
-  .pin=14,
-  .min=60,
-  .max=140,
-  .center=90,
-  .reverse=true
+static ServoConfig Outputs[] = {
+  {  // Left elevon
+    .pin=12,
+    .min=40,  //Upwards
+    .max=120, //Downwards
+    .center=90,
+    .reverse=false,
+    .max_slew=8.0,
+    .mix={1, -1}
+  },
+  {  // Right elevon
+    .pin=14,
+    .min=60,
+    .max=140,
+    .center=90,
+    .reverse=true,
+    .max_slew=8.0,
+    .mix={-1, -1}
+  },
 };
 
+#define OUTPUT_COUNT (sizeof(Outputs) / sizeof(Outputs[0]))
 
 
 void init_outputs(void);
-void handle_channels(float channels[], uint8_t channel_len);
+
+/* Sets new targets for the outputs from a control packet that arrived at arrival_us */
+void handle_channels(float channels[], uint8_t channel_len, uint32_t arrival_us);
 
 #endif
@@ -0,0 +1,197 @@
+#ifndef __PCA9685_H__
+#define __PCA9685_H__
+
+#include <stdint.h>
+#include <string.h>
+
+// A PCA9685 16 output PWM expander, driven as servo outputs.
+//
+// New pulse widths are staged with set_pulse_us() and sent by flush(), so
+// all the outputs changed in one update go out together. The expander
+// auto-increments the register address, so a run of registers is a single
+// write. Only the registers that differ from what the expander already has
+// are sent: every output turns on at count 0, so only the two "off"
+// registers of each changed output are written, and neighbouring changed
+// outputs are merged into one write as resending the two "on" registers
+// between them is cheaper than starting another write.
+//
+// It is specialised at compile time by an I2C bus traits type which
+// provides:
+//
+//  - MAX_WRITE_BYTES: the most bytes (register address included) one write
+//    can carry
+//  - begin(): sets up the bus at a clock rate
+//  - write(): one write to a device, returning nonzero if it didn't ACK
+//  - wait_us(): a busy wait
+//
+// See i2c_bus_wire.h and i2c_bus_null.h.
+
+
+struct Pca9685Registers {
+  static constexpr uint8_t MODE1 = 0x00;
+  static constexpr uint8_t MODE2 = 0x01;
+  static constexpr uint8_t LED0_ON_L = 0x06;  // Then ON_H, OFF_L, OFF_H for each output
+  static constexpr uint8_t PRE_SCALE = 0xFE;
+
+  static constexpr uint8_t MODE1_SLEEP = 0x10;
+  static constexpr uint8_t MODE1_AI = 0x20;  // Register auto-increment
+  static constexpr uint8_t MODE2_OUTDRV = 0x04;  // Totem pole outputs
+
+  static constexpr uint8_t BYTES_PER_OUTPUT = 4;
+  static constexpr uint8_t OFF_L = 2;  // Offset of the off registers in an output's four
+  static constexpr uint32_t OSCILLATOR_HZ = 25000000;
+  static constexpr uint16_t OSCILLATOR_START_US = 500;
+};
+
+
+template <typename Bus>
+class Pca9685 {
+ public:
+  static constexpr uint8_t OUTPUTS = 16;
+  static constexpr uint16_t FULL_SCALE = 4096;
+  // Unchanged registers between two changed ones that are worth resending
+  // to keep them in one write. A new write costs a start, the device
+  // address, the register address and a stop
+  static constexpr uint8_t MERGE_GAP_BYTES = 2;
+
+  static_assert(Bus::MAX_WRITE_BYTES >= 1 + OUTPUTS * Pca9685Registers::BYTES_PER_OUTPUT, "Every output has to fit in one write");
+
+  Pca9685(): address(0), period_us(0), writes(0), bytes(0) {
+    memset(staged, 0, sizeof(staged));
+    memset(sent, 0, sizeof(sent));
+  }
+
+  /*
+   * Puts the expander at address into servo mode at pwm_hz with every output
+   * off. The bus must already have been started. Returns nonzero if the
+   * expander didn't answer.
+   */
+  uint8_t begin(uint8_t i2c_address, float pwm_hz){
+    typedef Pca9685Registers R;
+    address = i2c_address;
+    uint8_t prescale = (uint8_t)(R::OSCILLATOR_HZ / (FULL_SCALE * pwm_hz) + 0.5) - 1;
+    if (prescale < 3){
+      prescale = 3;  // The hardware minimum
+    }
+    // The real rate, as the prescaler rounds it
+    period_us = (prescale + 1) * (float)FULL_SCALE * 1e6 / R::OSCILLATOR_HZ;
+
+    // The prescaler can only be set while the oscillator is asleep
+    uint8_t res = write_register(R::MODE1, R::MODE1_SLEEP | R::MODE1_AI);
+    res |= write_register(R::PRE_SCALE, prescale);
+    res |= write_register(R::MODE2, R::MODE2_OUTDRV);
+    res |= write_register(R::MODE1, R::MODE1_AI);
+    Bus::wait_us(R::OSCILLATOR_START_US);
+
+    // Start from a known state, so flush() can tell what has changed
+    memset(staged, 0, sizeof(staged));
+    memset(sent, 0, sizeof(sent));
+    uint8_t buf[1 + OUTPUTS * R::BYTES_PER_OUTPUT] = {R::LED0_ON_L};
+    res |= write_run(buf, sizeof(buf));
+    return res;
+  }
+
+  /* Stages a new pulse width for an output. Nothing is sent until flush() */
+  void set_pulse_us(uint8_t output, float pulse_us){
+    if (output >= OUTPUTS || period_us == 0){
+      return;
+    }
+    float counts = pulse_us * FULL_SCALE / period_us;
+    if (counts < 0){
+      counts = 0;
+    } else if (counts > FULL_SCALE - 1){
+      counts = FULL_SCALE - 1;
+    }
+    staged[output] = (uint16_t)(counts + 0.5);
+  }
+
+  /*
+   * Sends the staged pulse widths that differ from what the expander has, in
+   * as few writes as possible. Returns nonzero if a write failed, in which
+   * case the failed outputs are sent again next time.
+   */
+  uint8_t flush(void){
+    typedef Pca9685Registers R;
+    uint8_t res = 0;
+    uint8_t buf[1 + OUTPUTS * R::BYTES_PER_OUTPUT];
+    int16_t run_start = -1;  // First output in the current write
+    uint8_t run_end = 0;  // One past the last changed output in it
+
+    for (uint8_t output=0; output<OUTPUTS; output++){
+      if (staged[output] == sent[output]){
+        continue;
+      }
+      uint8_t gap = (output - run_end) * R::BYTES_PER_OUTPUT + R::OFF_L;
+      if (run_start >= 0 && gap > MERGE_GAP_BYTES){
+        res |= send_outputs(buf, run_start, run_end);
+        run_start = -1;
+      }
+      if (run_start < 0){
+        run_start = output;
+      }
+      run_end = output + 1;
+    }
+    if (run_start >= 0){
+      res |= send_outputs(buf, run_start, run_end);
+    }
+    return res;
+  }
+
+  /* The PWM period the prescaler gave, in microseconds */
+  float get_period_us(void){
+    return period_us;
+  }
+
+  /* Writes and bytes (register addresses included) sent since begin() */
+  uint32_t get_writes(void){
+    return writes;
+  }
+
+  uint32_t get_bytes(void){
+    return bytes;
+  }
+
+ private:
+  uint8_t address;
+  float period_us;
+  uint16_t staged[OUTPUTS];
+  uint16_t sent[OUTPUTS];  // What the expander has
+  uint32_t writes;
+  uint32_t bytes;
+
+  uint8_t write_register(uint8_t reg, uint8_t value){
+    uint8_t buf[2] = {reg, value};
+    return write_run(buf, sizeof(buf));
+  }
+
+  uint8_t write_run(const uint8_t buf[], uint8_t len){
+    writes += 1;
+    bytes += len;
+    return Bus::write(address, buf, len);
+  }
+
+  /*
+   * One write from the off registers of first to those of last - 1. The
+   * unchanged outputs in between are resent as they are
+   */
+  uint8_t send_outputs(uint8_t buf[], uint8_t first, uint8_t last){
+    typedef Pca9685Registers R;
+    uint8_t len = 0;
+    buf[len++] = R::LED0_ON_L + first * R::BYTES_PER_OUTPUT + R::OFF_L;
+    for (uint8_t output=first; output<last; output++){
+      if (output != first){
+        buf[len++] = 0;  // On at count 0
+        buf[len++] = 0;
+      }
+      buf[len++] = staged[output] & 0xFF;
+      buf[len++] = staged[output] >> 8;
+    }
+    uint8_t res = write_run(buf, len);
+    if (res == 0){
+      memcpy(sent + first, staged + first, (last - first) * sizeof(sent[0]));
+    }
+    return res;
+  }
+};
+
+#endif
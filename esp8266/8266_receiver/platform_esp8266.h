@@ -0,0 +1,99 @@
+#ifndef __PLATFORM_ESP8266_H__
+#define __PLATFORM_ESP8266_H__
+
+#include <stdint.h>
+extern "C" {
+  #include <user_interface.h>
+}
+#include "tranceiver_core.h"
+
+// Tranceiver traits for the ESP8266 NONOS SDK.
+//
+// The SDK doesn't publish the layout of what it passes the promiscuous
+// callback, so these structures come from the ESP8266 sniffer docs (via
+// https://github.com/kalanda/esp8266-sniffer/blob/master/src/main.ino). Only
+// the first 36 bytes of each frame are visible.
+
+struct RxControl {
+  signed rssi:8; // signal intensity of packet
+  unsigned rate:4;
+  unsigned is_group:1;
+  unsigned:1;
+  unsigned sig_mode:2; // 0:is 11n packet; 1:is not 11n packet;
+  unsigned legacy_length:12; // if not 11n packet, shows length of packet.
+  unsigned damatch0:1;
+  unsigned damatch1:1;
+  unsigned bssidmatch0:1;
+  unsigned bssidmatch1:1;
+  unsigned MCS:7; // if is 11n packet, shows the modulation and code used (range from 0 to 76)
+  unsigned CWB:1; // if is 11n packet, shows if is HT40 packet or not
+  unsigned HT_length:16;// if is 11n packet, shows length of packet.
+  unsigned Smoothing:1;
+  unsigned Not_Sounding:1;
+  unsigned:1;
+  unsigned Aggregation:1;
+  unsigned STBC:2;
+  unsigned FEC_CODING:1; // if is 11n packet, shows if is LDPC packet or not.
+  unsigned SGI:1;
+  unsigned rxend_state:8;
+  unsigned ampdu_cnt:8;
+  unsigned channel:4; //which channel this packet in.
+  unsigned:12;
+};
+
+struct LenSeq{
+  u16 len; // length of packet
+  u16 seq; // serial number of packet, the high 12bits are serial number,
+  // low 14 bits are Fragment number (usually be 0)
+  u8 addr3[6]; // the third address in packet
+};
+
+struct sniffer_buf{
+  struct RxControl rx_ctrl;
+  u8 buf[36]; // head of ieee80211 packet
+  u16 cnt; // number count of packet
+  struct LenSeq lenseq[1]; //length of packet
+};
+
+struct sniffer_buf2{
+  struct RxControl rx_ctrl;
+  u8 buf[112]; //may be 240, please refer to the real source code
+  u16 cnt;
+  u16 len; //length of packet
+};
+
+
+struct PlatformEsp8266 {
+  typedef sniffer_buf rx_frame;
+
+  static constexpr uint16_t MAX_VISIBLE_BYTES = sizeof(sniffer_buf::buf);
+  static constexpr bool HAS_HARDWARE_ID_FILTER = true;
+
+  static int8_t rssi(const rx_frame* frame){
+    return frame->rx_ctrl.rssi;
+  }
+
+  static uint16_t frame_len(const rx_frame* frame){
+    return frame->lenseq[0].len;
+  }
+
+  static const uint8_t* frame_bytes(const rx_frame* frame){
+    return frame->buf;
+  }
+
+  static uint8_t send(uint8_t frame[], uint16_t len){
+    return wifi_send_pkt_freedom(frame, len, false);
+  }
+
+  static void set_hardware_filter(const uint8_t id[FrameLayout::ID_LENGTH]){
+    wifi_promiscuous_set_mac(id);
+  }
+
+  static void clear_hardware_filter(void){
+    // The SDK only forgets the filter when sniffing is turned off
+    wifi_promiscuous_enable(0);
+    wifi_promiscuous_enable(1);
+  }
+};
+
+#endif
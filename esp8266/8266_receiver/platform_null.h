@@ -0,0 +1,58 @@
+#ifndef __PLATFORM_NULL_H__
+#define __PLATFORM_NULL_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "tranceiver_core.h"
+
+// Tranceiver traits with no radio behind them, so the frame handling can be
+// run on a host. Sent frames are kept, complete with their CRC length, in
+// last_sent() so they can be fed straight back into receive(). See
+// tools/host_tests/tranceiver_core_test.cpp.
+
+struct NullRxFrame {
+  int8_t rssi;
+  uint16_t len;  // Including the CRC
+  uint8_t buf[FrameLayout::MAX_FRAME_BYTES];
+};
+
+
+struct PlatformNull {
+  typedef NullRxFrame rx_frame;
+
+  static constexpr uint16_t MAX_VISIBLE_BYTES = FrameLayout::MAX_FRAME_BYTES;
+  static constexpr bool HAS_HARDWARE_ID_FILTER = false;
+
+  static int8_t rssi(const rx_frame* frame){
+    return frame->rssi;
+  }
+
+  static uint16_t frame_len(const rx_frame* frame){
+    return frame->len;
+  }
+
+  static const uint8_t* frame_bytes(const rx_frame* frame){
+    return frame->buf;
+  }
+
+  static NullRxFrame& last_sent(void){
+    static NullRxFrame frame;
+    return frame;
+  }
+
+  static uint8_t send(uint8_t frame[], uint16_t len){
+    NullRxFrame& sent = last_sent();
+    memcpy(sent.buf, frame, len);
+    sent.len = len + FrameLayout::CRC_BYTES;
+    sent.rssi = 0;
+    return 0;
+  }
+
+  static void set_hardware_filter(const uint8_t*){
+  }
+
+  static void clear_hardware_filter(void){
+  }
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include <math.h>
+#include "power_control.h"
+
+
+static int8_t power = POWER_CONTROL_MIN_POWER;
+static int8_t max_power = POWER_CONTROL_DEFAULT_MAX_POWER;
+static uint8_t enabled = 1;
+static uint8_t good_samples = 0;
+static uint32_t last_feedback_ms = 0;
+
+
+static void clamp_power(void){
+  if (power > max_power){
+    power = max_power;
+  }
+  if (power < POWER_CONTROL_MIN_POWER){
+    power = POWER_CONTROL_MIN_POWER;
+  }
+}
+
+
+void power_control_init(int8_t initial_power){
+  power = initial_power;
+  good_samples = 0;
+  clamp_power();
+}
+
+
+void power_control_enable(uint8_t enable){
+  enabled = enable;
+}
+
+
+void power_control_set_max_power(int8_t new_max_power){
+  max_power = new_max_power;
+  clamp_power();
+}
+
+
+void power_control_feedback(int8_t rssi, uint32_t now_ms){
+  last_feedback_ms = now_ms;
+  if (enabled){
+    if (rssi < POWER_CONTROL_TARGET_RSSI - POWER_CONTROL_HYSTERESIS){
+      // Fading. Make up the whole deficit in one go
+      int16_t step = (POWER_CONTROL_TARGET_RSSI - rssi) * 4;
+      if (step < POWER_CONTROL_MIN_STEP_UP){
+        step = POWER_CONTROL_MIN_STEP_UP;
+      }
+      int16_t next = power + step;
+      power = next > max_power ? max_power : next;
+      good_samples = 0;
+    } else if (rssi > POWER_CONTROL_TARGET_RSSI + POWER_CONTROL_HYSTERESIS){
+      good_samples += 1;
+      if (good_samples >= POWER_CONTROL_SAMPLES_BEFORE_STEP_DOWN){
+        power -= POWER_CONTROL_STEP_DOWN;
+        good_samples = 0;
+      }
+    } else {
+      good_samples = 0;
+    }
+    clamp_power();
+  }
+}
+
+
+int8_t power_control_update(uint32_t now_ms){
+  if (enabled && (now_ms - last_feedback_ms) > POWER_CONTROL_FEEDBACK_TIMEOUT_MS){
+    // Nothing heard from the far end. Assume it's a fade and shout louder
+    last_feedback_ms = now_ms;
+    power += POWER_CONTROL_MIN_STEP_UP;
+    good_samples = 0;
+    clamp_power();
+  }
+  return power;
+}
+
+
+int8_t power_control_get_power(void){
+  return power;
+}
+
+
+float power_control_get_dbm(void){
+  return power / 4.0f;
+}
+
+
+float power_control_frame_energy_uj(uint32_t airtime_us){
+  float milliwatts = powf(10.0f, power_control_get_dbm() / 10.0f);
+  return milliwatts * airtime_us / 1000.0f;
+}
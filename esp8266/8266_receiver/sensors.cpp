@@ -0,0 +1,119 @@
+#include <Arduino.h>
+#include <Ticker.h>
+#include "sensors.h"
+
+static Ticker sensor_ticker;
+static Sensor* sensors[SENSOR_MAX_SOURCES];
+static volatile uint8_t num_sensors = 0;
+
+
+static float filter_samples(const Sensor* sensor){
+  uint8_t count = sensor->count;
+  float window[SENSOR_MAX_WINDOW];
+  for (uint8_t i=0; i<count; i++){
+    // Oldest first
+    window[i] = sensor->samples[(sensor->head + SENSOR_MAX_WINDOW - count + i) % SENSOR_MAX_WINDOW];
+  }
+
+  switch (sensor->filter){
+    case SENSOR_FILTER_AVERAGE: {
+      float total = 0;
+      for (uint8_t i=0; i<count; i++){
+        total += window[i];
+      }
+      return total / count;
+    }
+    case SENSOR_FILTER_MEDIAN: {
+      // Insertion sort. The window is small
+      for (uint8_t i=1; i<count; i++){
+        float sample = window[i];
+        int8_t j = i - 1;
+        while (j >= 0 && window[j] > sample){
+          window[j + 1] = window[j];
+          j -= 1;
+        }
+        window[j + 1] = sample;
+      }
+      if (count % 2 == 0){
+        return (window[count / 2 - 1] + window[count / 2]) / 2;
+      }
+      return window[count / 2];
+    }
+    case SENSOR_FILTER_MIN_HOLD: {
+      float lowest = window[0];
+      for (uint8_t i=1; i<count; i++){
+        lowest = min(lowest, window[i]);
+      }
+      return lowest;
+    }
+    case SENSOR_FILTER_MAX_HOLD: {
+      float highest = window[0];
+      for (uint8_t i=1; i<count; i++){
+        highest = max(highest, window[i]);
+      }
+      return highest;
+    }
+    default:
+      return window[count - 1];
+  }
+}
+
+
+static void add_sample(Sensor* sensor, float sample){
+  sensor->samples[sensor->head] = sample;
+  sensor->head = (sensor->head + 1) % SENSOR_MAX_WINDOW;
+  if (sensor->count < sensor->window){
+    sensor->count += 1;
+  }
+  sensor->value = filter_samples(sensor);
+  if (sensor->channel != NULL){
+    sensor->channel->value = sensor->value;
+  }
+}
+
+
+static void sample_sensors(void){
+  for (uint8_t i=0; i<num_sensors; i++){
+    Sensor* sensor = sensors[i];
+    if (sensor->period_ms == 0){
+      continue;
+    }
+    if (sensor->due_ms > SENSOR_TICK_MS){
+      sensor->due_ms -= SENSOR_TICK_MS;
+      continue;
+    }
+    sensor->due_ms = sensor->period_ms;
+    add_sample(sensor, sensor->read());
+  }
+}
+
+
+void init_sensors(void){
+  sensor_ticker.attach_ms(SENSOR_TICK_MS, sample_sensors);
+}
+
+
+int8_t register_sensor(Sensor* sensor){
+  if (num_sensors == SENSOR_MAX_SOURCES){
+    Serial.print("Max number sensors reached");
+    return -1;
+  }
+  sensor->window = constrain(sensor->window, 1, SENSOR_MAX_WINDOW);
+  sensor->head = 0;
+  sensor->count = 0;
+  sensor->due_ms = 0;
+  sensor->value = 0;
+  sensors[num_sensors] = sensor;
+  num_sensors += 1;  // Only now can the timer see it
+  return 0;
+}
+
+
+void sensor_push(Sensor* sensor, float sample){
+  add_sample(sensor, sample);
+}
+
+
+float sensor_value(const Sensor* sensor){
+  return sensor->value;
+}
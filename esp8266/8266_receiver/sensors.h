@@ -0,0 +1,57 @@
+#ifndef __SENSORS_H__
+#define __SENSORS_H__
+
+#include <stdint.h>
+#include "telemetry.h"
+
+// Sensors are sampled off a timer rather than from the main loop, so a slow
+// read (the ADC takes ~100us) never holds up a control packet. Each sensor
+// keeps its last few samples and runs them through a filter, and the
+// filtered value is written straight into its telemetry channel.
+//
+// Sensors with a period of 0 aren't sampled. Instead the main loop pushes
+// values in as they happen (eg the RSSI of each control packet).
+
+#define SENSOR_MAX_SOURCES 6
+#define SENSOR_MAX_WINDOW 16  // Most samples a filter can cover
+#define SENSOR_TICK_MS 10  // Sample periods are rounded up to a multiple of this
+
+typedef enum {
+  SENSOR_FILTER_NONE,  // The latest sample
+  SENSOR_FILTER_AVERAGE,  // Mean of the window. Smooths out noise
+  SENSOR_FILTER_MEDIAN,  // Ignores the odd wild sample
+  SENSOR_FILTER_MIN_HOLD,  // Worst case over the window, eg for signal strength
+  SENSOR_FILTER_MAX_HOLD,
+} sensor_filter;
+
+typedef float (*sensor_read)(void);
+
+typedef struct {
+  sensor_read read;  // Called from the timer. NULL for pushed sensors
+  uint16_t period_ms;  // 0 for pushed sensors
+  sensor_filter filter;
+  uint8_t window;  // Samples the filter covers, up to SENSOR_MAX_WINDOW
+  TelemChannel* channel;  // Gets the filtered value. May be NULL
+
+  // Filter state
+  float samples[SENSOR_MAX_WINDOW];
+  uint8_t head;
+  uint8_t count;
+  uint16_t due_ms;
+  volatile float value;
+} Sensor;
+
+
+/* Starts sampling. Sensors can be registered before or after */
+void init_sensors(void);
+
+/* Returns -1 if there are already SENSOR_MAX_SOURCES sensors */
+int8_t register_sensor(Sensor* sensor);
+
+/* Adds a sample to a pushed sensor */
+void sensor_push(Sensor* sensor, float sample);
+
+/* The filtered value, or 0 if there have been no samples */
+float sensor_value(const Sensor* sensor);
+
+#endif
@@ -0,0 +1,127 @@
+#include <string.h>
+
+#include "sequence.h"
+#include "tranceiver.h"
+
+
+sequence_stream_id sequence_stream_for(uint8_t packet_type){
+  switch (packet_type){
+    case PACKET_CONTROL:
+      return SEQUENCE_STREAM_CONTROL;
+    case PACKET_GROUP:
+      return SEQUENCE_STREAM_GROUP;
+    case PACKET_TELEMETRY:
+      return SEQUENCE_STREAM_TELEMETRY;
+    default:
+      return SEQUENCE_STREAM_OTHER;
+  }
+}
+
+
+void sequence_reset(sequence_window* window){
+  memset(window, 0, sizeof(sequence_window));
+}
+
+
+static void measure_interval(sequence_window* window, uint32_t gap, uint32_t now_us){
+  uint32_t sample = (now_us - window->last_new_us) / gap;
+  if (sample > SEQUENCE_RESYNC_MAX_US){
+    sample = SEQUENCE_RESYNC_MAX_US;
+  }
+  if (window->interval_us == 0){
+    window->interval_us = sample;
+  } else {
+    window->interval_us += ((int32_t)sample - (int32_t)window->interval_us) / 8;
+  }
+}
+
+
+static uint32_t resync_timeout_us(const sequence_window* window){
+  if (window->interval_us == 0){
+    return SEQUENCE_RESYNC_MIN_US;
+  }
+  if (window->interval_us >= SEQUENCE_RESYNC_MAX_US / SEQUENCE_RESYNC_INTERVALS){
+    return SEQUENCE_RESYNC_MAX_US;
+  }
+  uint32_t timeout_us = window->interval_us * SEQUENCE_RESYNC_INTERVALS;
+  return timeout_us > SEQUENCE_RESYNC_MIN_US ? timeout_us : SEQUENCE_RESYNC_MIN_US;
+}
+
+
+/* timed_out is set for a restart after the timeout, rather than after stale packets */
+static void restart(sequence_window* window, uint8_t count, uint32_t now_us, uint8_t timed_out){
+  if (window->started){
+    window->stats.resyncs += 1;
+  }
+  // Keep counting up from where we were, so the numbers never go back
+  uint32_t newest = (window->stats.newest & ~0xFF) | count;
+  if (window->started && newest <= window->stats.newest){
+    newest += 0x100;
+  }
+  if (timed_out){
+    // The shortest gap it could have been, which is also how it gets an
+    // interval for a stream that loses packets from the start
+    uint32_t gap = newest - window->stats.newest;
+    window->stats.lost += gap - 1;
+    measure_interval(window, gap, now_us);
+  }
+  window->started = 1;
+  window->stale_in_a_row = 0;
+  // Whatever came before can't be told apart from duplicates
+  window->seen = ~0u;
+  window->last_new_us = now_us;
+  window->stats.newest = newest;
+  window->stats.received += 1;
+}
+
+
+sequence_result sequence_check(sequence_window* window, uint8_t count, uint32_t now_us, uint32_t* extended){
+  if (!window->started){
+    restart(window, count, now_us, 0);
+    *extended = window->stats.newest;
+    return SEQUENCE_NEW;
+  }
+  if ((now_us - window->last_new_us) > resync_timeout_us(window)){
+    restart(window, count, now_us, 1);
+    *extended = window->stats.newest;
+    return SEQUENCE_NEW;
+  }
+
+  int8_t delta = (int8_t)(count - (uint8_t)window->stats.newest);
+  sequence_stats* stats = &window->stats;
+  if (delta > 0){
+    stats->lost += delta - 1;
+    stats->newest += delta;
+    stats->received += 1;
+    measure_interval(window, delta, now_us);
+    window->seen = delta < SEQUENCE_WINDOW ? (window->seen << delta) | 1 : 1;
+    window->last_new_us = now_us;
+    window->stale_in_a_row = 0;
+    *extended = stats->newest;
+    return SEQUENCE_NEW;
+  }
+
+  uint8_t age = -delta;
+  if (age >= SEQUENCE_WINDOW){
+    stats->stale += 1;
+    window->stale_in_a_row += 1;
+    if (window->stale_in_a_row >= SEQUENCE_RESYNC_STALE){
+      restart(window, count, now_us, 0);
+      *extended = stats->newest;
+      return SEQUENCE_NEW;
+    }
+    return SEQUENCE_STALE;
+  }
+
+  window->stale_in_a_row = 0;
+  *extended = stats->newest - age;
+  if (window->seen & (1u << age)){
+    stats->duplicates += 1;
+    return SEQUENCE_DUPLICATE;
+  }
+  window->seen |= 1u << age;
+  stats->received += 1;
+  stats->lost -= 1;
+  stats->reordered += 1;
+  return SEQUENCE_REORDERED;
+}
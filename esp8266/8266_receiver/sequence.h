@@ -0,0 +1,83 @@
+#ifndef __SEQUENCE_H__
+#define __SEQUENCE_H__
+
+#include <stdint.h>
+
+// Per stream sequence numbers.
+//
+// Each stream of packets (see sequence_stream_id) has its own counter, sent
+// as the Pcnt byte of each frame, so a receiver can tell how many packets of
+// a stream it has missed without the others getting in the way. The byte
+// wraps every 256 packets, so the receiver extends it to 32 bits by taking
+// the value closest to the newest one it has seen. That is only ambiguous
+// after a gap of 128 packets, so the window times out after
+// SEQUENCE_RESYNC_INTERVALS of the streams own (smoothed) packet interval
+// without a new packet, and starts again from whatever arrives next. Streams
+// are sent at anything from 1kHz to a few Hz, so one fixed timeout would
+// either be ambiguous for the fast ones or restart on every lost packet of
+// the slow ones. The gap a restart skips is counted as lost, taking the
+// fewest packets it could have been.
+//
+// The window remembers which of the SEQUENCE_WINDOW packets before the
+// newest have arrived. That tells a packet that arrives late (reordered, by
+// a relay or the wifi stack) from a duplicate, and one from too far back to
+// tell (stale). Losses are counted as gaps open, and taken back if the late
+// packet turns up. A transmitter that reboots starts its counters again from
+// 0, which can look stale, so SEQUENCE_RESYNC_STALE stale packets in a row
+// also start the window again.
+
+#define SEQUENCE_WINDOW 32  // Packets before the newest that are remembered. At most 32
+#define SEQUENCE_RESYNC_INTERVALS 64  // Half the ambiguous gap, as the rate can change
+#define SEQUENCE_RESYNC_MIN_US 100000  // Until a stream's interval is known. Fewer than 128 packets at 1kHz
+#define SEQUENCE_RESYNC_MAX_US 10000000  // A transmitter silent this long has more likely rebooted
+#define SEQUENCE_RESYNC_STALE 8
+
+
+typedef enum {
+  SEQUENCE_STREAM_CONTROL = 0,
+  SEQUENCE_STREAM_GROUP = 1,
+  SEQUENCE_STREAM_TELEMETRY = 2,
+  SEQUENCE_STREAM_OTHER = 3,  // Names, link feedback, sync, bulk and binding
+  SEQUENCE_STREAM_COUNT
+} sequence_stream_id;
+
+typedef enum {
+  SEQUENCE_NEW = 0,  // Newer than anything before it
+  SEQUENCE_REORDERED = 1,  // Older than the newest, but the first copy
+  SEQUENCE_DUPLICATE = 2,
+  SEQUENCE_STALE = 3,  // Too far behind the newest to tell
+} sequence_result;
+
+typedef struct {
+  uint32_t newest;  // Extended sequence number of the newest packet
+  uint32_t received;  // New and reordered packets
+  uint32_t lost;  // Gaps that haven't been filled
+  uint32_t reordered;
+  uint32_t duplicates;
+  uint32_t stale;
+  uint32_t resyncs;  // Times the window started again
+} sequence_stats;
+
+typedef struct {
+  uint8_t started;
+  uint8_t stale_in_a_row;
+  uint32_t seen;  // Bit i is set if packet newest - i has arrived
+  uint32_t last_new_us;
+  uint32_t interval_us;  // Smoothed time between packets. 0 until measured
+  sequence_stats stats;
+} sequence_window;
+
+
+/* The stream a packet type is counted in */
+sequence_stream_id sequence_stream_for(uint8_t packet_type);
+
+/* Forgets everything, including the stats */
+void sequence_reset(sequence_window* window);
+
+/*
+* Checks the Pcnt of a packet that has arrived and records it. The extended
+* sequence number is put in extended (for anything but a stale packet).
+*/
+sequence_result sequence_check(sequence_window* window, uint8_t count, uint32_t now_us, uint32_t* extended);
+
+#endif
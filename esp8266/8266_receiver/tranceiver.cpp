@@ -6,100 +6,36 @@ extern "C" {
 }
 
 #include "tranceiver.h"
+#include "power_control.h"
+#include "duty_cycle.h"
+#include "clock_sync.h"
+#include "phy_rate.h"
+#include "bulk.h"
+#include "health.h"
+#include "bind.h"
+#include "tranceiver_core.h"
+#include "platform_esp8266.h"
 #include <stdlib.h>
 
 /* Parameters for the transmitter */
 #define DEFAULT_WIFI_CHANNEL 1
 #define DEFAULT_TRANSMIT_POWER 8 //2dbm = 1.5mW
 
-uint8_t last_sent_packet_count = 0;
-uint8_t filter_by_id = 1;
+uint8_t current_channel = DEFAULT_WIFI_CHANNEL;
+int8_t applied_power = DEFAULT_TRANSMIT_POWER;
+uint32_t last_sent_airtime_us = 0;
+phy_rate applied_rate = PHY_RATE_DEFAULT;
 
+// Link quality of the packets we receive, reported back to the transmitter
+int8_t last_rx_rssi = 0;
+uint32_t last_rx_ms = 0;
+uint32_t last_link_sent_ms = 0;
 
-uint8_t packet_header[] = {
-	0x08, 0x00, // Data packet (normal subtype)
-	0x00, 0x00, // Duration and ID
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Recipient Address
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // Transmitter Address
-	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, // BSSID Address
-	0x00, 0x00, // Sequence Control
-	0x00, 0x00, // QOS control
 
-	/* Data gets substituted here */
-	/* Then the ESP automatically adds the checksum for us */
-};
-
-#define ID_OFFSET 4
-#define ID_LENGTH 6
-#define PACKET_COUNT_OFFSET 22
-#define PACKET_TYPE_OFFSET 23
-#define DATA_1_OFFSET 10
-
-
-static uint8_t tx_packet_buffer[sizeof(packet_header) + TRANCEIVER_MAX_PACKET_BYTES] = {0};
+static TranceiverCore<PlatformEsp8266> core;
 uint8_t rx_packet_buffer[sizeof(packet_stats) + TRANCEIVER_MAX_PACKET_BYTES] = {0};
 
 
-/* ESp Gubbage. I can't find what file this should be #included from. Everyone online just
- * has this in the file directly....
- * 
- * Copied from https://github.com/kalanda/esp8266-sniffer/blob/master/src/main.ino
- */
-#define DATA_LENGTH           112
-
-#define TYPE_MANAGEMENT       0x00
-#define TYPE_CONTROL          0x01
-#define TYPE_DATA             0x02
-#define SUBTYPE_PROBE_REQUEST 0x04
-
-struct RxControl {
-  signed rssi:8; // signal intensity of packet
-  unsigned rate:4;
-  unsigned is_group:1;
-  unsigned:1;
-  unsigned sig_mode:2; // 0:is 11n packet; 1:is not 11n packet;
-  unsigned legacy_length:12; // if not 11n packet, shows length of packet.
-  unsigned damatch0:1;
-  unsigned damatch1:1;
-  unsigned bssidmatch0:1;
-  unsigned bssidmatch1:1;
-  unsigned MCS:7; // if is 11n packet, shows the modulation and code used (range from 0 to 76)
-  unsigned CWB:1; // if is 11n packet, shows if is HT40 packet or not
-  unsigned HT_length:16;// if is 11n packet, shows length of packet.
-  unsigned Smoothing:1;
-  unsigned Not_Sounding:1;
-  unsigned:1;
-  unsigned Aggregation:1;
-  unsigned STBC:2;
-  unsigned FEC_CODING:1; // if is 11n packet, shows if is LDPC packet or not.
-  unsigned SGI:1;
-  unsigned rxend_state:8;
-  unsigned ampdu_cnt:8;
-  unsigned channel:4; //which channel this packet in.
-  unsigned:12;
-};
-
-struct LenSeq{
-  u16 len; // length of packet
-  u16 seq; // serial number of packet, the high 12bits are serial number,
-  // low 14 bits are Fragment number (usually be 0)
-  u8 addr3[6]; // the third address in packet
-}; 
-
-struct sniffer_buf{
-  struct RxControl rx_ctrl;
-  u8 buf[36]; // head of ieee80211 packet
-  u16 cnt; // number count of packet
-  struct LenSeq lenseq[1]; //length of packet 
-};
-
-struct sniffer_buf2{
-  struct RxControl rx_ctrl;
-  u8 buf[112]; //may be 240, please refer to the real source code
-  u16 cnt;
-  u16 len; //length of packet
-}; 
-
 /* 
  *  Actual code.....
  */
@@ -109,11 +45,14 @@ void tranceiver_set_channel(uint8_t channel){
   Serial.print("Set channel to: ");
   Serial.println(channel);
 	wifi_set_channel(channel);
+  current_channel = channel;
 }
 
 
 void tranceiver_set_power(int8_t power){
 	system_phy_set_max_tpw(power);
+  applied_power = power;
+  power_control_init(power);
 }
 
 
@@ -127,67 +66,120 @@ static void print_buffer(uint8_t* buff, uint16_t len){
 }
 
 void tranceiver_set_id(const uint8_t id_bytes[6]){
-  uint8_t i = 0;
-  for (i=0; i<6; i+=1){
-    packet_header[ID_OFFSET + i] = id_bytes[i];
-  }
-  Serial.println("Set header to: ");
-  print_buffer(packet_header, sizeof(packet_header));
+  core.set_id(id_bytes);
+  Serial.println("Set ID to: ");
+  print_buffer((uint8_t*)core.get_id(), FrameLayout::ID_LENGTH);
 }
 
 void tranceiver_enable_filter_by_id(uint8_t enabled){
-  filter_by_id = enabled;
-  if (filter_by_id){
-    wifi_promiscuous_set_mac(&packet_header[ID_OFFSET]);
-  }
+  core.enable_filter_by_id(enabled);
 }
 
+uint8_t tranceiver_join_group(const uint8_t group_id[6], uint8_t member_index){
+  return core.join_group(group_id, member_index);
+}
 
-static void _handle_data_packet(uint8_t* buffer, uint16_t len) {
-	/* Runs whenever there is an incoming packet */
+void tranceiver_leave_group(void){
+  core.leave_group();
+}
+
+void tranceiver_enable_timestamps(uint8_t enabled){
+  core.enable_timestamps(enabled);
+}
+
+void tranceiver_get_link_stats(sequence_stream_id stream, sequence_stats* stats){
+  core.get_link_stats(stream, stats);
+}
+
+void tranceiver_bind_listen(uint32_t window_ms){
+  bind_listen(core.get_id(), window_ms, millis());
+}
+
+uint8_t tranceiver_is_bound(void){
+  return core.is_bound();
+}
+
+void tranceiver_unbind(void){
+  core.clear_key();
+  bind_forget();
+  bind_save_changes();
+}
+
+void tranceiver_get_auth_stats(auth_stats* stats){
+  core.get_auth_stats(stats);
+}
+
+
+static uint8_t _process_data_packet(uint8_t* buffer, uint16_t len) {
+  /* Returns nonzero if the frame was one of our packets */
   if (len == sizeof(sniffer_buf2)){
     // Management Packet
-    return;
+    return 0;
   } else if (len == sizeof(RxControl)){
     // Indesipherable packet (unsupported packet type)
-    return;
+    return 0;
   } else if (len % 10 != 0){
     Serial.println("Unknown Packet Duration?");
-    return;
+    return 0;
   }
   
-	struct sniffer_buf *snifferPacket = (struct sniffer_buf*) buffer;
-
-  //The ESP8266 doesn't provide all the data, maxing out with the first 36 bytes
-  uint16_t actual_length = snifferPacket->lenseq[0].len; 
-  uint16_t provided_length = min(actual_length, 36);
+  const sniffer_buf* snifferPacket = (const sniffer_buf*) buffer;
   if (snifferPacket->cnt == 0){
     Serial.println("Uhh?!");
   }
 
-  /* Check that the ID matches what we expect */
-  if (filter_by_id){
-    if (memcmp((snifferPacket->buf)+ID_OFFSET, packet_header+ID_OFFSET, ID_LENGTH) != 0) {
-      return;
+  uint8_t rx_buffer[sizeof(packet_stats) + TRANCEIVER_MAX_PACKET_BYTES];
+  packet_stats* this_packet = (packet_stats*)&rx_buffer;
+  uint8_t* data = rx_buffer + sizeof(packet_stats);
+  uint32_t now_us = micros();
+  packet_types packet_type = core.receive(snifferPacket, this_packet, data, now_us);
+  if (packet_type == PACKET_NONE){
+    return 0;
+  }
+
+  this_packet->rx_time_us = now_us;
+  last_rx_rssi = this_packet->rssi;
+  last_rx_ms = millis();
+  if (packet_type == PACKET_CONTROL){
+    duty_cycle_frame_received(now_us, (uint8_t)this_packet->packet_id);
+  }
+  if (packet_type == PACKET_LINK){
+    // The transmitter telling us how well it hears us
+    power_control_feedback((int8_t)data[0], millis());
+    return 1;
+  }
+  if (packet_type == PACKET_SYNC){
+    clock_sync_handle_reply(data, now_us);
+    return 1;
+  }
+  if (packet_type == PACKET_BULK){
+    bulk_handle_packet(data, this_packet->packet_len, now_us);
+    return 1;
+  }
+  if (packet_type == PACKET_BIND){
+    if (bind_handle_packet(this_packet->source_id, data, this_packet->packet_len, millis())){
+      core.set_key(bind_get_key(), 0);
     }
+    return 1;
+  }
+  if (packet_type == PACKET_CONTROL && core.is_bound()){
+    // It got through, so it was signed with our key
+    bind_authenticated();
   }
+  if (packet_type == PACKET_CONTROL && this_packet->tx_timestamp != 0){
+    this_packet->latency_us = clock_sync_packet_latency(this_packet->tx_timestamp, now_us);
+  }
+
   // Make metadata and data continuous in memory
-  packet_stats* this_packet = (packet_stats*)&rx_packet_buffer;
-  this_packet->rssi = snifferPacket->rx_ctrl.rssi;
-  this_packet->packet_len = 12;
-  this_packet->packet_id = *(uint8_t*)((snifferPacket->buf) + PACKET_COUNT_OFFSET);
-  uint8_t packet_type = *(uint8_t*)((snifferPacket->buf) + PACKET_TYPE_OFFSET);
-  this_packet->packet_type = (packet_types)packet_type;
-  memcpy(
-    this_packet->source_id,
-    &(snifferPacket->buf[ID_OFFSET]),
-    6
-  );
-  memcpy(
-    rx_packet_buffer + sizeof(packet_stats),
-    &(snifferPacket->buf[10]),
-    12
-  );
+  memcpy(rx_packet_buffer, rx_buffer, sizeof(packet_stats) + this_packet->packet_len);
+  return 1;
+}
+
+static void _handle_data_packet(uint8_t* buffer, uint16_t len) {
+	/* Runs whenever there is an incoming packet */
+  uint32_t start_us = micros();
+  uint8_t was_packet = _process_data_packet(buffer, len);
+  health_record_callback(micros() - start_us, was_packet);
 }
 
 void tranceiver_get_latest_packet(uint8_t buff[], packet_stats* stats){
@@ -206,6 +198,41 @@ void tranceiver_get_latest_packet(uint8_t buff[], packet_stats* stats){
 }
 
 
+uint8_t tranceiver_set_phy_rate(uint8_t rate){
+  // The SDK can only fix the rate to one of the OFDM rates
+  static const uint8_t sdk_rates[] = {
+    PHY_RATE_6, PHY_RATE_9, PHY_RATE_12, PHY_RATE_18,
+    PHY_RATE_24, PHY_RATE_36, PHY_RATE_48, PHY_RATE_54
+  };
+  if (rate == PHY_RATE_DEFAULT || rate == PHY_RATE_1M){
+    wifi_set_user_fixed_rate(FIXED_RATE_MASK_NONE, 0);
+  } else if (rate >= PHY_RATE_6M && rate <= PHY_RATE_54M){
+    wifi_set_user_fixed_rate(FIXED_RATE_MASK_ALL, sdk_rates[rate - PHY_RATE_6M]);
+  } else {
+    return 1;
+  }
+  applied_rate = (phy_rate)rate;
+  return 0;
+}
+
+
+void tranceiver_sleep(uint32_t us){
+  // Forced light sleep requires the wifi to be disconnected
+  wifi_promiscuous_enable(0);
+  wifi_set_opmode(NULL_MODE);
+  wifi_fpm_set_sleep_type(LIGHT_SLEEP_T);
+  wifi_fpm_open();
+  wifi_fpm_do_sleep(us);
+  delay(us / 1000 + 1);  // The chip only goes to sleep once we yield
+
+  wifi_fpm_close();
+  wifi_set_opmode(STATION_MODE);
+  wifi_set_channel(current_channel);
+  wifi_promiscuous_enable(1);
+  core.enable_filter_by_id(core.is_filtering_by_id());
+}
+
+
 volatile uint8_t can_send = 1;
 void callback_send_pkt_freedom(uint8 status)
 {
@@ -230,6 +257,12 @@ void tranceiver_init(void){
   tranceiver_set_id(mac);
   tranceiver_set_channel(DEFAULT_WIFI_CHANNEL);
   tranceiver_set_power(DEFAULT_TRANSMIT_POWER);
+
+  bind_begin();
+  const uint8_t* key = bind_get_key();
+  if (key != NULL){
+    core.set_key(key, bind_get_counter_limit());
+  }
 }
 
 
@@ -246,40 +279,19 @@ static uint8_t tranceiver_send_packet(const packet_types packet_type, const uint
   }
   can_send = 0;
 
-  // Copy in header
-  memcpy(&tx_packet_buffer, &packet_header, sizeof(packet_header));
-
-  // Copy in data
-  uint16_t i = 0;
-  uint16_t extra_bytes = 0; // Number bytes greater than the packet size
-  for (i=0; i < data_len; i++){
-    if (i < 12){ //First 12 bytes go into header
-      tx_packet_buffer[DATA_1_OFFSET + i] = data[i];
-    } else {  //The remaining data goes at teh end
-      tx_packet_buffer[sizeof(packet_header) + (i - 12)] = data[i];
-      extra_bytes += 1;
-    }
+  int8_t power = power_control_update(millis());
+  if (power != applied_power){
+    system_phy_set_max_tpw(power);
+    applied_power = power;
   }
 
-  // Set metadata
-  tx_packet_buffer[PACKET_TYPE_OFFSET] = (uint8_t)packet_type;
-  tx_packet_buffer[PACKET_COUNT_OFFSET] = last_sent_packet_count;
-  last_sent_packet_count += 1;
-
-  //Serial.println(data_len);
-  //Serial.println(extra_bytes);
-  //print_buffer(tx_packet_buffer, sizeof(packet_header) + extra_bytes);
-
-  int8_t res = 0;
-	res = wifi_send_pkt_freedom(
-		(uint8_t*)&tx_packet_buffer, sizeof(packet_header) + extra_bytes,
-		false
-	);
+  uint8_t res = core.send(packet_type, data, data_len, micros());
+  last_sent_airtime_us = phy_rate_airtime_us(applied_rate, core.get_last_frame_len());
   if (res != 0){
     Serial.print("Failed to send packet: ");
-    print_buffer(tx_packet_buffer, sizeof(packet_header) + extra_bytes);
+    print_buffer((uint8_t*)core.get_last_frame(), core.get_last_frame_len());
   }
-	return res;
+  return res;
 }
 
 
@@ -289,7 +301,35 @@ uint8_t tranceiver_send_telemtry(const telemetry_status status, const float valu
   memcpy(telemetry_buffer+1, (uint8_t*)&value, 4);
   memcpy(telemetry_buffer+5, name, min(name_len, TRANCEIVER_MAX_NAME_LENGTH));
   uint16_t total_size = min(name_len, TRANCEIVER_MAX_NAME_LENGTH) + sizeof(value) + 1;  // the 1 is the status
-  return tranceiver_send_packet(PACKET_TELEMETRY, (uint8_t*)&telemetry_buffer, total_size);
+  uint8_t res = tranceiver_send_packet(PACKET_TELEMETRY, (uint8_t*)&telemetry_buffer, total_size);
+
+  // Tell the transmitter how well we can hear it so it can adjust its power.
+  // Our RSSI telemetry comes round too rarely to steer it
+  uint32_t now_ms = millis();
+  if ((now_ms - last_link_sent_ms) >= POWER_CONTROL_LINK_INTERVAL_MS && (now_ms - last_rx_ms) < POWER_CONTROL_FEEDBACK_TIMEOUT_MS){
+    last_link_sent_ms = now_ms;
+    uint8_t link_data[2] = {(uint8_t)last_rx_rssi, (uint8_t)applied_power};
+    tranceiver_send_packet(PACKET_LINK, link_data, sizeof(link_data));
+  }
+
+  // Answer a bind request, and keep the key it brought
+  uint8_t accept[AUTH_BIND_ACCEPT_BYTES];
+  if (bind_take_accept(accept)){
+    tranceiver_send_packet(PACKET_BIND, accept, sizeof(accept));
+  }
+  bind_save_changes();
+
+  // Keep the saved counter limit ahead of the transmitter, and after a
+  // restart ask it to sign above the limit we carried on from
+  uint32_t limit = core.next_auth_limit();
+  if (limit != 0 && bind_save_counter_limit(limit) == 0){
+    core.set_auth_limit(limit);
+  }
+  uint8_t resync[AUTH_BIND_RESYNC_BYTES];
+  if (bind_take_resync(core.get_id(), core.get_auth_counter(), resync, now_ms)){
+    tranceiver_send_packet(PACKET_BIND, resync, sizeof(resync));
+  }
+  return res;
 }
 
 
@@ -299,7 +339,30 @@ uint8_t tranceiver_send_name_packet(const uint8_t name[], uint8_t len){
     len = min(len, TRANCEIVER_MAX_NAME_LENGTH);
   }
   uint8_t concatenated[TRANCEIVER_MAX_NAME_LENGTH + 6] = {0x00};
-  memcpy(concatenated, packet_header+ID_OFFSET, 6); // Copy in ID
+  memcpy(concatenated, core.get_id(), 6); // Copy in ID
   memcpy(concatenated + 6, name, len);
   return tranceiver_send_packet(PACKET_NAME, concatenated, len+6);
 }
+
+
+void tranceiver_bulk_update(void){
+  uint8_t bulk_data[TRANCEIVER_MAX_PACKET_BYTES];
+  for (uint8_t i=0; i<BULK_PACKETS_PER_UPDATE; i++){
+    uint16_t len = bulk_next_packet(bulk_data, micros());
+    if (len == 0 || tranceiver_send_packet(PACKET_BULK, bulk_data, len) != 0){
+      break;
+    }
+    bulk_charge_airtime(last_sent_airtime_us);
+  }
+}
+
+
+void tranceiver_enable_bulk_receive(uint8_t enabled){
+  // Segments have to fit in the part of the frame we can see
+  bulk_enable_receive(enabled, TranceiverCore<PlatformEsp8266>::MAX_VISIBLE_DATA - BULK_HEADER_BYTES);
+}
+
+
+uint32_t tranceiver_get_last_frame_airtime_us(void){
+  return last_sent_airtime_us;
+}
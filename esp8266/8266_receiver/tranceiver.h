@@ -4,9 +4,12 @@
 
 //This module handles injecting and sniffing packets. It implements the
 #include <stdint.h>
+#include "sequence.h"
+#include "auth.h"
 #define TRANCEIVER_MAX_PACKET_BYTES 64
 #define TRANCEIVER_MAX_NAME_LENGTH 16
 const int16_t CHANNEL_VALUE_UNDEFINED = -32768;
+#define TELEMETRY_NAME_RSSI "RSSI"  // Receivers report the RSSI of control packets under this name
 
 
 typedef enum {
@@ -22,15 +25,30 @@ typedef enum {
   PACKET_CONTROL = 0x01,
   PACKET_TELEMETRY = 0x02,
   PACKET_NAME = 0x03,
+  PACKET_LINK = 0x04,
+  PACKET_SYNC = 0x05,
+  PACKET_BULK = 0x06,
+  PACKET_GROUP = 0x07,  // Arrives as PACKET_CONTROL, holding just our slice
+  PACKET_BIND = 0x08,
 } packet_types;
 
+// The top bits of the packet type byte are flags
+#define PACKET_TYPE_MASK 0x0F
+#define PACKET_HOPS_MASK 0x30  // Times the frame has been repeated by a relay
+#define PACKET_HOPS_SHIFT 4
+#define PACKET_FLAG_AUTH 0x40  // The last 4 bytes are a tag (auth.h), and any timestamp comes before them
+#define PACKET_FLAG_TIMESTAMP 0x80  // The last 4 bytes are the senders clock in us
+
 
 typedef struct {
   int8_t rssi;
   uint8_t source_id[6];
-  uint8_t packet_id;
+  uint32_t packet_id;  // Sequence number within its stream, extended to 32 bits for control packets
   uint8_t packet_len;
   packet_types packet_type;
+  uint32_t tx_timestamp;  // The senders clock, if the packet was timestamped
+  int32_t latency_us;  // One way latency, or CLOCK_SYNC_LATENCY_UNKNOWN
+  uint32_t rx_time_us;  // Our clock when the packet arrived
 } packet_stats;
 
 typedef struct {
@@ -73,6 +91,19 @@ uint8_t tranceiver_send_name_packet(const uint8_t name[], uint8_t len);
  */
 void tranceiver_set_power(int8_t transmit_power);
 
+/*
+ * How long the last frame sent held the channel for. Used to work out the
+ * energy spent per frame.
+ */
+uint32_t tranceiver_get_last_frame_airtime_us(void);
+
+/*
+ * Fixes the PHY rate packets are sent at (one of the phy_rate values in
+ * phy_rate.h). Only 1Mbps and the 802.11g rates are supported. Returns
+ * nonzero if the rate is not supported.
+ */
+uint8_t tranceiver_set_phy_rate(uint8_t rate);
+
 
 /* Sets the wifi transmission frequency. Check your countries regulations.
  * (most countries allow use of 1 - 11. Some countries restrict the use of
@@ -89,4 +120,58 @@ void tranceiver_set_id(const uint8_t id_bytes[6]);
 
 void tranceiver_enable_filter_by_id(uint8_t enabled);
 
+/*
+ * Be driven by group control packets sent to group_id as well, taking the
+ * channels of member member_index. Returns nonzero if the index is out of
+ * range.
+ */
+uint8_t tranceiver_join_group(const uint8_t group_id[6], uint8_t member_index);
+
+void tranceiver_leave_group(void);
+
+/*
+ * Timestamps outgoing control and telemetry packets. The receiver needs this
+ * on to synchronise its clock with the transmitter.
+ */
+void tranceiver_enable_timestamps(uint8_t enabled);
+
+/*
+ * How the sequence numbers of a stream of packets we have received went
+ * (see sequence.h). Stale and duplicate packets are dropped, and so are
+ * control packets that arrive after a newer one.
+ */
+void tranceiver_get_link_stats(sequence_stream_id stream, sequence_stats* stats);
+
+/*
+ * Lets a transmitter bind us for the next window_ms (see bind.h). Our
+ * accept is sent along with the next telemetry packet.
+ */
+void tranceiver_bind_listen(uint32_t window_ms);
+
+uint8_t tranceiver_is_bound(void);
+
+/* Forgets the transmitter we are bound to, so anything can drive us again */
+void tranceiver_unbind(void);
+
+/*
+ * How the control packets checked against our key went. Once bound, those
+ * that aren't signed with it are dropped.
+ */
+void tranceiver_get_auth_stats(auth_stats* stats);
+
+/*
+ * Sends any bulk transfer packets that are due (see bulk.h). Call this
+ * regularly.
+ */
+void tranceiver_bulk_update(void);
+
+/* Accept bulk transfers from the far end */
+void tranceiver_enable_bulk_receive(uint8_t enabled);
+
+/*
+ * Turns the radio and CPU off for the specified time. Packets arriving in
+ * this time are lost.
+ */
+void tranceiver_sleep(uint32_t us);
+
 #endif
@@ -0,0 +1,452 @@
+#ifndef __TRANCEIVER_CORE_H__
+#define __TRANCEIVER_CORE_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "tranceiver.h"
+#include "clock_sync.h"
+#include "sequence.h"
+#include "auth.h"
+#include "bind.h"
+
+// The platform independent half of the tranceiver: building the frames we
+// send and picking apart the ones we receive. It is specialised at compile
+// time by a platform traits type which provides:
+//
+//  - rx_frame: the layout of what the SDK hands the sniffer callback
+//  - MAX_VISIBLE_BYTES: how much of a received frame the SDK lets us see
+//  - HAS_HARDWARE_ID_FILTER: whether the radio can drop frames for other
+//    receivers before they reach us
+//  - rssi(), frame_len(), frame_bytes(): accessors for an rx_frame
+//  - send(): the raw frame injection primitive
+//  - set_hardware_filter(): programs the hardware ID filter, if there is one
+//  - clear_hardware_filter(): lets frames for any ID through again
+//
+// Everything the hot path depends on is a compile time constant, so each
+// build gets its own fully inlined copy. See platform_esp8266.h and
+// platform_null.h.
+
+
+// Where things are in a frame. See PacketFormat.md
+struct FrameLayout {
+  static constexpr uint16_t HEADER_BYTES = 26;
+  static constexpr uint16_t ID_OFFSET = 4;
+  static constexpr uint16_t ID_LENGTH = 6;
+  static constexpr uint16_t DATA_1_OFFSET = 10;
+  static constexpr uint16_t HEADER_DATA_BYTES = 12;
+  static constexpr uint16_t PACKET_COUNT_OFFSET = 22;
+  static constexpr uint16_t PACKET_TYPE_OFFSET = 23;
+  static constexpr uint16_t CRC_BYTES = 4;
+  static constexpr uint16_t TIMESTAMP_BYTES = 4;
+  static constexpr uint16_t MIN_TRAILED_DATA = 8;  // Short packets are padded to this before a timestamp or tag
+  static constexpr uint16_t MAX_FRAME_BYTES = HEADER_BYTES + TRANCEIVER_MAX_PACKET_BYTES - HEADER_DATA_BYTES;
+};
+
+
+// The data of a group control packet. The member count, then where each
+// members channels start (and where the last one ends), then the channels
+// from an even offset. See "Group Control Packet" in PacketFormat.md
+struct GroupLayout {
+  static constexpr uint8_t MAX_MEMBERS = 16;
+
+  static constexpr uint16_t table_bytes(uint8_t members){
+    return (1 + members + 1 + 1) & ~1;
+  }
+};
+
+
+constexpr uint16_t tranceiver_min(uint16_t a, uint16_t b){
+  return a < b ? a : b;
+}
+
+
+template <typename Platform>
+class TranceiverCore {
+ public:
+  typedef typename Platform::rx_frame rx_frame;
+
+  // The most data bytes of a received frame we can ever see
+  static constexpr uint16_t MAX_VISIBLE_DATA = tranceiver_min(
+    Platform::MAX_VISIBLE_BYTES - FrameLayout::HEADER_BYTES + FrameLayout::HEADER_DATA_BYTES,
+    TRANCEIVER_MAX_PACKET_BYTES
+  );
+
+  TranceiverCore(): filter_by_id(1), timestamps_enabled(0), group_joined(0), member_index(0), bound(0), rx_auth_counter(0), rx_auth_newest(0), rx_auth_limit(0), tx_auth_counter(0), last_frame_len(0) {
+    memset(header, 0, sizeof(header));
+    memset(group_id, 0, sizeof(group_id));
+    memset(packet_counts, 0, sizeof(packet_counts));
+    memset(&auth_results, 0, sizeof(auth_results));
+    reset_windows();
+    header[0] = 0x08;  // Data packet (normal subtype)
+  }
+
+  /* The ID is the recipient address of every frame we send */
+  void set_id(const uint8_t id[FrameLayout::ID_LENGTH]){
+    if (memcmp(header + FrameLayout::ID_OFFSET, id, FrameLayout::ID_LENGTH) != 0){
+      reset_windows();  // Someone else's packets are numbered separately
+    }
+    memcpy(header + FrameLayout::ID_OFFSET, id, FrameLayout::ID_LENGTH);
+    apply_hardware_filter();
+  }
+
+  const uint8_t* get_id(void) const {
+    return header + FrameLayout::ID_OFFSET;
+  }
+
+  void enable_filter_by_id(uint8_t enabled){
+    filter_by_id = enabled;
+    apply_hardware_filter();
+  }
+
+  /*
+   * Also take our slice of group control packets sent to group_id. The
+   * hardware filter only holds one ID, so it is off while in a group.
+   * Returns nonzero if the index is out of range.
+   */
+  uint8_t join_group(const uint8_t id[FrameLayout::ID_LENGTH], uint8_t index){
+    if (index >= GroupLayout::MAX_MEMBERS){
+      return 1;
+    }
+    memcpy(group_id, id, FrameLayout::ID_LENGTH);
+    member_index = index;
+    group_joined = 1;
+    apply_hardware_filter();
+    return 0;
+  }
+
+  void leave_group(void){
+    group_joined = 0;
+    apply_hardware_filter();
+  }
+
+  uint8_t is_filtering_by_id(void) const {
+    return filter_by_id;
+  }
+
+  void enable_timestamps(uint8_t enabled){
+    timestamps_enabled = enabled;
+  }
+
+  /*
+   * Binds us to the transmitter with this key (see bind.h): control packets
+   * we send are signed with it, and those we receive have to be. Counters
+   * up to last_counter count as already had: 0 for a new key, or the limit
+   * saved with it after a restart.
+   */
+  void set_key(const uint8_t new_key[AUTH_KEY_BYTES], uint32_t last_counter){
+    auth_init_key(&key, new_key);
+    rx_auth_counter = last_counter;
+    rx_auth_newest = last_counter;
+    rx_auth_limit = last_counter;
+    bound = 1;
+  }
+
+  void clear_key(void){
+    rx_auth_counter = 0;
+    rx_auth_newest = 0;
+    rx_auth_limit = 0;
+    bound = 0;
+  }
+
+  /* The last counter we took, for a resync */
+  uint32_t get_auth_counter(void) const {
+    return rx_auth_counter;
+  }
+
+  /*
+   * Counters are only taken up to a limit, which has to be saved before it
+   * goes up so that set_key() can carry on from it after a restart. Returns
+   * the limit to save next, or 0 if the current one will do for a while.
+   */
+  uint32_t next_auth_limit(void) const {
+    if (!bound || rx_auth_limit == UINT32_MAX){
+      return 0;
+    }
+    if (rx_auth_newest < rx_auth_limit && rx_auth_limit - rx_auth_newest >= BIND_COUNTER_BLOCK / 2){
+      return 0;
+    }
+    return rx_auth_newest <= UINT32_MAX - BIND_COUNTER_BLOCK ? rx_auth_newest + BIND_COUNTER_BLOCK : UINT32_MAX;
+  }
+
+  /* Once the limit from next_auth_limit() is saved */
+  void set_auth_limit(uint32_t limit){
+    if (limit > rx_auth_limit){
+      rx_auth_limit = limit;
+    }
+  }
+
+  uint8_t is_bound(void) const {
+    return bound;
+  }
+
+  /* Number of data bytes in a frame frame_len bytes long (including the CRC) */
+  static constexpr uint16_t data_len(uint16_t frame_len){
+    return frame_len > FrameLayout::HEADER_BYTES + FrameLayout::CRC_BYTES
+      ? frame_len - FrameLayout::HEADER_BYTES - FrameLayout::CRC_BYTES + FrameLayout::HEADER_DATA_BYTES
+      : FrameLayout::HEADER_DATA_BYTES;
+  }
+
+  /* How many of those data bytes the platform lets us see */
+  static constexpr uint16_t visible_data_len(uint16_t frame_len){
+    return tranceiver_min(data_len(frame_len), MAX_VISIBLE_DATA);
+  }
+
+  /*
+   * Picks apart a received frame into its metadata and data. The data
+   * buffer must hold MAX_VISIBLE_DATA bytes. Returns PACKET_NONE if the
+   * frame is for someone else, or is a stale or duplicate copy of one we
+   * have had (see sequence.h). Control packets older than one we have
+   * already had are dropped too, so the outputs never go backwards.
+   */
+  packet_types receive(const rx_frame* frame, packet_stats* stats, uint8_t data[], uint32_t now_us){
+    const uint8_t* buf = Platform::frame_bytes(frame);
+    uint8_t packet_type = buf[FrameLayout::PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK;
+    uint8_t packet_flags = buf[FrameLayout::PACKET_TYPE_OFFSET] & ~PACKET_TYPE_MASK;
+    if (packet_type == PACKET_GROUP){
+      // Sent to the group rather than to us
+      if (!group_joined || memcmp(buf + FrameLayout::ID_OFFSET, group_id, FrameLayout::ID_LENGTH) != 0){
+        return PACKET_NONE;
+      }
+    } else if (filter_by_id && memcmp(buf + FrameLayout::ID_OFFSET, get_id(), FrameLayout::ID_LENGTH) != 0){
+      return PACKET_NONE;
+    }
+    uint16_t frame_len = Platform::frame_len(frame);
+    uint16_t len = data_len(frame_len);
+    uint16_t visible_len = visible_data_len(frame_len);
+
+    stats->rssi = Platform::rssi(frame);
+    stats->packet_id = buf[FrameLayout::PACKET_COUNT_OFFSET];
+    stats->packet_type = (packet_types)packet_type;
+    memcpy(stats->source_id, buf + FrameLayout::ID_OFFSET, FrameLayout::ID_LENGTH);
+    memcpy(data, buf + FrameLayout::DATA_1_OFFSET, FrameLayout::HEADER_DATA_BYTES);
+    memcpy(
+      data + FrameLayout::HEADER_DATA_BYTES,
+      buf + FrameLayout::HEADER_BYTES,
+      visible_len - FrameLayout::HEADER_DATA_BYTES
+    );
+
+    // Once bound to a transmitter, only control packets signed with its key
+    // get through. Group packets can't be signed for each member, so none
+    // do. Checked before the sequence window, so a forged Pcnt can't push
+    // the real ones out of it
+    if (bound && (packet_type == PACKET_CONTROL || packet_type == PACKET_GROUP)){
+      if (packet_type == PACKET_GROUP || !(packet_flags & PACKET_FLAG_AUTH)){
+        auth_results.unsigned_rejected += 1;
+        return PACKET_NONE;
+      }
+      uint8_t signed_header[AUTH_HEADER_BYTES];
+      auth_frame_header(signed_header, buf + FrameLayout::ID_OFFSET, buf[FrameLayout::PACKET_COUNT_OFFSET], buf[FrameLayout::PACKET_TYPE_OFFSET]);
+      // The whole packet has to be visible to check it
+      if (len > visible_len || len < AUTH_TRAILER_BYTES || !auth_verify(&key, signed_header, data, len)){
+        auth_results.bad_tag += 1;
+        return PACKET_NONE;
+      }
+      // A recorded copy has a good tag too, but not a new counter
+      uint32_t auth_counter;
+      memcpy(&auth_counter, data + len - AUTH_TRAILER_BYTES, AUTH_COUNTER_BYTES);
+      if (auth_counter <= rx_auth_counter){
+        auth_results.replayed += 1;
+        return PACKET_NONE;
+      }
+      if (auth_counter > rx_auth_newest){
+        rx_auth_newest = auth_counter;
+      }
+      // Past the saved limit, a restart would forget we took it, so it has
+      // to wait for the main loop to raise the limit
+      if (auth_counter > rx_auth_limit){
+        auth_results.early += 1;
+        return PACKET_NONE;
+      }
+      rx_auth_counter = auth_counter;
+      auth_results.verified += 1;
+    }
+
+    // A signed packet ends with the counter and tag, and a timestamp goes
+    // just before them. Only control packets are ever signed
+    uint16_t trailer_len = 0;
+    if (packet_flags & PACKET_FLAG_AUTH){
+      if (packet_type != PACKET_CONTROL){
+        return PACKET_NONE;
+      }
+      trailer_len += AUTH_TRAILER_BYTES;
+    }
+    if (packet_flags & PACKET_FLAG_TIMESTAMP){
+      trailer_len += FrameLayout::TIMESTAMP_BYTES;
+    }
+    if (len < trailer_len){
+      return PACKET_NONE;
+    }
+    len -= trailer_len;
+    stats->tx_timestamp = 0;
+    stats->latency_us = CLOCK_SYNC_LATENCY_UNKNOWN;
+    if (packet_flags & PACKET_FLAG_TIMESTAMP){
+      if (len + FrameLayout::TIMESTAMP_BYTES <= visible_len){
+        memcpy(&stats->tx_timestamp, data + len, FrameLayout::TIMESTAMP_BYTES);
+      }
+    }
+    stats->packet_len = tranceiver_min(visible_len, len);
+
+    // Only our slice of a group packet goes any further, as a control packet
+    if (packet_type == PACKET_GROUP){
+      uint16_t offset = 0;
+      uint16_t slice_len = find_slice(data, stats->packet_len, &offset);
+      if (slice_len == 0){
+        return PACKET_NONE;
+      }
+      memmove(data, data + offset, slice_len);
+      stats->packet_len = slice_len;
+      stats->packet_type = PACKET_CONTROL;
+    }
+
+    sequence_stream_id stream = sequence_stream_for(packet_type);
+    if (stream != SEQUENCE_STREAM_OTHER && (filter_by_id || stream == SEQUENCE_STREAM_GROUP)){
+      sequence_result result = sequence_check(&windows[stream], buf[FrameLayout::PACKET_COUNT_OFFSET], now_us, &stats->packet_id);
+      if (result == SEQUENCE_STALE || result == SEQUENCE_DUPLICATE){
+        return PACKET_NONE;
+      }
+      if (stats->packet_type == PACKET_CONTROL && result != SEQUENCE_NEW){
+        return PACKET_NONE;
+      }
+    }
+    return stats->packet_type;
+  }
+
+  /* How the sequence numbers of a stream we receive went. See sequence.h */
+  void get_link_stats(sequence_stream_id stream, sequence_stats* stats) const {
+    if (stream >= SEQUENCE_STREAM_COUNT){
+      memset(stats, 0, sizeof(sequence_stats));
+      return;
+    }
+    memcpy(stats, &windows[stream].stats, sizeof(sequence_stats));
+  }
+
+  void get_auth_stats(auth_stats* stats) const {
+    memcpy(stats, &auth_results, sizeof(auth_stats));
+  }
+
+  /*
+   * Builds a frame around the data and hands it to the platform to send.
+   * Returns nonzero if not sent.
+   */
+  uint8_t send(const packet_types packet_type, const uint8_t data[], uint16_t len, uint32_t now_us){
+    if (len > TRANCEIVER_MAX_PACKET_BYTES){
+      return 1;
+    }
+    // Control packets are signed once we are bound, with room kept for the
+    // counter and tag
+    uint8_t sign = bound && packet_type == PACKET_CONTROL;
+    uint16_t max_len = sign ? TRANCEIVER_MAX_PACKET_BYTES - AUTH_TRAILER_BYTES : TRANCEIVER_MAX_PACKET_BYTES;
+    if (len > max_len){
+      return 1;
+    }
+    uint8_t payload[TRANCEIVER_MAX_PACKET_BYTES] = {0};
+    memcpy(payload, data, len);
+
+    uint8_t packet_flags = 0;
+    if (timestamps_enabled && (packet_type == PACKET_CONTROL || packet_type == PACKET_TELEMETRY) && len + FrameLayout::TIMESTAMP_BYTES <= max_len){
+      // The timestamp has to be the last four bytes (before any tag), and
+      // short packets are padded out to fill the header anyway.
+      if (len < FrameLayout::MIN_TRAILED_DATA){
+        len = FrameLayout::MIN_TRAILED_DATA;
+      }
+      memcpy(payload + len, &now_us, FrameLayout::TIMESTAMP_BYTES);
+      len += FrameLayout::TIMESTAMP_BYTES;
+      packet_flags |= PACKET_FLAG_TIMESTAMP;
+    }
+
+    uint8_t* count = &packet_counts[sequence_stream_for(packet_type)];
+    if (sign){
+      packet_flags |= PACKET_FLAG_AUTH;
+      if (len < FrameLayout::MIN_TRAILED_DATA){
+        len = FrameLayout::MIN_TRAILED_DATA;
+      }
+      tx_auth_counter += 1;
+      memcpy(payload + len, &tx_auth_counter, AUTH_COUNTER_BYTES);
+      len += AUTH_COUNTER_BYTES;
+      uint8_t signed_header[AUTH_HEADER_BYTES];
+      auth_frame_header(signed_header, get_id(), *count, (uint8_t)packet_type | packet_flags);
+      uint32_t tag = auth_tag(&key, signed_header, payload, len);
+      memcpy(payload + len, &tag, AUTH_TAG_BYTES);
+      len += AUTH_TAG_BYTES;
+    }
+
+    // The first 12 data bytes go in the header, the rest after it
+    uint16_t extra_bytes = len > FrameLayout::HEADER_DATA_BYTES ? len - FrameLayout::HEADER_DATA_BYTES : 0;
+    memcpy(tx_buffer, header, FrameLayout::HEADER_BYTES);
+    memcpy(tx_buffer + FrameLayout::DATA_1_OFFSET, payload, FrameLayout::HEADER_DATA_BYTES);
+    memcpy(tx_buffer + FrameLayout::HEADER_BYTES, payload + FrameLayout::HEADER_DATA_BYTES, extra_bytes);
+
+    tx_buffer[FrameLayout::PACKET_TYPE_OFFSET] = (uint8_t)packet_type | packet_flags;
+    // Each stream is numbered separately
+    tx_buffer[FrameLayout::PACKET_COUNT_OFFSET] = *count;
+    *count += 1;
+
+    last_frame_len = FrameLayout::HEADER_BYTES + extra_bytes;
+    return Platform::send(tx_buffer, last_frame_len);
+  }
+
+  /* The length of the last frame sent, excluding the CRC */
+  uint16_t get_last_frame_len(void) const {
+    return last_frame_len;
+  }
+
+  /* The last frame sent */
+  const uint8_t* get_last_frame(void) const {
+    return tx_buffer;
+  }
+
+ private:
+  void reset_windows(void){
+    for (uint8_t i=0; i<SEQUENCE_STREAM_COUNT; i++){
+      sequence_reset(&windows[i]);
+    }
+  }
+
+  void apply_hardware_filter(void){
+    if (!Platform::HAS_HARDWARE_ID_FILTER){
+      return;
+    }
+    if (filter_by_id && !group_joined){
+      Platform::set_hardware_filter(header + FrameLayout::ID_OFFSET);
+    } else {
+      Platform::clear_hardware_filter();
+    }
+  }
+
+  /* Where our channels are in group packet data. Returns their length in bytes, or 0 if there are none */
+  uint16_t find_slice(const uint8_t data[], uint16_t len, uint16_t* offset) const {
+    uint8_t members = data[0];
+    if (member_index >= members || members > GroupLayout::MAX_MEMBERS || GroupLayout::table_bytes(members) > len){
+      return 0;
+    }
+    uint16_t start = GroupLayout::table_bytes(members) + data[1 + member_index] * 2;
+    uint16_t end = GroupLayout::table_bytes(members) + data[1 + member_index + 1] * 2;
+    if (end <= start || end > len){
+      return 0;
+    }
+    *offset = start;
+    return end - start;
+  }
+
+  uint8_t header[FrameLayout::HEADER_BYTES];
+  uint8_t tx_buffer[FrameLayout::MAX_FRAME_BYTES];
+  uint8_t packet_counts[SEQUENCE_STREAM_COUNT];  // The next Pcnt of each stream we send
+  sequence_window windows[SEQUENCE_STREAM_COUNT];  // The streams we receive
+  uint8_t filter_by_id;
+  uint8_t timestamps_enabled;
+  uint8_t group_joined;
+  uint8_t group_id[FrameLayout::ID_LENGTH];
+  uint8_t member_index;
+  auth_key_state key;
+  uint8_t bound;
+  uint32_t rx_auth_counter;  // The last good one, see auth.h
+  uint32_t rx_auth_newest;  // The newest with a good tag, taken or not
+  uint32_t rx_auth_limit;  // Saved, see next_auth_limit()
+  // Only in RAM: this firmware never sends control packets, so nothing
+  // needs it kept over a restart the way the ESP32 transmitter does
+  uint32_t tx_auth_counter;
+  auth_stats auth_results;
+  uint16_t last_frame_len;
+};
+
+#endif
@@ -0,0 +1,158 @@
+// What signed control packets (see "Binding" in PacketFormat.md) cost the
+// ESP8266 receive path, measured with its auth.cpp and a
+// TranceiverCore<PlatformNull>:
+//  - verify: the time and cycles (the TSC, on x86) to check the tag on a
+//    control packet with each number of data bytes in DATA_SIZES, the
+//    counter and tag included
+//  - rx: the time in receive() per control packet for FRAMES packets:
+//    unsigned while unbound, signed while bound, and unsigned while bound
+//    (a forger, all of which should be rejected). The difference between
+//    the first two is the latency signing adds.
+//  - airtime: a 4 channel control packet at RATE, with and without a
+//    timestamp. Short packets are padded to fill the header, which hides
+//    some of the counter and tag.
+//
+// The host is a lot faster than an ESP8266, so compare builds, and the
+// share signing takes of the receive path, rather than the absolute times.
+// esp32_receiver/auth_benchmark.py measures the same on an ESP32.
+//
+//     make -C tools/host_tests auth_benchmark
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "platform_null.h"
+#include "phy_rate.h"
+
+
+static const uint16_t DATA_SIZES[] = {16, 20, 24, 64};  // 4 channels, with a timestamp, 6 channels with one, the most
+static const uint32_t VERIFY_ITERATIONS = 200000;
+static const uint32_t FRAMES = 50000;  // Within one counter limit block
+static const phy_rate RATE = PHY_RATE_1M;
+
+static const uint8_t RX_ID[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x30};
+static const uint8_t KEY[AUTH_KEY_BYTES] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+static const uint32_t CONTROL_INTERVAL_US = 1000;
+
+
+static volatile uint32_t good_tags;  // So the checks can't be optimised away
+
+
+static uint64_t cycle_count(void){
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+static void bench_verify(void){
+  printf("%6s %8s %8s\n", "bytes", "ns", "cycles");
+  auth_key_state state;
+  auth_init_key(&state, KEY);
+  uint8_t header[AUTH_HEADER_BYTES] = {0};
+  uint8_t data[TRANCEIVER_MAX_PACKET_BYTES] = {0};
+  for (uint16_t len : DATA_SIZES){
+    uint32_t good = 0;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t start_cycles = cycle_count();
+    for (uint32_t i=0; i<VERIFY_ITERATIONS; i++){
+      data[0] = i;
+      good += auth_verify(&state, header, data, len);
+    }
+    uint64_t cycles = cycle_count() - start_cycles;
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    good_tags = good;
+    printf("%6u %8.1f %8.0f\n", (unsigned)len, ns / VERIFY_ITERATIONS, (double)cycles / VERIFY_ITERATIONS);
+  }
+}
+
+
+/*
+ * Mean ns in receive() per control packet. Returns the packets that got
+ * through in *accepted.
+ */
+static double bench_rx(uint8_t bound, uint8_t signed_packets, uint32_t* accepted){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  if (signed_packets){
+    tx.set_key(KEY, 0);
+  }
+  if (bound){
+    // As the main loop would save the first counter limit
+    rx.set_key(KEY, 0);
+    rx.set_auth_limit(rx.next_auth_limit());
+  }
+
+  // Signed up front, so only the receive side is timed
+  std::vector<NullRxFrame> frames(FRAMES);
+  for (uint32_t i=0; i<FRAMES; i++){
+    int16_t channels[4] = {(int16_t)(i & 0x7FFF), 0, 0, 0};
+    tx.send(PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), i * CONTROL_INTERVAL_US);
+    frames[i] = PlatformNull::last_sent();
+    frames[i].rssi = -50;
+  }
+
+  *accepted = 0;
+  packet_stats stats;
+  uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i=0; i<FRAMES; i++){
+    *accepted += rx.receive(&frames[i], &stats, data, i * CONTROL_INTERVAL_US) == PACKET_CONTROL;
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return ns / FRAMES;
+}
+
+
+/* Frame length without the CRC, as phy_rate_airtime_us wants it */
+static uint16_t frame_bytes(uint16_t data_len){
+  uint16_t extra = data_len > FrameLayout::HEADER_DATA_BYTES ? data_len - FrameLayout::HEADER_DATA_BYTES : 0;
+  return FrameLayout::HEADER_BYTES + extra;
+}
+
+static uint16_t trailed(uint16_t data_len, uint16_t trailer_len){
+  return (data_len > FrameLayout::MIN_TRAILED_DATA ? data_len : FrameLayout::MIN_TRAILED_DATA) + trailer_len;
+}
+
+
+static void bench_airtime(void){
+  for (uint8_t timestamped=0; timestamped<2; timestamped++){
+    uint16_t data_len = 8;  // 4 channels
+    if (timestamped){
+      data_len = trailed(data_len, FrameLayout::TIMESTAMP_BYTES);
+    }
+    printf("airtime %s timestamp: %uus unsigned, %uus signed\n", timestamped ? "with" : "without",
+      (unsigned)phy_rate_airtime_us(RATE, frame_bytes(data_len)),
+      (unsigned)phy_rate_airtime_us(RATE, frame_bytes(trailed(data_len, AUTH_TRAILER_BYTES)))
+    );
+  }
+}
+
+
+int main(){
+  bench_verify();
+  printf("\n");
+
+  printf("%-10s %8s %9s %9s\n", "packets", "rx ns", "accepted", "rejected");
+  const char* names[] = {"unbound", "signed", "forged"};
+  const uint8_t bound[] = {0, 1, 1};
+  const uint8_t signed_packets[] = {0, 1, 0};
+  double rx_ns[3];
+  for (uint8_t i=0; i<3; i++){
+    uint32_t accepted;
+    rx_ns[i] = bench_rx(bound[i], signed_packets[i], &accepted);
+    printf("%-10s %8.1f %9u %9u\n", names[i], rx_ns[i], (unsigned)accepted, (unsigned)(FRAMES - accepted));
+  }
+  printf("Signing adds %.1fns to the receive path\n", rx_ns[1] - rx_ns[0]);
+  printf("\n");
+
+  bench_airtime();
+  return 0;
+}
@@ -0,0 +1,187 @@
+// How long a config upload takes: the ESP32 transmitters bulk module sending
+// a blob to a receivers one (ESP8266, or a second copy of the ESP32 one) over
+// a simulated channel that loses frames at random. See "Bulk Transfer Packet"
+// in PacketFormat.md.
+//
+// The transmitter sends a control packet at CONTROL_HZ and follows each one
+// with whatever bulk packets its airtime budget allows, as
+// tranceiver_send_control_packet does. The receiver answers from its main
+// loop every RX_LOOP_US. Time only moves on by the airtime of each frame
+// (phy_rate_airtime_us at RATE), so this is the best case for an otherwise
+// idle channel.
+//
+//     make -C tools/host_tests bulk_benchmark
+
+#include <stdio.h>
+#include <string.h>
+#include "bulk.h"  // The ESP8266 one
+#include "phy_rate.h"
+#include "bulk_ends.h"
+
+
+static const uint32_t CONTROL_HZ = 30;
+static const uint16_t CONTROL_DATA_BYTES = 20;  // 4 channels, a timestamp, and the auth counter and tag
+static const uint32_t RX_LOOP_US = 10000;
+static const phy_rate RATE = PHY_RATE_1M;
+static const float LOSSES[] = {0.0f, 0.1f, 0.3f};
+static const uint16_t RUNS = 20;
+static const uint32_t TIMEOUT_US = 30000000;
+
+static const uint32_t BULK_MAX_BYTES_ESP32 = 8192;
+static const uint16_t HEADER_BYTES = 26;
+static const uint16_t HEADER_DATA_BYTES = 12;
+
+
+static uint8_t esp8266_is_complete(uint8_t xfer_id){
+  bulk_stats stats;
+  bulk_get_stats(&stats);
+  return stats.state == BULK_COMPLETE && stats.xfer_id == xfer_id;
+}
+
+static uint32_t esp8266_retransmits(void){
+  bulk_stats stats;
+  bulk_get_stats(&stats);
+  return stats.retransmits;
+}
+
+static const bulk_end esp8266_receiver_end = {
+  bulk_send,
+  bulk_enable_receive,
+  bulk_handle_packet,
+  bulk_next_packet,
+  bulk_charge_airtime,
+  esp8266_is_complete,
+  esp8266_retransmits,
+  bulk_get_data,
+  BULK_PACKETS_PER_UPDATE,
+  BULK_MAX_BYTES,
+};
+
+struct Receiver {
+  const char* name;
+  const bulk_end* end;
+  uint16_t max_segment;
+};
+
+static const Receiver RECEIVERS[] = {
+  {"ESP8266", &esp8266_receiver_end, 22 - BULK_HEADER_BYTES},  // Only sees 22 data bytes
+  {"ESP32", &esp32_receiver_end, BULK_MAX_SEGMENT_BYTES},
+};
+
+
+static uint32_t rng_state = 1;
+
+static float random_unit(void){
+  // xorshift32, so runs are the same everywhere
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return (rng_state & 0xFFFFFF) / (float)0x1000000;
+}
+
+static uint32_t frame_airtime_us(uint16_t data_len){
+  uint16_t extra = data_len > HEADER_DATA_BYTES ? data_len - HEADER_DATA_BYTES : 0;
+  return phy_rate_airtime_us(RATE, HEADER_BYTES + extra);
+}
+
+
+/* Sends a burst of up to packets_per_update bulk packets from one end to the other */
+static void send_burst(const bulk_end& from, const bulk_end& to, float loss, uint32_t t){
+  uint8_t packet[TRANCEIVER_MAX_PACKET_BYTES];
+  for (uint8_t i=0; i<from.packets_per_update; i++){
+    uint16_t len = from.next_packet(packet, t);
+    if (len == 0){
+      break;
+    }
+    uint32_t airtime_us = frame_airtime_us(len);
+    from.charge_airtime(airtime_us);
+    t += airtime_us;
+    if (random_unit() >= loss){
+      to.handle_packet(packet, len, t);
+    }
+  }
+}
+
+
+/*
+ * Returns how long a blob_bytes blob took to arrive intact, or 0 if it
+ * didn't. Runs on until the transmitter has heard it arrived, so the next
+ * upload can start.
+ */
+static uint32_t upload(const Receiver& receiver, uint32_t blob_bytes, uint8_t xfer_id, float loss, uint32_t* now_us, uint32_t* retransmits){
+  const bulk_end& tx = esp32_transmitter_end;
+  const bulk_end& rx = *receiver.end;
+  static uint8_t blob[BULK_MAX_BYTES_ESP32];
+  for (uint32_t i=0; i<blob_bytes; i++){
+    blob[i] = (uint8_t)(random_unit() * 256);
+  }
+  uint32_t start_us = *now_us;
+  rx.enable_receive(1, receiver.max_segment);
+  if (tx.send(xfer_id, blob, blob_bytes, start_us) != 0){
+    return 0;
+  }
+
+  uint32_t next_control_us = start_us;
+  uint32_t next_rx_us = start_us + RX_LOOP_US / 2;
+  uint32_t arrived_us = 0;
+  while (!tx.is_complete(xfer_id) && *now_us - start_us < TIMEOUT_US){
+    if ((int32_t)(next_control_us - next_rx_us) <= 0){
+      *now_us = next_control_us;
+      send_burst(tx, rx, loss, *now_us + frame_airtime_us(CONTROL_DATA_BYTES));
+      next_control_us += 1000000 / CONTROL_HZ;
+    } else {
+      *now_us = next_rx_us;
+      send_burst(rx, tx, loss, *now_us);
+      next_rx_us += RX_LOOP_US;
+    }
+    if (arrived_us == 0 && rx.is_complete(xfer_id)){
+      arrived_us = *now_us;
+    }
+  }
+  *retransmits = tx.retransmits();
+
+  uint32_t len = 0;
+  const uint8_t* received = rx.get_data(&len);
+  *now_us += 1000000;  // Let both airtime budgets fill up again
+  if (arrived_us == 0 || received == NULL || len != blob_bytes || memcmp(received, blob, len) != 0){
+    return 0;
+  }
+  return arrived_us - start_us;
+}
+
+
+int main(){
+  printf("%d byte control packets at %uHz, %u runs each\n", CONTROL_DATA_BYTES, (unsigned)CONTROL_HZ, (unsigned)RUNS);
+  printf("%-8s %6s %5s %8s %8s %7s %6s\n", "receiver", "bytes", "loss", "mean ms", "worst ms", "resent", "failed");
+  uint32_t now_us = 0;
+  uint8_t xfer_id = 0;
+  int failures = 0;
+  for (const Receiver& receiver : RECEIVERS){
+    for (float loss : LOSSES){
+      uint64_t total_us = 0;
+      uint32_t worst_us = 0;
+      uint32_t resent = 0;
+      uint16_t failed = 0;
+      for (uint16_t run=0; run<RUNS; run++){
+        rng_state = 1 + run;
+        uint32_t retransmits = 0;
+        uint32_t elapsed_us = upload(receiver, receiver.end->max_bytes, ++xfer_id, loss, &now_us, &retransmits);
+        if (elapsed_us == 0){
+          failed += 1;
+          continue;
+        }
+        total_us += elapsed_us;
+        worst_us = elapsed_us > worst_us ? elapsed_us : worst_us;
+        resent += retransmits;
+      }
+      uint16_t done = RUNS - failed;
+      printf("%-8s %6u %4.0f%% %8.0f %8.0f %7.1f %6u\n",
+        receiver.name, (unsigned)receiver.end->max_bytes, loss * 100,
+        done ? total_us / 1000.0 / done : 0.0, worst_us / 1000.0,
+        done ? resent / (float)done : 0.0f, failed
+      );
+      failures += failed;
+    }
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+// Two independent copies of the ESP32 bulk module: the one the build links
+// in for the transmitter, and a second one compiled in here under other names
+// for an ESP32 receiver.
+
+#include "bulk.h"
+#include "bulk_ends.h"
+
+
+static uint8_t transmitter_is_complete(uint8_t xfer_id){
+    bulk_stats stats;
+    bulk_get_stats(&stats);
+    return stats.state == BULK_COMPLETE && stats.xfer_id == xfer_id;
+}
+
+static uint32_t transmitter_retransmits(void){
+    bulk_stats stats;
+    bulk_get_stats(&stats);
+    return stats.retransmits;
+}
+
+const bulk_end esp32_transmitter_end = {
+    bulk_send,
+    bulk_enable_receive,
+    bulk_handle_packet,
+    bulk_next_packet,
+    bulk_charge_airtime,
+    transmitter_is_complete,
+    transmitter_retransmits,
+    bulk_get_data,
+    BULK_PACKETS_PER_UPDATE,
+    BULK_MAX_BYTES,
+};
+
+
+#define bulk_send receiver_bulk_send
+#define bulk_enable_receive receiver_bulk_enable_receive
+#define bulk_abort receiver_bulk_abort
+#define bulk_handle_packet receiver_bulk_handle_packet
+#define bulk_next_packet receiver_bulk_next_packet
+#define bulk_charge_airtime receiver_bulk_charge_airtime
+#define bulk_get_stats receiver_bulk_get_stats
+#define bulk_get_data receiver_bulk_get_data
+#include "bulk.c"
+
+
+static uint8_t receiver_is_complete(uint8_t xfer_id){
+    bulk_stats stats;
+    bulk_get_stats(&stats);
+    return stats.state == BULK_COMPLETE && stats.xfer_id == xfer_id;
+}
+
+static uint32_t receiver_retransmits(void){
+    bulk_stats stats;
+    bulk_get_stats(&stats);
+    return stats.retransmits;
+}
+
+const bulk_end esp32_receiver_end = {
+    bulk_send,
+    bulk_enable_receive,
+    bulk_handle_packet,
+    bulk_next_packet,
+    bulk_charge_airtime,
+    receiver_is_complete,
+    receiver_retransmits,
+    bulk_get_data,
+    BULK_PACKETS_PER_UPDATE,
+    BULK_MAX_BYTES,
+};
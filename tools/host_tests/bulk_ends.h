@@ -0,0 +1,35 @@
+#ifndef __BULK_ENDS_H__
+#define __BULK_ENDS_H__
+
+#include <stdint.h>
+
+// The two ends of a bulk transfer for bulk_benchmark.cpp, behind function
+// pointers as the ESP32 and ESP8266 modules have the same names and their
+// headers declare the same types. The transmitter is always the ESP32
+// module (bulk_ends.c). See bulk_benchmark.cpp for the receivers.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  uint8_t (*send)(uint8_t xfer_id, const uint8_t data[], uint32_t len, uint32_t now_us);
+  void (*enable_receive)(uint8_t enabled, uint16_t max_segment);
+  void (*handle_packet)(const uint8_t data[], uint16_t len, uint32_t now_us);
+  uint16_t (*next_packet)(uint8_t out[], uint32_t now_us);
+  void (*charge_airtime)(uint32_t airtime_us);
+  uint8_t (*is_complete)(uint8_t xfer_id);  // The blob has arrived or been acknowledged
+  uint32_t (*retransmits)(void);
+  const uint8_t* (*get_data)(uint32_t* len);
+  uint8_t packets_per_update;
+  uint32_t max_bytes;
+} bulk_end;
+
+extern const bulk_end esp32_transmitter_end;
+extern const bulk_end esp32_receiver_end;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,185 @@
+// One group control packet against a control packet for each member, on a
+// simulated medium: the group data is built by the ESP32 transmitter's
+// group_build, and every member is a TranceiverCore<PlatformNull> that hears
+// every frame. See "Group Control Packet" in PacketFormat.md.
+//
+// Frames go out back to back at RATE, each after FRAME_GAP_US of DIFS and
+// backoff, and each member misses a frame at random with probability loss.
+// Per round it reports how long the frames hold the channel, when the
+// members have their channels on average and the last of them (gaps
+// included), what share of members' rounds arrived intact, and the host
+// time each member spent in receive() for the round's frames. Nothing is
+// timestamped or signed, as a bound receiver drops group packets.
+//
+//     make -C tools/host_tests group_benchmark
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "platform_null.h"
+#include "phy_rate.h"
+extern "C" {
+  #include "group.h"  // The ESP32 one
+}
+
+
+static const uint8_t GROUP_SIZES[] = {2, 4, 6};  // 6 members of 4 channels is about all that fits in a packet
+static const uint8_t CHANNELS_PER_MEMBER = 4;
+static const float LOSSES[] = {0.0f, 0.1f};
+static const uint16_t ROUNDS = 2000;
+static const phy_rate RATE = PHY_RATE_1M;
+static const uint32_t FRAME_GAP_US = 120;  // CONGESTION_FRAME_OVERHEAD_US
+
+static const uint8_t GROUP_ID[6] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+
+static uint32_t rng_state = 1;
+
+static float random_unit(void){
+  // xorshift32, so runs are the same everywhere
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return (rng_state & 0xFFFFFF) / (float)0x1000000;
+}
+
+
+struct Result {
+  uint32_t airtime_us;  // Per round, without the gaps
+  float mean_us;  // When a member has its channels, from the start of the round
+  uint32_t last_us;
+  float delivered;  // Share of member rounds that arrived intact
+  float rx_ns;  // Per member per round
+};
+
+struct Member {
+  TranceiverCore<PlatformNull> core;
+  uint8_t id[6];
+};
+
+
+static void member_id(uint8_t index, uint8_t id[6]){
+  const uint8_t base[6] = {0x02, 0x00, 0x00, 0x00, 0x01, index};
+  memcpy(id, base, 6);
+}
+
+static void member_channels(uint8_t index, uint16_t round, int16_t channels[]){
+  for (uint8_t c=0; c<CHANNELS_PER_MEMBER; c++){
+    channels[c] = (index * 1000 + round + c) % 30000;
+  }
+}
+
+
+/*
+ * Puts the frame the sender last sent in front of every member that doesn't
+ * lose it. Members that come away with their channels are marked in got.
+ */
+static void deliver(Member members[], uint8_t count, uint16_t round, float loss, uint32_t now_us, uint8_t got[], uint64_t* rx_ns){
+  NullRxFrame frame = PlatformNull::last_sent();
+  frame.rssi = -50;
+  for (uint8_t i=0; i<count; i++){
+    if (random_unit() < loss){
+      continue;
+    }
+    packet_stats stats;
+    uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+    auto start = std::chrono::steady_clock::now();
+    packet_types packet_type = members[i].core.receive(&frame, &stats, data, now_us);
+    *rx_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+    int16_t expected[CHANNELS_PER_MEMBER];
+    member_channels(i, round, expected);
+    if (packet_type == PACKET_CONTROL && stats.packet_len >= sizeof(expected) && memcmp(data, expected, sizeof(expected)) == 0){
+      got[i] = 1;
+    }
+  }
+}
+
+
+static uint32_t frame_airtime_us(uint16_t data_len){
+  uint16_t extra = data_len > FrameLayout::HEADER_DATA_BYTES ? data_len - FrameLayout::HEADER_DATA_BYTES : 0;
+  return phy_rate_airtime_us(RATE, FrameLayout::HEADER_BYTES + extra);
+}
+
+
+static Result run(uint8_t count, uint8_t group, float loss){
+  static Member members[GROUP_MAX_MEMBERS];
+  for (uint8_t i=0; i<count; i++){
+    members[i].core = TranceiverCore<PlatformNull>();
+    member_id(i, members[i].id);
+    members[i].core.set_id(members[i].id);
+    members[i].core.join_group(GROUP_ID, i);
+  }
+  TranceiverCore<PlatformNull> transmitter;
+
+  Result result = {0, 0, 0, 0, 0};
+  uint64_t got_total = 0;
+  uint64_t latency_total_us = 0;
+  uint64_t rx_ns = 0;
+  uint32_t now_us = 0;
+  for (uint16_t round=0; round<ROUNDS; round++){
+    uint8_t got[GROUP_MAX_MEMBERS] = {0};
+    uint32_t round_us = 0;
+    if (group){
+      int16_t channels[GROUP_MAX_MEMBERS * CHANNELS_PER_MEMBER];
+      uint8_t counts[GROUP_MAX_MEMBERS];
+      for (uint8_t i=0; i<count; i++){
+        member_channels(i, round, channels + i * CHANNELS_PER_MEMBER);
+        counts[i] = CHANNELS_PER_MEMBER;
+      }
+      uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+      uint16_t len = group_build(data, sizeof(data), channels, counts, count);
+      transmitter.set_id(GROUP_ID);
+      transmitter.send(PACKET_GROUP, data, len, now_us);
+      result.airtime_us = frame_airtime_us(len);
+      round_us = FRAME_GAP_US + result.airtime_us;
+      deliver(members, count, round, loss, now_us + round_us, got, &rx_ns);
+      // Every member has its channels once the one frame is out
+      for (uint8_t i=0; i<count; i++){
+        latency_total_us += got[i] ? round_us : 0;
+      }
+    } else {
+      for (uint8_t i=0; i<count; i++){
+        int16_t channels[CHANNELS_PER_MEMBER];
+        member_channels(i, round, channels);
+        transmitter.set_id(members[i].id);
+        transmitter.send(PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us + round_us);
+        result.airtime_us = (i + 1) * frame_airtime_us(sizeof(channels));
+        round_us += FRAME_GAP_US + frame_airtime_us(sizeof(channels));
+        uint8_t had = got[i];
+        deliver(members, count, round, loss, now_us + round_us, got, &rx_ns);
+        // Member i has its channels once the first i + 1 frames are out
+        latency_total_us += got[i] && !had ? round_us : 0;
+      }
+    }
+    for (uint8_t i=0; i<count; i++){
+      got_total += got[i];
+    }
+    result.last_us = round_us;
+    now_us += 20000;
+  }
+  result.mean_us = got_total ? latency_total_us / (float)got_total : 0;
+  result.delivered = got_total / (float)(ROUNDS * count);
+  result.rx_ns = rx_ns / (float)(ROUNDS * count);
+  return result;
+}
+
+
+int main(){
+  printf("%u rounds of %u channels per member at %ukbps, %uus between frames\n", (unsigned)ROUNDS, (unsigned)CHANNELS_PER_MEMBER, (unsigned)phy_rate_kbps(RATE), (unsigned)FRAME_GAP_US);
+  printf("%-8s %7s %5s %10s %8s %8s %10s %8s\n", "packets", "members", "loss", "airtime us", "mean us", "last us", "delivered", "rx ns");
+  for (float loss : LOSSES){
+    for (uint8_t count : GROUP_SIZES){
+      for (uint8_t group=0; group<2; group++){
+        rng_state = 1;
+        Result result = run(count, group, loss);
+        printf("%-8s %7u %4.0f%% %10u %8.0f %8u %9.1f%% %8.0f\n",
+          group ? "group" : "unicast", (unsigned)count, loss * 100,
+          (unsigned)result.airtime_us, result.mean_us, (unsigned)result.last_us,
+          result.delivered * 100, result.rx_ns
+        );
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef __HOST_TEST_H__
+#define __HOST_TEST_H__
+
+#include <stdio.h>
+
+// Just enough of a test harness to run the platform independent parts of
+// the receivers on a PC. Each test file is its own program: CHECK records a
+// failure and carries on, and main returns host_test_result().
+
+static int host_test_failures = 0;
+static int host_test_checks = 0;
+
+#define CHECK(condition) do { \
+    host_test_checks += 1; \
+    if (!(condition)){ \
+      host_test_failures += 1; \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) do { \
+    long long host_test_a = (long long)(a); \
+    long long host_test_b = (long long)(b); \
+    host_test_checks += 1; \
+    if (host_test_a != host_test_b){ \
+      host_test_failures += 1; \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, host_test_a, host_test_b); \
+    } \
+  } while (0)
+
+
+static int host_test_result(const char* name){
+  printf("%s: %d checks, %d failed\n", name, host_test_checks, host_test_failures);
+  return host_test_failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,55 @@
+// How long each output update holds the I2C bus with the PCA9685 backend,
+// and what share of the time that is at the rates the output timer could run
+// at. Every moving output changes on every update, the worst case for
+// flush(). Times are the bits on the wire at I2C_HZ (I2cBusNull), so the
+// ESP8266's software I2C only adds to them.
+//
+//     make -C tools/host_tests pca9685_benchmark
+
+#include <stdio.h>
+#include "pca9685.h"
+#include "i2c_bus_null.h"
+
+
+static const uint32_t I2C_HZ = 400000;  // PCA9685_I2C_HZ
+static const float PWM_HZ = 50;  // PCA9685_PWM_HZ
+static const uint16_t UPDATE_HZ[] = {250, 50};  // OUTPUT_UPDATE_HZ, and capped at PWM_HZ
+static const uint8_t MOVING[] = {1, 4, 8, 16};
+static const uint16_t UPDATES = 1000;
+
+
+int main(){
+  printf("%u updates at %ukHz, every moving output changing each update\n", (unsigned)UPDATES, (unsigned)(I2C_HZ / 1000));
+  printf("%6s %7s %6s %8s", "moving", "writes", "bytes", "us each");
+  for (uint16_t hz : UPDATE_HZ){
+    printf(" %5uHz", (unsigned)hz);
+  }
+  printf("\n");
+
+  for (uint8_t moving : MOVING){
+    I2cBusNull::begin(0, 0, I2C_HZ);
+    Pca9685<I2cBusNull> expander;
+    expander.begin(0x40, PWM_HZ);
+    NullI2cLog start = I2cBusNull::log();
+
+    for (uint16_t update=0; update<UPDATES; update++){
+      for (uint8_t output=0; output<moving; output++){
+        // Sweep, so every update is a new pulse width
+        expander.set_pulse_us(output, 1000 + (update % 2) * 1000 + output);
+      }
+      expander.flush();
+    }
+
+    const NullI2cLog& end = I2cBusNull::log();
+    float us_each = (end.bus_time_us - start.bus_time_us) / (float)UPDATES;
+    printf("%6u %7.1f %6.1f %8.0f",
+      (unsigned)moving, (end.writes - start.writes) / (float)UPDATES,
+      (end.bytes - start.bytes) / (float)UPDATES, us_each
+    );
+    for (uint16_t hz : UPDATE_HZ){
+      printf(" %6.1f%%", us_each * hz / 1e4);
+    }
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,92 @@
+// Drives Pca9685<I2cBusNull> and checks what lands in the expander's
+// registers, and that flush() only sends what changed. See the Makefile.
+
+#include "host_test.h"
+#include "pca9685.h"
+#include "i2c_bus_null.h"
+
+typedef Pca9685Registers R;
+
+static const uint8_t ADDRESS = 0x40;
+static const uint32_t CLOCK_HZ = 400000;
+
+
+static uint16_t off_count(uint8_t output){
+  const uint8_t* registers = I2cBusNull::log().registers[ADDRESS];
+  uint8_t reg = R::LED0_ON_L + output * R::BYTES_PER_OUTPUT + R::OFF_L;
+  return registers[reg] | (registers[reg + 1] << 8);
+}
+
+
+static void test_begin(void){
+  I2cBusNull::begin(0, 0, CLOCK_HZ);
+  Pca9685<I2cBusNull> expander;
+  CHECK_EQ(expander.begin(ADDRESS, 50), 0);
+
+  const uint8_t* registers = I2cBusNull::log().registers[ADDRESS];
+  // 25MHz / (4096 * 50Hz) rounds to 122
+  CHECK_EQ(registers[R::PRE_SCALE], 121);
+  CHECK_EQ(registers[R::MODE1], R::MODE1_AI);
+  CHECK_EQ(registers[R::MODE2], R::MODE2_OUTDRV);
+  CHECK(expander.get_period_us() > 19980 && expander.get_period_us() < 19990);
+  CHECK_EQ(I2cBusNull::log().wait_us, R::OSCILLATOR_START_US);
+
+  // Nowhere to send to
+  Pca9685<I2cBusNull> missing;
+  CHECK(missing.begin(200, 50) != 0);
+}
+
+
+static void test_flush_sends_changes(void){
+  I2cBusNull::begin(0, 0, CLOCK_HZ);
+  Pca9685<I2cBusNull> expander;
+  expander.begin(ADDRESS, 50);
+  uint32_t writes = I2cBusNull::log().writes;
+
+  expander.set_pulse_us(0, 1500);
+  expander.set_pulse_us(15, 1000);
+  CHECK_EQ(expander.flush(), 0);
+  CHECK_EQ(off_count(0), 307);
+  CHECK_EQ(off_count(15), 205);
+  // Too far apart to share a write
+  CHECK_EQ(I2cBusNull::log().writes - writes, 2);
+
+  // Nothing changed, nothing sent
+  writes = I2cBusNull::log().writes;
+  expander.set_pulse_us(0, 1500);
+  CHECK_EQ(expander.flush(), 0);
+  CHECK_EQ(I2cBusNull::log().writes, writes);
+
+  // Neighbours go in one write, from output 3's off registers to output 4's
+  uint32_t bytes = I2cBusNull::log().bytes;
+  expander.set_pulse_us(3, 1200);
+  expander.set_pulse_us(4, 1800);
+  CHECK_EQ(expander.flush(), 0);
+  CHECK_EQ(I2cBusNull::log().writes - writes, 1);
+  CHECK_EQ(I2cBusNull::log().bytes - bytes, 1 + 2 + 2 + 2);
+  CHECK_EQ(off_count(3), 246);
+  CHECK_EQ(off_count(4), 369);
+  CHECK_EQ(expander.get_writes(), I2cBusNull::log().writes);
+}
+
+
+static void test_pulse_limits(void){
+  I2cBusNull::begin(0, 0, CLOCK_HZ);
+  Pca9685<I2cBusNull> expander;
+  expander.begin(ADDRESS, 50);
+
+  expander.set_pulse_us(1, -100);
+  expander.set_pulse_us(2, 30000);
+  expander.set_pulse_us(Pca9685<I2cBusNull>::OUTPUTS, 1500);  // Ignored
+  CHECK_EQ(expander.flush(), 0);
+  CHECK_EQ(off_count(1), 0);
+  CHECK_EQ(off_count(2), Pca9685<I2cBusNull>::FULL_SCALE - 1);
+}
+
+
+int main(){
+  test_begin();
+  test_flush_sends_changes();
+  test_pulse_limits();
+  return host_test_result("pca9685_test");
+}
@@ -0,0 +1,276 @@
+// How much delay and loss relays add to the link, on a simulated medium: a
+// transmitter and a receiver (TranceiverCore<PlatformNull>s) at the two ends
+// of a chain of copies of the ESP32 relay module (relay_hops.h). See
+// "Relaying" in PacketFormat.md.
+//
+// Each node only hears its neighbours in the chain, and misses each frame
+// from them at random with probability LINK_LOSS. The transmitter sends a
+// control packet at each rate in CONTROL_RATES_HZ and the receiver sends
+// telemetry back every TELEMETRY_EVERY of them. Everything shares one
+// channel: a frame goes on the air FRAME_GAP_US after the channel is free.
+// A relay's TX task runs TASK_WAKE_US after it queues a frame, and hands the
+// wifi stack one frame at a time as the channel frees up, so the wait
+// behind other frames counts towards the relay's max_delay_us. An endpoint
+// sheds a packet that would wait more than a period to go out, as
+// congestion control would.
+//
+// For each chain it reports the delay each hop adds to the control packets
+// (from the first relay hearing them to the receiver), the longest wait in
+// a relay against the RELAY_DEFAULT_MAX_DELAY_US cap, what the relays
+// dropped and why, and the control loss against what the lossy links alone
+// would lose.
+//
+//     make -C tools/host_tests relay_benchmark
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <queue>
+#include <vector>
+#include "platform_null.h"
+#include "phy_rate.h"
+#include "relay_hops.h"
+
+
+static const uint8_t RELAY_COUNTS[] = {1, 2, 3};
+static const uint16_t CONTROL_RATES_HZ[] = {50, 250, 1000};
+static const uint32_t RUN_US = 10000000;
+static const float LINK_LOSS = 0.1f;
+static const uint8_t TELEMETRY_EVERY = 10;
+static const uint8_t CONTROL_CHANNELS = 8;
+static const uint32_t TASK_WAKE_US = 50;
+static const phy_rate RATE = PHY_RATE_1M;
+static const uint32_t FRAME_GAP_US = 120;  // CONGESTION_FRAME_OVERHEAD_US
+
+static const uint8_t RX_ID[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x21};
+
+static relay_node* const RELAYS[RELAY_HOP_COPIES] = {&relay_hop1, &relay_hop2, &relay_hop3};
+
+
+static uint32_t rng_state = 1;
+
+static float random_unit(void){
+  // xorshift32, so runs are the same everywhere
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return (rng_state & 0xFFFFFF) / (float)0x1000000;
+}
+
+
+enum event_kind {
+  EVENT_TICK,  // The transmitter's next control packet is due
+  EVENT_ARRIVE,  // A frame has been heard by a node
+  EVENT_WAKE,  // A relay's TX task runs
+};
+
+struct Event {
+  uint32_t time_us;
+  uint32_t order;  // Keeps events at the same time in the order they were made
+  event_kind kind;
+  uint8_t node;  // 0 is the transmitter, then the relays, then the receiver
+  uint16_t frame_len;  // Without the CRC
+  uint8_t frame[FrameLayout::MAX_FRAME_BYTES];
+
+  bool operator<(const Event& other) const {
+    // Earliest first out of a priority_queue
+    return time_us != other.time_us ? time_us > other.time_us : order > other.order;
+  }
+};
+
+struct Result {
+  uint32_t sent;
+  uint32_t shed;  // By the endpoints
+  uint32_t delivered;
+  float hop_us;  // Added by each hop to the control packets, on average
+  uint32_t max_us;  // The longest a control packet took from the first relay to the receiver
+  uint32_t telemetry_sent;
+  uint32_t telemetry_delivered;
+  relay_stats relays;  // Summed over the chain, apart from delay_max_us
+};
+
+
+static std::priority_queue<Event> events;
+static uint32_t event_order;
+static uint32_t channel_free_us;
+static uint8_t last_node;
+static uint8_t wake_pending[RELAY_HOP_COPIES];
+
+
+static void push(uint32_t time_us, event_kind kind, uint8_t node, const uint8_t frame[], uint16_t frame_len){
+  Event event;
+  event.time_us = time_us;
+  event.order = event_order++;
+  event.kind = kind;
+  event.node = node;
+  event.frame_len = frame_len;
+  memcpy(event.frame, frame, frame_len);
+  events.push(event);
+}
+
+
+/*
+ * Sends a frame from node once the channel is free, to the neighbours that
+ * don't lose it. Returns when it is off the air.
+ */
+static uint32_t put_on_air(uint8_t node, const uint8_t frame[], uint16_t frame_len, uint32_t ready_us){
+  uint32_t start_us = (channel_free_us > ready_us ? channel_free_us : ready_us) + FRAME_GAP_US;
+  uint32_t end_us = start_us + phy_rate_airtime_us(RATE, frame_len);
+  channel_free_us = end_us;
+  for (int8_t step=-1; step<=1; step+=2){
+    int16_t neighbour = node + step;
+    if (neighbour >= 0 && neighbour <= last_node && random_unit() >= LINK_LOSS){
+      push(end_us, EVENT_ARRIVE, neighbour, frame, frame_len);
+    }
+  }
+  return end_us;
+}
+
+
+static void relay_transmit(relay_node* relay, const uint8_t frame[], uint16_t frame_len){
+  uint8_t node = 1;
+  while (RELAYS[node - 1] != relay){
+    node++;
+  }
+  // The next queued frame can't be handed over until this one is out
+  relay->now_us = put_on_air(node, frame, frame_len, relay->now_us);
+}
+
+
+/* Sends what an endpoint last sent, unless it would wait too long */
+static uint8_t endpoint_send(uint8_t node, uint32_t now_us, uint32_t period_us){
+  if (channel_free_us > now_us + period_us){
+    return 0;
+  }
+  const NullRxFrame& sent = PlatformNull::last_sent();
+  put_on_air(node, sent.buf, sent.len - FrameLayout::CRC_BYTES, now_us);
+  return 1;
+}
+
+
+static Result run(uint8_t relay_count, uint16_t rate_hz){
+  uint32_t period_us = 1000000 / rate_hz;
+  TranceiverCore<PlatformNull> transmitter;
+  TranceiverCore<PlatformNull> receiver;
+  transmitter.set_id(RX_ID);
+  receiver.set_id(RX_ID);
+  for (uint8_t i=0; i<relay_count; i++){
+    RELAYS[i]->transmit = relay_transmit;
+    RELAYS[i]->requested = 0;
+    RELAYS[i]->start(RX_ID, relay_count, RELAY_DEFAULT_MAX_DELAY_US);
+    wake_pending[i] = 0;
+  }
+  last_node = relay_count + 1;
+  channel_free_us = 0;
+  event_order = 0;
+
+  Result result;
+  memset(&result, 0, sizeof(result));
+  std::vector<uint32_t> first_hop_us(RUN_US / period_us + 1, 0);  // When the first relay could have heard each control packet
+  uint64_t latency_total_us = 0;
+  push(0, EVENT_TICK, 0, NULL, 0);
+
+  while (!events.empty()){
+    Event event = events.top();
+    events.pop();
+    uint32_t now_us = event.time_us;
+
+    if (event.kind == EVENT_TICK){
+      int16_t channels[CONTROL_CHANNELS] = {(int16_t)result.sent};
+      result.sent += 1;
+      transmitter.send(PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us);
+      if (endpoint_send(0, now_us, period_us)){
+        first_hop_us[channels[0]] = channel_free_us;
+      } else {
+        result.shed += 1;
+      }
+      if (result.sent % TELEMETRY_EVERY == 0){
+        uint8_t telemetry[10] = {TELEMETRY_OK};
+        memcpy(telemetry + 1, &result.sent, sizeof(result.sent));
+        result.telemetry_sent += 1;
+        receiver.send(PACKET_TELEMETRY, telemetry, sizeof(telemetry), now_us);
+        if (!endpoint_send(last_node, now_us, period_us)){
+          result.shed += 1;
+        }
+      }
+      if (now_us + period_us < RUN_US){
+        push(now_us + period_us, EVENT_TICK, 0, NULL, 0);
+      }
+
+    } else if (event.kind == EVENT_WAKE){
+      relay_node* relay = RELAYS[event.node - 1];
+      wake_pending[event.node - 1] = 0;
+      relay->requested = 0;
+      relay->now_us = channel_free_us > now_us ? channel_free_us : now_us;
+      relay->forward();
+
+    } else if (event.node == 0){
+      uint8_t packet_type = event.frame[FrameLayout::PACKET_TYPE_OFFSET] & PACKET_TYPE_MASK;
+      result.telemetry_delivered += packet_type == PACKET_TELEMETRY;
+
+    } else if (event.node == last_node){
+      NullRxFrame frame;
+      frame.rssi = -50;
+      frame.len = event.frame_len + FrameLayout::CRC_BYTES;
+      memcpy(frame.buf, event.frame, event.frame_len);
+      packet_stats stats;
+      uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+      if (receiver.receive(&frame, &stats, data, now_us) == PACKET_CONTROL){
+        int16_t index;
+        memcpy(&index, data, sizeof(index));
+        uint32_t latency_us = now_us - first_hop_us[index];
+        result.delivered += 1;
+        latency_total_us += latency_us;
+        result.max_us = latency_us > result.max_us ? latency_us : result.max_us;
+      }
+
+    } else {
+      relay_node* relay = RELAYS[event.node - 1];
+      relay->now_us = now_us;
+      relay->receive(event.frame, event.frame_len, now_us);
+      if (relay->requested && !wake_pending[event.node - 1]){
+        wake_pending[event.node - 1] = 1;
+        push(now_us + TASK_WAKE_US, EVENT_WAKE, event.node, NULL, 0);
+      }
+    }
+  }
+
+  for (uint8_t i=0; i<relay_count; i++){
+    relay_stats stats;
+    RELAYS[i]->get_stats(&stats);
+    result.relays.offered += stats.offered;
+    result.relays.forwarded += stats.forwarded;
+    result.relays.duplicates += stats.duplicates;
+    result.relays.expired += stats.expired;
+    result.relays.late += stats.late;
+    result.relays.queue_full += stats.queue_full;
+    result.relays.delay_total_us += stats.delay_total_us;
+    if (stats.delay_max_us > result.relays.delay_max_us){
+      result.relays.delay_max_us = stats.delay_max_us;
+    }
+  }
+  result.hop_us = result.delivered ? latency_total_us / (float)result.delivered / relay_count : 0;
+  return result;
+}
+
+
+int main(){
+  printf("%.0f%% lost on each link, %ukbps, %uus between frames, relays hand a frame over within %uus\n", LINK_LOSS * 100, (unsigned)phy_rate_kbps(RATE), (unsigned)FRAME_GAP_US, (unsigned)RELAY_DEFAULT_MAX_DELAY_US);
+  printf("%6s %5s %7s %7s %8s %6s %5s %5s %5s %8s %8s %9s\n", "relays", "hz", "hop us", "max us", "relay us", "dups", "late", "full", "shed", "control", "links", "telemetry");
+  for (uint8_t relay_count : RELAY_COUNTS){
+    for (uint16_t rate_hz : CONTROL_RATES_HZ){
+      rng_state = 1;
+      Result result = run(relay_count, rate_hz);
+      // What the links alone would lose on the way out
+      float link_loss = 1 - powf(1 - LINK_LOSS, relay_count + 1);
+      printf("%6u %5u %7.0f %7u %8u %6u %5u %5u %5u %7.1f%% %7.1f%% %8.1f%%\n",
+        (unsigned)relay_count, (unsigned)rate_hz, result.hop_us, (unsigned)result.max_us,
+        (unsigned)result.relays.delay_max_us, (unsigned)result.relays.duplicates,
+        (unsigned)result.relays.late, (unsigned)result.relays.queue_full, (unsigned)result.shed,
+        100 - result.delivered * 100.0f / result.sent, link_loss * 100,
+        100 - result.telemetry_delivered * 100.0f / result.telemetry_sent
+      );
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+// One copy of the ESP32 relay module, built with RELAY_HOP set to 1, 2 or 3
+// and everything it defines or calls renamed to match. See relay_hops.h.
+
+#define RELAY_PASTE_(prefix, hop, name) prefix##hop##_##name
+#define RELAY_PASTE(prefix, hop, name) RELAY_PASTE_(prefix, hop, name)
+#define RELAY_NAME(name) RELAY_PASTE(relay_hop, RELAY_HOP, name)
+#define RELAY_NODE_(hop) relay_hop##hop
+#define RELAY_NODE_NAME(hop) RELAY_NODE_(hop)
+#define RELAY_NODE RELAY_NODE_NAME(RELAY_HOP)
+
+#define relay_start RELAY_NAME(relay_start)
+#define relay_stop RELAY_NAME(relay_stop)
+#define relay_get_stats RELAY_NAME(relay_get_stats)
+#define relay_receive RELAY_NAME(relay_receive)
+#define relay_sent RELAY_NAME(relay_sent)
+#define relay_forward RELAY_NAME(relay_forward)
+#define esp_timer_get_time RELAY_NAME(esp_timer_get_time)
+#define radio_tasks_running RELAY_NAME(radio_tasks_running)
+#define radio_tasks_request_relay RELAY_NAME(radio_tasks_request_relay)
+#define tranceiver_relay_frame RELAY_NAME(tranceiver_relay_frame)
+#include "relay.c"
+
+#include "relay_hops.h"
+
+
+relay_node RELAY_NODE = {
+    relay_start,
+    relay_get_stats,
+    relay_receive,
+    relay_forward,
+    NULL,
+    0,
+    0,
+};
+
+
+int64_t esp_timer_get_time(void){
+    return RELAY_NODE.now_us;
+}
+
+uint8_t radio_tasks_running(void){
+    return 1;
+}
+
+void radio_tasks_request_relay(void){
+    RELAY_NODE.requested = 1;
+}
+
+uint8_t tranceiver_relay_frame(const uint8_t frame[], uint16_t frame_len){
+    // As the tranceiver does for every frame it sends
+    relay_sent(frame, frame_len, RELAY_NODE.now_us);
+    RELAY_NODE.transmit(&RELAY_NODE, frame, frame_len);
+    return TRANCEIVER_TX_OK;
+}
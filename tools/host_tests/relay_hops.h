@@ -0,0 +1,40 @@
+#ifndef __RELAY_HOPS_H__
+#define __RELAY_HOPS_H__
+
+#include <stdint.h>
+
+// Separate copies of the ESP32 relay module for relay_benchmark.cpp, so it
+// can chain them. The module keeps its state in statics, so relay_hop.c is
+// compiled once per copy under other names, and each copy is reached
+// through its relay_node. The node also stands in for the parts of the
+// tranceiver and radio tasks the module calls.
+
+#define RELAY_HOP_COPIES 3  // RELAY_MAX_HOPS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "relay.h"  // The ESP32 one
+
+typedef struct relay_node {
+  uint8_t (*start)(const uint8_t target_id[6], uint8_t max_hops, uint32_t max_delay_us);
+  void (*get_stats)(relay_stats* stats);
+  uint8_t (*receive)(const uint8_t frame[], uint16_t frame_len, uint32_t now_us);
+  void (*forward)(void);
+
+  // Set by the caller
+  void (*transmit)(struct relay_node* node, const uint8_t frame[], uint16_t frame_len);  // Puts a relayed frame on the air
+  uint32_t now_us;  // What the module gets from esp_timer_get_time()
+  uint8_t requested;  // The module has asked for the TX task to run
+} relay_node;
+
+extern relay_node relay_hop1;
+extern relay_node relay_hop2;
+extern relay_node relay_hop3;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
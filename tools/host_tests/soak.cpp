@@ -0,0 +1,364 @@
+// Soak test of the receive path: millions of frames of mixed traffic through
+// TranceiverCore<PlatformNull>, the way the ESP8266's sniffer callback and
+// main loop handle them, then one line of JSON to compare with the report
+// from an earlier build (or the one esp32_receiver/soak.py prints on the
+// device).
+//
+// The medium carries the bound transmitter's signed control packets, its
+// link reports and bulk packets, telemetry and names from lots of other
+// receivers, and the frames a receiver has to throw away: unsigned and
+// forged control packets, replays of recorded ones and corrupted copies.
+// Control packets carry a pattern so a bad one getting through is caught.
+//
+// The callback queues what it accepts for the main loop, which drains the
+// queue at a random interval and answers with telemetry and bulk acks. The
+// whole run goes on its own thread with a painted stack for the high-water
+// mark, and the heap high-water mark counts everything that goes through
+// operator new, which the receive path should never need. The worst
+// callback time includes whatever the host's scheduler adds, so compare
+// the mean between builds and treat the worst case as an upper bound.
+//
+//     make -C tools/host_tests soak
+//     ./tools/host_tests/build/soak [frames] [seed]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <chrono>
+#include <pthread.h>
+#include "platform_null.h"
+#include "bulk.h"
+
+
+static const uint32_t DEFAULT_FRAMES = 2000000;
+static const uint32_t FRAME_US = 500;  // Time on the medium between frames
+static const uint8_t LOSS_PERCENT = 5;  // Of the transmitter's frames
+
+// Share of the frames on the medium, in percent
+static const uint8_t MIX_CONTROL = 40;
+static const uint8_t MIX_LINK = 5;
+static const uint8_t MIX_BULK = 5;
+static const uint8_t MIX_TELEMETRY = 15;  // From MIX_DEVICES other receivers
+static const uint8_t MIX_NAME = 5;
+static const uint8_t MIX_UNSIGNED = 8;
+static const uint8_t MIX_FORGED = 8;
+static const uint8_t MIX_REPLAYED = 7;  // The rest are corrupted copies
+static const uint8_t MIX_DEVICES = 100;
+
+static const uint8_t RX_QUEUE_SLOTS = 16;  // RADIO_TASKS_RX_RING_SLOTS
+static const uint16_t LOOP_FRAMES = 20;  // Frames between main loops, on average
+static const uint8_t RECORDED_FRAMES = 64;  // Control frames kept for replaying
+static const size_t STACK_BYTES = 256 * 1024;
+static const uint8_t STACK_PAINT = 0xA5;
+
+static const uint8_t RX_ID[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t KEY[AUTH_KEY_BYTES] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+static const uint8_t WRONG_KEY[AUTH_KEY_BYTES] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+
+
+// Heap high-water mark of everything allocated with new once the soak starts
+static size_t heap_bytes = 0;
+static size_t heap_max_bytes = 0;
+
+void* operator new(size_t size){
+  size_t* block = (size_t*)malloc(sizeof(size_t) + size);
+  if (block == NULL){
+    throw std::bad_alloc();
+  }
+  *block = size;
+  heap_bytes += size;
+  heap_max_bytes = heap_bytes > heap_max_bytes ? heap_bytes : heap_max_bytes;
+  return block + 1;
+}
+
+void operator delete(void* pointer) noexcept {
+  if (pointer == NULL){
+    return;
+  }
+  size_t* block = (size_t*)pointer - 1;
+  heap_bytes -= *block;
+  free(block);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+  operator delete(pointer);
+}
+
+
+static uint32_t rng_state = 1;
+
+static uint32_t random_u32(void){
+  // xorshift32, so runs are the same everywhere
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+
+struct QueuedPacket {
+  packet_stats stats;
+  uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+};
+
+struct Soak {
+  uint32_t frames;
+  uint32_t seed;
+
+  TranceiverCore<PlatformNull> rx;
+  TranceiverCore<PlatformNull> transmitter;  // Bound, signs its control packets
+  TranceiverCore<PlatformNull> stranger;  // Sends to us, but isn't bound
+  TranceiverCore<PlatformNull> forger;  // Signs with the wrong key
+  TranceiverCore<PlatformNull> neighbour;  // Every other receiver on the channel
+
+  QueuedPacket queue[RX_QUEUE_SLOTS];
+  uint8_t queue_head;
+  uint8_t queue_len;
+  uint8_t queue_max;
+  uint32_t queue_dropped;
+
+  NullRxFrame recorded[RECORDED_FRAMES];
+  uint8_t recorded_count;
+  NullRxFrame last_frame;  // For corrupting
+
+  uint64_t callback_total_ns;
+  uint64_t callback_max_ns;
+  uint32_t packets;
+  uint32_t controls_sent;
+  uint32_t controls_accepted;
+  uint32_t bad_controls;  // Got through without being a real one
+  uint32_t loops;
+  double seconds;
+};
+
+
+/* The sniffer callback: pick the frame apart and queue anything for us */
+static void callback(Soak& soak, const NullRxFrame& frame, uint32_t now_us){
+  auto start = std::chrono::steady_clock::now();
+  QueuedPacket packet;
+  packet_types packet_type = soak.rx.receive(&frame, &packet.stats, packet.data, now_us);
+  if (packet_type == PACKET_BULK){
+    bulk_handle_packet(packet.data, packet.stats.packet_len, now_us);
+  } else if (packet_type != PACKET_NONE){
+    if (soak.queue_len == RX_QUEUE_SLOTS){
+      soak.queue_dropped += 1;
+    } else {
+      soak.queue[(soak.queue_head + soak.queue_len) % RX_QUEUE_SLOTS] = packet;
+      soak.queue_len += 1;
+      soak.queue_max = soak.queue_len > soak.queue_max ? soak.queue_len : soak.queue_max;
+    }
+  }
+  uint64_t elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+  soak.callback_total_ns += elapsed_ns;
+  soak.callback_max_ns = elapsed_ns > soak.callback_max_ns ? elapsed_ns : soak.callback_max_ns;
+}
+
+
+/* Control packets carry their own number and a pattern made from it */
+static uint16_t make_channels(int16_t channels[], uint32_t number){
+  uint8_t count = 1 + number % 16;
+  for (uint8_t i=0; i<count; i++){
+    channels[i] = (int16_t)(number * 7 + i);
+  }
+  return count * 2;
+}
+
+static uint8_t channels_match(const uint8_t data[], uint16_t len){
+  if (len < 2 || len % 2 != 0){
+    return 0;
+  }
+  int16_t channels[TRANCEIVER_MAX_PACKET_BYTES / 2];
+  memcpy(channels, data, len);
+  // 7 is its own inverse mod 16, which gives back the count
+  uint8_t count = 1 + ((channels[0] * 7) & 15);
+  if (len < count * 2){
+    return 0;
+  }
+  for (uint8_t i=1; i<len / 2; i++){
+    // Short packets are padded with zeros
+    if (channels[i] != (i < count ? (int16_t)(channels[0] + i) : 0)){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+/* The main loop: drain the queue and answer with telemetry and bulk acks */
+static void main_loop(Soak& soak, uint32_t now_us){
+  while (soak.queue_len > 0){
+    const QueuedPacket& packet = soak.queue[soak.queue_head];
+    soak.queue_head = (soak.queue_head + 1) % RX_QUEUE_SLOTS;
+    soak.queue_len -= 1;
+    soak.packets += 1;
+    if (packet.stats.packet_type == PACKET_CONTROL){
+      soak.controls_accepted += 1;
+      if (!channels_match(packet.data, packet.stats.packet_len) || memcmp(packet.stats.source_id, RX_ID, 6) != 0){
+        soak.bad_controls += 1;
+      }
+    }
+  }
+  telemetry_packet telemetry = {TELEMETRY_OK, (float)soak.loops, "Soak Loops"};
+  soak.rx.send(PACKET_TELEMETRY, (uint8_t*)&telemetry, sizeof(telemetry), now_us);
+  uint8_t ack[TRANCEIVER_MAX_PACKET_BYTES];
+  uint16_t ack_len = bulk_next_packet(ack, now_us);
+  if (ack_len > 0){
+    soak.rx.send(PACKET_BULK, ack, ack_len, now_us);
+  }
+  // As if the raised counter limit was saved with the key
+  uint32_t limit = soak.rx.next_auth_limit();
+  if (limit != 0){
+    soak.rx.set_auth_limit(limit);
+  }
+  soak.loops += 1;
+}
+
+
+/* Puts the next frame on the medium. Returns 0 if it was lost */
+static uint8_t next_frame(Soak& soak, NullRxFrame* frame, uint32_t now_us){
+  uint8_t data[TRANCEIVER_MAX_PACKET_BYTES];
+  for (uint8_t i=0; i<sizeof(data); i++){
+    data[i] = random_u32();
+  }
+  uint32_t pick = random_u32() % 100;
+  uint8_t from_transmitter = 0;
+  if (pick < MIX_CONTROL){
+    int16_t channels[16];
+    uint16_t len = make_channels(channels, soak.controls_sent);
+    soak.transmitter.send(PACKET_CONTROL, (uint8_t*)channels, len, now_us);
+    soak.controls_sent += 1;
+    from_transmitter = 1;
+  } else if ((pick -= MIX_CONTROL) < MIX_LINK){
+    soak.transmitter.send(PACKET_LINK, data, 1, now_us);
+    from_transmitter = 1;
+  } else if ((pick -= MIX_LINK) < MIX_BULK){
+    soak.transmitter.send(PACKET_BULK, data, BULK_HEADER_BYTES + random_u32() % BULK_MAX_SEGMENT_BYTES, now_us);
+    from_transmitter = 1;
+  } else if ((pick -= MIX_BULK) < MIX_TELEMETRY + MIX_NAME){
+    uint8_t id[6] = {0x02, 0x00, 0x00, 0x00, 0x01, (uint8_t)(random_u32() % MIX_DEVICES)};
+    soak.neighbour.set_id(id);
+    soak.neighbour.send(pick < MIX_TELEMETRY ? PACKET_TELEMETRY : PACKET_NAME, data, 5 + random_u32() % TRANCEIVER_MAX_NAME_LENGTH, now_us);
+  } else if ((pick -= MIX_TELEMETRY + MIX_NAME) < MIX_UNSIGNED){
+    soak.stranger.send(PACKET_CONTROL, data, 2 + random_u32() % 30, now_us);
+  } else if ((pick -= MIX_UNSIGNED) < MIX_FORGED){
+    soak.forger.send(PACKET_CONTROL, data, 2 + random_u32() % 30, now_us);
+  } else if ((pick -= MIX_FORGED) < MIX_REPLAYED && soak.recorded_count > 0){
+    *frame = soak.recorded[random_u32() % soak.recorded_count];
+    return 1;
+  } else {
+    // Bits flipped and the length changed, as a bad CRC check might let through
+    *frame = soak.last_frame;
+    for (uint8_t i=1 + random_u32() % 4; i>0; i--){
+      frame->buf[random_u32() % FrameLayout::MAX_FRAME_BYTES] ^= 1 << (random_u32() % 8);
+    }
+    if (random_u32() % 2){
+      frame->len = random_u32() % (FrameLayout::MAX_FRAME_BYTES + FrameLayout::CRC_BYTES + 1);
+    }
+    return 1;
+  }
+
+  *frame = PlatformNull::last_sent();
+  frame->rssi = -40 - random_u32() % 50;
+  soak.last_frame = *frame;
+  if (from_transmitter && frame->buf[FrameLayout::PACKET_TYPE_OFFSET] & PACKET_FLAG_AUTH){
+    if (soak.recorded_count < RECORDED_FRAMES){
+      soak.recorded[soak.recorded_count++] = *frame;
+    } else {
+      soak.recorded[random_u32() % RECORDED_FRAMES] = *frame;
+    }
+  }
+  return !from_transmitter || random_u32() % 100 >= LOSS_PERCENT;
+}
+
+
+static void* run(void* arg){
+  Soak& soak = *(Soak*)arg;
+  rng_state = soak.seed;
+  soak.rx.set_id(RX_ID);
+  soak.rx.set_key(KEY, 0);
+  soak.transmitter.set_id(RX_ID);
+  soak.transmitter.set_key(KEY, 0);
+  soak.transmitter.enable_timestamps(1);
+  soak.stranger.set_id(RX_ID);
+  soak.forger.set_id(RX_ID);
+  soak.forger.set_key(WRONG_KEY, 0);
+  soak.forger.enable_timestamps(1);
+  bulk_enable_receive(1, BULK_MAX_SEGMENT_BYTES);
+
+  auto start = std::chrono::steady_clock::now();
+  uint32_t now_us = 0;
+  uint32_t next_loop = LOOP_FRAMES;
+  for (uint32_t i=0; i<soak.frames; i++){
+    now_us += FRAME_US;
+    NullRxFrame frame;
+    if (next_frame(soak, &frame, now_us)){
+      callback(soak, frame, now_us);
+    }
+    if (i >= next_loop){
+      // Sometimes busy for a while, so the queue fills up
+      main_loop(soak, now_us);
+      next_loop = i + 1 + random_u32() % (2 * LOOP_FRAMES);
+    }
+  }
+  main_loop(soak, now_us);
+  soak.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return NULL;
+}
+
+
+/* How deep into the painted stack the run went */
+static size_t stack_used(const uint8_t stack[]){
+  size_t untouched = 0;
+  while (untouched < STACK_BYTES && stack[untouched] == STACK_PAINT){
+    untouched += 1;
+  }
+  return STACK_BYTES - untouched;
+}
+
+static size_t run_on_painted_stack(void* (*function)(void*), void* arg){
+  static uint8_t stack[STACK_BYTES] __attribute__((aligned(64)));
+  memset(stack, STACK_PAINT, sizeof(stack));
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, stack, sizeof(stack));
+  pthread_t thread;
+  if (pthread_create(&thread, &attr, function, arg) != 0){
+    return 0;
+  }
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+  return stack_used(stack);
+}
+
+static void* idle(void*){
+  return NULL;
+}
+
+
+int main(int argc, char* argv[]){
+  static Soak soak_state;
+  Soak* soak = &soak_state;
+  soak->frames = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_FRAMES;
+  soak->seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+  // What the thread itself takes, so only the soak's own stack use is reported
+  size_t thread_stack = run_on_painted_stack(idle, NULL);
+  size_t stack = run_on_painted_stack(run, soak);
+  if (stack == 0){
+    printf("Couldn't start the soak thread\n");
+    return 1;
+  }
+
+  sequence_stats link;
+  soak->rx.get_link_stats(SEQUENCE_STREAM_CONTROL, &link);
+  auth_stats auth;
+  soak->rx.get_auth_stats(&auth);
+
+  printf("{\"frames\":%u,\"packets\":%u,\"seconds\":%.3f,\"frames_per_second\":%.0f,", (unsigned)soak->frames, (unsigned)soak->packets, soak->seconds, soak->frames / soak->seconds);
+  printf("\"callback_ns\":{\"mean\":%.0f,\"max\":%llu},", soak->callback_total_ns / (double)soak->frames, (unsigned long long)soak->callback_max_ns);
+  printf("\"queue\":{\"slots\":%u,\"max\":%u,\"dropped\":%u},", (unsigned)RX_QUEUE_SLOTS, (unsigned)soak->queue_max, (unsigned)soak->queue_dropped);
+  printf("\"memory\":{\"stack_max_bytes\":%zu,\"heap_max_bytes\":%zu},", stack > thread_stack ? stack - thread_stack : 0, heap_max_bytes);
+  printf("\"control\":{\"sent\":%u,\"accepted\":%u,\"bad\":%u,\"lost\":%u,\"resyncs\":%u},", (unsigned)soak->controls_sent, (unsigned)soak->controls_accepted, (unsigned)soak->bad_controls, (unsigned)link.lost, (unsigned)link.resyncs);
+  printf("\"auth\":{\"verified\":%u,\"unsigned\":%u,\"bad_tag\":%u,\"replayed\":%u,\"early\":%u}}\n", (unsigned)auth.verified, (unsigned)auth.unsigned_rejected, (unsigned)auth.bad_tag, (unsigned)auth.replayed, (unsigned)auth.early);
+  return soak->bad_controls == 0 && soak->controls_accepted > 0 ? 0 : 1;
+}
@@ -0,0 +1,11 @@
+#ifndef __HOST_ESP_TIMER_H__
+#define __HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+
+// The ESP32 radio modules built on the host read the time from here. Each
+// host program defines it to return its simulated clock.
+
+int64_t esp_timer_get_time(void);
+
+#endif
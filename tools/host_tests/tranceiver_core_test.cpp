@@ -0,0 +1,347 @@
+// Sends frames through TranceiverCore<PlatformNull> and feeds them back in,
+// checking what comes out the other side. See the Makefile.
+
+#include "host_test.h"
+#include "platform_null.h"
+
+
+// An ESP8266 only sees the first 36 bytes of a frame
+struct PlatformNarrow : PlatformNull {
+  static constexpr uint16_t MAX_VISIBLE_BYTES = 36;
+};
+
+static const uint8_t RX_ID[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t OTHER_ID[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+static const uint8_t GROUP_ID[6] = {0x03, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint32_t CONTROL_INTERVAL_US = 20000;
+
+
+template <typename Platform>
+static packet_types loop_back(TranceiverCore<Platform>& tx, TranceiverCore<Platform>& rx, packet_types packet_type, const uint8_t data[], uint16_t len, uint32_t now_us, packet_stats* stats, uint8_t out[]){
+  if (tx.send(packet_type, data, len, now_us) != 0){
+    return PACKET_NONE;
+  }
+  NullRxFrame frame = PlatformNull::last_sent();
+  frame.rssi = -40;
+  return rx.receive(&frame, stats, out, now_us);
+}
+
+
+/* Binds both ends with key, as the receiver would once its counter limit is saved */
+template <typename Platform>
+static void bind_both(TranceiverCore<Platform>& tx, TranceiverCore<Platform>& rx, const uint8_t key[AUTH_KEY_BYTES]){
+  tx.set_key(key, 0);
+  rx.set_key(key, 0);
+  rx.set_auth_limit(rx.next_auth_limit());
+}
+
+
+static void test_control_round_trip(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[4] = {100, -200, 300, -400};
+
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), 1000, &stats, out), PACKET_CONTROL);
+  // Short packets are padded out to fill the header
+  CHECK_EQ(stats.packet_len, FrameLayout::HEADER_DATA_BYTES);
+  CHECK_EQ(stats.rssi, -40);
+  CHECK(memcmp(out, channels, sizeof(channels)) == 0);
+  CHECK(memcmp(stats.source_id, RX_ID, 6) == 0);
+  CHECK_EQ(stats.tx_timestamp, 0);
+  CHECK_EQ(tx.get_last_frame_len(), FrameLayout::HEADER_BYTES);
+
+  // Long ones spill past it
+  uint8_t long_data[40];
+  for (uint8_t i=0; i<sizeof(long_data); i++){
+    long_data[i] = i;
+  }
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, long_data, sizeof(long_data), 2000, &stats, out), PACKET_CONTROL);
+  CHECK_EQ(stats.packet_len, sizeof(long_data));
+  CHECK(memcmp(out, long_data, sizeof(long_data)) == 0);
+  CHECK_EQ(tx.get_last_frame_len(), FrameLayout::HEADER_BYTES + sizeof(long_data) - FrameLayout::HEADER_DATA_BYTES);
+
+  CHECK(tx.send(PACKET_CONTROL, long_data, TRANCEIVER_MAX_PACKET_BYTES + 1, 3000) != 0);
+}
+
+
+static void test_timestamps(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  tx.enable_timestamps(1);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[2] = {1, 2};
+
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), 123456, &stats, out), PACKET_CONTROL);
+  CHECK_EQ(stats.tx_timestamp, 123456);
+  // Padded to 8 bytes before the timestamp
+  CHECK_EQ(stats.packet_len, FrameLayout::MIN_TRAILED_DATA);
+  CHECK(memcmp(out, channels, sizeof(channels)) == 0);
+  CHECK_EQ(PlatformNull::last_sent().buf[FrameLayout::PACKET_TYPE_OFFSET], PACKET_CONTROL | PACKET_FLAG_TIMESTAMP);
+
+  // Names aren't timestamped
+  uint8_t name[6] = {'R', 'o', 'v', 'e', 'r', 0};
+  CHECK_EQ(loop_back(tx, rx, PACKET_NAME, name, sizeof(name), 123457, &stats, out), PACKET_NAME);
+  CHECK_EQ(stats.tx_timestamp, 0);
+
+  // Only control packets are signed, so a tag on anything else is refused
+  // rather than cut off
+  uint8_t telemetry[5] = {0};
+  CHECK_EQ(tx.send(PACKET_TELEMETRY, telemetry, sizeof(telemetry), 123458), 0);
+  NullRxFrame frame = PlatformNull::last_sent();
+  frame.buf[FrameLayout::PACKET_TYPE_OFFSET] |= PACKET_FLAG_AUTH;
+  CHECK_EQ(rx.receive(&frame, &stats, out, 123458), PACKET_NONE);
+}
+
+
+static void test_filter_by_id(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(OTHER_ID);
+  rx.set_id(RX_ID);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[4] = {0};
+
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), 1000, &stats, out), PACKET_NONE);
+  rx.enable_filter_by_id(0);
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), 2000, &stats, out), PACKET_CONTROL);
+  CHECK(memcmp(stats.source_id, OTHER_ID, 6) == 0);
+}
+
+
+static void test_duplicates_dropped(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[4] = {0};
+
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), CONTROL_INTERVAL_US, &stats, out), PACKET_CONTROL);
+  NullRxFrame copy = PlatformNull::last_sent();
+  CHECK_EQ(rx.receive(&copy, &stats, out, CONTROL_INTERVAL_US + 10), PACKET_NONE);
+
+  sequence_stats link;
+  rx.get_link_stats(SEQUENCE_STREAM_CONTROL, &link);
+  CHECK_EQ(link.received, 1);
+  CHECK_EQ(link.duplicates, 1);
+}
+
+
+static void test_slow_stream_losses(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[4] = {0};
+
+  // 5Hz with every other packet lost: longer gaps than a fast stream would
+  // time out after, but nowhere near 128 packets of this one
+  const uint32_t interval_us = 200000;
+  for (uint8_t i=0; i<100; i++){
+    uint32_t now_us = 1000 + i * interval_us;
+    if (i % 2 == 0){
+      CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_CONTROL);
+    } else {
+      tx.send(PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us);
+    }
+  }
+  sequence_stats link;
+  rx.get_link_stats(SEQUENCE_STREAM_CONTROL, &link);
+  CHECK_EQ(link.received, 50);
+  CHECK_EQ(link.lost, 49);
+  // Only the first gap, before the interval is known
+  CHECK_EQ(link.resyncs, 1);
+
+  // A silence longer than the timeout still counts the packets it can be
+  // sure of as lost
+  for (uint8_t i=0; i<150; i++){
+    tx.send(PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), 0);
+  }
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), 1000 + 100 * interval_us + SEQUENCE_RESYNC_MAX_US, &stats, out), PACKET_CONTROL);
+  rx.get_link_stats(SEQUENCE_STREAM_CONTROL, &link);
+  CHECK_EQ(link.resyncs, 2);
+  CHECK_EQ(link.lost, 49 + 1 + 150);
+}
+
+
+static void test_replay_dropped(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  uint8_t key[AUTH_KEY_BYTES] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16};
+  bind_both(tx, rx, key);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[4] = {1, 2, 3, 4};
+
+  uint32_t now_us = CONTROL_INTERVAL_US;
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_CONTROL);
+  CHECK_EQ(stats.packet_len, sizeof(channels));
+  CHECK(memcmp(out, channels, sizeof(channels)) == 0);
+  NullRxFrame recorded = PlatformNull::last_sent();
+  recorded.rssi = -40;
+
+  // Straight away, once it is old enough to be stale, over and over as
+  // stale packets would restart the window, and after long enough for it to
+  // time out
+  CHECK_EQ(rx.receive(&recorded, &stats, out, now_us + 10), PACKET_NONE);
+  for (uint8_t i=0; i<SEQUENCE_WINDOW; i++){
+    now_us += CONTROL_INTERVAL_US;
+    CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_CONTROL);
+  }
+  for (uint8_t i=0; i<SEQUENCE_RESYNC_STALE + 1; i++){
+    CHECK_EQ(rx.receive(&recorded, &stats, out, now_us + 10), PACKET_NONE);
+  }
+  now_us += SEQUENCE_RESYNC_MAX_US + 1;
+  CHECK_EQ(rx.receive(&recorded, &stats, out, now_us), PACKET_NONE);
+
+  auth_stats auth;
+  rx.get_auth_stats(&auth);
+  CHECK_EQ(auth.verified, 1 + SEQUENCE_WINDOW);
+  CHECK_EQ(auth.replayed, 1 + SEQUENCE_RESYNC_STALE + 1 + 1);
+
+  // Unsigned ones are refused without touching the window either
+  TranceiverCore<PlatformNull> unbound;
+  unbound.set_id(RX_ID);
+  CHECK_EQ(loop_back(unbound, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_NONE);
+  rx.get_auth_stats(&auth);
+  CHECK_EQ(auth.unsigned_rejected, 1);
+  sequence_stats link;
+  rx.get_link_stats(SEQUENCE_STREAM_CONTROL, &link);
+  CHECK_EQ(link.received, 1 + SEQUENCE_WINDOW);
+  CHECK_EQ(link.resyncs, 0);
+
+  // The real transmitter carries on
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us + CONTROL_INTERVAL_US, &stats, out), PACKET_CONTROL);
+}
+
+
+static void test_replay_after_restart(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  uint8_t key[AUTH_KEY_BYTES] = {16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1};
+  tx.set_key(key, 0);
+  rx.set_key(key, 0);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  int16_t channels[4] = {5, 6, 7, 8};
+  auth_stats auth;
+
+  // Nothing is taken until a limit has been saved
+  uint32_t now_us = CONTROL_INTERVAL_US;
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_NONE);
+  rx.get_auth_stats(&auth);
+  CHECK_EQ(auth.early, 1);
+  uint32_t limit = rx.next_auth_limit();
+  CHECK_EQ(limit, 1 + BIND_COUNTER_BLOCK);
+  rx.set_auth_limit(limit);
+  CHECK_EQ(rx.next_auth_limit(), 0);
+  for (uint8_t i=0; i<3; i++){
+    now_us += CONTROL_INTERVAL_US;
+    CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_CONTROL);
+  }
+  NullRxFrame recorded = PlatformNull::last_sent();
+  recorded.rssi = -40;
+
+  // A new core with the same key and the saved limit, as after a restart
+  TranceiverCore<PlatformNull> restarted;
+  restarted.set_id(RX_ID);
+  restarted.set_key(key, limit);
+  now_us += SEQUENCE_RESYNC_MAX_US + 1;
+  CHECK_EQ(restarted.receive(&recorded, &stats, out, now_us), PACKET_NONE);
+  restarted.get_auth_stats(&auth);
+  CHECK_EQ(auth.replayed, 1);
+  CHECK_EQ(restarted.get_auth_counter(), limit);
+
+  // So are real ones the transmitter sends before it hears our resync
+  now_us += CONTROL_INTERVAL_US;
+  CHECK_EQ(loop_back(tx, restarted, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_NONE);
+  restarted.get_auth_stats(&auth);
+  CHECK_EQ(auth.replayed, 2);
+
+  // Once it signs above the limit, as it would on a resync, they wait for
+  // the next limit to be saved. It has signed 5 so far
+  for (uint32_t counter=5; counter<limit; counter++){
+    tx.send(PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us);
+  }
+  now_us += SEQUENCE_RESYNC_MAX_US + 1;
+  CHECK_EQ(loop_back(tx, restarted, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_NONE);
+  restarted.get_auth_stats(&auth);
+  CHECK_EQ(auth.early, 1);
+  restarted.set_auth_limit(restarted.next_auth_limit());
+  now_us += CONTROL_INTERVAL_US;
+  CHECK_EQ(loop_back(tx, restarted, PACKET_CONTROL, (uint8_t*)channels, sizeof(channels), now_us, &stats, out), PACKET_CONTROL);
+  CHECK(memcmp(out, channels, sizeof(channels)) == 0);
+  CHECK_EQ(restarted.receive(&recorded, &stats, out, now_us + 10), PACKET_NONE);
+}
+
+
+static void test_group_slice(void){
+  TranceiverCore<PlatformNull> tx, rx;
+  tx.set_id(GROUP_ID);
+  rx.set_id(RX_ID);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+
+  // 2 members, 2 then 3 channels
+  uint8_t group[4 + 10] = {2, 0, 2, 5};
+  int16_t channels[5] = {10, 11, 20, 21, 22};
+  memcpy(group + 4, channels, sizeof(channels));
+
+  CHECK_EQ(loop_back(tx, rx, PACKET_GROUP, group, sizeof(group), 1000, &stats, out), PACKET_NONE);
+  CHECK_EQ(rx.join_group(GROUP_ID, 1), 0);
+  CHECK_EQ(loop_back(tx, rx, PACKET_GROUP, group, sizeof(group), 2000, &stats, out), PACKET_CONTROL);
+  CHECK_EQ(stats.packet_len, 6);
+  CHECK(memcmp(out, channels + 2, 6) == 0);
+
+  // Past the end of the group
+  CHECK_EQ(rx.join_group(GROUP_ID, 2), 0);
+  CHECK_EQ(loop_back(tx, rx, PACKET_GROUP, group, sizeof(group), 3000, &stats, out), PACKET_NONE);
+}
+
+
+static void test_narrow_visibility(void){
+  TranceiverCore<PlatformNarrow> tx, rx;
+  tx.set_id(RX_ID);
+  rx.set_id(RX_ID);
+  tx.enable_timestamps(1);
+  packet_stats stats;
+  uint8_t out[TRANCEIVER_MAX_PACKET_BYTES];
+  CHECK_EQ(TranceiverCore<PlatformNarrow>::MAX_VISIBLE_DATA, 22);
+
+  // Only the first 22 data bytes arrive, and the timestamp isn't among them
+  uint8_t data[30];
+  for (uint8_t i=0; i<sizeof(data); i++){
+    data[i] = i;
+  }
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, data, sizeof(data), 5000, &stats, out), PACKET_CONTROL);
+  CHECK_EQ(stats.packet_len, 22);
+  CHECK(memcmp(out, data, 22) == 0);
+  CHECK_EQ(stats.tx_timestamp, 0);
+
+  // One that fits keeps its timestamp
+  CHECK_EQ(loop_back(tx, rx, PACKET_CONTROL, data, 16, 6000, &stats, out), PACKET_CONTROL);
+  CHECK_EQ(stats.packet_len, 16);
+  CHECK_EQ(stats.tx_timestamp, 6000);
+}
+
+
+int main(){
+  test_control_round_trip();
+  test_timestamps();
+  test_filter_by_id();
+  test_duplicates_dropped();
+  test_slow_stream_losses();
+  test_replay_dropped();
+  test_replay_after_restart();
+  test_group_slice();
+  test_narrow_visibility();
+  return host_test_result("tranceiver_core_test");
+}
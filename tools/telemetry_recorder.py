@@ -0,0 +1,366 @@
+#!/usr/bin/env python3
+"""Ground station recorder for the telemetry the ESP32 transmitter streams
+over serial (SERIAL_RECORDS in esp32_transmitter/main.py).
+
+Records are written to a log directory with one append-only column file per
+telemetry name, so a whole flight can be queried without parsing text logs:
+
+    telemetry_recorder.py record flight1 --port /dev/ttyUSB0
+    telemetry_recorder.py columns flight1
+    telemetry_recorder.py query flight1 "Battery Voltage" --start 60 --end 120
+    telemetry_recorder.py export flight1 flight1.csv
+
+Times on the command line are seconds since the log was created.
+
+Log layout:
+    meta.json    {"version": 1, "created": <unix time>, "columns": {name: file}}
+    <n>.col      fixed size rows of ROW_FORMAT, in the order they arrived
+
+Rows are appended in arrival order, so each column is sorted by host time
+and range queries binary search the memory mapped file. Link statistics
+become the "link/..." columns.
+
+Recording from a serial port needs pyserial. Anything else the transmitter
+prints is skipped.
+"""
+import argparse
+import csv
+import json
+import mmap
+import os
+import struct
+import sys
+import time
+
+
+SYNC = b'\xa5\x5a'
+RECORD_NAME = 0x01
+RECORD_TELEMETRY = 0x02
+RECORD_LINK = 0x03
+
+TELEMETRY_FORMAT = struct.Struct('<IBBf')  # device ms, name id, status, value
+LINK_FORMAT = struct.Struct('<IbffI')  # device ms, rssi, packet loss, control rate, tx failures
+LINK_COLUMNS = ('link/rssi', 'link/packet_loss', 'link/control_rate', 'link/tx_failed')
+
+ROW_FORMAT = struct.Struct('<dIfB')  # host time, device ms, value, status
+STATUS_UNDEFINED = 255
+
+META_FILE = 'meta.json'
+LOG_VERSION = 1
+FLUSH_SECONDS = 1.0
+
+
+def fletcher16(data):
+    sum1 = 0
+    sum2 = 0
+    for byte in data:
+        sum1 = (sum1 + byte) % 255
+        sum2 = (sum2 + sum1) % 255
+    return (sum2 << 8) | sum1
+
+
+class RecordDecoder:
+    """Picks the records out of a serial byte stream"""
+
+    def __init__(self):
+        self._buffer = bytearray()
+        self.records = 0
+        self.bad_records = 0
+
+    def feed(self, data, final=False):
+        """Yields (record type, payload) for each complete record. Pass final
+        at the end of the input, when a partial record will never finish"""
+        self._buffer += data
+        while True:
+            start = self._buffer.find(SYNC)
+            if start < 0:
+                # Keep a trailing 0xA5 in case it starts the next sync
+                del self._buffer[:max(0, len(self._buffer) - 1)]
+                return
+            del self._buffer[:start]
+            length = self._buffer[3] if len(self._buffer) >= 4 else 0
+            end = 4 + length + 2
+            if len(self._buffer) < end:
+                if not final or len(self._buffer) < 2:
+                    return
+                # Sync bytes in the text, too near the end to be a record
+                del self._buffer[:1]
+                continue
+            body = bytes(self._buffer[2:4 + length])
+            checksum, = struct.unpack_from('<H', self._buffer, 4 + length)
+            if fletcher16(body) != checksum:
+                # Text that happened to contain the sync bytes
+                self.bad_records += 1
+                del self._buffer[:1]
+                continue
+            del self._buffer[:end]
+            self.records += 1
+            yield body[0], body[2:]
+
+
+class Column:
+    def __init__(self, path):
+        self.path = path
+        self._file = None
+
+    def append(self, host_time, device_ms, value, status):
+        if self._file is None:
+            self._file = open(self.path, 'ab')
+        self._file.write(ROW_FORMAT.pack(host_time, device_ms, value, status))
+
+    def flush(self):
+        if self._file is not None:
+            self._file.flush()
+
+    def close(self):
+        if self._file is not None:
+            self._file.close()
+            self._file = None
+
+    def __len__(self):
+        if not os.path.exists(self.path):
+            return 0
+        return os.path.getsize(self.path) // ROW_FORMAT.size
+
+    def rows(self, start=None, end=None):
+        """Yields (host time, device ms, value, status) with start <= host
+        time < end"""
+        count = len(self)
+        if count == 0:
+            return
+        with open(self.path, 'rb') as column_file:
+            with mmap.mmap(column_file.fileno(), count * ROW_FORMAT.size, access=mmap.ACCESS_READ) as rows:
+                first = 0 if start is None else self._bisect(rows, count, start)
+                for i in range(first, count):
+                    row = ROW_FORMAT.unpack_from(rows, i * ROW_FORMAT.size)
+                    if end is not None and row[0] >= end:
+                        return
+                    yield row
+
+    def span(self):
+        """The host times of the first and last rows, or None if it's empty"""
+        count = len(self)
+        if count == 0:
+            return None
+        with open(self.path, 'rb') as column_file:
+            first = ROW_FORMAT.unpack(column_file.read(ROW_FORMAT.size))[0]
+            column_file.seek((count - 1) * ROW_FORMAT.size)
+            last = ROW_FORMAT.unpack(column_file.read(ROW_FORMAT.size))[0]
+        return first, last
+
+    @staticmethod
+    def _bisect(rows, count, host_time):
+        low = 0
+        high = count
+        while low < high:
+            middle = (low + high) // 2
+            if ROW_FORMAT.unpack_from(rows, middle * ROW_FORMAT.size)[0] < host_time:
+                low = middle + 1
+            else:
+                high = middle
+        return low
+
+
+class ColumnLog:
+    def __init__(self, path, create=False):
+        self.path = path
+        meta_path = os.path.join(path, META_FILE)
+        if create and not os.path.exists(meta_path):
+            os.makedirs(path, exist_ok=True)
+            self._meta = {'version': LOG_VERSION, 'created': time.time(), 'columns': {}}
+            self._save_meta()
+        else:
+            with open(meta_path) as meta_file:
+                self._meta = json.load(meta_file)
+            if self._meta.get('version') != LOG_VERSION:
+                raise ValueError("{} is log version {}, expected {}".format(path, self._meta.get('version'), LOG_VERSION))
+        self._columns = {}
+
+    @property
+    def created(self):
+        return self._meta['created']
+
+    @property
+    def names(self):
+        return sorted(self._meta['columns'])
+
+    def _save_meta(self):
+        # Written to the side and renamed, so a crash never loses the column list
+        meta_path = os.path.join(self.path, META_FILE)
+        with open(meta_path + '.tmp', 'w') as meta_file:
+            json.dump(self._meta, meta_file, indent=1)
+        os.replace(meta_path + '.tmp', meta_path)
+
+    def column(self, name, create=False):
+        column = self._columns.get(name)
+        if column is None:
+            file_name = self._meta['columns'].get(name)
+            if file_name is None:
+                if not create:
+                    raise KeyError(name)
+                file_name = '{}.col'.format(len(self._meta['columns']))
+                self._meta['columns'][name] = file_name
+                self._save_meta()
+            column = Column(os.path.join(self.path, file_name))
+            self._columns[name] = column
+        return column
+
+    def append(self, name, host_time, device_ms, value, status):
+        self.column(name, create=True).append(host_time, device_ms, value, status)
+
+    def flush(self):
+        for column in self._columns.values():
+            column.flush()
+
+    def close(self):
+        for column in self._columns.values():
+            column.close()
+
+
+class Recording:
+    """Turns decoded records into column rows"""
+
+    def __init__(self, log):
+        self._log = log
+        self._names = {}
+        self.rows = 0
+        self.unknown_names = 0
+
+    def handle(self, record_type, payload, host_time):
+        if record_type == RECORD_NAME and payload:
+            self._names[payload[0]] = payload[1:].decode('utf-8', 'replace')
+        elif record_type == RECORD_TELEMETRY and len(payload) == TELEMETRY_FORMAT.size:
+            device_ms, name_id, status, value = TELEMETRY_FORMAT.unpack(payload)
+            name = self._names.get(name_id)
+            if name is None:
+                # Started part way through. The name comes round again shortly
+                self.unknown_names += 1
+                return
+            self._log.append(name, host_time, device_ms, value, status)
+            self.rows += 1
+        elif record_type == RECORD_LINK and len(payload) == LINK_FORMAT.size:
+            device_ms, *values = LINK_FORMAT.unpack(payload)
+            for name, value in zip(LINK_COLUMNS, values):
+                self._log.append(name, host_time, device_ms, value, STATUS_UNDEFINED)
+            self.rows += len(LINK_COLUMNS)
+
+
+def _open_input(args):
+    if args.port:
+        import serial
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+        return lambda: port.read(4096)
+    if args.input == '-':
+        stream = sys.stdin.buffer
+    else:
+        stream = open(args.input, 'rb')
+    return lambda: stream.read1(4096) if hasattr(stream, 'read1') else stream.read(4096)
+
+
+def record(args):
+    log = ColumnLog(args.log, create=True)
+    read = _open_input(args)
+    decoder = RecordDecoder()
+    recording = Recording(log)
+    last_flush = time.time()
+    try:
+        while True:
+            data = read()
+            finished = not data and not args.port
+            now = time.time()
+            for record_type, payload in decoder.feed(data, final=finished):
+                recording.handle(record_type, payload, now)
+            if finished:
+                break
+            if now - last_flush > FLUSH_SECONDS:
+                log.flush()
+                last_flush = now
+    except KeyboardInterrupt:
+        pass
+    finally:
+        log.close()
+    print("{} records, {} rows, {} bad records, {} before their name".format(
+        decoder.records, recording.rows, decoder.bad_records, recording.unknown_names
+    ), file=sys.stderr)
+
+
+def _time_range(log, args):
+    start = None if args.start is None else log.created + args.start
+    end = None if args.end is None else log.created + args.end
+    return start, end
+
+
+def columns(args):
+    log = ColumnLog(args.log)
+    for name in log.names:
+        column = log.column(name)
+        span = column.span()
+        if span:
+            print("{:32} {:8} rows  {:10.3f}s - {:10.3f}s".format(
+                name, len(column), span[0] - log.created, span[1] - log.created
+            ))
+        else:
+            print("{:32} {:8} rows".format(name, 0))
+
+
+def query(args):
+    log = ColumnLog(args.log)
+    start, end = _time_range(log, args)
+    for name in args.names:
+        for host_time, device_ms, value, status in log.column(name).rows(start, end):
+            print("{:10.3f} {:10} {:3} {}  {}".format(host_time - log.created, device_ms, status, value, name))
+
+
+def export(args):
+    log = ColumnLog(args.log)
+    start, end = _time_range(log, args)
+    names = args.names or log.names
+    rows = []
+    for name in names:
+        for host_time, device_ms, value, status in log.column(name).rows(start, end):
+            rows.append((host_time - log.created, device_ms, name, status, value))
+    rows.sort(key=lambda row: row[0])
+
+    with open(args.csv, 'w', newline='') as csv_file:
+        writer = csv.writer(csv_file)
+        writer.writerow(('seconds', 'device_ms', 'name', 'status', 'value'))
+        writer.writerows(rows)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    record_parser = commands.add_parser('record', help="Record from a serial port or a capture file")
+    record_parser.add_argument('log')
+    source = record_parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--port', help="Serial port, eg /dev/ttyUSB0")
+    source.add_argument('--input', help="Raw capture file, or - for stdin")
+    record_parser.add_argument('--baud', type=int, default=115200)
+    record_parser.set_defaults(function=record)
+
+    columns_parser = commands.add_parser('columns', help="List the columns in a log")
+    columns_parser.add_argument('log')
+    columns_parser.set_defaults(function=columns)
+
+    query_parser = commands.add_parser('query', help="Print the rows of some columns in a time range")
+    query_parser.add_argument('log')
+    query_parser.add_argument('names', nargs='+')
+    query_parser.set_defaults(function=query)
+
+    export_parser = commands.add_parser('export', help="Export columns to CSV")
+    export_parser.add_argument('log')
+    export_parser.add_argument('csv')
+    export_parser.add_argument('--names', nargs='*', help="Columns to export. All of them by default")
+    export_parser.set_defaults(function=export)
+
+    for time_parser in (query_parser, export_parser):
+        time_parser.add_argument('--start', type=float, help="Seconds since the log was created")
+        time_parser.add_argument('--end', type=float)
+
+    args = parser.parse_args()
+    args.function(args)
+
+
+if __name__ == '__main__':
+    main()